@@ -52,10 +52,19 @@ static int time_step_caching = 0;
 static int hz_caching = 0;
 static uint32_t* cached_header_copy;
 
+enum IO_MODE { PIDX_READ, PIDX_WRITE};
+
 static PIDX_return_code PIDX_cleanup(PIDX_file file);
 static PIDX_return_code PIDX_write(PIDX_file file);
 static PIDX_return_code PIDX_file_initialize_time_step(PIDX_file file, char* file_name, int current_time_step);
 static PIDX_return_code PIDX_cache_headers(PIDX_file file);
+static PIDX_return_code create_layout_from_patches(PIDX_file file);
+static PIDX_return_code create_layout_from_headers(PIDX_file file);
+static int progressive_level(int level, int last_level, void* user_data);
+static int aggregated_read_fits(PIDX_file file);
+static int roi_read_is_small(PIDX_file file);
+static int plan_variable_groups(PIDX_file file);
+static int flush_finish(PIDX_request request);
 
 
 /// PIDX File descriptor (equivalent to the descriptor returned by)
@@ -87,10 +96,19 @@ struct PIDX_file_descriptor
   PIDX_compression_id compression_id;                   ///< Compression (lossy and lossless) id
   PIDX_agg_id agg_id;                                   ///< Aggregation phase id
   PIDX_io_id io_id;                                     ///< IO phase id
+  PIDX_async_io_id async_io_id;                         ///< Background writer for the aggregator buffers (NULL unless async IO is enabled)
+  PIDX_request flush_request;                           ///< The last non-blocking flush, until it is waited for (NULL: none)
+  PIDX_io_map_id io_map_id;                             ///< Mapped binary files for reads with PIDX_io_backend_mmap (NULL until the first such read)
+  PIDX_query_id query_id;                               ///< Region of interest reads (NULL until the first such read)
+  PIDX_prefetch_id prefetch_id;                         ///< Read-ahead of the next time steps (NULL until the first such read)
   
   int local_variable_index;                             ///<
   int local_variable_count;                             ///<
-  int variable_pipelining_factor;                       ///<
+  int variable_pipelining_factor;                       ///< variables per group - 1 set by the user (-1: chosen from memory_budget)
+  uint64_t memory_budget;                               ///< bytes the buffers of a variable group may take per process (0: no budget)
+  int variable_group_count;                             ///< variable groups of the last flush
+  int variable_group_size[1024];                        ///< variables of every group of the last flush
+  int64_t variable_group_bytes[1024];                   ///< predicted RST, HZ and aggregation bytes per process of every group
   
   int write_on_close;                                   ///< HPC Writes
   int one_time_initializations;                         ///<
@@ -102,6 +120,42 @@ struct PIDX_file_descriptor
   int perform_agg;                                      ///< Counter to activate/deactivate (1/0) aggregation phase
   int perform_io;                                       ///< Counter to activate/deactivate (1/0) I/O phase
   int perform_compression;                              ///< Counter to activate/deactivate (1/0) compression
+  int roi_read;                                         ///< 1 (default) if every process reads the blocks of its own patches when they are a small part of the dataset, 0 for the aggregated reads
+  int read_level;                                       ///< deepest HZ level read (-1: full resolution)
+  PIDX_point read_subsampling;                          ///< stride of the samples read in every dimension (0: not set)
+  PIDX_progressive_callback progressive_callback;       ///< called as every HZ level of a box is read (NULL: whole boxes only)
+  void* progressive_data;                               ///< user data of progressive_callback
+  int prefetch_depth;                                   ///< time steps read ahead after a region of interest read (0: none)
+};
+
+/// A non-blocking flush. The write runs on a thread of its own when MPI allows it (or without MPI), on copies of the
+/// user buffers; otherwise it runs in PIDX_iflush and only the file system writes are left to a writer of its own.
+struct PIDX_request_struct
+{
+  PIDX_file file;                                       ///< the file flushed (NULL once it is closed)
+  int error;                                            ///< set if the write failed
+  int threaded;                                         ///< 1 if the write runs on its own thread
+  int joined;                                           ///< 1 once that thread is joined
+#if PIDX_HAVE_PTHREADS
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int done;                                             ///< set by the thread once the write is over
+#endif
+  PIDX_async_io_id async_io_id;                         ///< writer of the aggregator buffers of a write run by PIDX_iflush (NULL: none)
+  int buffer_count;
+  unsigned char** buffer;                               ///< copies of the user buffers, freed once written
+};
+
+/// The non-blocking flush running on its own thread; there is at most one per process, the next flush (blocking or
+/// not) of any file waits for it so that every process runs the collective writes in the same order
+static PIDX_request background_flush = NULL;
+
+/// The box a progressive read is on
+struct progressive_read
+{
+  PIDX_file file;
+  PIDX_variable variable;
+  int patch;
 };
 
 
@@ -167,6 +221,10 @@ void PIDX_init_timming_buffers()
 /// Function to create IDX file descriptor (based on flags and access)
 PIDX_return_code PIDX_file_create(const char* filename, PIDX_flags flags, PIDX_access access_type, PIDX_file* file)
 {
+  // the timing buffers are those of a non-blocking flush still running
+  if (background_flush != NULL)
+    flush_finish(background_flush);
+  
   PIDX_init_timming_buffers();
   
   sim_start = PIDX_get_time();
@@ -224,6 +282,7 @@ PIDX_return_code PIDX_file_create(const char* filename, PIDX_flags flags, PIDX_a
   (*file)->perform_hz = 1;
   (*file)->perform_agg = 1;
   (*file)->perform_io = 1;
+  (*file)->variable_pipelining_factor = -1;
   
 #if PIDX_HAVE_MPI
   if (access_type->parallel)
@@ -328,6 +387,7 @@ PIDX_return_code PIDX_file_create(const char* filename, PIDX_flags flags, PIDX_a
   (*file)->idx_ptr->compression_block_size[2] = 1;
   (*file)->idx_ptr->compression_block_size[3] = 1;
   (*file)->idx_ptr->compression_block_size[4] = 1;
+  (*file)->idx_ptr->compression_bit_rate = PIDX_default_compression_bit_rate;
   
   (*file)->idx_ptr->bits_per_block = PIDX_default_bits_per_block;
   (*file)->idx_derived_ptr->samples_per_block = pow(2, PIDX_default_bits_per_block);
@@ -339,6 +399,10 @@ PIDX_return_code PIDX_file_create(const char* filename, PIDX_flags flags, PIDX_a
 /// Function to get file descriptor when opening an existing IDX file
 PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_access access_type, PIDX_file* file)
 {
+  // the timing buffers are those of a non-blocking flush still running
+  if (background_flush != NULL)
+    flush_finish(background_flush);
+  
   PIDX_init_timming_buffers();
   
   sim_start = PIDX_get_time();
@@ -396,6 +460,9 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
   (*file)->perform_hz = 1;
   (*file)->perform_agg = 1;
   (*file)->perform_io = 1;
+  (*file)->roi_read = 1;
+  (*file)->read_level = -1;
+  (*file)->variable_pipelining_factor = -1;
   
 #if PIDX_HAVE_MPI
   if (access_type->parallel)
@@ -540,6 +607,7 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
 	while (strcmp(line, "(version)") != 0 && strcmp(line, "(box)") != 0 && strcmp(line, "(bits)") && strcmp(line, "(bitsperblock)") != 0 && strcmp(line, "(blocksperfile)") != 0 && strcmp(line, "(filename_template)") != 0 && strcmp(line, "(time)") != 0)
 	{
 	  (*file)->idx_ptr->variable[variable_counter] = malloc(sizeof (*((*file)->idx_ptr->variable[variable_counter])));
+	  memset((*file)->idx_ptr->variable[variable_counter], 0, sizeof (*((*file)->idx_ptr->variable[variable_counter])));
 	  
 	  pch1 = strtok(line, " *+");
 	  while (pch1 != NULL)
@@ -593,6 +661,41 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
 	  line[len] = 0;
 	(*file)->idx_ptr->blocks_per_file= atoi(line);
       }
+      if (strcmp(line, "(compression type)") == 0)
+      {
+	fgets(line, sizeof line, fp);
+	(*file)->idx_ptr->compression_type = atoi(line);
+      }
+      if (strcmp(line, "(compression bit rate)") == 0)
+      {
+	fgets(line, sizeof line, fp);
+	(*file)->idx_ptr->compression_bit_rate = atoi(line);
+      }
+      if (strcmp(line, "(compression block size)") == 0)
+      {
+	fgets(line, sizeof line, fp);
+	pch = strtok(line, " ");
+	count = 0;
+	while (pch != NULL && count < PIDX_MAX_DIMENSIONS)
+	{
+	  (*file)->idx_ptr->compression_block_size[count] = atoi(pch);
+	  count++;
+	  pch = strtok(NULL, " ");
+	}
+      }
+      if (strcmp(line, "(compression modes)") == 0)
+      {
+	for (var = 0; var < (*file)->idx_ptr->variable_count; var++)
+	{
+	  fgets(line, sizeof line, fp);
+	  sscanf(line, "%d %lf %d", &(*file)->idx_ptr->variable[var]->compression_mode, &(*file)->idx_ptr->variable[var]->compression_param, &(*file)->idx_ptr->variable[var]->compression_bits);
+	}
+      }
+      if (strcmp(line, "(sparse layout)") == 0)
+      {
+	fgets(line, sizeof line, fp);
+	(*file)->idx_ptr->sparse_layout = atoi(line);
+      }
       if (strcmp(line, "(filename_template)") == 0) 
       {
 	fgets(line, sizeof line, fp);
@@ -611,13 +714,20 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
   MPI_Bcast(&((*file)->idx_ptr->blocks_per_file), 1, MPI_INT, 0, (*file)->comm);
   MPI_Bcast(&((*file)->idx_ptr->bits_per_block), 1, MPI_INT, 0, (*file)->comm);
   MPI_Bcast(&((*file)->idx_ptr->variable_count), 1, MPI_INT, 0, (*file)->comm);
+  MPI_Bcast(&((*file)->idx_ptr->compression_type), 1, MPI_INT, 0, (*file)->comm);
+  MPI_Bcast(&((*file)->idx_ptr->compression_bit_rate), 1, MPI_INT, 0, (*file)->comm);
+  MPI_Bcast((*file)->idx_ptr->compression_block_size, PIDX_MAX_DIMENSIONS, MPI_LONG_LONG, 0, (*file)->comm);
+  MPI_Bcast(&((*file)->idx_ptr->sparse_layout), 1, MPI_INT, 0, (*file)->comm);
 
   (*file)->idx_derived_ptr->samples_per_block = pow(2, (*file)->idx_ptr->bits_per_block);
   
   if(rank != 0)
   {
     for (var = 0; var < (*file)->idx_ptr->variable_count; var++) 
+    {
       (*file)->idx_ptr->variable[var] = malloc(sizeof (*((*file)->idx_ptr->variable[var])));
+      memset((*file)->idx_ptr->variable[var], 0, sizeof (*((*file)->idx_ptr->variable[var])));
+    }
   }
 #endif
   
@@ -627,6 +737,9 @@ PIDX_return_code PIDX_file_open(const char* filename, PIDX_flags flags, PIDX_acc
     MPI_Bcast(&((*file)->idx_ptr->variable[var]->values_per_sample), 1, MPI_INT, 0, (*file)->comm);
     MPI_Bcast((*file)->idx_ptr->variable[var]->var_name, 512, MPI_CHAR, 0, (*file)->comm);
     MPI_Bcast((*file)->idx_ptr->variable[var]->type_name, 512, MPI_CHAR, 0, (*file)->comm);
+    MPI_Bcast(&((*file)->idx_ptr->variable[var]->compression_mode), 1, MPI_INT, 0, (*file)->comm);
+    MPI_Bcast(&((*file)->idx_ptr->variable[var]->compression_param), 1, MPI_DOUBLE, 0, (*file)->comm);
+    MPI_Bcast(&((*file)->idx_ptr->variable[var]->compression_bits), 1, MPI_INT, 0, (*file)->comm);
 #endif
     
     (*file)->idx_ptr->variable[var]->patch_count = 0;
@@ -1043,7 +1156,21 @@ PIDX_return_code PIDX_append_and_write_variable(PIDX_variable variable, PIDX_poi
 }
 
 /////////////////////////////////////////////////
-PIDX_return_code populate_idx_dataset(PIDX_file file)
+/// Exchanges the patch groups and the block restructured groups of the variables, HZ works on patch_group_ptr
+static void swap_block_rst_groups(PIDX_file file, int start_index, int end_index)
+{
+  int var;
+  Ndim_box_group* groups;
+  for (var = start_index; var <= end_index; var++)
+  {
+    groups = file->idx_ptr->variable[var]->patch_group_ptr;
+    file->idx_ptr->variable[var]->patch_group_ptr = file->idx_ptr->variable[var]->post_rst_block;
+    file->idx_ptr->variable[var]->post_rst_block = groups;
+  }
+}
+
+/////////////////////////////////////////////////
+PIDX_return_code populate_idx_dataset(PIDX_file file, int MODE)
 {
   int i, j, counter = 0, file_number = 0;
     int bounding_box[2][5] = {
@@ -1083,6 +1210,44 @@ PIDX_return_code populate_idx_dataset(PIDX_file file)
   else
     memcpy(file->idx_ptr->compressed_global_bounds, file->idx_ptr->global_bounds, sizeof(uint64_t) * PIDX_MAX_DIMENSIONS);
   
+  // the bricks may not fill a single block, as in PIDX_validate
+  if (file->perform_compression == 1)
+  {
+    int64_t compressed_dims;
+    PIDX_inner_product(&compressed_dims, file->idx_ptr->compressed_global_bounds);
+    if (compressed_dims < file->idx_derived_ptr->samples_per_block)
+    {
+      file->idx_derived_ptr->samples_per_block = getPowerOf2(compressed_dims) >> 1;
+      file->idx_ptr->bits_per_block = getNumBits(file->idx_derived_ptr->samples_per_block) - 1;
+    }
+  }
+  
+  // the fixed accuracy mode picks the bits per code from the value range, the first time a variable is written
+  if (MODE == PIDX_WRITE)
+  {
+    for (i = file->local_variable_index; i < file->local_variable_index + file->local_variable_count; i++)
+    {
+      double range[2];
+      if (file->idx_ptr->variable[i]->compression_mode != PIDX_COMPRESSION_FIXED_ACCURACY || file->idx_ptr->variable[i]->compression_bits != 0)
+        continue;
+
+      PIDX_compression_value_range(file->idx_ptr, i, &range[0], &range[1]);
+      range[0] = -range[0];
+#if PIDX_HAVE_MPI
+      MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_DOUBLE, MPI_MAX, file->comm);
+#endif
+      file->idx_ptr->variable[i]->compression_bits = PIDX_compression_accuracy_bits(-range[0], range[1], file->idx_ptr->variable[i]->compression_param);
+      // the bricks of a variable whose tolerance cannot be met are stored raw (-1 also keeps the range from being searched again)
+      if (file->idx_ptr->variable[i]->compression_bits == 0)
+        file->idx_ptr->variable[i]->compression_bits = -1;
+    }
+  }
+
+  // every HZ sample is one brick, its size is also needed for the variables written by earlier flushes
+  for (i = 0; i < file->idx_ptr->variable_index_tracker || i < file->idx_ptr->variable_count; i++)
+    if (file->idx_ptr->variable[i] != NULL)
+      file->idx_ptr->variable[i]->bytes_per_brick = PIDX_compression_bytes_per_brick(file->idx_ptr, i);
+  
   
   global_bounds_point.x = (int) file->idx_ptr->compressed_global_bounds[0];
   global_bounds_point.y = (int) file->idx_ptr->compressed_global_bounds[1];
@@ -1174,6 +1339,7 @@ PIDX_return_code populate_idx_dataset(PIDX_file file)
       }
       ctr = ctr * 2;
     }
+    PIDX_blocks_index_layout(file->idx_ptr->variable[var]->VAR_global_block_layout);
     
     int *temp_file_index = malloc(sizeof(int) * (file->idx_derived_ptr->max_file_count));
     memset(temp_file_index, 0, sizeof(int) * (file->idx_derived_ptr->max_file_count));
@@ -1223,7 +1389,18 @@ PIDX_return_code populate_idx_dataset(PIDX_file file)
   }
   
   file->idx_derived_ptr->global_block_layout =  malloc(sizeof (*file->idx_derived_ptr->global_block_layout));
-  PIDX_blocks_create_layout(bounding_box, file->idx_ptr->blocks_per_file, file->idx_ptr->bits_per_block, file->idx_derived_ptr->maxh, file->idx_ptr->bitPattern, file->idx_derived_ptr->global_block_layout);
+  if (file->idx_ptr->sparse_layout == 1 && MODE == PIDX_WRITE)
+  {
+    if (create_layout_from_patches(file) != PIDX_success)
+      return PIDX_err_file;
+  }
+  else if (file->idx_ptr->sparse_layout == 1 && MODE == PIDX_READ)
+  {
+    if (create_layout_from_headers(file) != PIDX_success)
+      return PIDX_err_file;
+  }
+  else
+    PIDX_blocks_create_layout(bounding_box, file->idx_ptr->blocks_per_file, file->idx_ptr->bits_per_block, file->idx_derived_ptr->maxh, file->idx_ptr->bitPattern, file->idx_derived_ptr->global_block_layout);
   
   int k = 1;
   for (i = 1; i < (file->idx_derived_ptr->global_block_layout->levels); i++)
@@ -1279,11 +1456,382 @@ PIDX_return_code populate_idx_dataset(PIDX_file file)
       count++;
     }
   free(temp_file_index); 
+  
+  // per file offsets of every variable and block, looked up by the header and I/O code
+  int variable_count = (file->idx_ptr->variable_count > 0) ? file->idx_ptr->variable_count : 0;
+  
+  uint64_t *block_size = malloc(sizeof(uint64_t) * (variable_count > 0 ? variable_count : 1));
+  for (i = 0; i < variable_count; i++)
+    block_size[i] = (uint64_t)file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[i]->bytes_per_brick * file->idx_ptr->variable[i]->values_per_sample;
+  
+  if (file->idx_derived_ptr->block_offset_table == NULL)
+    file->idx_derived_ptr->block_offset_table = malloc(sizeof (*file->idx_derived_ptr->block_offset_table));
+  else
+    PIDX_blocks_free_offset_table(file->idx_derived_ptr->block_offset_table);
+  
+  if (PIDX_blocks_create_offset_table(file->idx_derived_ptr->global_block_layout, file->idx_derived_ptr->max_file_count, file->idx_ptr->blocks_per_file, variable_count, block_size, file->idx_derived_ptr->block_offset_table) != 0)
+  {
+    free(block_size);
+    return PIDX_err_file;
+  }
+  free(block_size);
+#endif
+    
+  return PIDX_success;
+}
+
+/// Global layout covering only the blocks touched by the patches of all the processes
+static PIDX_return_code create_layout_from_patches(PIDX_file file)
+{
+  int i, d, p, var, box_count = 0;
+  int (*boxes)[2][PIDX_MAX_DIMENSIONS];
+  
+  for (var = file->local_variable_index; var < file->local_variable_index + file->local_variable_count; var++)
+    box_count = box_count + file->idx_ptr->variable[var]->patch_count;
+  
+  boxes = malloc(sizeof(*boxes) * (box_count > 0 ? box_count : 1));
+  i = 0;
+  for (var = file->local_variable_index; var < file->local_variable_index + file->local_variable_count; var++)
+  {
+    for (p = 0; p < file->idx_ptr->variable[var]->patch_count; p++, i++)
+    {
+      for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        boxes[i][0][d] = file->idx_ptr->variable[var]->patch[p]->Ndim_box_offset[d] / file->idx_ptr->compression_block_size[d];
+        boxes[i][1][d] = (file->idx_ptr->variable[var]->patch[p]->Ndim_box_offset[d] + file->idx_ptr->variable[var]->patch[p]->Ndim_box_size[d] + file->idx_ptr->compression_block_size[d] - 1) / file->idx_ptr->compression_block_size[d];
+      }
+    }
+  }
+  
+#if PIDX_HAVE_MPI
+  int nprocs = 1, total_count = 0;
+  int *counts, *displacements;
+  int local_count = box_count * 2 * PIDX_MAX_DIMENSIONS;
+  int (*all_boxes)[2][PIDX_MAX_DIMENSIONS];
+  
+  MPI_Comm_size(file->comm, &nprocs);
+  counts = malloc(sizeof(int) * nprocs);
+  displacements = malloc(sizeof(int) * nprocs);
+  MPI_Allgather(&local_count, 1, MPI_INT, counts, 1, MPI_INT, file->comm);
+  for (i = 0; i < nprocs; i++)
+  {
+    displacements[i] = total_count;
+    total_count = total_count + counts[i];
+  }
+  
+  all_boxes = malloc(sizeof(int) * (total_count > 0 ? total_count : 1));
+  MPI_Allgatherv(boxes, local_count, MPI_INT, all_boxes, counts, displacements, MPI_INT, file->comm);
+  free(counts);
+  free(displacements);
+  free(boxes);
+  
+  boxes = all_boxes;
+  box_count = total_count / (2 * PIDX_MAX_DIMENSIONS);
+#endif
+  
+  PIDX_blocks_create_layout_from_boxes(box_count, boxes, file->idx_ptr->blocks_per_file, file->idx_ptr->bits_per_block, file->idx_derived_ptr->maxh, file->idx_ptr->bitPattern, file->idx_derived_ptr->global_block_layout);
+  free(boxes);
+  
+  return PIDX_success;
+}
+
+
+/// Global layout of a dataset written with a sparse layout: a block is there if the
+/// binary file lists it (non zero length for the first variable) in its header
+static PIDX_return_code create_layout_from_headers(PIDX_file file)
+{
+  int i, f, level, rank = 0;
+  int blocks_per_file = file->idx_ptr->blocks_per_file;
+  int block_count = file->idx_derived_ptr->max_file_count * blocks_per_file;
+  char bin_file[PATH_MAX];
+  unsigned char *present;
+  uint32_t *headers;
+  PIDX_io_backend_file fh;
+  PIDX_block_layout layout = file->idx_derived_ptr->global_block_layout;
+  
+  present = malloc(block_count);
+  memset(present, 0, block_count);
+  present[0] = 1;
+  
+#if PIDX_HAVE_MPI
+  MPI_Comm_rank(file->comm, &rank);
+#endif
+  
+  if (rank == 0)
+  {
+    // the file names depend on maxh, known only now
+    PIDX_file_initialize_time_step(file, file->idx_ptr->filename, file->idx_ptr->current_time_step);
+    
+    headers = malloc((10 + 10 * blocks_per_file) * sizeof (uint32_t));
+    for (f = 0; f < file->idx_derived_ptr->max_file_count; f++)
+    {
+      if (generate_file_name(blocks_per_file, file->idx_ptr->filename_template, f, bin_file, PATH_MAX) == 1)
+      {
+        fprintf(stderr, "[%s] [%d] generate_file_name() failed.\n", __FILE__, __LINE__);
+        free(headers);
+        free(present);
+        return PIDX_err_file;
+      }
+      
+      // files without any block were never created
+      if (PIDX_io_backend_get_ops(file->idx_derived_ptr->io_backend)->file_system == 1 && access(bin_file, F_OK) != 0)
+        continue;
+      
+      if (PIDX_io_backend_open(file->idx_derived_ptr->io_backend, bin_file, PIDX_IO_BACKEND_READ, &fh) == -1)
+        continue;
+      
+      if (PIDX_io_backend_pread(fh, (unsigned char*)headers, (10 + 10 * blocks_per_file) * sizeof (uint32_t), 0) == 0)
+        for (i = 0; i < blocks_per_file; i++)
+          if (ntohl(headers[14 + i * 10]) != 0)
+            present[f * blocks_per_file + i] = 1;
+      
+      PIDX_io_backend_close(fh);
+    }
+    free(headers);
+  }
+  
+#if PIDX_HAVE_MPI
+  MPI_Bcast(present, block_count, MPI_UNSIGNED_CHAR, 0, file->comm);
 #endif
+  
+  PIDX_blocks_initialize_layout(layout, file->idx_derived_ptr->maxh, file->idx_ptr->bits_per_block);
+  for (i = 1; i < block_count && i < layout->block_count; i++)
+  {
+    if (present[i] == 0)
+      continue;
     
+    // the blocks of a level are listed first, in order, as PIDX_blocks_index_layout expects
+    level = getNumBits(i);
+    layout->hz_block_number_array[level][layout->hz_block_count_array[level]++] = i;
+  }
+  PIDX_blocks_index_layout(layout);
+  
+  free(present);
   return PIDX_success;
 }
 
+
+/// Splits the variables of a flush into the groups that go through RST, HZ, aggregation and I/O together (the same
+/// groups on all the processes). A group never has more aggregators than processes (every process holds at most one
+/// aggregation buffer). With variable_pipelining_factor set a group takes that many variables plus one; with a memory
+/// budget it takes as many as fit, at least one, from the predicted size of the restructured boxes, their HZ buffers
+/// and the biggest aggregation buffer; otherwise groups take 16 variables.
+static int plan_variable_groups(PIDX_file file)
+{
+  int i, d, p, var, nprocs = 1, rank = 0;
+  int64_t size, samples, volume, brick_volume = 1;
+  int64_t group_bytes, group_aggregators, buffer_bytes;
+  int64_t *box_bytes, *aggregator_count, *agg_buffer_bytes;
+  
+#if PIDX_HAVE_MPI
+  MPI_Comm_rank(file->comm, &rank);
+  MPI_Comm_size(file->comm, &nprocs);
+#endif
+  
+  file->variable_group_count = 0;
+  if (file->local_variable_count <= 0)
+    return 0;
+  
+  box_bytes = malloc(sizeof (*box_bytes) * file->local_variable_count);
+  aggregator_count = malloc(sizeof (*aggregator_count) * file->local_variable_count);
+  agg_buffer_bytes = malloc(sizeof (*agg_buffer_bytes) * file->local_variable_count);
+  if (box_bytes == NULL || aggregator_count == NULL || agg_buffer_bytes == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    free(box_bytes);
+    free(aggregator_count);
+    free(agg_buffer_bytes);
+    return -1;
+  }
+  
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    brick_volume = brick_volume * file->idx_ptr->compression_block_size[d];
+  
+  for (i = 0; i < file->local_variable_count; i++)
+  {
+    PIDX_variable variable = file->idx_ptr->variable[file->local_variable_index + i];
+    
+    // the restructured boxes are powers of two, HZ holds their samples (or bricks) level by level
+    samples = 0;
+    for (p = 0; p < variable->patch_count; p++)
+    {
+      volume = 1;
+      for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      {
+        for (size = 1; size < variable->patch[p]->Ndim_box_size[d]; size = size * 2)
+          ;
+        volume = (variable->patch[p]->Ndim_box_size[d] == 0) ? 0 : volume * size;
+      }
+      samples = samples + volume;
+    }
+    box_bytes[i] = samples * variable->values_per_sample * (variable->bits_per_value / 8) + (samples / brick_volume) * variable->values_per_sample * variable->bytes_per_brick;
+    
+    // one aggregator per sample, file and aggregation factor, each with the blocks of its share of the file
+    aggregator_count[i] = variable->values_per_sample * file->idx_derived_ptr->existing_file_count * file->idx_derived_ptr->aggregation_factor;
+    agg_buffer_bytes[i] = (int64_t)file->idx_ptr->blocks_per_file * (file->idx_derived_ptr->samples_per_block / file->idx_derived_ptr->aggregation_factor) * variable->bytes_per_brick;
+  }
+  
+#if PIDX_HAVE_MPI
+  // the biggest boxes of any process decide, so that all of them make the same groups
+  MPI_Allreduce(MPI_IN_PLACE, box_bytes, file->local_variable_count, MPI_INT64_T, MPI_MAX, file->comm);
+#endif
+  
+  for (i = 0; i < file->local_variable_count; i = i + file->variable_group_size[file->variable_group_count++])
+  {
+    file->variable_group_size[file->variable_group_count] = 0;
+    group_bytes = 0;
+    group_aggregators = 0;
+    buffer_bytes = 0;
+    for (var = i; var < file->local_variable_count; var++)
+    {
+      if (var != i && group_aggregators + aggregator_count[var] > nprocs)
+        break;
+      if (file->variable_pipelining_factor >= 0 && var - i == file->variable_pipelining_factor + 1)
+        break;
+      if (file->variable_pipelining_factor < 0 && file->memory_budget == 0 && var - i == 16)
+        break;
+      if (file->variable_pipelining_factor < 0 && file->memory_budget != 0 && var != i && (uint64_t)(group_bytes + box_bytes[var] + ((agg_buffer_bytes[var] > buffer_bytes) ? agg_buffer_bytes[var] : buffer_bytes)) > file->memory_budget)
+        break;
+      
+      group_bytes = group_bytes + box_bytes[var];
+      group_aggregators = group_aggregators + aggregator_count[var];
+      if (agg_buffer_bytes[var] > buffer_bytes)
+        buffer_bytes = agg_buffer_bytes[var];
+      file->variable_group_size[file->variable_group_count]++;
+    }
+    file->variable_group_bytes[file->variable_group_count] = group_bytes + buffer_bytes;
+    
+    if (file->variable_pipelining_factor < 0 && file->memory_budget != 0 && (uint64_t)file->variable_group_bytes[file->variable_group_count] > file->memory_budget && file->flags != PIDX_file_rdonly && rank == 0)
+      fprintf(stderr, "(Warning !!!!) Variable %d needs %lld bytes, over the memory budget of %lld bytes\n", file->local_variable_index + i, (long long)file->variable_group_bytes[file->variable_group_count], (long long)file->memory_budget);
+  }
+  
+  free(box_bytes);
+  free(aggregator_count);
+  free(agg_buffer_bytes);
+  
+  return 0;
+}
+
+
+/// The boxes of a read are a small part of the dataset when they add up to at most 1 / PIDX_ROI_READ_FRACTION of it
+#define PIDX_ROI_READ_FRACTION 8
+
+/// 1 if the boxes of all the processes (the first variable of the read) are a small part of the dataset, so that every
+/// process reading the blocks of its boxes reads far less than the aggregators, which read every file (the same answer
+/// on all the processes)
+static int roi_read_is_small(PIDX_file file)
+{
+  int d, p;
+  int64_t box_volume, volume = 0, dataset_volume = 1;
+  PIDX_variable var;
+  
+  if (file->local_variable_count == 0)
+    return 0;
+  
+  var = file->idx_ptr->variable[file->local_variable_index];
+  for (p = 0; p < var->patch_count; p++)
+  {
+    box_volume = 1;
+    for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      box_volume = box_volume * var->patch[p]->Ndim_box_size[d];
+    volume = volume + box_volume;
+  }
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    dataset_volume = dataset_volume * file->idx_ptr->global_bounds[d];
+  
+#if PIDX_HAVE_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &volume, 1, MPI_INT64_T, MPI_SUM, file->comm);
+#endif
+  
+  return (volume * PIDX_ROI_READ_FRACTION <= dataset_volume) ? 1 : 0;
+}
+
+
+/// 1 if the aggregated read can serve the patches of the processes (the same answer on all of them): the restructuring
+/// phase needs one patch per process, the same for all the variables, and patches that tile the dataset; the
+/// aggregators need a process each. A restart on fewer processes or another decomposition than the writer's may
+/// have neither.
+static int aggregated_read_fits(PIDX_file file)
+{
+  int d, g, var, start_index, end_index, fits = 1, nprocs = 1;
+  int64_t patch_volume = 1, volume = 0, dataset_volume = 1, aggregator_count;
+  int64_t local_patch[2 * PIDX_MAX_DIMENSIONS] = {0};
+  int64_t* patch_offset = local_patch;
+  int64_t* patch_size = local_patch + PIDX_MAX_DIMENSIONS;
+  
+  if (file->local_variable_count == 0)
+    return 1;
+  
+  // a process without a patch reads nothing, an empty box
+  for (var = file->local_variable_index; var < file->local_variable_index + file->local_variable_count; var++)
+  {
+    if (file->idx_ptr->variable[var]->patch_count != 1)
+      fits = 0;
+    else if (var == file->local_variable_index)
+    {
+      memcpy(patch_offset, file->idx_ptr->variable[var]->patch[0]->Ndim_box_offset, sizeof (PIDX_point));
+      memcpy(patch_size, file->idx_ptr->variable[var]->patch[0]->Ndim_box_size, sizeof (PIDX_point));
+    }
+    else if (memcmp(file->idx_ptr->variable[var]->patch[0]->Ndim_box_offset, patch_offset, sizeof (PIDX_point)) != 0 || memcmp(file->idx_ptr->variable[var]->patch[0]->Ndim_box_size, patch_size, sizeof (PIDX_point)) != 0)
+      fits = 0;
+  }
+  
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    patch_volume = patch_volume * patch_size[d];
+    dataset_volume = dataset_volume * file->idx_ptr->global_bounds[d];
+    if (patch_offset[d] < 0 || patch_offset[d] + patch_size[d] > file->idx_ptr->global_bounds[d])
+      fits = 0;
+  }
+  
+#if PIDX_HAVE_MPI
+  MPI_Comm_size(file->comm, &nprocs);
+#endif
+  
+  plan_variable_groups(file);
+  for (g = 0, start_index = file->local_variable_index; g < file->variable_group_count; start_index = start_index + file->variable_group_size[g++])
+  {
+    end_index = start_index + file->variable_group_size[g] - 1;
+    aggregator_count = 0;
+    for (var = start_index; var <= end_index; var++)
+      aggregator_count = aggregator_count + file->idx_ptr->variable[var]->values_per_sample * file->idx_derived_ptr->existing_file_count * file->idx_derived_ptr->aggregation_factor;
+    if (aggregator_count > nprocs)
+      fits = 0;
+  }
+  
+#if PIDX_HAVE_MPI
+  // disjoint patches whose volumes add up to the dataset tile it
+  int i, rank, all_fit = 0;
+  int64_t* patches = malloc(sizeof (*patches) * nprocs * 2 * PIDX_MAX_DIMENSIONS);
+  
+  MPI_Comm_rank(file->comm, &rank);
+  MPI_Allgather(local_patch, 2 * PIDX_MAX_DIMENSIONS, MPI_LONG_LONG, patches, 2 * PIDX_MAX_DIMENSIONS, MPI_LONG_LONG, file->comm);
+  
+  for (i = 0; i < nprocs; i++)
+  {
+    int64_t* offset = patches + i * 2 * PIDX_MAX_DIMENSIONS;
+    int64_t* size = offset + PIDX_MAX_DIMENSIONS;
+    
+    volume = volume + size[0] * size[1] * size[2] * size[3] * size[4];
+    if (i == rank || patch_volume == 0)
+      continue;
+    for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      if (offset[d] >= patch_offset[d] + patch_size[d] || patch_offset[d] >= offset[d] + size[d])
+        break;
+    if (d == PIDX_MAX_DIMENSIONS)
+      fits = 0;
+  }
+  free(patches);
+  
+  MPI_Allreduce(&fits, &all_fit, 1, MPI_INT, MPI_LAND, file->comm);
+  fits = all_fit;
+#else
+  volume = patch_volume;
+#endif
+  
+  return (fits == 1 && volume == dataset_volume) ? 1 : 0;
+}
+
 /////////////////////////////////////////////////
 PIDX_return_code PIDX_read(PIDX_file file)
 {
@@ -1291,15 +1839,16 @@ PIDX_return_code PIDX_read(PIDX_file file)
     return PIDX_success;
     
   int j = 0, p, var = 0;
-  int rank = 0;
+  int rank = 0, nprocs = 1;
   int var_used_in_binary_file, total_header_size;
-  file->perform_compression = 1;
+  file->perform_compression = (file->idx_ptr->compression_block_size[0] * file->idx_ptr->compression_block_size[1] * file->idx_ptr->compression_block_size[2] * file->idx_ptr->compression_block_size[3] * file->idx_ptr->compression_block_size[4] > 1);
   //static int header_io = 0;
 #if PIDX_HAVE_MPI
   MPI_Comm_rank(file->comm, &rank);
+  MPI_Comm_size(file->comm, &nprocs);
 #endif
   
-  populate_idx_dataset(file);
+  populate_idx_dataset(file, PIDX_READ);
   
   /// Initialization ONLY ONCE per IDX file
   if(file->one_time_initializations == 0)
@@ -1396,14 +1945,85 @@ PIDX_return_code PIDX_read(PIDX_file file)
   }
     
 
-  int do_agg = 1;
+  // every process reads the blocks that hold samples of its own patches, without the other processes; this reads
+  // far less than the aggregators when the patches are a small part of the dataset, full reads stay with the aggregators
+  // (resolution limited reads always go this way, and so do the restarts whose processes the aggregators can not serve)
+  if (file->read_level != -1 || file->read_subsampling[0] != 0 || file->progressive_callback != NULL || (file->idx_derived_ptr->io_backend != PIDX_io_backend_memory && ((file->roi_read == 1 && roi_read_is_small(file) == 1) || aggregated_read_fits(file) == 0)))
+  {
+    int read_level;
+    PIDX_point read_stride;
+    struct progressive_read progressive;
+
+    if (file->query_id == NULL)
+      file->query_id = PIDX_query_init(file->idx_ptr, file->idx_derived_ptr);
+
+    if (PIDX_query_resolution(file->idx_ptr, file->read_level, (file->read_subsampling[0] != 0) ? file->read_subsampling : NULL, &read_level, read_stride) == -1)
+      return PIDX_err_size;
+    PIDX_query_set_resolution(file->query_id, read_level, read_stride);
+
+    // the blocks of the sparse layouts move from one time step to the next, there is nothing to read ahead
+    if (file->prefetch_depth > 0 && file->idx_ptr->sparse_layout == 0 && file->idx_derived_ptr->io_backend != PIDX_io_backend_memory && file->prefetch_id == NULL)
+      file->prefetch_id = PIDX_prefetch_init(file->idx_derived_ptr->io_backend, file->idx_ptr->blocks_per_file);
+    PIDX_query_set_prefetch(file->query_id, (file->prefetch_depth > 0 && file->idx_ptr->sparse_layout == 0) ? file->prefetch_id : NULL);
+
+    for (var = file->local_variable_index; var < file->local_variable_index + file->local_variable_count; var++)
+    {
+      for (p = 0; p < file->idx_ptr->variable[var]->patch_count; p++)
+      {
+        Ndim_box patch = file->idx_ptr->variable[var]->patch[p];
+        if (patch->Ndim_box_size[0] * patch->Ndim_box_size[1] * patch->Ndim_box_size[2] * patch->Ndim_box_size[3] * patch->Ndim_box_size[4] == 0)
+          continue;
+        if (PIDX_query_plan(file->query_id, var, patch->Ndim_box_offset, patch->Ndim_box_size) == -1)
+          return PIDX_err_offset;
+        progressive.file = file;
+        progressive.variable = file->idx_ptr->variable[var];
+        progressive.patch = p;
+        PIDX_query_set_callback(file->query_id, (file->progressive_callback != NULL) ? progressive_level : NULL, &progressive);
+        if (PIDX_query_read(file->query_id, patch->Ndim_box_buffer, file->idx_ptr->variable[var]->data_layout) == -1)
+          return PIDX_err_file;
+      }
+    }
+
+    // while the application works on this time step the same blocks of the next ones go into the block cache
+    if (file->prefetch_id != NULL && file->prefetch_depth > 0 && file->idx_ptr->sparse_layout == 0)
+    {
+      int t;
+      char (*filename_template)[1024] = malloc(file->prefetch_depth * sizeof (*filename_template));
+      if (filename_template == NULL)
+        return PIDX_err_file;
+
+      for (t = 0; t < file->prefetch_depth; t++)
+        generate_file_name_template(file->idx_derived_ptr->maxh, file->idx_ptr->bits_per_block, file->idx_ptr->filename, file->idx_ptr->current_time_step + 1 + t, filename_template[t]);
+      PIDX_prefetch_start(file->prefetch_id, filename_template, file->prefetch_depth);
+      free(filename_template);
+    }
+
+    return PIDX_success;
+  }
+
+  // without aggregation (PIDX_enable_agg) every process writes or reads its own HZ runs
+  int do_agg = (file->perform_agg == 1);
   int local_do_rst = 0, global_do_rst = 0;
-  int start_index = 0, end_index = 0;
+  int g, start_index = 0, end_index = 0;
+  
+  // with the mmap backend (and no compression) the samples are gathered straight from the mapped files,
+  // so neither the aggregation buffers nor the HZ level buffers are needed
+  int map_read = 0;
+  if (file->idx_derived_ptr->io_backend == PIDX_io_backend_mmap && file->idx_ptr->compression_type != PIDX_LOSSLESS_COMPRESSION && file->idx_ptr->compression_type != PIDX_ADAPTIVE_COMPRESSION && file->idx_ptr->compression_block_size[0] * file->idx_ptr->compression_block_size[1] * file->idx_ptr->compression_block_size[2] * file->idx_ptr->compression_block_size[3] * file->idx_ptr->compression_block_size[4] == 1)
+  {
+    map_read = 1;
+    do_agg = 0;
+    if (file->io_map_id == NULL)
+      file->io_map_id = PIDX_io_map_init(file->idx_ptr, file->idx_derived_ptr);
+    PIDX_io_map_reset(file->io_map_id);
+  }
+  
+  if (plan_variable_groups(file) == -1)
+    return PIDX_err_file;
   
-  file->variable_pipelining_factor = 15;
-  for (start_index = file->local_variable_index; start_index < file->local_variable_index + file->local_variable_count; start_index = start_index + (file->variable_pipelining_factor + 1))
+  for (g = 0, start_index = file->local_variable_index; g < file->variable_group_count; start_index = start_index + file->variable_group_size[g++])
   {
-    end_index = ((start_index + file->variable_pipelining_factor) >= (file->local_variable_index + file->local_variable_count)) ? ((file->local_variable_index + file->local_variable_count) - 1) : (start_index + file->variable_pipelining_factor);
+    end_index = start_index + file->variable_group_size[g] - 1;
     
     ///----------------------------------IO init start-------------------------------------------------///
     io_init_start[vp] = PIDX_get_time();
@@ -1460,6 +2080,18 @@ PIDX_return_code PIDX_read(PIDX_file file)
     
     ///------------------------------Var buffer init start---------------------------------------------///
     var_init_start[vp] = PIDX_get_time();
+#if PIDX_HAVE_MPI
+    // the restructuring phase sizes its boxes from the extents of all the processes
+    file->idx_ptr->variable[start_index]->rank_r_offset = malloc(sizeof (int64_t) * nprocs * PIDX_MAX_DIMENSIONS);
+    memset(file->idx_ptr->variable[start_index]->rank_r_offset, 0, (sizeof (int64_t) * nprocs * PIDX_MAX_DIMENSIONS));
+
+    file->idx_ptr->variable[start_index]->rank_r_count =  malloc(sizeof (int64_t) * nprocs * PIDX_MAX_DIMENSIONS);
+    memset(file->idx_ptr->variable[start_index]->rank_r_count, 0, (sizeof (int64_t) * nprocs * PIDX_MAX_DIMENSIONS));
+
+    MPI_Allgather(file->idx_ptr->variable[start_index]->patch[0]->Ndim_box_offset , PIDX_MAX_DIMENSIONS, MPI_LONG_LONG, file->idx_ptr->variable[start_index]->rank_r_offset, PIDX_MAX_DIMENSIONS, MPI_LONG_LONG, file->comm);
+    
+    MPI_Allgather(file->idx_ptr->variable[start_index]->patch[0]->Ndim_box_size, PIDX_MAX_DIMENSIONS, MPI_LONG_LONG, file->idx_ptr->variable[start_index]->rank_r_count, PIDX_MAX_DIMENSIONS, MPI_LONG_LONG, file->comm);
+#endif
 #ifdef PIDX_VAR_SLOW_LOOP
     for (var = start_index; var <= end_index; var++)
     {
@@ -1565,20 +2197,40 @@ PIDX_return_code PIDX_read(PIDX_file file)
     
 #endif
 
-    PIDX_hz_encode_buf_create(file->hz_id);
-    
-    file->idx_derived_ptr->agg_buffer = malloc(sizeof(*file->idx_derived_ptr->agg_buffer));
-    PIDX_agg_buf_create(file->agg_id);  
-    
-    buffer_end[vp] = PIDX_get_time();
-    ///--------------------------------------ALL buffer end time---------------------------------------------------///
- 
-    
-    ///------------------------------------IO start time---------------------------------------------------///
-    io_start[vp] = PIDX_get_time();
-    if (do_agg == 1)
+    // HZ decodes into the brick ordered buffers, they are decompressed and scattered into the patch groups afterwards
+    if (file->perform_compression == 1)
+    {
+      file->block_rst_id = PIDX_block_rst_init(file->idx_ptr, file->idx_derived_ptr, start_index, end_index);
+      file->compression_id = PIDX_compression_init(file->idx_ptr, file->idx_derived_ptr, start_index, end_index);
+#if PIDX_HAVE_MPI
+      PIDX_block_rst_set_communicator(file->block_rst_id, file->comm);
+      PIDX_compression_set_communicator(file->compression_id, file->comm);
+#endif
+      if (PIDX_block_rst_buf_create(file->block_rst_id) == -1)
+        return PIDX_err_file;
+      PIDX_compression_prepare(file->compression_id);
+      swap_block_rst_groups(file, start_index, end_index);
+    }
+
+    if (map_read == 1)
+      PIDX_hz_encode_set_io_map(file->hz_id, file->io_map_id);
+    PIDX_hz_encode_buf_create(file->hz_id);
+    
+    if (do_agg == 1)
+    {
+      file->idx_derived_ptr->agg_buffer = malloc(sizeof(*file->idx_derived_ptr->agg_buffer));
+      PIDX_agg_buf_create(file->agg_id);
+    }
+    
+    buffer_end[vp] = PIDX_get_time();
+    ///--------------------------------------ALL buffer end time---------------------------------------------------///
+ 
+    
+    ///------------------------------------IO start time---------------------------------------------------///
+    io_start[vp] = PIDX_get_time();
+    if (do_agg == 1)
       PIDX_io_aggregated_read(file->io_id);
-    else
+    else if (map_read == 0)
       PIDX_io_per_process_read(file->io_id);
     io_end[vp] = PIDX_get_time();
     ///---------------------------------------IO end time---------------------------------------------------///
@@ -1606,6 +2258,21 @@ PIDX_return_code PIDX_read(PIDX_file file)
     ///------------------------------------HZ end time------------------------------------------------------///
     
     
+    ///---------------------------------Compression start time----------------------------------------------///
+    compression_start[vp] = PIDX_get_time();
+    if (file->perform_compression == 1)
+    {
+      swap_block_rst_groups(file, start_index, end_index);
+      if (PIDX_compression_decompress(file->compression_id) == -1 || PIDX_block_rst_restore(file->block_rst_id) == -1)
+        return PIDX_err_file;
+      PIDX_block_rst_buf_destroy(file->block_rst_id);
+      PIDX_compression_finalize(file->compression_id);
+      PIDX_block_rst_finalize(file->block_rst_id);
+    }
+    compression_end[vp] = PIDX_get_time();
+    ///----------------------------------Compression end time-----------------------------------------------///
+    
+    
     ///---------------------------------------Agg start time--------------------------------------------------///
     rst_start[vp] = PIDX_get_time();  
 #if PIDX_HAVE_MPI
@@ -1632,6 +2299,12 @@ PIDX_return_code PIDX_read(PIDX_file file)
       }
       free(file->idx_ptr->variable[var]->patch_group_ptr);
     }
+    
+#if PIDX_HAVE_MPI
+    free(file->idx_ptr->variable[start_index]->rank_r_offset);
+    free(file->idx_ptr->variable[start_index]->rank_r_count);
+#endif
+    
     cleanup_end[vp] = PIDX_get_time();
     ///-------------------------------------cleanup end time------------------------------------------------///
     
@@ -1651,7 +2324,9 @@ PIDX_return_code PIDX_read(PIDX_file file)
     finalize_end[vp] = PIDX_get_time();
     ///------------------------------------finalize end time------------------------------------------------///
     
-    vp++;
+    // the timing buffers hold 64 groups, small memory budgets may make more
+    if (vp < 63)
+      vp++;
   }
 
   return PIDX_success;
@@ -1671,6 +2346,23 @@ PIDX_return_code PIDX_hz_encoding_caching_OFF()
   return PIDX_success;
 }
 
+/////////////////////////////////////////////////
+PIDX_return_code PIDX_set_block_cache_size(uint64_t byte_budget)
+{
+  // the cache is shared by all the files of the process, writes empty it
+  PIDX_block_cache_set_size(byte_budget);
+  
+  return PIDX_success;
+}
+
+/////////////////////////////////////////////////
+PIDX_return_code PIDX_get_block_cache_stats(int64_t* hit_count, int64_t* miss_count, int64_t* byte_count)
+{
+  PIDX_block_cache_get_stats(hit_count, miss_count, byte_count);
+  
+  return PIDX_success;
+}
+
 /////////////////////////////////////////////////
 PIDX_return_code PIDX_time_step_caching_ON()
 {
@@ -1719,6 +2411,284 @@ PIDX_return_code PIDX_enable_io(PIDX_file file, int io)
   return PIDX_success;
 }
 
+PIDX_return_code PIDX_enable_async_io(PIDX_file file, int async_io)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  if (async_io == 1 && file->async_io_id == NULL)
+  {
+    file->async_io_id = PIDX_async_io_init();
+    if (file->async_io_id == NULL)
+      return PIDX_err_not_implemented;
+  }
+  else if (async_io == 0 && file->async_io_id != NULL)
+  {
+    PIDX_async_io_wait(file->async_io_id);
+    PIDX_async_io_finalize(file->async_io_id);
+    file->async_io_id = NULL;
+  }
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_enable_direct_io(PIDX_file file, int direct_io)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  file->idx_derived_ptr->direct_io = direct_io;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_set_memory_budget(PIDX_file file, uint64_t byte_budget)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  // every group of a flush takes as many variables as fit (at least one), from the predicted size of the restructured
+  // boxes, their HZ buffers and the aggregation buffers; a group never has more aggregators than processes
+  file->memory_budget = byte_budget;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_set_variable_pipelining_factor(PIDX_file file, int factor)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  if (factor < -1)
+    return PIDX_err_size;
+  
+  file->variable_pipelining_factor = factor;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_get_variable_groups(PIDX_file file, int* group_count, int* variable_count, int64_t* byte_count)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  *group_count = file->variable_group_count;
+  if (variable_count != NULL)
+    memcpy(variable_count, file->variable_group_size, file->variable_group_count * sizeof (*variable_count));
+  if (byte_count != NULL)
+    memcpy(byte_count, file->variable_group_bytes, file->variable_group_count * sizeof (*byte_count));
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_enable_sparse_layout(PIDX_file file, int sparse_layout)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  // the layout of a file opened for reading is the one recorded in its .idx file
+  if (file->flags == PIDX_file_rdonly)
+    return PIDX_success;
+  
+  file->idx_ptr->sparse_layout = sparse_layout;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_enable_roi_read(PIDX_file file, int roi_read)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  // the boxes go through their blocks when, all processes together, they cover at most an eighth of the dataset;
+  // larger reads stay with the aggregators (or the mmap gather), the memory backend always uses them. The boxes go
+  // through their blocks anyway when they do not tile the dataset or there are fewer processes than aggregators.
+  file->roi_read = roi_read;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_set_resolution(PIDX_file file, int max_level)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  if (max_level < -1)
+    return PIDX_err_size;
+  
+  // the boxes get the samples on multiples of the stride of the level, read from the first blocks of every file
+  file->read_level = max_level;
+  memset(file->read_subsampling, 0, sizeof (file->read_subsampling));
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_set_subsampling(PIDX_file file, PIDX_point subsampling)
+{
+  int d;
+  
+  if(!file)
+    return PIDX_err_file;
+  
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    if (subsampling[d] < 1 || (subsampling[d] & (subsampling[d] - 1)) != 0)
+      return PIDX_err_size;
+  
+  file->read_level = -1;
+  memcpy(file->read_subsampling, subsampling, sizeof (file->read_subsampling));
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_get_resolution_dims(PIDX_file file, PIDX_point offset, PIDX_point dims, PIDX_point stride, PIDX_point coarse_dims)
+{
+  int d, level;
+  
+  if(!file)
+    return PIDX_err_file;
+  
+  if (PIDX_query_resolution(file->idx_ptr, file->read_level, (file->read_subsampling[0] != 0) ? file->read_subsampling : NULL, &level, stride) == -1)
+    return PIDX_err_size;
+  
+  // the multiples of the stride in the box
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    coarse_dims[d] = (dims[d] < 1) ? 0 : (offset[d] + dims[d] - 1) / stride[d] - offset[d] / stride[d] + ((offset[d] % stride[d] == 0) ? 1 : 0);
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_set_progressive_callback(PIDX_file file, PIDX_progressive_callback callback, void* user_data)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  // the whole box is filled in from the levels read so far and refined in place, progressive reads are region of interest reads
+  file->progressive_callback = callback;
+  file->progressive_data = user_data;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_set_prefetch_depth(PIDX_file file, int depth)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  if (depth < 0)
+    return PIDX_err_size;
+  
+  // the read ahead runs on a thread of its own and goes on after PIDX_close, the block cache has to be big enough to hold
+  // it; without threads, with the sparse layout or with the memory backend it is off
+  file->prefetch_depth = depth;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_set_read_thread_count(PIDX_file file, int thread_count)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  if (thread_count < 0)
+    return PIDX_err_size;
+  
+  // every thread reads its own files, decodes their blocks and copies the samples into the box; with MPI the ranks of
+  // a node already share its cores, so 0 reads from the calling thread alone
+  file->idx_ptr->read_thread_count = thread_count;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_get_read_thread_count(PIDX_file file, int* thread_count)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  *thread_count = file->idx_ptr->read_thread_count;
+  
+  return PIDX_success;
+}
+
+static int progressive_level(int level, int last_level, void* user_data)
+{
+  struct progressive_read* progressive = user_data;
+  
+  return progressive->file->progressive_callback(progressive->variable, progressive->patch, level, last_level, progressive->file->progressive_data);
+}
+
+PIDX_return_code PIDX_get_roi_read_stats(PIDX_file file, int64_t* block_count, int64_t* file_count, int64_t* byte_count)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  *block_count = 0;
+  *file_count = 0;
+  *byte_count = 0;
+  if (file->query_id != NULL)
+    PIDX_query_get_stats(file->query_id, block_count, file_count, byte_count);
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_set_io_backend(PIDX_file file, PIDX_io_backend io_backend)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  if (io_backend != PIDX_io_backend_mpi && io_backend != PIDX_io_backend_posix && io_backend != PIDX_io_backend_mmap && io_backend != PIDX_io_backend_memory)
+    return PIDX_err_unsupported_flags;
+  
+  file->idx_derived_ptr->io_backend = io_backend;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_get_io_backend(PIDX_file file, PIDX_io_backend* io_backend)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  *io_backend = file->idx_derived_ptr->io_backend;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_test(PIDX_file file, int* flag)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  *flag = 1;
+  if (file->flush_request != NULL && PIDX_request_test(file->flush_request, flag) != PIDX_success)
+    return PIDX_err_file;
+  
+  if (*flag == 1 && file->async_io_id != NULL && PIDX_async_io_test(file->async_io_id, flag) != 0)
+    return PIDX_err_file;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_wait(PIDX_file file)
+{
+  if(!file)
+    return PIDX_err_file;
+  
+  if (file->flush_request != NULL && flush_finish(file->flush_request) != 0)
+    return PIDX_err_file;
+  
+  if (file->async_io_id != NULL && PIDX_async_io_wait(file->async_io_id) != 0)
+    return PIDX_err_file;
+  
+  return PIDX_success;
+}
+
+PIDX_return_code PIDX_wait_all()
+{
+  PIDX_async_io_wait_all();
+  PIDX_prefetch_wait_all();
+  return PIDX_success;
+}
+
 PIDX_return_code PIDX_debug_rst(PIDX_file file, int debug_rst)
 {
   if(!file)
@@ -1801,16 +2771,16 @@ static PIDX_return_code PIDX_cache_headers(PIDX_file file)
         if (all_scalars == 0)
         {
           for (k = 0; k < j; k++)
-            base_offset = base_offset + (file->idx_ptr->variable[file->local_variable_index]->VAR_blocks_per_file[file->idx_derived_ptr->agg_buffer->file_number] /*- empty_blocks*/) * (file->idx_ptr->variable[k]->bits_per_value / 8) * file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[k]->values_per_sample;
+            base_offset = base_offset + (file->idx_ptr->variable[file->local_variable_index]->VAR_blocks_per_file[file->idx_derived_ptr->agg_buffer->file_number] /*- empty_blocks*/) * file->idx_ptr->variable[k]->bytes_per_brick * file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[k]->values_per_sample;
         }
         else
-          base_offset =  j * (file->idx_ptr->variable[file->local_variable_index]->VAR_blocks_per_file[file->idx_derived_ptr->agg_buffer->file_number] /*- empty_blocks*/) * (file->idx_ptr->variable[file->local_variable_index]->bits_per_value / 8) * file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[file->local_variable_index]->values_per_sample;
+          base_offset =  j * (file->idx_ptr->variable[file->local_variable_index]->VAR_blocks_per_file[file->idx_derived_ptr->agg_buffer->file_number] /*- empty_blocks*/) * file->idx_ptr->variable[file->local_variable_index]->bytes_per_brick * file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[file->local_variable_index]->values_per_sample;
         
-        data_offset = (((i) - block_negative_offset) * file->idx_derived_ptr->samples_per_block) * (file->idx_ptr->variable[j]->bits_per_value / 8) * file->idx_ptr->variable[j]->values_per_sample;
+        data_offset = (((i) - block_negative_offset) * file->idx_derived_ptr->samples_per_block) * file->idx_ptr->variable[j]->bytes_per_brick * file->idx_ptr->variable[j]->values_per_sample;
         data_offset = base_offset + data_offset + file->idx_derived_ptr->start_fs_block * file->idx_derived_ptr->fs_block_size;
         
         cached_header_copy[12 + ((i + (file->idx_ptr->blocks_per_file * j))*10)] = htonl(data_offset);
-        cached_header_copy[14 + ((i + (file->idx_ptr->blocks_per_file * j))*10)] = htonl(file->idx_derived_ptr->samples_per_block * (file->idx_ptr->variable[j]->bits_per_value / 8) * file->idx_ptr->variable[j]->values_per_sample);  
+        cached_header_copy[14 + ((i + (file->idx_ptr->blocks_per_file * j))*10)] = htonl(file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[j]->bytes_per_brick * file->idx_ptr->variable[j]->values_per_sample);  
       }
     }
   }
@@ -1828,21 +2798,21 @@ static PIDX_return_code PIDX_cache_headers(PIDX_file file)
         if (all_scalars == 0)
         {
           for (k = 0; k < j; k++)
-            base_offset = base_offset + (file->idx_derived_ptr->existing_blocks_index_per_file[file->idx_derived_ptr->agg_buffer->file_number] /*- empty_blocks*/) * (file->idx_ptr->variable[k]->bits_per_value / 8) * file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[k]->values_per_sample;
+            base_offset = base_offset + (file->idx_derived_ptr->existing_blocks_index_per_file[file->idx_derived_ptr->agg_buffer->file_number] /*- empty_blocks*/) * file->idx_ptr->variable[k]->bytes_per_brick * file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[k]->values_per_sample;
         }
         else
-          base_offset =  j * (file->idx_derived_ptr->existing_blocks_index_per_file[file->idx_derived_ptr->agg_buffer->file_number] /*- empty_blocks*/) * (file->idx_ptr->variable[file->local_variable_index]->bits_per_value / 8) * file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[file->local_variable_index]->values_per_sample;
+          base_offset =  j * (file->idx_derived_ptr->existing_blocks_index_per_file[file->idx_derived_ptr->agg_buffer->file_number] /*- empty_blocks*/) * file->idx_ptr->variable[file->local_variable_index]->bytes_per_brick * file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[file->local_variable_index]->values_per_sample;
         
-        data_offset = (((i) - block_negative_offset) * file->idx_derived_ptr->samples_per_block) * (file->idx_ptr->variable[j]->bits_per_value / 8) * file->idx_ptr->variable[j]->values_per_sample;
+        data_offset = (((i) - block_negative_offset) * file->idx_derived_ptr->samples_per_block) * file->idx_ptr->variable[j]->bytes_per_brick * file->idx_ptr->variable[j]->values_per_sample;
         
         //if (j == 1)
         //printf("%d Block %d: [BO %ld DO %ld = %ld] Offset %ld Count %d\n", j, i, 
-          //     base_offset, data_offset, (base_offset + data_offset), data_offset, (file->idx_derived_ptr->samples_per_block * (file->idx_ptr->variable[j]->bits_per_value / 8) * file->idx_ptr->variable[j]->values_per_sample));
+          //     base_offset, data_offset, (base_offset + data_offset), data_offset, (file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[j]->bytes_per_brick * file->idx_ptr->variable[j]->values_per_sample));
         
         data_offset = base_offset + data_offset + file->idx_derived_ptr->start_fs_block * file->idx_derived_ptr->fs_block_size;
-        //printf("[%d %d]: (%d) O %ld (%ld) C %d\n", j, i, file->idx_derived_ptr->existing_blocks_index_per_file[file->idx_derived_ptr->agg_buffer->file_number], data_offset, base_offset, (file->idx_derived_ptr->samples_per_block * (file->idx_ptr->variable[j]->bits_per_value / 8) * file->idx_ptr->variable[j]->values_per_sample));
+        //printf("[%d %d]: (%d) O %ld (%ld) C %d\n", j, i, file->idx_derived_ptr->existing_blocks_index_per_file[file->idx_derived_ptr->agg_buffer->file_number], data_offset, base_offset, (file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[j]->bytes_per_brick * file->idx_ptr->variable[j]->values_per_sample));
         cached_header_copy[12 + ((i + (file->idx_ptr->blocks_per_file * j))*10)] = htonl(data_offset);
-        cached_header_copy[14 + ((i + (file->idx_ptr->blocks_per_file * j))*10)] = htonl(file->idx_derived_ptr->samples_per_block * (file->idx_ptr->variable[j]->bits_per_value / 8) * file->idx_ptr->variable[j]->values_per_sample);  
+        cached_header_copy[14 + ((i + (file->idx_ptr->blocks_per_file * j))*10)] = htonl(file->idx_derived_ptr->samples_per_block * file->idx_ptr->variable[j]->bytes_per_brick * file->idx_ptr->variable[j]->values_per_sample);  
       }
       //printf("\n");
     }
@@ -1854,7 +2824,7 @@ static PIDX_return_code PIDX_cache_headers(PIDX_file file)
 
 PIDX_return_code PIDX_set_compression_type(PIDX_file file, int compression_type)
 {
-  if(compression_type != 1)
+  if(compression_type != PIDX_NO_COMPRESSION && compression_type != PIDX_LOSSY_COMPRESSION && compression_type != PIDX_LOSSLESS_COMPRESSION && compression_type != PIDX_ADAPTIVE_COMPRESSION)
     return PIDX_err_unsupported_compression_type;
   
   if(file == NULL)
@@ -1877,6 +2847,56 @@ PIDX_return_code PIDX_get_compression_type(PIDX_file file, int *compression_type
 }
 
 
+PIDX_return_code PIDX_set_compression_bit_rate(PIDX_file file, int compression_bit_rate)
+{
+  if(compression_bit_rate <= 0)
+    return PIDX_err_unsupported_compression_type;
+  
+  if(file == NULL)
+    return PIDX_err_file;
+  
+  file->idx_ptr->compression_bit_rate = compression_bit_rate;
+  
+  return PIDX_success;
+}
+
+
+PIDX_return_code PIDX_get_compression_bit_rate(PIDX_file file, int *compression_bit_rate)
+{
+  if(file == NULL)
+    return PIDX_err_file;
+  
+  *compression_bit_rate = file->idx_ptr->compression_bit_rate;
+  
+  return PIDX_success;
+}
+
+
+PIDX_return_code PIDX_set_compression_thread_count(PIDX_file file, int thread_count)
+{
+  if(thread_count < 0)
+    return PIDX_err_unsupported_compression_type;
+  
+  if(file == NULL)
+    return PIDX_err_file;
+  
+  file->idx_ptr->compression_thread_count = thread_count;
+  
+  return PIDX_success;
+}
+
+
+PIDX_return_code PIDX_get_compression_thread_count(PIDX_file file, int *thread_count)
+{
+  if(file == NULL)
+    return PIDX_err_file;
+  
+  *thread_count = file->idx_ptr->compression_thread_count;
+  
+  return PIDX_success;
+}
+
+
 PIDX_return_code PIDX_set_compression_block_size(PIDX_file file, PIDX_point compression_block_size)
 {
   if(compression_block_size[0] < 0 || compression_block_size[1] < 0 || compression_block_size[2] < 0 || compression_block_size[3] < 0 || compression_block_size[4] < 0)
@@ -1907,10 +2927,14 @@ static PIDX_return_code PIDX_write(PIDX_file file)
   if (file->local_variable_index == file->idx_ptr->variable_count)
     return PIDX_success;
     
+  // the cached blocks (and those being read ahead) may be those being rewritten
+  PIDX_prefetch_wait_all();
+  PIDX_block_cache_clear();
+  
   int j = 0, p, var = 0;
   int rank = 0, nprocs = 1;
   int var_used_in_binary_file, total_header_size;
-  file->perform_compression = 1;
+  file->perform_compression = (file->idx_ptr->compression_block_size[0] * file->idx_ptr->compression_block_size[1] * file->idx_ptr->compression_block_size[2] * file->idx_ptr->compression_block_size[3] * file->idx_ptr->compression_block_size[4] > 1);
   //static int header_io = 0;
   
 #if PIDX_HAVE_MPI
@@ -1918,7 +2942,7 @@ static PIDX_return_code PIDX_write(PIDX_file file)
   MPI_Comm_size(file->comm, &nprocs);
 #endif
   
-  populate_idx_dataset(file);
+  populate_idx_dataset(file, PIDX_WRITE);
   /// Initialization ONLY ONCE per IDX file
   if(file->one_time_initializations == 0)
   {
@@ -2043,14 +3067,17 @@ static PIDX_return_code PIDX_write(PIDX_file file)
         }
   }
 
-  int do_agg = 1;
+  // without aggregation (PIDX_enable_agg) every process writes or reads its own HZ runs
+  int do_agg = (file->perform_agg == 1);
   int local_do_rst = 0, global_do_rst = 0;
-  int start_index = 0, end_index = 0;
-  file->variable_pipelining_factor = 15;
+  int g, start_index = 0, end_index = 0;
+  
+  if (plan_variable_groups(file) == -1)
+    return PIDX_err_file;
   
-  for (start_index = file->local_variable_index; start_index < file->local_variable_index + file->local_variable_count; start_index = start_index + (file->variable_pipelining_factor + 1))
+  for (g = 0, start_index = file->local_variable_index; g < file->variable_group_count; start_index = start_index + file->variable_group_size[g++])
   {
-    end_index = ((start_index + file->variable_pipelining_factor) >= (file->local_variable_index + file->local_variable_count)) ? ((file->local_variable_index + file->local_variable_count) - 1) : (start_index + file->variable_pipelining_factor);
+    end_index = start_index + file->variable_group_size[g] - 1;
     
     ///----------------------------------- RST init start----------------------------------------------///
     rst_init_start[vp] = PIDX_get_time();
@@ -2192,27 +3219,6 @@ static PIDX_return_code PIDX_write(PIDX_file file)
         file->idx_ptr->variable[var]->HZ_patch[p] = malloc(sizeof(*(file->idx_ptr->variable[var]->HZ_patch[p])));
         memset(file->idx_ptr->variable[var]->HZ_patch[p], 0, sizeof(*(file->idx_ptr->variable[var]->HZ_patch[p])));
       }    
-      //TODO
-      file->idx_ptr->variable[var]->post_rst_block = malloc(sizeof(*file->idx_ptr->variable[var]->post_rst_block) * file->idx_ptr->variable[var]->patch_group_count);
-      memset(file->idx_ptr->variable[var]->post_rst_block, 0, sizeof(*file->idx_ptr->variable[var]->post_rst_block) * file->idx_ptr->variable[var]->patch_group_count);
-      for (p = 0; p < file->idx_ptr->variable[var]->patch_group_count; p++)
-      {
-        file->idx_ptr->variable[var]->post_rst_block[p] = malloc(sizeof(*(file->idx_ptr->variable[var]->post_rst_block[p])));
-        memset(file->idx_ptr->variable[var]->post_rst_block[p], 0, sizeof(*(file->idx_ptr->variable[var]->post_rst_block[p])));
-        
-        file->idx_ptr->variable[var]->post_rst_block[p]->box_count = 1;
-        file->idx_ptr->variable[var]->post_rst_block[p]->box_group_type = file->idx_ptr->variable[var]->patch_group_ptr[p]->box_group_type;
-        
-        file->idx_ptr->variable[var]->post_rst_block[p]->box = malloc(sizeof(*(file->idx_ptr->variable[var]->post_rst_block[p]->box)) * file->idx_ptr->variable[var]->post_rst_block[p]->box_count);
-        
-        file->idx_ptr->variable[var]->post_rst_block[p]->box[0] = malloc(sizeof(*(file->idx_ptr->variable[var]->post_rst_block[p]->box[0])));
-        memcpy(file->idx_ptr->variable[var]->post_rst_block[p]->box[0]->Ndim_box_offset, file->idx_ptr->variable[var]->patch_group_ptr[p]->enclosing_box_offset, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
-        memcpy(file->idx_ptr->variable[var]->post_rst_block[p]->box[0]->Ndim_box_size, file->idx_ptr->variable[var]->patch_group_ptr[p]->enclosing_box_size, PIDX_MAX_DIMENSIONS *       sizeof(int64_t));
-        file->idx_ptr->variable[var]->post_rst_block[p]->box[0]->Ndim_box_buffer = file->idx_ptr->variable[var]->patch[p]->Ndim_box_buffer;
-        
-        memcpy(file->idx_ptr->variable[var]->post_rst_block[p]->enclosing_box_offset, file->idx_ptr->variable[var]->patch_group_ptr[p]->enclosing_box_offset, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
-        memcpy(file->idx_ptr->variable[var]->post_rst_block[p]->enclosing_box_size, file->idx_ptr->variable[var]->patch_group_ptr[p]->enclosing_box_size, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
-      }
     }
 #endif
     var_init_end[vp] = PIDX_get_time();
@@ -2279,15 +3285,31 @@ static PIDX_return_code PIDX_write(PIDX_file file)
     block_rst_start[vp] = PIDX_get_time();                                    
     if (file->perform_compression == 1)
     {
-      PIDX_block_rst_prepare(file->block_rst_id);
-      //PIDX_block_rst_compress(file->block_rst_id);
+      if (PIDX_block_rst_buf_create(file->block_rst_id) == -1 || PIDX_block_rst_prepare(file->block_rst_id) == -1)
+        return PIDX_err_file;
     }
     block_rst_end[vp] = PIDX_get_time();
     ///----------------------------BLOCK restructure end time-----------------------------------------------///
     
 
+    ///---------------------------------Compression start time----------------------------------------------///
+    compression_start[vp] = PIDX_get_time();
+    if(file->perform_compression == 1)
+    {
+      PIDX_compression_prepare(file->compression_id);
+      if (PIDX_compression_compress(file->compression_id) == -1)
+        return PIDX_err_file;
+    }
+    compression_end[vp] = PIDX_get_time();
+    ///----------------------------------Compression end time-----------------------------------------------///
+    
+
     ///-------------------------------------HZ start time---------------------------------------------------///
     hz_start[vp] = PIDX_get_time();
+    // HZ encodes the (compressed) bricks instead of the samples
+    if (file->perform_compression == 1)
+      swap_block_rst_groups(file, start_index, end_index);
+    
     PIDX_hz_encode_buf_create(file->hz_id);
     
     if (file->perform_hz == 1)
@@ -2296,6 +3318,11 @@ static PIDX_return_code PIDX_write(PIDX_file file)
     if(global_do_rst == 1 && file->debug_hz == 1)
       HELPER_Hz_encode(file->hz_id);
     
+    if (file->perform_compression == 1)
+    {
+      swap_block_rst_groups(file, start_index, end_index);
+      PIDX_block_rst_buf_destroy(file->block_rst_id);
+    }
 
 #if PIDX_HAVE_MPI
     if(global_do_rst == 1)
@@ -2305,18 +3332,6 @@ static PIDX_return_code PIDX_write(PIDX_file file)
     hz_end[vp] = PIDX_get_time();
     ///------------------------------------HZ end time------------------------------------------------------///
     
-
-    ///---------------------------------Compression start time----------------------------------------------///
-    compression_start[vp] = PIDX_get_time();
-    if(file->perform_compression == 1)
-    {
-      PIDX_compression_prepare(file->compression_id);
-      PIDX_compression_compress(file->compression_id);
-      PIDX_compression_finalize(file->compression_id);
-    }
-    compression_end[vp] = PIDX_get_time();
-    ///----------------------------------Compression end time-----------------------------------------------///
-    
     
     ///------------------------------------Agg start time---------------------------------------------------///
     agg_start[vp] = PIDX_get_time();
@@ -2333,17 +3348,18 @@ static PIDX_return_code PIDX_write(PIDX_file file)
       
       for (p = 0; p < file->idx_ptr->variable[start_index]->patch_group_count; p++)
       {
-        file->idx_derived_ptr->agg_level_start[p] = malloc(sizeof(*file->idx_derived_ptr->agg_level_start[p]) * (end_index - start_index + 1));
-        memset(file->idx_derived_ptr->agg_level_start[p], 0, sizeof(*file->idx_derived_ptr->agg_level_start[p]) * (end_index - start_index + 1));
-        file->idx_derived_ptr->agg_level_end[p] = malloc(sizeof(*file->idx_derived_ptr->agg_level_end[p]) * (end_index - start_index + 1));
-        memset(file->idx_derived_ptr->agg_level_end[p], 0, sizeof(*file->idx_derived_ptr->agg_level_end[p]) * (end_index - start_index + 1));
+        // indexed by variable (not by variable of the group) and by HZ level
+        file->idx_derived_ptr->agg_level_start[p] = malloc(sizeof(*file->idx_derived_ptr->agg_level_start[p]) * (end_index + 1));
+        memset(file->idx_derived_ptr->agg_level_start[p], 0, sizeof(*file->idx_derived_ptr->agg_level_start[p]) * (end_index + 1));
+        file->idx_derived_ptr->agg_level_end[p] = malloc(sizeof(*file->idx_derived_ptr->agg_level_end[p]) * (end_index + 1));
+        memset(file->idx_derived_ptr->agg_level_end[p], 0, sizeof(*file->idx_derived_ptr->agg_level_end[p]) * (end_index + 1));
         
         for(var = start_index; var <= end_index; var++)
         {
-          file->idx_derived_ptr->agg_level_start[p][var] = malloc(sizeof(*file->idx_derived_ptr->agg_level_start[p][var]) * (file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_to - file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_from));
-          memset(file->idx_derived_ptr->agg_level_start[p][var], 0, sizeof(*file->idx_derived_ptr->agg_level_start[p][var]) * (file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_to - file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_from));
-          file->idx_derived_ptr->agg_level_end[p][var] = malloc(sizeof(*file->idx_derived_ptr->agg_level_end[p][var]) * (file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_to - file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_from));
-          memset(file->idx_derived_ptr->agg_level_end[p][var], 0, sizeof(*file->idx_derived_ptr->agg_level_end[p][var]) * (file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_to - file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_from));
+          file->idx_derived_ptr->agg_level_start[p][var] = malloc(sizeof(*file->idx_derived_ptr->agg_level_start[p][var]) * file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_to);
+          memset(file->idx_derived_ptr->agg_level_start[p][var], 0, sizeof(*file->idx_derived_ptr->agg_level_start[p][var]) * file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_to);
+          file->idx_derived_ptr->agg_level_end[p][var] = malloc(sizeof(*file->idx_derived_ptr->agg_level_end[p][var]) * file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_to);
+          memset(file->idx_derived_ptr->agg_level_end[p][var], 0, sizeof(*file->idx_derived_ptr->agg_level_end[p][var]) * file->idx_ptr->variable[start_index]->HZ_patch[p]->HZ_level_to);
         }
       }
       agg_2[vp] = PIDX_get_time();
@@ -2360,6 +3376,19 @@ static PIDX_return_code PIDX_write(PIDX_file file)
         PIDX_cache_headers(file);
         caching_state = 0;
       }
+      
+      for (p = 0; p < file->idx_ptr->variable[start_index]->patch_group_count; p++)
+      {
+        for (var = start_index; var <= end_index; var++)
+        {
+          free(file->idx_derived_ptr->agg_level_start[p][var]);
+          free(file->idx_derived_ptr->agg_level_end[p][var]);
+        }
+        free(file->idx_derived_ptr->agg_level_start[p]);
+        free(file->idx_derived_ptr->agg_level_end[p]);
+      }
+      free(file->idx_derived_ptr->agg_level_start);
+      free(file->idx_derived_ptr->agg_level_end);
       agg_6[vp] = PIDX_get_time();
     }
     agg_end[vp] = PIDX_get_time();
@@ -2374,7 +3403,9 @@ static PIDX_return_code PIDX_write(PIDX_file file)
       {
         if (time_step_caching == 1)
           PIDX_io_cached_data(cached_header_copy);
-      
+        
+        PIDX_io_set_async(file->io_id, file->async_io_id);
+        PIDX_io_lossless_encode(file->io_id);
         PIDX_io_aggregated_write(file->io_id);
       }
       PIDX_agg_buf_destroy(file->agg_id);
@@ -2422,6 +3453,12 @@ static PIDX_return_code PIDX_write(PIDX_file file)
       PIDX_agg_finalize(file->agg_id);
     PIDX_hz_encode_finalize(file->hz_id);
     
+    if (file->perform_compression == 1)
+    {
+      PIDX_compression_finalize(file->compression_id);
+      PIDX_block_rst_finalize(file->block_rst_id);
+    }
+    
 #if PIDX_HAVE_MPI
     if(global_do_rst == 1)
       PIDX_rst_finalize(file->rst_id);
@@ -2430,7 +3467,9 @@ static PIDX_return_code PIDX_write(PIDX_file file)
     finalize_end[vp] = PIDX_get_time();
     ///------------------------------------finalize end time------------------------------------------------///
     
-    vp++;
+    // the timing buffers hold 64 groups, small memory budgets may make more
+    if (vp < 63)
+      vp++;
   }
   
   return PIDX_success;
@@ -2439,6 +3478,9 @@ static PIDX_return_code PIDX_write(PIDX_file file)
 /////////////////////////////////////////////////
 PIDX_return_code PIDX_flush(PIDX_file file)
 {
+  if (background_flush != NULL)
+    flush_finish(background_flush);
+  
   if (file->flags == PIDX_file_trunc)
     PIDX_write(file);
   else if (file->flags == PIDX_file_rdonly)
@@ -2450,6 +3492,236 @@ PIDX_return_code PIDX_flush(PIDX_file file)
   return PIDX_success;
 }
 
+#if PIDX_HAVE_PTHREADS
+static void* flush_thread(void* arg)
+{
+  int i;
+  PIDX_request request = (PIDX_request)arg;
+  
+  if (PIDX_write(request->file) != PIDX_success)
+    request->error = 1;
+  PIDX_cleanup(request->file);
+  
+  for (i = 0; i < request->buffer_count; i++)
+    free(request->buffer[i]);
+  free(request->buffer);
+  request->buffer = NULL;
+  request->buffer_count = 0;
+  
+  pthread_mutex_lock(&request->lock);
+  request->done = 1;
+  pthread_mutex_unlock(&request->lock);
+  
+  return NULL;
+}
+#endif
+
+/// Waits for the write of a non-blocking flush (its file system writes included); 0 if it succeeded
+static int flush_finish(PIDX_request request)
+{
+#if PIDX_HAVE_PTHREADS
+  if (request->threaded == 1 && request->joined == 0)
+  {
+    pthread_join(request->thread, NULL);
+    request->joined = 1;
+    if (background_flush == request)
+      background_flush = NULL;
+  }
+#endif
+  
+  if (request->async_io_id != NULL)
+  {
+    if (PIDX_async_io_wait(request->async_io_id) != 0)
+      request->error = 1;
+    PIDX_async_io_finalize(request->async_io_id);
+    request->async_io_id = NULL;
+  }
+  
+  return (request->error == 0) ? 0 : -1;
+}
+
+/// 1 if the writes can run on a thread of their own: without MPI, or with an MPI that takes calls from any thread
+static int progress_thread_available()
+{
+#if PIDX_HAVE_PTHREADS
+#if PIDX_HAVE_MPI
+  int provided = MPI_THREAD_SINGLE;
+  MPI_Query_thread(&provided);
+  return (provided == MPI_THREAD_MULTIPLE);
+#else
+  return 1;
+#endif
+#else
+  return 0;
+#endif
+}
+
+PIDX_return_code PIDX_iflush(PIDX_file file, PIDX_request* request)
+{
+  int var, p;
+  uint64_t size;
+  PIDX_async_io_id async_io_id;
+#if PIDX_HAVE_PTHREADS
+  int i, copied;
+  unsigned char* copy;
+  unsigned char** user_buffer;
+#endif
+  
+  // with pthreads, and without MPI or with MPI_THREAD_MULTIPLE, the user buffers are copied and the whole write (RST, HZ,
+  // aggregation and I/O) runs on a thread of its own on the communicator of the file, otherwise everything but the file
+  // system writes is done here. The next flush of any file waits for it. If the buffers can not be copied the error is
+  // returned with the file as it was and request set to NULL. The request has its own test and wait because PIDX_test and
+  // PIDX_wait cover all the data flushed to the file.
+  if(!file)
+    return PIDX_err_file;
+  
+  *request = malloc(sizeof (*(*request)));
+  memset(*request, 0, sizeof (*(*request)));
+  (*request)->file = file;
+  
+  if (file->flush_request != NULL)
+  {
+    flush_finish(file->flush_request);
+    file->flush_request->file = NULL;
+  }
+  file->flush_request = *request;
+  
+  // the reads fill the user buffers, they are done at once
+  if (file->flags != PIDX_file_trunc)
+    return PIDX_flush(file);
+  
+  if (background_flush != NULL)
+    flush_finish(background_flush);
+  
+#if PIDX_HAVE_PTHREADS
+  if (progress_thread_available() == 1)
+  {
+    // the user buffers may be reused as soon as this returns
+    for (var = file->local_variable_index; var < file->local_variable_index + file->local_variable_count; var++)
+      (*request)->buffer_count += file->idx_ptr->variable[var]->patch_count;
+    (*request)->buffer = malloc(((*request)->buffer_count + 1) * sizeof (*(*request)->buffer));
+    user_buffer = malloc(((*request)->buffer_count + 1) * sizeof (*user_buffer));
+    copied = ((*request)->buffer != NULL && user_buffer != NULL);
+    (*request)->buffer_count = 0;
+    
+    for (var = file->local_variable_index; copied == 1 && var < file->local_variable_index + file->local_variable_count; var++)
+    {
+      PIDX_variable variable = file->idx_ptr->variable[var];
+      for (p = 0; copied == 1 && p < variable->patch_count; p++)
+      {
+        Ndim_box patch = variable->patch[p];
+        size = patch->Ndim_box_size[0] * patch->Ndim_box_size[1] * patch->Ndim_box_size[2] * patch->Ndim_box_size[3] * patch->Ndim_box_size[4] * variable->values_per_sample * (variable->bits_per_value / 8);
+        copy = malloc(size);
+        if (copy == NULL)
+        {
+          copied = 0;
+          break;
+        }
+        memcpy(copy, patch->Ndim_box_buffer, size);
+        user_buffer[(*request)->buffer_count] = patch->Ndim_box_buffer;
+        patch->Ndim_box_buffer = copy;
+        (*request)->buffer[(*request)->buffer_count] = copy;
+        (*request)->buffer_count++;
+      }
+    }
+    
+    if (copied == 0)
+    {
+      fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+      
+      // the patches copied so far (in the same order) get their user buffers back, as if the call was never made
+      i = 0;
+      for (var = file->local_variable_index; var < file->local_variable_index + file->local_variable_count; var++)
+        for (p = 0; p < file->idx_ptr->variable[var]->patch_count && i < (*request)->buffer_count; p++, i++)
+        {
+          file->idx_ptr->variable[var]->patch[p]->Ndim_box_buffer = user_buffer[i];
+          free((*request)->buffer[i]);
+        }
+      
+      free(user_buffer);
+      free((*request)->buffer);
+      file->flush_request = NULL;
+      free(*request);
+      *request = NULL;
+      return PIDX_err_file;
+    }
+    free(user_buffer);
+    
+    pthread_mutex_init(&(*request)->lock, NULL);
+    if (pthread_create(&(*request)->thread, NULL, flush_thread, *request) == 0)
+    {
+      (*request)->threaded = 1;
+      background_flush = *request;
+      return PIDX_success;
+    }
+    fprintf(stderr, "[%s] [%d] pthread_create() failed.\n", __FILE__, __LINE__);
+    pthread_mutex_destroy(&(*request)->lock);
+  }
+#endif
+  
+  // without a thread for the whole write only the file system writes are left for later, to a writer of the request
+  async_io_id = file->async_io_id;
+  file->async_io_id = PIDX_async_io_init();
+  (*request)->async_io_id = file->async_io_id;
+  
+  if (PIDX_write(file) != PIDX_success)
+    (*request)->error = 1;
+  PIDX_cleanup(file);
+  
+  file->async_io_id = async_io_id;
+  
+  for (p = 0; p < (*request)->buffer_count; p++)
+    free((*request)->buffer[p]);
+  free((*request)->buffer);
+  (*request)->buffer = NULL;
+  (*request)->buffer_count = 0;
+  
+  return ((*request)->error == 0) ? PIDX_success : PIDX_err_file;
+}
+
+PIDX_return_code PIDX_request_test(PIDX_request request, int* flag)
+{
+  if (!request)
+    return PIDX_err_file;
+  
+  *flag = 1;
+#if PIDX_HAVE_PTHREADS
+  if (request->threaded == 1)
+  {
+    pthread_mutex_lock(&request->lock);
+    *flag = request->done;
+    pthread_mutex_unlock(&request->lock);
+  }
+#endif
+  
+  if (*flag == 1 && request->async_io_id != NULL && PIDX_async_io_test(request->async_io_id, flag) != 0)
+    return PIDX_err_file;
+  
+  return (request->error == 0) ? PIDX_success : PIDX_err_file;
+}
+
+PIDX_return_code PIDX_request_wait(PIDX_request* request)
+{
+  int ret;
+  
+  if (!request || !(*request))
+    return PIDX_err_file;
+  
+  ret = flush_finish(*request);
+  
+#if PIDX_HAVE_PTHREADS
+  if ((*request)->threaded == 1)
+    pthread_mutex_destroy(&(*request)->lock);
+#endif
+  if ((*request)->file != NULL && (*request)->file->flush_request == *request)
+    (*request)->file->flush_request = NULL;
+  
+  free(*request);
+  *request = NULL;
+  
+  return (ret == 0) ? PIDX_success : PIDX_err_file;
+}
+
 /////////////////////////////////////////////////
 static PIDX_return_code PIDX_cleanup(PIDX_file file)
 {
@@ -2483,6 +3755,9 @@ static PIDX_return_code PIDX_cleanup(PIDX_file file)
 /////////////////////////////////////////////////
 PIDX_return_code PIDX_close(PIDX_file file) 
 {
+  if (file->flush_request != NULL)
+    flush_finish(file->flush_request);
+  
   file->write_on_close = 1;
   PIDX_flush(file);
   
@@ -2537,6 +3812,26 @@ PIDX_return_code PIDX_close(PIDX_file file)
         fprintf(stdout, "----------------------------------------VG %d (END)-------------------------------------\n", var);
       }
       
+#if PIDX_RECORD_TIME
+      // compression reports, applications get the same numbers from PIDX_variable_get_compression_stats and PIDX_variable_get_block_codecs
+      for (var = 0; var < file->idx_ptr->variable_count; var++)
+      {
+        double ratio, max_error, rms_error;
+        if (file->idx_ptr->variable[var]->compression_raw_bytes == 0)
+          continue;
+        PIDX_variable_get_compression_stats(file->idx_ptr->variable[var], &ratio, &max_error, &rms_error);
+        fprintf(stdout, "Compression %s ratio %f max error %g rms error %g\n", file->idx_ptr->variable[var]->var_name, ratio, max_error, rms_error);
+      }
+      
+      for (var = 0; var < file->idx_ptr->variable_count; var++)
+      {
+        int64_t* block_count = file->idx_ptr->variable[var]->compression_block_count;
+        if (block_count[PIDX_BLOCK_RAW] + block_count[PIDX_BLOCK_LOSSY] + block_count[PIDX_BLOCK_LOSSLESS] + block_count[PIDX_BLOCK_CONSTANT] == 0)
+          continue;
+        fprintf(stdout, "Block codecs %s raw %lld lossy %lld lossless %lld constant %lld\n", file->idx_ptr->variable[var]->var_name, (long long)block_count[PIDX_BLOCK_RAW], (long long)block_count[PIDX_BLOCK_LOSSY], (long long)block_count[PIDX_BLOCK_LOSSLESS], (long long)block_count[PIDX_BLOCK_CONSTANT]);
+      }
+#endif
+      
       /*
       double total_agg_time = 0, all_time = 0;
       for (p = 0; p < file->idx_ptr->variable[0]->patch_group_count; p++)
@@ -2694,6 +3989,10 @@ PIDX_return_code PIDX_close(PIDX_file file)
   PIDX_blocks_free_layout(file->idx_derived_ptr->global_block_layout);
   free(file->idx_derived_ptr->global_block_layout);
   file->idx_derived_ptr->global_block_layout = 0;
+  
+  PIDX_blocks_free_offset_table(file->idx_derived_ptr->block_offset_table);
+  free(file->idx_derived_ptr->block_offset_table);
+  file->idx_derived_ptr->block_offset_table = 0;
 #endif
   for (i = 0; i < 1024; i++)
   {
@@ -2714,6 +4013,23 @@ PIDX_return_code PIDX_close(PIDX_file file)
     MPI_Comm_free(&(file->global_comm));
 #endif
   
+  // the request outlives the file until PIDX_request_wait
+  if (file->flush_request != NULL)
+    file->flush_request->file = NULL;
+  
+  // pending writes carry on in the background, see PIDX_wait_all
+  if (file->async_io_id != NULL)
+    PIDX_async_io_finalize(file->async_io_id);
+  
+  if (file->io_map_id != NULL)
+    PIDX_io_map_finalize(file->io_map_id);
+  
+  if (file->prefetch_id != NULL)
+    PIDX_prefetch_finalize(file->prefetch_id);
+  
+  if (file->query_id != NULL)
+    PIDX_query_finalize(file->query_id);
+  
   free(file);
   
   return PIDX_success;
@@ -2747,6 +4063,62 @@ PIDX_return_code PIDX_variable_get_box_metadata(PIDX_variable variable, int* on_
   return PIDX_err_not_implemented;
 }
 
+/////////////////////////////////////////////////
+PIDX_return_code PIDX_variable_set_compression(PIDX_variable variable, int mode, double param)
+{
+  if(!variable)
+    return PIDX_err_variable;
+  
+  if (mode != PIDX_COMPRESSION_FILE_DEFAULT && mode != PIDX_COMPRESSION_FIXED_RATE && mode != PIDX_COMPRESSION_FIXED_PRECISION && mode != PIDX_COMPRESSION_FIXED_ACCURACY)
+    return PIDX_err_unsupported_compression_type;
+  
+  if (mode != PIDX_COMPRESSION_FILE_DEFAULT && !(param > 0))
+    return PIDX_err_unsupported_compression_type;
+  
+  variable->compression_mode = mode;
+  variable->compression_param = param;
+  variable->compression_bits = 0;
+  
+  return PIDX_success;
+}
+
+/////////////////////////////////////////////////
+PIDX_return_code PIDX_variable_get_compression(PIDX_variable variable, int* mode, double* param)
+{
+  if(!variable)
+    return PIDX_err_variable;
+  
+  *mode = variable->compression_mode;
+  *param = variable->compression_param;
+  
+  return PIDX_success;
+}
+
+/////////////////////////////////////////////////
+PIDX_return_code PIDX_variable_get_block_codecs(PIDX_variable variable, int64_t* block_count, int64_t* block_bytes)
+{
+  if(!variable)
+    return PIDX_err_variable;
+  
+  memcpy(block_count, variable->compression_block_count, PIDX_BLOCK_CODEC_COUNT * sizeof(int64_t));
+  memcpy(block_bytes, variable->compression_block_bytes, PIDX_BLOCK_CODEC_COUNT * sizeof(int64_t));
+  
+  return PIDX_success;
+}
+
+/////////////////////////////////////////////////
+PIDX_return_code PIDX_variable_get_compression_stats(PIDX_variable variable, double* ratio, double* max_error, double* rms_error)
+{
+  if(!variable)
+    return PIDX_err_variable;
+  
+  *ratio = (variable->compression_coded_bytes > 0) ? variable->compression_raw_bytes / variable->compression_coded_bytes : 1;
+  *max_error = variable->compression_max_error;
+  *rms_error = (variable->compression_value_count > 0) ? sqrt(variable->compression_square_error / variable->compression_value_count) : 0;
+  
+  return PIDX_success;
+}
+
 /////////////////////////////////////////////////
 PIDX_return_code PIDX_get_bits_per_sample(PIDX_type type_name, unsigned int bits_per_sample)
 {
@@ -2821,7 +4193,8 @@ PIDX_return_code PIDX_set_current_variable(PIDX_file file, PIDX_variable variabl
 /////////////////////////////////////////////////
 PIDX_return_code PIDX_read_variable(PIDX_variable variable, PIDX_point offset, PIDX_point dims, const void* read_from_this_buffer, PIDX_data_layout layout)
 {
-  return PIDX_err_not_implemented;
+  // the box is read at the next PIDX_flush or PIDX_close, only its blocks when the region of interest reads are on
+  return PIDX_read_next_variable(variable, offset, dims, (void*)read_from_this_buffer, layout);
 }
 
 /////////////////////////////////////////////////
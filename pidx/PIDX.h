@@ -46,6 +46,13 @@ extern "C" {
 struct PIDX_file_descriptor;
 typedef struct PIDX_file_descriptor* PIDX_file;
 
+struct PIDX_request_struct;
+typedef struct PIDX_request_struct* PIDX_request;
+
+/// Progressive read callback: the patch-th box read into variable holds the HZ levels 0 ... level of max_level;
+/// return 0 to go on reading the box, anything else to keep it as is
+typedef int (*PIDX_progressive_callback)(PIDX_variable variable, int patch, int level, int max_level, void* user_data);
+
 /// Creates an IDX file.
 /// PIDX_file_create is the primary function for creating IDX files;
 /// it creates a new IDX file with the specified name and mode
@@ -88,6 +95,14 @@ PIDX_return_code PIDX_time_step_caching_ON();
 PIDX_return_code PIDX_time_step_caching_OFF();
 
 
+///Keep up to byte_budget bytes of decoded blocks read by region of interest reads in memory (0, the default: off)
+PIDX_return_code PIDX_set_block_cache_size(uint64_t byte_budget);
+
+
+///Block cache hits, misses and bytes held on this process
+PIDX_return_code PIDX_get_block_cache_stats(int64_t* hit_count, int64_t* miss_count, int64_t* byte_count);
+
+
 ///
 PIDX_return_code PIDX_hz_encoding_caching_ON();
 
@@ -213,6 +228,36 @@ PIDX_return_code PIDX_variable_set_box_metadata_off(PIDX_variable variable);
 PIDX_return_code PIDX_variable_get_box_metadata(PIDX_variable variable, int* on_off_bool);
 
 
+/// Sets how the lossy codec treats a variable (the bricks need a compression block size larger than 1).
+/// \param variable The variable handler.
+/// \param mode PIDX_COMPRESSION_FILE_DEFAULT (the file compression type and bit rate), PIDX_COMPRESSION_FIXED_RATE,
+/// PIDX_COMPRESSION_FIXED_PRECISION or PIDX_COMPRESSION_FIXED_ACCURACY.
+/// \param param bits per value (fixed rate), bits per code (fixed precision) or largest absolute error (fixed accuracy).
+/// The fixed accuracy mode finds the bits per code from the value range of the first write of the variable.
+PIDX_return_code PIDX_variable_set_compression(PIDX_variable variable, int mode, double param);
+
+
+/// Queries the mode and parameter of the lossy codec for a variable.
+/// \param variable The variable handler.
+PIDX_return_code PIDX_variable_get_compression(PIDX_variable variable, int* mode, double* param);
+
+
+/// Queries how many IDX blocks of a variable each block codec took on the last write (PIDX_ADAPTIVE_COMPRESSION
+/// or PIDX_LOSSLESS_COMPRESSION), over all processes.
+/// \param variable The variable handler.
+/// \param block_count blocks per codec, indexed by PIDX_BLOCK_RAW, PIDX_BLOCK_LOSSY, PIDX_BLOCK_LOSSLESS and PIDX_BLOCK_CONSTANT
+/// \param block_bytes bytes written per codec (same indices)
+PIDX_return_code PIDX_variable_get_block_codecs(PIDX_variable variable, int64_t* block_count, int64_t* block_bytes);
+
+
+/// Queries what the lossy codec achieved on the last write of a variable, over all processes.
+/// \param variable The variable handler.
+/// \param ratio raw bytes over compressed bytes of the bricks
+/// \param max_error largest absolute error
+/// \param rms_error root mean square error
+PIDX_return_code PIDX_variable_get_compression_stats(PIDX_variable variable, double* ratio, double* max_error, double* rms_error);
+
+
 /// Gets the number of boxes.
 /// This function gets the number of boxes written by all the processes.
 /// \param file The file handler.
@@ -276,7 +321,7 @@ PIDX_return_code PIDX_set_current_variable(PIDX_file file, PIDX_variable variabl
 PIDX_return_code PIDX_get_current_variable(PIDX_file file, PIDX_variable* variable);
 
 
-///
+/// Reads a box of a variable at the next PIDX_flush or PIDX_close
 PIDX_return_code PIDX_read_variable(PIDX_variable variable, PIDX_point offset, PIDX_point dims, const void*  dst_buffer, PIDX_data_layout layout);
 
 
@@ -288,10 +333,110 @@ PIDX_return_code PIDX_write_variable(PIDX_variable variable, PIDX_point offset,
 PIDX_return_code PIDX_flush(PIDX_file file);
 
 
+///Non-blocking PIDX_flush: the user buffers may be reused once it returns, finish it with PIDX_request_wait
+///Only PIDX_request_test, PIDX_request_wait, PIDX_test, PIDX_wait and PIDX_close may be called on the file meanwhile
+PIDX_return_code PIDX_iflush(PIDX_file file, PIDX_request* request);
+
+
+///Sets flag to 1 if the write of a non-blocking flush is over and on disk, 0 otherwise (never blocks)
+PIDX_return_code PIDX_request_test(PIDX_request request, int* flag);
+
+
+///Blocks until the write of a non-blocking flush is over and on disk, then frees the request (set to NULL)
+PIDX_return_code PIDX_request_wait(PIDX_request* request);
+
+
 ///Perform all the necessary cleanups
+///With async IO enabled this returns once the aggregator buffers are queued, use PIDX_wait (before closing) or PIDX_wait_all to know when they are on disk
 PIDX_return_code PIDX_close(PIDX_file file);
 
 
+///Write the aggregator buffers from a background thread so that PIDX_flush/PIDX_close return without waiting for the file system (1 on, 0 off)
+PIDX_return_code PIDX_enable_async_io(PIDX_file file, int async_io);
+
+
+///Write the fs block aligned aggregator buffers (the header and the aggregator extents) with O_DIRECT (1 on, 0 off)
+///Unaligned tails go through the page cache; with PIDX_io_backend_mpi the buffers stay aligned but MPI-IO writes them
+PIDX_return_code PIDX_enable_direct_io(PIDX_file file, int direct_io);
+
+
+///Bytes the buffers of the variables flushed together may take on a process (0, the default: groups of 16 variables)
+PIDX_return_code PIDX_set_memory_budget(PIDX_file file, uint64_t byte_budget);
+
+
+///Flush the variables in groups of factor + 1 whatever the memory budget; -1 (the default) lets the budget decide
+PIDX_return_code PIDX_set_variable_pipelining_factor(PIDX_file file, int factor);
+
+
+///Number of variable groups of the last flush, and the variables and predicted bytes of each (either array may be NULL)
+PIDX_return_code PIDX_get_variable_groups(PIDX_file file, int* group_count, int* variable_count, int64_t* byte_count);
+
+
+///Lay out only the blocks touched by the patches of all the processes instead of every block of their
+///bounding box (1 on, 0 off); empty blocks and files are then neither created nor described in the headers.
+///The choice is recorded in the .idx file: a file opened for reading uses the layout it was written with (read from
+///the headers of the binary files when sparse) and ignores this call.
+PIDX_return_code PIDX_enable_sparse_layout(PIDX_file file, int sparse_layout);
+
+
+///Read small boxes from only the blocks that hold them instead of through the aggregators (1 on, the default, 0 off)
+PIDX_return_code PIDX_enable_roi_read(PIDX_file file, int roi_read);
+
+
+///Read the HZ levels 0 ... max_level only (-1, the default: all of them); see PIDX_get_resolution_dims for the box sizes
+PIDX_return_code PIDX_set_resolution(PIDX_file file, int max_level);
+
+
+///Read every subsampling-th sample (powers of two) in every dimension (replaces PIDX_set_resolution)
+PIDX_return_code PIDX_set_subsampling(PIDX_file file, PIDX_point subsampling);
+
+
+///Stride of the samples read with the current resolution and their number in a box (the dims of the read buffer)
+PIDX_return_code PIDX_get_resolution_dims(PIDX_file file, PIDX_point offset, PIDX_point dims, PIDX_point stride, PIDX_point coarse_dims);
+
+
+///Read the boxes coarse to fine, calling callback as every HZ level is done (NULL, the default: off)
+PIDX_return_code PIDX_set_progressive_callback(PIDX_file file, PIDX_progressive_callback callback, void* user_data);
+
+
+///Read the blocks of a region of interest read from the next depth time steps into the block cache (0, the default: off)
+PIDX_return_code PIDX_set_prefetch_depth(PIDX_file file, int depth);
+
+
+///Number of threads reading the blocks of a region of interest read (0, the default: one per core, one with MPI)
+PIDX_return_code PIDX_set_read_thread_count(PIDX_file file, int thread_count);
+
+
+///
+PIDX_return_code PIDX_get_read_thread_count(PIDX_file file, int* thread_count);
+
+
+///Blocks, files and bytes the region of interest reads of this process went through since the file was opened
+PIDX_return_code PIDX_get_roi_read_stats(PIDX_file file, int64_t* block_count, int64_t* file_count, int64_t* byte_count);
+
+
+///Select where the binary files go: PIDX_io_backend_mpi (default), PIDX_io_backend_posix, PIDX_io_backend_mmap
+///or PIDX_io_backend_memory (per process, nothing is written to disk; for benchmarking the pipeline)
+///With PIDX_io_backend_mmap, reads of uncompressed data skip aggregation and copy the samples straight from the mapped files
+PIDX_return_code PIDX_set_io_backend(PIDX_file file, PIDX_io_backend io_backend);
+
+
+///Get the backend the binary files go through
+PIDX_return_code PIDX_get_io_backend(PIDX_file file, PIDX_io_backend* io_backend);
+
+
+///Sets flag to 1 if all the data flushed so far is on disk, 0 otherwise (never blocks), non-blocking flushes included
+PIDX_return_code PIDX_test(PIDX_file file, int* flag);
+
+
+///Block until all the data flushed so far is on disk, non-blocking flushes included
+PIDX_return_code PIDX_wait(PIDX_file file);
+
+
+///Block until the data of all files, including the ones already closed, is on disk (and their read ahead is done)
+PIDX_return_code PIDX_wait_all();
+
+
 ///
 PIDX_return_code PIDX_set_aggregation_factor(PIDX_file file, int agg_factor);
 
@@ -300,12 +445,30 @@ PIDX_return_code PIDX_set_aggregation_factor(PIDX_file file, int agg_factor);
 PIDX_return_code PIDX_get_aggregation_factor(PIDX_file file, int *agg_factor);
 
 
-///
+/// Sets the compression type, PIDX_NO_COMPRESSION (default), PIDX_LOSSY_COMPRESSION or PIDX_LOSSLESS_COMPRESSION.
+/// PIDX_LOSSY_COMPRESSION only takes effect with a compression block size larger than 1, the bricks of the floating
+/// point variables are then stored at the compression bit rate. With PIDX_LOSSLESS_COMPRESSION the aggregators byte
+/// shuffle and LZ code every IDX block of the scalar variables (aggregation factor 1) and only write the coded bytes.
+/// PIDX_ADAPTIVE_COMPRESSION picks, for every such block, the smallest of raw, constant fill, lossless and (for the
+/// variables in the PIDX_COMPRESSION_FIXED_ACCURACY mode) lossy coding.
 PIDX_return_code PIDX_set_compression_type(PIDX_file file, int compression_type);
 
 ///
 PIDX_return_code PIDX_get_compression_type(PIDX_file file, int *compression_type);
 
+/// Sets the bits per value of the lossy compression (PIDX_default_compression_bit_rate by default)
+PIDX_return_code PIDX_set_compression_bit_rate(PIDX_file file, int compression_bit_rate);
+
+///
+PIDX_return_code PIDX_get_compression_bit_rate(PIDX_file file, int *compression_bit_rate);
+
+/// Sets the number of threads that compress and decompress the bricks (lossy) and blocks (lossless) of a process.
+/// 0 (the default) uses one thread with MPI (the ranks of a node share its cores) and one per core without.
+PIDX_return_code PIDX_set_compression_thread_count(PIDX_file file, int thread_count);
+
+///
+PIDX_return_code PIDX_get_compression_thread_count(PIDX_file file, int *thread_count);
+
 ///
 PIDX_return_code PIDX_set_compression_block_size(PIDX_file file, PIDX_point compression_block_size);
 
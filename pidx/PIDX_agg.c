@@ -108,8 +108,8 @@ int aggregate_write_read(PIDX_agg_id agg_id, int variable_index, uint64_t hz_sta
   samples_in_file = agg_id->idx_ptr->variable[variable_index]->VAR_blocks_per_file[file_no] * agg_id->idx_derived_ptr->samples_per_block;
   assert(samples_in_file <= samples_per_file);
 #else
-  negative_block_offset = PIDX_blocks_find_negative_offset(agg_id->idx_ptr->blocks_per_file, block_no, agg_id->idx_derived_ptr->global_block_layout);
-  assert(negative_block_offset >= 0);
+  negative_block_offset = (block_no % agg_id->idx_ptr->blocks_per_file) - agg_id->idx_derived_ptr->block_offset_table->block_index[block_no];
+  assert(agg_id->idx_derived_ptr->block_offset_table->block_index[block_no] >= 0);
   
   //number of samples in file "file_no"
   samples_in_file = agg_id->idx_derived_ptr->existing_blocks_index_per_file[file_no] * agg_id->idx_derived_ptr->samples_per_block;
@@ -135,7 +135,7 @@ int aggregate_write_read(PIDX_agg_id agg_id, int variable_index, uint64_t hz_sta
 #endif
   target_count = hz_count * values_per_sample;
   
-  bytes_per_datatype = (agg_id->idx_ptr->variable[variable_index]->bits_per_value / 8) * agg_id->idx_ptr->compression_block_size[0] * agg_id->idx_ptr->compression_block_size[1] * agg_id->idx_ptr->compression_block_size[2] * agg_id->idx_ptr->compression_block_size[3] * agg_id->idx_ptr->compression_block_size[4];
+  bytes_per_datatype = agg_id->idx_ptr->variable[variable_index]->bytes_per_brick;
   
   hz_buffer = hz_buffer + buffer_offset * bytes_per_datatype * values_per_sample;
   
@@ -415,6 +415,41 @@ int aggregate_write_read(PIDX_agg_id agg_id, int variable_index, uint64_t hz_sta
   return PIDX_success;
 }
 
+/// Allocates the aggregator buffer (buffer_size bytes). The aggregator holding sample 0 of variable 0 of a file also
+/// writes the file header, so room for it (start_fs_block * fs_block_size bytes) is left in front of the buffer.
+/// With direct IO the allocation is aligned (and padded) to fs_block_size.
+static int allocate_agg_buffer(PIDX_agg_id agg_id)
+{
+  uint64_t allocation_size;
+  void* memory = NULL;
+  Agg_buffer agg_buffer = agg_id->idx_derived_ptr->agg_buffer;
+  
+  agg_buffer->buffer_header_size = 0;
+  if (agg_buffer->var_number == 0 && agg_buffer->sample_number == 0)
+    agg_buffer->buffer_header_size = agg_id->idx_derived_ptr->start_fs_block * agg_id->idx_derived_ptr->fs_block_size;
+  
+  allocation_size = agg_buffer->buffer_header_size + agg_buffer->buffer_size;
+  
+  if (agg_id->idx_derived_ptr->direct_io == 1)
+  {
+    if (allocation_size % agg_id->idx_derived_ptr->fs_block_size)
+      allocation_size = allocation_size + agg_id->idx_derived_ptr->fs_block_size - (allocation_size % agg_id->idx_derived_ptr->fs_block_size);
+    if (posix_memalign(&memory, agg_id->idx_derived_ptr->fs_block_size, allocation_size) != 0)
+      memory = NULL;
+  }
+  else
+    memory = malloc(allocation_size);
+  
+  if (memory == NULL)
+    return -1;
+  
+  memset(memory, 0, allocation_size);
+  agg_buffer->buffer_memory = memory;
+  agg_buffer->buffer = agg_buffer->buffer_memory + agg_buffer->buffer_header_size;
+  
+  return 0;
+}
+
 int PIDX_agg_buf_create(PIDX_agg_id agg_id) 
 {
   int i, j, k, var;
@@ -426,6 +461,9 @@ int PIDX_agg_buf_create(PIDX_agg_id agg_id)
 #endif
   
   agg_id->idx_derived_ptr->agg_buffer->buffer_size = 0;
+  agg_id->idx_derived_ptr->agg_buffer->buffer_header_size = 0;
+  agg_id->idx_derived_ptr->agg_buffer->buffer = 0;
+  agg_id->idx_derived_ptr->agg_buffer->buffer_memory = 0;
   agg_id->idx_derived_ptr->agg_buffer->sample_number = -1;
   agg_id->idx_derived_ptr->agg_buffer->var_number = -1;
   agg_id->idx_derived_ptr->agg_buffer->file_number = -1;
@@ -481,9 +519,12 @@ int PIDX_agg_buf_create(PIDX_agg_id agg_id)
           agg_id->idx_derived_ptr->agg_buffer->var_number = i;
           agg_id->idx_derived_ptr->agg_buffer->sample_number = j;
           
-          agg_id->idx_derived_ptr->agg_buffer->buffer_size = agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number] * (agg_id->idx_derived_ptr->samples_per_block / agg_id->idx_derived_ptr->aggregation_factor) * (agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8);
-          agg_id->idx_derived_ptr->agg_buffer->buffer = malloc(agg_id->idx_derived_ptr->agg_buffer->buffer_size);
-          memset(agg_id->idx_derived_ptr->agg_buffer->buffer, 0, agg_id->idx_derived_ptr->agg_buffer->buffer_size);
+          agg_id->idx_derived_ptr->agg_buffer->buffer_size = agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number] * (agg_id->idx_derived_ptr->samples_per_block / agg_id->idx_derived_ptr->aggregation_factor) * agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bytes_per_brick;
+          if (allocate_agg_buffer(agg_id) == -1)
+          {
+            fprintf(stderr, " Error in allocate_agg_buffer %lld: Line %d File %s\n", (long long) agg_id->idx_derived_ptr->agg_buffer->buffer_size, __LINE__, __FILE__);
+            return (-1);
+          }
           //printf("Aggregator Rank %d Buffer Size %d (Var no: %d) (Sample no: %d) (File no: %d) (%d x %d x %d)\n", rank, agg_id->idx_derived_ptr->agg_buffer->buffer_size, agg_id->idx_derived_ptr->agg_buffer->var_number, agg_id->idx_derived_ptr->agg_buffer->sample_number, agg_id->idx_derived_ptr->agg_buffer->file_number, agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->blocks_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number], agg_id->idx_derived_ptr->samples_per_block, (agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8));
         }
       }
@@ -505,9 +546,12 @@ int PIDX_agg_buf_create(PIDX_agg_id agg_id)
           agg_id->idx_derived_ptr->agg_buffer->var_number = i;
           agg_id->idx_derived_ptr->agg_buffer->sample_number = j;
           
-          agg_id->idx_derived_ptr->agg_buffer->buffer_size = agg_id->idx_derived_ptr->existing_blocks_index_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number] * (agg_id->idx_derived_ptr->samples_per_block/ agg_id->idx_derived_ptr->aggregation_factor) * (agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8);
-          agg_id->idx_derived_ptr->agg_buffer->buffer = malloc(agg_id->idx_derived_ptr->agg_buffer->buffer_size);
-          memset(agg_id->idx_derived_ptr->agg_buffer->buffer, 0, agg_id->idx_derived_ptr->agg_buffer->buffer_size);
+          agg_id->idx_derived_ptr->agg_buffer->buffer_size = agg_id->idx_derived_ptr->existing_blocks_index_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number] * (agg_id->idx_derived_ptr->samples_per_block/ agg_id->idx_derived_ptr->aggregation_factor) * agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bytes_per_brick;
+          if (allocate_agg_buffer(agg_id) == -1)
+          {
+            fprintf(stderr, " Error in allocate_agg_buffer %lld: Line %d File %s\n", (long long) agg_id->idx_derived_ptr->agg_buffer->buffer_size, __LINE__, __FILE__);
+            return (-1);
+          }
           //printf("Aggregator Rank %d Buffer Size %d (Var no: %d) (Sample no: %d) (File no: %d) (%d x %d x %d)\n", rank, agg_id->idx_derived_ptr->agg_buffer->buffer_size, agg_id->idx_derived_ptr->agg_buffer->var_number, agg_id->idx_derived_ptr->agg_buffer->sample_number, agg_id->idx_derived_ptr->agg_buffer->file_number, agg_id->idx_derived_ptr->existing_blocks_index_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number], agg_id->idx_derived_ptr->samples_per_block, (agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8));
         }
       }
@@ -533,9 +577,12 @@ int PIDX_agg_buf_create(PIDX_agg_id agg_id)
           agg_id->idx_derived_ptr->agg_buffer->var_number = i;
           agg_id->idx_derived_ptr->agg_buffer->sample_number = j;
           
-          agg_id->idx_derived_ptr->agg_buffer->buffer_size = agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number] * (agg_id->idx_derived_ptr->samples_per_block / agg_id->idx_derived_ptr->aggregation_factor) * (agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8);
-          agg_id->idx_derived_ptr->agg_buffer->buffer = malloc(agg_id->idx_derived_ptr->agg_buffer->buffer_size);
-          memset(agg_id->idx_derived_ptr->agg_buffer->buffer, 0, agg_id->idx_derived_ptr->agg_buffer->buffer_size);
+          agg_id->idx_derived_ptr->agg_buffer->buffer_size = agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number] * (agg_id->idx_derived_ptr->samples_per_block / agg_id->idx_derived_ptr->aggregation_factor) * agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bytes_per_brick;
+          if (allocate_agg_buffer(agg_id) == -1)
+          {
+            fprintf(stderr, " Error in allocate_agg_buffer %lld: Line %d File %s\n", (long long) agg_id->idx_derived_ptr->agg_buffer->buffer_size, __LINE__, __FILE__);
+            return (-1);
+          }
         }
       }
     }
@@ -556,17 +603,15 @@ int PIDX_agg_buf_create(PIDX_agg_id agg_id)
           agg_id->idx_derived_ptr->agg_buffer->var_number = i;
           agg_id->idx_derived_ptr->agg_buffer->sample_number = j;
           
-          agg_id->idx_derived_ptr->agg_buffer->buffer_size = agg_id->idx_derived_ptr->existing_blocks_index_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number] * (agg_id->idx_derived_ptr->samples_per_block / agg_id->idx_derived_ptr->aggregation_factor) * (agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8) * agg_id->idx_ptr->compression_block_size[0] * agg_id->idx_ptr->compression_block_size[1] * agg_id->idx_ptr->compression_block_size[2] * agg_id->idx_ptr->compression_block_size[3] * agg_id->idx_ptr->compression_block_size[4];
+          agg_id->idx_derived_ptr->agg_buffer->buffer_size = agg_id->idx_derived_ptr->existing_blocks_index_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number] * (agg_id->idx_derived_ptr->samples_per_block / agg_id->idx_derived_ptr->aggregation_factor) * agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bytes_per_brick;
           
-          agg_id->idx_derived_ptr->agg_buffer->buffer = malloc(agg_id->idx_derived_ptr->agg_buffer->buffer_size);
-          if (agg_id->idx_derived_ptr->agg_buffer->buffer == NULL)
+          if (allocate_agg_buffer(agg_id) == -1)
           {
             printf("[%d] [%d %d %d] : %lld (%d %d (%d/%d) %d)\n", rank, i, j, k, (long long) agg_id->idx_derived_ptr->agg_buffer->buffer_size, agg_id->idx_derived_ptr->existing_blocks_index_per_file[agg_id->idx_derived_ptr->agg_buffer->file_number], (agg_id->idx_derived_ptr->samples_per_block / agg_id->idx_derived_ptr->aggregation_factor), agg_id->idx_derived_ptr->samples_per_block, agg_id->idx_derived_ptr->aggregation_factor, (agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8));
 
             fprintf(stderr, " Error in malloc %lld: Line %d File %s\n", (long long) agg_id->idx_derived_ptr->agg_buffer->buffer_size, __LINE__, __FILE__);
             return (-1);
           }
-          memset(agg_id->idx_derived_ptr->agg_buffer->buffer, 0, agg_id->idx_derived_ptr->agg_buffer->buffer_size);
         }
       }
     }
@@ -623,7 +668,7 @@ int PIDX_agg_write(PIDX_agg_id agg_id)
 #if PIDX_HAVE_MPI
   agg_id->idx_derived_ptr->win_time_start = MPI_Wtime();
   if (agg_id->idx_derived_ptr->agg_buffer->buffer_size != 0)
-    MPI_Win_create(agg_id->idx_derived_ptr->agg_buffer->buffer, agg_id->idx_derived_ptr->agg_buffer->buffer_size, agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8, MPI_INFO_NULL, agg_id->comm, &(agg_id->win));
+    MPI_Win_create(agg_id->idx_derived_ptr->agg_buffer->buffer, agg_id->idx_derived_ptr->agg_buffer->buffer_size, agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bytes_per_brick, MPI_INFO_NULL, agg_id->comm, &(agg_id->win));
   else
     MPI_Win_create(0, 0, 1, MPI_INFO_NULL, agg_id->comm, &(agg_id->win));    
   agg_id->idx_derived_ptr->win_time_end = MPI_Wtime();      
@@ -859,7 +904,7 @@ int PIDX_agg_read(PIDX_agg_id agg_id)
 #if PIDX_HAVE_MPI
   agg_id->idx_derived_ptr->win_time_start = MPI_Wtime();
   if (agg_id->idx_derived_ptr->agg_buffer->buffer_size != 0)
-    MPI_Win_create(agg_id->idx_derived_ptr->agg_buffer->buffer, agg_id->idx_derived_ptr->agg_buffer->buffer_size, agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8, MPI_INFO_NULL, agg_id->comm, &(agg_id->win));
+    MPI_Win_create(agg_id->idx_derived_ptr->agg_buffer->buffer, agg_id->idx_derived_ptr->agg_buffer->buffer_size, agg_id->idx_ptr->variable[agg_id->idx_derived_ptr->agg_buffer->var_number]->bytes_per_brick, MPI_INFO_NULL, agg_id->comm, &(agg_id->win));
   else
     MPI_Win_create(0, 0, 1, MPI_INFO_NULL, agg_id->comm, &(agg_id->win));    
   agg_id->idx_derived_ptr->win_time_end = MPI_Wtime();      
@@ -944,7 +989,8 @@ int PIDX_agg_buf_destroy(PIDX_agg_id agg_id)
 {
   if (agg_id->idx_derived_ptr->agg_buffer->buffer_size != 0) 
   {
-    free(agg_id->idx_derived_ptr->agg_buffer->buffer);
+    free(agg_id->idx_derived_ptr->agg_buffer->buffer_memory);
+    agg_id->idx_derived_ptr->agg_buffer->buffer_memory = 0;
     agg_id->idx_derived_ptr->agg_buffer->buffer = 0;
   }
   
@@ -0,0 +1,309 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+#define _GNU_SOURCE
+#include "PIDX_inc.h"
+
+static int write_all(int fd, unsigned char* buffer, uint64_t size, off_t offset)
+{
+  ssize_t ret;
+  uint64_t written = 0;
+  
+  while (written < size)
+  {
+    ret = pwrite(fd, buffer + written, size - written, offset + written);
+    if (ret == -1 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+      return -1;
+    written += ret;
+  }
+  
+  return 0;
+}
+
+int PIDX_async_io_pwrite(const char* file_name, off_t offset, unsigned char* buffer, uint64_t size, int alignment, int sync)
+{
+  int fd;
+  uint64_t direct_size = 0;
+  
+#ifdef O_DIRECT
+  // the aligned prefix of the extent bypasses the page cache, the remainder (if any) is written normally
+  if (alignment > 0 && offset % alignment == 0 && ((uintptr_t) buffer) % alignment == 0)
+    direct_size = size - (size % alignment);
+  
+  if (direct_size != 0)
+  {
+    fd = open(file_name, O_WRONLY | O_DIRECT);
+    if (fd == -1)
+      direct_size = 0;  // file system without O_DIRECT support
+    else
+    {
+      if (write_all(fd, buffer, direct_size, offset) == -1)
+      {
+        fprintf(stderr, "[%s] [%d] pwrite() (O_DIRECT) failed. (%s)\n", __FILE__, __LINE__, file_name);
+        close(fd);
+        return -1;
+      }
+      close(fd);
+    }
+  }
+#endif
+  
+  fd = open(file_name, O_WRONLY);
+  if (fd == -1)
+  {
+    fprintf(stderr, "[%s] [%d] open() failed. (%s)\n", __FILE__, __LINE__, file_name);
+    return -1;
+  }
+  
+  if (write_all(fd, buffer + direct_size, size - direct_size, offset + direct_size) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] pwrite() failed. (%s)\n", __FILE__, __LINE__, file_name);
+    close(fd);
+    return -1;
+  }
+  
+  if (sync == 1 && fdatasync(fd) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] fdatasync() failed. (%s)\n", __FILE__, __LINE__, file_name);
+    close(fd);
+    return -1;
+  }
+  
+  close(fd);
+  return 0;
+}
+
+#if PIDX_HAVE_PTHREADS
+
+/// One queued write
+struct PIDX_async_io_request_struct
+{
+  char file_name[PATH_MAX];                             ///< target file
+  off_t offset;                                         ///< byte offset in the target file
+  unsigned char* buffer;                                ///< data (owned by the request)
+  uint64_t size;                                        ///< number of bytes to write
+  int alignment;                                        ///< O_DIRECT alignment (0 for buffered writes)
+  struct PIDX_async_io_request_struct* next;            ///< next request in the queue
+};
+typedef struct PIDX_async_io_request_struct* PIDX_async_io_request;
+
+struct PIDX_async_io_struct
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;                                  ///< signalled when a request is queued or completed
+  
+  PIDX_async_io_request head;
+  PIDX_async_io_request tail;
+  
+  int pending;                                          ///< queued + in flight requests
+  int error;                                            ///< set if any of the writes failed
+  int finalized;                                        ///< set by PIDX_async_io_finalize, the thread frees the id once the queue is empty
+};
+
+/// Number of writer threads still running (finalized or not)
+static int live_writer_count = 0;
+static pthread_mutex_t live_writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t live_writer_cond = PTHREAD_COND_INITIALIZER;
+
+static void* writer_thread(void* arg)
+{
+  int ret;
+  PIDX_async_io_id async_id = (PIDX_async_io_id)arg;
+  PIDX_async_io_request request;
+  
+  pthread_mutex_lock(&async_id->lock);
+  while (1)
+  {
+    while (async_id->head == NULL && async_id->finalized == 0)
+      pthread_cond_wait(&async_id->cond, &async_id->lock);
+    
+    if (async_id->head == NULL)
+      break;
+    
+    request = async_id->head;
+    async_id->head = request->next;
+    if (async_id->head == NULL)
+      async_id->tail = NULL;
+    pthread_mutex_unlock(&async_id->lock);
+    
+    ret = PIDX_async_io_pwrite(request->file_name, request->offset, request->buffer, request->size, request->alignment, 1);
+    free(request->buffer);
+    free(request);
+    
+    pthread_mutex_lock(&async_id->lock);
+    if (ret == -1)
+      async_id->error = 1;
+    async_id->pending--;
+    pthread_cond_broadcast(&async_id->cond);
+  }
+  pthread_mutex_unlock(&async_id->lock);
+  
+  pthread_mutex_destroy(&async_id->lock);
+  pthread_cond_destroy(&async_id->cond);
+  free(async_id);
+  
+  pthread_mutex_lock(&live_writer_lock);
+  live_writer_count--;
+  pthread_cond_broadcast(&live_writer_cond);
+  pthread_mutex_unlock(&live_writer_lock);
+  
+  return NULL;
+}
+
+PIDX_async_io_id PIDX_async_io_init()
+{
+  PIDX_async_io_id async_id;
+  
+  async_id = malloc(sizeof (*async_id));
+  memset(async_id, 0, sizeof (*async_id));
+  
+  pthread_mutex_init(&async_id->lock, NULL);
+  pthread_cond_init(&async_id->cond, NULL);
+  
+  pthread_mutex_lock(&live_writer_lock);
+  live_writer_count++;
+  pthread_mutex_unlock(&live_writer_lock);
+  
+  if (pthread_create(&async_id->thread, NULL, writer_thread, async_id) != 0)
+  {
+    fprintf(stderr, "[%s] [%d] pthread_create() failed.\n", __FILE__, __LINE__);
+    pthread_mutex_lock(&live_writer_lock);
+    live_writer_count--;
+    pthread_mutex_unlock(&live_writer_lock);
+    
+    pthread_mutex_destroy(&async_id->lock);
+    pthread_cond_destroy(&async_id->cond);
+    free(async_id);
+    return NULL;
+  }
+  pthread_detach(async_id->thread);
+  
+  return async_id;
+}
+
+int PIDX_async_io_submit(PIDX_async_io_id async_id, const char* file_name, off_t offset, unsigned char* buffer, uint64_t size, int alignment)
+{
+  PIDX_async_io_request request;
+  
+  request = malloc(sizeof (*request));
+  memset(request, 0, sizeof (*request));
+  strncpy(request->file_name, file_name, PATH_MAX - 1);
+  request->offset = offset;
+  request->buffer = buffer;
+  request->size = size;
+  request->alignment = alignment;
+  
+  pthread_mutex_lock(&async_id->lock);
+  if (async_id->tail == NULL)
+    async_id->head = request;
+  else
+    async_id->tail->next = request;
+  async_id->tail = request;
+  async_id->pending++;
+  pthread_cond_broadcast(&async_id->cond);
+  pthread_mutex_unlock(&async_id->lock);
+  
+  return 0;
+}
+
+int PIDX_async_io_test(PIDX_async_io_id async_id, int* done)
+{
+  int ret;
+  
+  pthread_mutex_lock(&async_id->lock);
+  *done = (async_id->pending == 0);
+  ret = (async_id->error == 0) ? 0 : -1;
+  pthread_mutex_unlock(&async_id->lock);
+  
+  return ret;
+}
+
+int PIDX_async_io_wait(PIDX_async_io_id async_id)
+{
+  int ret;
+  
+  pthread_mutex_lock(&async_id->lock);
+  while (async_id->pending != 0)
+    pthread_cond_wait(&async_id->cond, &async_id->lock);
+  ret = (async_id->error == 0) ? 0 : -1;
+  pthread_mutex_unlock(&async_id->lock);
+  
+  return ret;
+}
+
+int PIDX_async_io_finalize(PIDX_async_io_id async_id)
+{
+  int ret;
+  
+  // after this the writer thread owns (and frees) the id
+  pthread_mutex_lock(&async_id->lock);
+  ret = (async_id->error == 0) ? 0 : -1;
+  async_id->finalized = 1;
+  pthread_cond_broadcast(&async_id->cond);
+  pthread_mutex_unlock(&async_id->lock);
+  
+  return ret;
+}
+
+int PIDX_async_io_wait_all()
+{
+  pthread_mutex_lock(&live_writer_lock);
+  while (live_writer_count != 0)
+    pthread_cond_wait(&live_writer_cond, &live_writer_lock);
+  pthread_mutex_unlock(&live_writer_lock);
+  
+  return 0;
+}
+
+#else
+
+PIDX_async_io_id PIDX_async_io_init()
+{
+  return NULL;
+}
+
+int PIDX_async_io_submit(PIDX_async_io_id async_id, const char* file_name, off_t offset, unsigned char* buffer, uint64_t size, int alignment)
+{
+  return PIDX_err_not_implemented;
+}
+
+int PIDX_async_io_test(PIDX_async_io_id async_id, int* done)
+{
+  *done = 1;
+  return 0;
+}
+
+int PIDX_async_io_wait(PIDX_async_io_id async_id)
+{
+  return 0;
+}
+
+int PIDX_async_io_finalize(PIDX_async_io_id async_id)
+{
+  return 0;
+}
+
+int PIDX_async_io_wait_all()
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+/**
+ * \file PIDX_async_io.h
+ *
+ * Background writer for the aggregator buffers. Buffers handed to it
+ * are written (and synced) by a separate thread so that PIDX_flush and
+ * PIDX_close do not have to wait for the file system.
+ *
+ */
+
+#ifndef __PIDX_ASYNC_IO_H
+#define __PIDX_ASYNC_IO_H
+
+
+struct PIDX_async_io_struct;
+typedef struct PIDX_async_io_struct* PIDX_async_io_id;
+
+
+/// Creates the async IO ID and starts its writer thread.
+/// \return PIDX_async_io_id The identifier (NULL if threads are not available)
+PIDX_async_io_id PIDX_async_io_init();
+
+
+
+/// Queues a write. The async IO ID takes ownership of buffer and frees it
+/// once it has been written.
+/// \param async_id async IO id
+/// \param file_name file to write to (must already exist)
+/// \param offset byte offset in the file
+/// \param buffer the data (allocated with malloc or posix_memalign)
+/// \param size number of bytes to write
+/// \param alignment see PIDX_async_io_pwrite
+/// \return error code
+int PIDX_async_io_submit(PIDX_async_io_id async_id, const char* file_name, off_t offset, unsigned char* buffer, uint64_t size, int alignment);
+
+
+
+/// Writes one extent synchronously, this is what the writer thread does (with sync) for every queued write.
+/// If alignment is non zero and offset and buffer are aligned to it, the aligned part of the extent
+/// is written with O_DIRECT and only the unaligned tail goes through the page cache.
+/// \param file_name file to write to (must already exist)
+/// \param offset byte offset in the file
+/// \param buffer the data
+/// \param size number of bytes to write
+/// \param alignment O_DIRECT alignment in bytes (0 for a buffered write)
+/// \param sync 1 to fdatasync the file before returning
+/// \return error code
+int PIDX_async_io_pwrite(const char* file_name, off_t offset, unsigned char* buffer, uint64_t size, int alignment, int sync);
+
+
+
+/// Checks (without blocking) whether all the queued writes are on disk.
+/// \param async_id async IO id
+/// \param done set to 1 if nothing is pending, 0 otherwise
+/// \return error code (-1 if any of the completed writes failed)
+int PIDX_async_io_test(PIDX_async_io_id async_id, int* done);
+
+
+
+/// Blocks until all the queued writes are on disk.
+/// \param async_id async IO id
+/// \return error code (-1 if any of the writes failed)
+int PIDX_async_io_wait(PIDX_async_io_id async_id);
+
+
+
+/// Releases the ID without waiting. The writer thread keeps draining the
+/// queue and frees the ID when it is done.
+/// \param async_id async IO id
+/// \return error code
+int PIDX_async_io_finalize(PIDX_async_io_id async_id);
+
+
+
+/// Blocks until the writer threads of all (including finalized) async IO IDs have finished.
+/// \return error code
+int PIDX_async_io_wait_all();
+
+#endif //__PIDX_ASYNC_IO_H
@@ -0,0 +1,292 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+#include "PIDX_inc.h"
+
+/// One cached block
+struct block_cache_entry
+{
+  char* file_name;                                      ///< binary file of the block
+  int variable_index;
+  int block_number;
+  uint64_t hash;
+  unsigned char* block;                                 ///< the decoded block
+  uint64_t block_size;
+  struct block_cache_entry* hash_next;                  ///< next entry of the hash bucket
+  struct block_cache_entry* lru_prev;                   ///< entry used more recently
+  struct block_cache_entry* lru_next;                   ///< entry used less recently
+};
+
+static uint64_t cache_byte_budget = 0;
+static uint64_t cache_byte_count = 0;
+static int64_t cache_hit_count = 0;
+static int64_t cache_miss_count = 0;
+static int cache_entry_count = 0;
+static int cache_bucket_count = 0;
+static struct block_cache_entry** cache_buckets = NULL;
+static struct block_cache_entry* lru_head = NULL;      ///< most recently used
+static struct block_cache_entry* lru_tail = NULL;      ///< least recently used, the next to go
+
+#if PIDX_HAVE_PTHREADS
+// the time step prefetcher fills the cache from its own thread
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void lock_cache()
+{
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_lock(&cache_lock);
+#endif
+}
+
+static void unlock_cache()
+{
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_unlock(&cache_lock);
+#endif
+}
+
+static uint64_t hash_key(const char* file_name, int variable_index, int block_number)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  const unsigned char* c;
+
+  for (c = (const unsigned char*)file_name; *c != 0; c++)
+    hash = (hash ^ *c) * 1099511628211ULL;
+  hash = (hash ^ (uint32_t)variable_index) * 1099511628211ULL;
+  hash = (hash ^ (uint32_t)block_number) * 1099511628211ULL;
+
+  return hash;
+}
+
+static struct block_cache_entry* find_entry(const char* file_name, int variable_index, int block_number)
+{
+  struct block_cache_entry* entry;
+  uint64_t hash;
+
+  if (cache_bucket_count == 0)
+    return NULL;
+
+  hash = hash_key(file_name, variable_index, block_number);
+  for (entry = cache_buckets[hash & (cache_bucket_count - 1)]; entry != NULL; entry = entry->hash_next)
+    if (entry->hash == hash && entry->variable_index == variable_index && entry->block_number == block_number && strcmp(entry->file_name, file_name) == 0)
+      return entry;
+
+  return NULL;
+}
+
+static void unlink_lru(struct block_cache_entry* entry)
+{
+  if (entry->lru_prev != NULL)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    lru_head = entry->lru_next;
+  if (entry->lru_next != NULL)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    lru_tail = entry->lru_prev;
+}
+
+static void push_lru(struct block_cache_entry* entry)
+{
+  entry->lru_prev = NULL;
+  entry->lru_next = lru_head;
+  if (lru_head != NULL)
+    lru_head->lru_prev = entry;
+  lru_head = entry;
+  if (lru_tail == NULL)
+    lru_tail = entry;
+}
+
+static void drop_entry(struct block_cache_entry* entry)
+{
+  struct block_cache_entry** link = &cache_buckets[entry->hash & (cache_bucket_count - 1)];
+
+  while (*link != entry)
+    link = &(*link)->hash_next;
+  *link = entry->hash_next;
+  unlink_lru(entry);
+
+  cache_byte_count -= entry->block_size;
+  cache_entry_count--;
+  free(entry->file_name);
+  free(entry->block);
+  free(entry);
+}
+
+/// Drops the least recently used blocks until byte_count more bytes fit in the budget
+static void evict(uint64_t byte_count)
+{
+  while (lru_tail != NULL && cache_byte_count + byte_count > cache_byte_budget)
+    drop_entry(lru_tail);
+}
+
+/// Doubles the buckets (the table starts at 256) once there are more entries than buckets
+static int grow_buckets()
+{
+  int i, bucket_count = (cache_bucket_count == 0) ? 256 : 2 * cache_bucket_count;
+  struct block_cache_entry *entry, *next;
+  struct block_cache_entry** buckets;
+
+  buckets = calloc(bucket_count, sizeof (*buckets));
+  if (buckets == NULL)
+    return -1;
+
+  for (i = 0; i < cache_bucket_count; i++)
+    for (entry = cache_buckets[i]; entry != NULL; entry = next)
+    {
+      next = entry->hash_next;
+      entry->hash_next = buckets[entry->hash & (bucket_count - 1)];
+      buckets[entry->hash & (bucket_count - 1)] = entry;
+    }
+
+  free(cache_buckets);
+  cache_buckets = buckets;
+  cache_bucket_count = bucket_count;
+
+  return 0;
+}
+
+int PIDX_block_cache_set_size(uint64_t byte_budget)
+{
+  lock_cache();
+  cache_byte_budget = byte_budget;
+  evict(0);
+  unlock_cache();
+
+  return 0;
+}
+
+int PIDX_block_cache_get(const char* file_name, int variable_index, int block_number, unsigned char* block, uint64_t block_size)
+{
+  struct block_cache_entry* entry;
+
+  lock_cache();
+  if (cache_byte_budget == 0)
+  {
+    unlock_cache();
+    return 0;
+  }
+
+  entry = find_entry(file_name, variable_index, block_number);
+  if (entry == NULL || entry->block_size != block_size)
+  {
+    cache_miss_count++;
+    unlock_cache();
+    return 0;
+  }
+
+  memcpy(block, entry->block, block_size);
+  unlink_lru(entry);
+  push_lru(entry);
+  cache_hit_count++;
+  unlock_cache();
+
+  return 1;
+}
+
+int PIDX_block_cache_contains(const char* file_name, int variable_index, int block_number)
+{
+  int ret;
+
+  lock_cache();
+  ret = (cache_byte_budget != 0 && find_entry(file_name, variable_index, block_number) != NULL) ? 1 : 0;
+  unlock_cache();
+
+  return ret;
+}
+
+int PIDX_block_cache_put(const char* file_name, int variable_index, int block_number, const unsigned char* block, uint64_t block_size)
+{
+  struct block_cache_entry* entry;
+
+  lock_cache();
+  if (block_size > cache_byte_budget)
+  {
+    unlock_cache();
+    return 0;
+  }
+
+  entry = find_entry(file_name, variable_index, block_number);
+  if (entry != NULL)
+    drop_entry(entry);
+  evict(block_size);
+
+  if (cache_entry_count >= cache_bucket_count && grow_buckets() == -1)
+  {
+    fprintf(stderr, "[%s] [%d] calloc() failed.\n", __FILE__, __LINE__);
+    unlock_cache();
+    return -1;
+  }
+
+  entry = malloc(sizeof (*entry));
+  if (entry != NULL)
+  {
+    entry->file_name = strdup(file_name);
+    entry->block = malloc(block_size);
+  }
+  if (entry == NULL || entry->file_name == NULL || entry->block == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    if (entry != NULL)
+    {
+      free(entry->file_name);
+      free(entry->block);
+      free(entry);
+    }
+    unlock_cache();
+    return -1;
+  }
+
+  memcpy(entry->block, block, block_size);
+  entry->block_size = block_size;
+  entry->variable_index = variable_index;
+  entry->block_number = block_number;
+  entry->hash = hash_key(file_name, variable_index, block_number);
+  entry->hash_next = cache_buckets[entry->hash & (cache_bucket_count - 1)];
+  cache_buckets[entry->hash & (cache_bucket_count - 1)] = entry;
+  push_lru(entry);
+
+  cache_byte_count += block_size;
+  cache_entry_count++;
+  unlock_cache();
+
+  return 0;
+}
+
+int PIDX_block_cache_clear()
+{
+  lock_cache();
+  while (lru_tail != NULL)
+    drop_entry(lru_tail);
+  unlock_cache();
+
+  return 0;
+}
+
+int PIDX_block_cache_get_stats(int64_t* hit_count, int64_t* miss_count, int64_t* byte_count)
+{
+  lock_cache();
+  *hit_count = cache_hit_count;
+  *miss_count = cache_miss_count;
+  *byte_count = cache_byte_count;
+  unlock_cache();
+
+  return 0;
+}
@@ -0,0 +1,75 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+/**
+ * \file PIDX_block_cache.h
+ *
+ * Per process cache of decoded IDX blocks, shared by all the reads (and
+ * the files opened) of the process. Blocks are found by binary file,
+ * variable and block number; when the cache is over its byte budget the
+ * least recently used blocks are dropped. The cache is off (a budget of
+ * 0 bytes) until PIDX_block_cache_set_size.
+ *
+ */
+
+#ifndef __PIDX_BLOCK_CACHE_H
+#define __PIDX_BLOCK_CACHE_H
+
+
+/// Sets the byte budget of the cache (0: off, the blocks in it are dropped); the least recently used blocks over the
+/// budget are dropped at once.
+/// \param byte_budget bytes of block data the cache may hold
+/// \return error code
+int PIDX_block_cache_set_size(uint64_t byte_budget);
+
+
+
+/// Copies a block out of the cache.
+/// \param file_name binary file of the block
+/// \param variable_index the variable
+/// \param block_number the block (in the dataset)
+/// \param block the decoded block, block_size bytes
+/// \param block_size size of the decoded block
+/// \return 1 if the block was in the cache (a hit), 0 if not (a miss)
+int PIDX_block_cache_get(const char* file_name, int variable_index, int block_number, unsigned char* block, uint64_t block_size);
+
+
+
+/// 1 if the block is in the cache, without counting a hit or a miss or touching its place in the LRU order
+int PIDX_block_cache_contains(const char* file_name, int variable_index, int block_number);
+
+
+
+/// Copies a decoded block into the cache, dropping the least recently used blocks as needed (a block bigger than the
+/// budget is not kept).
+/// \return error code
+int PIDX_block_cache_put(const char* file_name, int variable_index, int block_number, const unsigned char* block, uint64_t block_size);
+
+
+
+/// Drops every block (the files are being written).
+/// \return error code
+int PIDX_block_cache_clear();
+
+
+
+/// Hits and misses of PIDX_block_cache_get since the process started, and bytes held.
+/// \return error code
+int PIDX_block_cache_get_stats(int64_t* hit_count, int64_t* miss_count, int64_t* byte_count);
+
+#endif //__PIDX_BLOCK_CACHE_H
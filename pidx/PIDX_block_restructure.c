@@ -28,6 +28,11 @@
  */
 
 #include "PIDX_inc.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum IO_MODE { PIDX_READ, PIDX_WRITE};
 
 
 ///Struct for restructuring ID
@@ -76,129 +81,268 @@ int PIDX_block_rst_set_communicator(PIDX_block_rst_id block_rst_id, MPI_Comm com
 }
 #endif
 
-// one restructured box per group
-// TODO: detect wrong input
-int PIDX_block_rst_prepare(PIDX_block_rst_id block_rst_id)
+/// Copies a row of a brick (2, 4 or 8 values of 4 or 8 bytes)
+static inline void copy_brick_row(unsigned char* dst, const unsigned char* src, int row_bytes)
 {
-  // compute the intra compression block strides
-  int64_t *compression_block_size = block_rst_id->idx_ptr->compression_block_size;
-  int64_t intra_cblock_stride[PIDX_MAX_DIMENSIONS]; // stride inside a compression block
-  intra_cblock_stride[0] = 1;
-  int d = 0;
-  for (d = 1; d < PIDX_MAX_DIMENSIONS; ++d)
+#if defined(__SSE2__)
+  switch (row_bytes)
   {
-    intra_cblock_stride[d] *= compression_block_size[d - 1];
+    case 64:
+      _mm_storeu_si128((__m128i*)(dst + 48), _mm_loadu_si128((const __m128i*)(src + 48)));
+      _mm_storeu_si128((__m128i*)(dst + 32), _mm_loadu_si128((const __m128i*)(src + 32)));
+      /* fall through */
+    case 32:
+      _mm_storeu_si128((__m128i*)(dst + 16), _mm_loadu_si128((const __m128i*)(src + 16)));
+      /* fall through */
+    case 16:
+      _mm_storeu_si128((__m128i*)dst, _mm_loadu_si128((const __m128i*)src));
+      break;
+    default:
+      memcpy(dst, src, 8);
   }
+#else
+  memcpy(dst, src, row_bytes);
+#endif
+}
 
-  // loop through all variables
-  int v = 0;
-  for (v = block_rst_id->start_variable_index; v <= block_rst_id->end_variable_index; ++v)
-  {
-    PIDX_variable var = block_rst_id->idx_ptr->variable[v];
-    int bytes_per_value = var->bits_per_value / (8 * sizeof(unsigned char));
+/// Whether copy_box_bricks_fast applies: one value per sample of 4 or 8 bytes, 2-D (x, y) or 3-D bricks with
+/// edges of 2, 4 or 8, and a box made of whole bricks of its enclosing box
+static int fast_bricks(PIDX_block_rst_id block_rst_id, PIDX_variable var, Ndim_box_group box_group, Ndim_box box)
+{
+  int d;
+  int64_t *compression_block_size = block_rst_id->idx_ptr->compression_block_size;
 
-    // loop through all groups
-    int g = 0;
-    for (g = 0; g < var->patch_group_count; ++g)
+  if (var->values_per_sample != 1 || (var->bits_per_value != 32 && var->bits_per_value != 64))
+    return 0;
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (d < 2 || (d == 2 && compression_block_size[2] != 1))
     {
-      // copy the size and offset to output
-      Ndim_box_group box_group = var->patch_group_ptr[g];
-      Ndim_box_group out_box = var->post_rst_block[g];
-      memcpy(&out_box->box[0]->Ndim_box_size, &box_group->enclosing_box_size, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
-      memcpy(&out_box->box[0]->Ndim_box_offset, &box_group->enclosing_box_offset, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
-      int64_t num_elems_group = 1; // number of elements in the group
-      for (d = 0; d < PIDX_MAX_DIMENSIONS; ++d)
-      {
-        if (box_group->enclosing_box_size[d] > 0)
-        {
-          num_elems_group *= box_group->enclosing_box_size[d];
-        }
-      }
-      out_box->box[0]->Ndim_box_buffer = malloc(bytes_per_value * num_elems_group);
-      int64_t *group_offset = box_group->enclosing_box_offset;
+      if (compression_block_size[d] != 2 && compression_block_size[d] != 4 && compression_block_size[d] != 8)
+        return 0;
+    }
+    else if (compression_block_size[d] != 1)
+      return 0;
 
-      // loop through all boxes
-      int b = 0;
-      for (b = 0; b < box_group->box_count; ++b)
-      {
-        Ndim_box box = box_group->box[b];
-        int64_t *box_size = box->Ndim_box_size;
-        int64_t *box_offset = box->Ndim_box_offset; // global offset of the box
-
-        // compute the number of elements in the box, and before the box
-        int64_t num_elems_box = 1; // number of elements in the box
-        int64_t num_prev_elems = 1; // number of elements that precede this group
-        for (d = 0; d < PIDX_MAX_DIMENSIONS; ++d)
-        {
-          if (box_size[d] > 0)
-          {
-            int64_t local_offset = box_offset[d] - group_offset[d];
-            num_prev_elems *= local_offset;
-            num_elems_box *= box_size[d];
-          }
-        }
+    if (box->Ndim_box_size[d] % compression_block_size[d] != 0 || (box->Ndim_box_offset[d] - box_group->enclosing_box_offset[d]) % compression_block_size[d] != 0)
+      return 0;
+  }
 
-        // compute strides in all dimensions
-        // stride[i] = the number of elements between two consecutive indices in the ith dimension
-        int64_t stride[PIDX_MAX_DIMENSIONS];
-        stride[0] = 1; // assume x (or dimension [0]) is the fastest varying dimension
-        for (d = 1; d < PIDX_MAX_DIMENSIONS; ++d)
-        {
-          stride[d] = stride[d - 1] * box_size[d - 1];
-        }
+  return 1;
+}
 
-        // loop through the elements to find their new positions
-        int64_t i = 0;
-        int64_t k = bytes_per_value * compression_block_size[0]; // we copy k consecutive bytes at a time
-        for (i = 0; i < num_elems_box; i += compression_block_size[0])
+/// Same as copy_box_bricks for the boxes fast_bricks accepts: whole bricks are copied row by row,
+/// with the positions in both buffers advanced incrementally instead of recomputed per run of samples
+static void copy_box_bricks_fast(PIDX_block_rst_id block_rst_id, PIDX_variable var, Ndim_box_group box_group, Ndim_box box, unsigned char* brick_buffer, int MODE)
+{
+  int d;
+  int64_t t, u, z, y, x, bz, by;
+  int64_t brick_count[PIDX_MAX_DIMENSIONS], first[PIDX_MAX_DIMENSIONS], count[PIDX_MAX_DIMENSIONS];
+  int64_t *compression_block_size = block_rst_id->idx_ptr->compression_block_size;
+  int bytes_per_value = var->bits_per_value / 8;
+  int row_bytes = compression_block_size[0] * bytes_per_value;
+  int64_t brick_bytes = compression_block_size[0] * compression_block_size[1] * compression_block_size[2] * bytes_per_value;
+  int64_t row_pitch = box->Ndim_box_size[0] * bytes_per_value;
+  int64_t plane_pitch = row_pitch * box->Ndim_box_size[1];
+  unsigned char *brick, *box_row, *brick_row, *sample_row;
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    brick_count[d] = box_group->enclosing_box_size[d] / compression_block_size[d];
+    first[d] = (box->Ndim_box_offset[d] - box_group->enclosing_box_offset[d]) / compression_block_size[d];
+    count[d] = box->Ndim_box_size[d] / compression_block_size[d];
+  }
+
+  for (t = 0; t < count[4]; t++)
+    for (u = 0; u < count[3]; u++)
+      for (bz = 0; bz < count[2]; bz++)
+        for (by = 0; by < count[1]; by++)
         {
-          // compute the 5D index of the ith element
-          int64_t j = i + num_prev_elems;
-          int64_t index[PIDX_MAX_DIMENSIONS];
-          // the following calculation is based on the formula
-          // linear index = index[0] * stride[0] + index[1] * stride[1] + ... + index[n] * stride[n] (n == PIDX_MAX_DIMENSIONS)
-          // in which stride[1] is a multiple of stride[0], stride[2] is a multiple of stride[1] and so on
-          // and index[i] * stride[i] < stride[i + 1]
-          for (d = 0; d + 1 < PIDX_MAX_DIMENSIONS; ++d)
+          // first brick of the row of bricks, and the first row of its samples in the box
+          brick = brick_buffer + ((((first[4] + t) * brick_count[3] + first[3] + u) * brick_count[2] + first[2] + bz) * brick_count[1] + first[1] + by) * brick_count[0] * brick_bytes + first[0] * brick_bytes;
+          box_row = box->Ndim_box_buffer + ((t * box->Ndim_box_size[3] + u) * box->Ndim_box_size[2] + bz * compression_block_size[2]) * plane_pitch + by * compression_block_size[1] * row_pitch;
+
+          for (x = 0; x < count[0]; x++, brick = brick + brick_bytes, box_row = box_row + row_bytes)
           {
-            if (j > 0)
+            brick_row = brick;
+            for (z = 0; z < compression_block_size[2]; z++)
             {
-              int64_t k = j % stride[d + 1];
-              index[d] = k / stride[d];
-              j -= k;
+              sample_row = box_row + z * plane_pitch;
+              for (y = 0; y < compression_block_size[1]; y++, brick_row = brick_row + row_bytes, sample_row = sample_row + row_pitch)
+              {
+                if (MODE == PIDX_WRITE)
+                  copy_brick_row(brick_row, sample_row, row_bytes);
+                else
+                  copy_brick_row(sample_row, brick_row, row_bytes);
+              }
             }
           }
-          if (stride[PIDX_MAX_DIMENSIONS - 1] > 0)
-          {
-            index[PIDX_MAX_DIMENSIONS - 1] = j / stride[PIDX_MAX_DIMENSIONS - 1];
-          }
+        }
+}
+
+/// Copies the samples of one box into (PIDX_WRITE) or out of (PIDX_READ) the brick ordered buffer of its group.
+/// In the brick ordered buffer the bricks follow each other in row major order over the enclosing box
+/// and every brick holds, for each of the values_per_sample values, its samples in row major order.
+static int copy_box_bricks(PIDX_block_rst_id block_rst_id, PIDX_variable var, Ndim_box_group box_group, Ndim_box box, unsigned char* brick_buffer, int MODE)
+{
+  int d, s;
+  int64_t i, r, row_count, run;
+  int64_t index[PIDX_MAX_DIMENSIONS], local[PIDX_MAX_DIMENSIONS], brick_count[PIDX_MAX_DIMENSIONS];
+  int64_t brick, intra, box_index;
+  int64_t *compression_block_size = block_rst_id->idx_ptr->compression_block_size;
+  int64_t total_compression_block_size = 1;
+  int bytes_per_value = var->bits_per_value / 8;
+  int values_per_sample = var->values_per_sample;
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (box_group->enclosing_box_size[d] % compression_block_size[d] != 0)
+    {
+      fprintf(stderr, "[%s] [%d] the box size (%lld) is not a multiple of the compression block size (%lld) in dimension %d.\n", __FILE__, __LINE__, (long long)box_group->enclosing_box_size[d], (long long)compression_block_size[d], d);
+      return -1;
+    }
+    brick_count[d] = box_group->enclosing_box_size[d] / compression_block_size[d];
+    total_compression_block_size = total_compression_block_size * compression_block_size[d];
+  }
+
+  if (fast_bricks(block_rst_id, var, box_group, box) == 1)
+  {
+    copy_box_bricks_fast(block_rst_id, var, box_group, box, brick_buffer, MODE);
+    return 0;
+  }
+
+  row_count = box->Ndim_box_size[1] * box->Ndim_box_size[2] * box->Ndim_box_size[3] * box->Ndim_box_size[4];
+  for (r = 0; r < row_count; r++)
+  {
+    // position of the row in the box, then in the enclosing box
+    index[0] = 0;
+    index[1] = r % box->Ndim_box_size[1];
+    index[2] = (r / box->Ndim_box_size[1]) % box->Ndim_box_size[2];
+    index[3] = (r / (box->Ndim_box_size[1] * box->Ndim_box_size[2])) % box->Ndim_box_size[3];
+    index[4] = r / (box->Ndim_box_size[1] * box->Ndim_box_size[2] * box->Ndim_box_size[3]);
+    for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      local[d] = box->Ndim_box_offset[d] - box_group->enclosing_box_offset[d] + index[d];
+
+    box_index = r * box->Ndim_box_size[0];
+
+    // the row crosses the bricks in runs of at most compression_block_size[0] samples
+    for (i = 0; i < box->Ndim_box_size[0]; i = i + run)
+    {
+      run = compression_block_size[0] - ((local[0] + i) % compression_block_size[0]);
+      if (run > box->Ndim_box_size[0] - i)
+        run = box->Ndim_box_size[0] - i;
+
+      brick = 0;
+      intra = 0;
+      for (d = PIDX_MAX_DIMENSIONS - 1; d >= 0; d--)
+      {
+        brick = brick * brick_count[d] + ((d == 0 ? local[0] + i : local[d]) / compression_block_size[d]);
+        intra = intra * compression_block_size[d] + ((d == 0 ? local[0] + i : local[d]) % compression_block_size[d]);
+      }
 
-          // compute the output linear index
-          j = 0; // compression block-level linear index
-          stride[0] = 1;
-          for (d = 0; d < PIDX_MAX_DIMENSIONS; ++d)
+      if (values_per_sample == 1)
+      {
+        if (MODE == PIDX_WRITE)
+          memcpy(brick_buffer + (brick * total_compression_block_size + intra) * bytes_per_value, box->Ndim_box_buffer + (box_index + i) * bytes_per_value, run * bytes_per_value);
+        else
+          memcpy(box->Ndim_box_buffer + (box_index + i) * bytes_per_value, brick_buffer + (brick * total_compression_block_size + intra) * bytes_per_value, run * bytes_per_value);
+      }
+      else
+      {
+        int64_t k;
+        for (k = 0; k < run; k++)
+          for (s = 0; s < values_per_sample; s++)
           {
-            int64_t cbz = compression_block_size[d];
-            if (cbz > 0)
-            {
-              if (d > 0)
-              { // reduce the stride based on the new blocking scheme
-                stride[d] = stride[d - 1] * (box_group->enclosing_box_size[d - 1] / compression_block_size[d - 1]);
-              }
-              j += (index[d] /cbz) * stride[d];
-              j += (index[d] % cbz) * intra_cblock_stride[d];
-            }
+            if (MODE == PIDX_WRITE)
+              memcpy(brick_buffer + ((brick * values_per_sample + s) * total_compression_block_size + intra + k) * bytes_per_value, box->Ndim_box_buffer + ((box_index + i + k) * values_per_sample + s) * bytes_per_value, bytes_per_value);
+            else
+              memcpy(box->Ndim_box_buffer + ((box_index + i + k) * values_per_sample + s) * bytes_per_value, brick_buffer + ((brick * values_per_sample + s) * total_compression_block_size + intra + k) * bytes_per_value, bytes_per_value);
           }
+      }
+    }
+  }
 
-          // copy k consecutive elements at once
-          memcpy(&out_box->box[0]->Ndim_box_buffer[j * k], &box->Ndim_box_buffer[i * k], k);
-        }
+  return 0;
+}
+
+// one restructured box per group, the enclosing box of the group
+int PIDX_block_rst_buf_create(PIDX_block_rst_id block_rst_id)
+{
+  int v, g, d;
+  for (v = block_rst_id->start_variable_index; v <= block_rst_id->end_variable_index; ++v)
+  {
+    PIDX_variable var = block_rst_id->idx_ptr->variable[v];
+    int bytes_per_value = var->bits_per_value / 8;
+
+    var->post_rst_block = malloc(sizeof(*var->post_rst_block) * var->patch_group_count);
+    memset(var->post_rst_block, 0, sizeof(*var->post_rst_block) * var->patch_group_count);
+
+    for (g = 0; g < var->patch_group_count; ++g)
+    {
+      Ndim_box_group box_group = var->patch_group_ptr[g];
+      Ndim_box_group out_box;
+      int64_t num_elems_group = 1;
+
+      var->post_rst_block[g] = malloc(sizeof(*(var->post_rst_block[g])));
+      memset(var->post_rst_block[g], 0, sizeof(*(var->post_rst_block[g])));
+      out_box = var->post_rst_block[g];
+
+      out_box->box_count = 1;
+      out_box->box_group_type = box_group->box_group_type;
+      out_box->box = malloc(sizeof(*(out_box->box)) * out_box->box_count);
+      out_box->box[0] = malloc(sizeof(*(out_box->box[0])));
+      memset(out_box->box[0], 0, sizeof(*(out_box->box[0])));
+
+      memcpy(out_box->box[0]->Ndim_box_size, box_group->enclosing_box_size, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
+      memcpy(out_box->box[0]->Ndim_box_offset, box_group->enclosing_box_offset, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
+      memcpy(out_box->enclosing_box_size, box_group->enclosing_box_size, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
+      memcpy(out_box->enclosing_box_offset, box_group->enclosing_box_offset, PIDX_MAX_DIMENSIONS * sizeof(int64_t));
+
+      for (d = 0; d < PIDX_MAX_DIMENSIONS; ++d)
+        num_elems_group *= box_group->enclosing_box_size[d];
+
+      // the parts of the enclosing box no box covers stay zero
+      out_box->box[0]->Ndim_box_buffer = malloc(bytes_per_value * var->values_per_sample * num_elems_group);
+      if (out_box->box[0]->Ndim_box_buffer == NULL)
+      {
+        fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+        return -1;
       }
+      memset(out_box->box[0]->Ndim_box_buffer, 0, bytes_per_value * var->values_per_sample * num_elems_group);
     }
   }
   return 0;
 }
 
+int PIDX_block_rst_prepare(PIDX_block_rst_id block_rst_id)
+{
+  int v, g, b;
+  for (v = block_rst_id->start_variable_index; v <= block_rst_id->end_variable_index; ++v)
+  {
+    PIDX_variable var = block_rst_id->idx_ptr->variable[v];
+    for (g = 0; g < var->patch_group_count; ++g)
+      for (b = 0; b < var->patch_group_ptr[g]->box_count; ++b)
+        if (copy_box_bricks(block_rst_id, var, var->patch_group_ptr[g], var->patch_group_ptr[g]->box[b], var->post_rst_block[g]->box[0]->Ndim_box_buffer, PIDX_WRITE) == -1)
+          return -1;
+  }
+  return 0;
+}
+
+int PIDX_block_rst_restore(PIDX_block_rst_id block_rst_id)
+{
+  int v, g, b;
+  for (v = block_rst_id->start_variable_index; v <= block_rst_id->end_variable_index; ++v)
+  {
+    PIDX_variable var = block_rst_id->idx_ptr->variable[v];
+    for (g = 0; g < var->patch_group_count; ++g)
+      for (b = 0; b < var->patch_group_ptr[g]->box_count; ++b)
+        if (copy_box_bricks(block_rst_id, var, var->patch_group_ptr[g], var->patch_group_ptr[g]->box[b], var->post_rst_block[g]->box[0]->Ndim_box_buffer, PIDX_READ) == -1)
+          return -1;
+  }
+  return 0;
+}
+
 int PIDX_block_rst_compress(PIDX_block_rst_id block_rst_id)
 {
   return -1;
@@ -206,10 +350,30 @@ int PIDX_block_rst_compress(PIDX_block_rst_id block_rst_id)
 
 int PIDX_block_rst_buf_destroy(PIDX_block_rst_id block_rst_id)
 {
-  return -1;
+  int v, g;
+  for (v = block_rst_id->start_variable_index; v <= block_rst_id->end_variable_index; ++v)
+  {
+    PIDX_variable var = block_rst_id->idx_ptr->variable[v];
+    if (var->post_rst_block == NULL)
+      continue;
+
+    for (g = 0; g < var->patch_group_count; ++g)
+    {
+      free(var->post_rst_block[g]->box[0]->Ndim_box_buffer);
+      free(var->post_rst_block[g]->box[0]);
+      free(var->post_rst_block[g]->box);
+      free(var->post_rst_block[g]);
+    }
+    free(var->post_rst_block);
+    var->post_rst_block = 0;
+  }
+  return 0;
 }
 
 int PIDX_block_rst_finalize(PIDX_block_rst_id block_rst_id)
 {
-  return -1;
+  free(block_rst_id);
+  block_rst_id = 0;
+
+  return 0;
 }
\ No newline at end of file
@@ -36,6 +36,9 @@ PIDX_block_rst_id PIDX_block_rst_init(idx_dataset idx_meta_data, idx_dataset_der
 int PIDX_block_rst_set_communicator(PIDX_block_rst_id id, MPI_Comm comm);
 #endif
 
+/// Allocates the restructured (post_rst_block) groups, one brick ordered box spanning the enclosing box of every patch group
+int PIDX_block_rst_buf_create(PIDX_block_rst_id id);
+
 /// Restructures the voxels in (m x n x p) blocks
 /// Example: The following 2D array
 /// 1 2 3  4  5  6
@@ -44,8 +47,12 @@ int PIDX_block_rst_set_communicator(PIDX_block_rst_id id, MPI_Comm comm);
 /// The restructured storage, in 3 x 2 blocks, is 1 2 3 7 8 9 4 5 6 10 11 12
 int PIDX_block_rst_prepare(PIDX_block_rst_id id);
 
+/// Inverse of PIDX_block_rst_prepare (for reads), scatters the bricks back into the boxes of the patch groups
+int PIDX_block_rst_restore(PIDX_block_rst_id id);
+
 int PIDX_block_rst_compress(PIDX_block_rst_id id);
 
+/// Frees the restructured (post_rst_block) groups
 int PIDX_block_rst_buf_destroy(PIDX_block_rst_id id);
 
 int PIDX_block_rst_finalize(PIDX_block_rst_id id);
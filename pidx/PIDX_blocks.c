@@ -21,6 +21,82 @@
 const int PIDX_default_bits_per_block       = 15;
 const int PIDX_default_blocks_per_file      = 256;
 
+#if defined(__GNUC__)
+#define popcount64(x) __builtin_popcountll(x)
+#else
+static int popcount64(uint64_t x)
+{
+  int count = 0;
+  for (; x; count++)
+    x &= x - 1;
+  return count;
+}
+#endif
+
+#define BITMAP_WORD_BITS 64
+#define RANK_WORDS (PIDX_BLOCK_RANK_BITS / BITMAP_WORD_BITS)
+
+static void allocate_bitmap(PIDX_block_layout layout);
+static void set_block(PIDX_block_layout layout, int block_number);
+static void build_rank(PIDX_block_layout layout);
+static int rank(PIDX_block_layout layout, int block_number);
+
+
+/// One bit per block number (block 0 set), plus one spare word so that rank() can look one past the end
+static void allocate_bitmap(PIDX_block_layout layout)
+{
+  int words;
+  
+  layout->block_count = 1 << (layout->levels - 1);
+  words = layout->block_count / BITMAP_WORD_BITS + 1;
+  
+  layout->block_bitmap = (uint64_t*)malloc(sizeof(uint64_t) * words);
+  memset(layout->block_bitmap, 0, sizeof(uint64_t) * words);
+  layout->block_rank = (int*)malloc(sizeof(int) * (words / RANK_WORDS + 1));
+  memset(layout->block_rank, 0, sizeof(int) * (words / RANK_WORDS + 1));
+  
+  layout->block_bitmap[0] = 1;
+}
+
+
+static void set_block(PIDX_block_layout layout, int block_number)
+{
+  layout->block_bitmap[block_number / BITMAP_WORD_BITS] |= ((uint64_t)1) << (block_number % BITMAP_WORD_BITS);
+}
+
+
+static void build_rank(PIDX_block_layout layout)
+{
+  int w, count = 0;
+  int words = layout->block_count / BITMAP_WORD_BITS + 1;
+  
+  for (w = 0; w < words; w++)
+  {
+    if (w % RANK_WORDS == 0)
+      layout->block_rank[w / RANK_WORDS] = count;
+    count = count + popcount64(layout->block_bitmap[w]);
+  }
+}
+
+
+/// Number of filled blocks with a block number below block_number
+static int rank(PIDX_block_layout layout, int block_number)
+{
+  int w, i, count;
+  
+  if (block_number > layout->block_count)
+    block_number = layout->block_count;
+  
+  w = block_number / BITMAP_WORD_BITS;
+  count = layout->block_rank[w / RANK_WORDS];
+  for (i = (w / RANK_WORDS) * RANK_WORDS; i < w; i++)
+    count = count + popcount64(layout->block_bitmap[i]);
+  if (block_number % BITMAP_WORD_BITS)
+    count = count + popcount64(layout->block_bitmap[w] & ((((uint64_t)1) << (block_number % BITMAP_WORD_BITS)) - 1));
+  
+  return count;
+}
+
 
 ///
 int PIDX_blocks_initialize_layout (PIDX_block_layout layout, int maxh, int bits_per_block)
@@ -57,16 +133,101 @@ int PIDX_blocks_initialize_layout (PIDX_block_layout layout, int maxh, int bits_
   /// This block contains data upto level "bits_per_block"
   layout->hz_block_count_array[0] = 1;
   
+  allocate_bitmap(layout);
+  
   return 1;
 }
 
 
+/// Per z-address bit, what it adds to the coordinates once set: the axis and the value
+struct block_walk_struct
+{
+  int axis[64];
+  int64_t value[64];
+  
+  /// below[p][d]: coordinate d with all the z-address bits under position p set
+  int64_t below[65][PIDX_MAX_DIMENSIONS];
+  
+  int H;
+  int bits_per_block;
+  int levels;
+  
+  /// The boxes to cover, and per level the indices of the boxes still overlapping the current subtree
+  int box_count;
+  int (*box)[2][PIDX_MAX_DIMENSIONS];
+  int *active;
+};
+
+
+static int box_overlaps(int box[2][PIDX_MAX_DIMENSIONS], const int64_t* from, const int64_t* to)
+{
+  int d;
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    if (to[d] < box[0][d] || from[d] >= box[1][d])
+      return 0;
+  return 1;
+}
+
+
+/// Visits the blocks numbered pow(2, m - 1) + t and below: the z-addresses whose m - 1 top bits are t.
+/// prefix holds the coordinates of those m - 1 bits; subtrees whose z range misses every box are skipped.
+static void walk_blocks(const struct block_walk_struct* walk, int m, int t, const int64_t* prefix, const int* active, int active_count, PIDX_block_layout layout)
+{
+  int b, d, count = 0, s = walk->H - m - walk->bits_per_block;
+  int *still_active = walk->active + m * walk->box_count;
+  int64_t from[PIDX_MAX_DIMENSIONS], to[PIDX_MAX_DIMENSIONS];
+  
+  // every sample under this prefix
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    to[d] = prefix[d] + walk->below[walk->H - m + 1][d];
+  for (b = 0; b < active_count; b++)
+    if (box_overlaps(walk->box[active[b]], prefix, to))
+      still_active[count++] = active[b];
+  if (count == 0)
+    return;
+  
+  // the block itself: the level bit at s, the bits_per_block bits above it free
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    from[d] = prefix[d] + (walk->axis[s] == d ? walk->value[s] : 0);
+    to[d] = from[d] + walk->below[s + walk->bits_per_block + 1][d] - walk->below[s + 1][d];
+  }
+  for (b = 0; b < count; b++)
+  {
+    if (box_overlaps(walk->box[still_active[b]], from, to))
+    {
+      layout->hz_block_count_array[m] = layout->hz_block_count_array[m] + 1;
+      layout->hz_block_number_array[m][t] = (1 << (m - 1)) + t;
+      set_block(layout, (1 << (m - 1)) + t);
+      break;
+    }
+  }
+  
+  if (m + 1 >= walk->levels)
+    return;
+  
+  // the next level fixes one more bit, at position H - m
+  walk_blocks(walk, m + 1, 2 * t, prefix, still_active, count, layout);
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    from[d] = prefix[d] + (walk->axis[walk->H - m] == d ? walk->value[walk->H - m] : 0);
+  walk_blocks(walk, m + 1, 2 * t + 1, from, still_active, count, layout);
+}
+
+
 ///
 int PIDX_blocks_create_layout (int bounding_box[2][5], int blocks_per_file, int bits_per_block, int maxH, const char* bitPattern, PIDX_block_layout layout)
 {
-  int i = 0, j = 0, m = 0, n_blocks = 1, ctr = 1, t = 0, block_number = 1;
-  int64_t hz_from = 0, hz_to = 0;
-  int64_t *ZYX_from, *ZYX_to;
+  return PIDX_blocks_create_layout_from_boxes(1, (int (*)[2][PIDX_MAX_DIMENSIONS])bounding_box, blocks_per_file, bits_per_block, maxH, bitPattern, layout);
+}
+
+
+///
+int PIDX_blocks_create_layout_from_boxes(int box_count, int (*boxes)[2][PIDX_MAX_DIMENSIONS], int blocks_per_file, int bits_per_block, int maxH, const char* bitPattern, PIDX_block_layout layout)
+{
+  int i = 0, j = 0, p = 0, d = 0, ctr = 1;
+  int count[PIDX_MAX_DIMENSIONS] = {0, 0, 0, 0, 0};
+  int64_t prefix[PIDX_MAX_DIMENSIONS] = {0, 0, 0, 0, 0};
+  struct block_walk_struct walk;
   
   if (maxH < bits_per_block)
     layout->levels = 1;
@@ -82,54 +243,46 @@ int PIDX_blocks_create_layout (int bounding_box[2][5], int blocks_per_file, int
   {
     layout->hz_block_count_array[j] = 0;
     layout->hz_block_number_array[j] = (int*)malloc(sizeof(int) * ctr);
+    memset(layout->hz_block_number_array[j], 0, sizeof(int) * ctr);
     ctr = ctr * 2;
   }
-  ctr = 1;
   layout->hz_block_number_array[0][0] = 0;
-  for (j = 1 ; j < (layout->levels) ; j++)
-  {
-    for (i = 0 ; i < ctr ; i++)
-    {
-      layout->hz_block_number_array[j][i] = 0;
-    }
-    ctr = ctr * 2;
-  }
   
   /// This block contains data upto level "bits_per_block"
   layout->hz_block_count_array[0] = 1;
   
-  hz_from = (int64_t)(block_number - 1) * pow(2, bits_per_block);
-  hz_to = (int64_t)(block_number * pow(2, bits_per_block)) - 1;
+  allocate_bitmap(layout);
   
-  for (m = 1 ; m < (maxH - bits_per_block); m++)
+  if (layout->levels > 1 && box_count > 0)
   {
-    n_blocks = pow(2, (m - 1));
-    for (t = 0 ; t < n_blocks ; t++)
+    // same bit order as Hz_to_xyz(bitPattern, maxH - 1, ...): z-address bit p belongs to axis bitPattern[H - p]
+    memset(&walk, 0, sizeof (walk));
+    walk.H = maxH - 1;
+    walk.bits_per_block = bits_per_block;
+    walk.levels = layout->levels;
+    for (p = 0; p < walk.H; p++)
     {
-      block_number = block_number + 1;
-      
-      hz_from = (int64_t)(block_number - 1) * pow(2, bits_per_block);
-      hz_to = (int64_t)(block_number * pow(2, bits_per_block)) - 1;
+      walk.axis[p] = bitPattern[walk.H - p];
+      walk.value[p] = ((int64_t)1) << count[walk.axis[p]];
+      count[walk.axis[p]]++;
       
-      ZYX_to = (int64_t*) malloc(sizeof(int64_t) * PIDX_MAX_DIMENSIONS);
-      ZYX_from = (int64_t*) malloc(sizeof(int64_t) * PIDX_MAX_DIMENSIONS);
-      
-      Hz_to_xyz(bitPattern, maxH - 1, hz_from, ZYX_from);
-      Hz_to_xyz(bitPattern, maxH - 1, hz_to, ZYX_to);
-      
-      if (ZYX_to[0] >= bounding_box[0][0] && ZYX_from[0] < bounding_box[1][0] && ZYX_to[1] >= bounding_box[0][1] && ZYX_from[1] < bounding_box[1][1] && ZYX_to[2] >= bounding_box[0][2] && ZYX_from[2] < bounding_box[1][2] && ZYX_to[3] >= bounding_box[0][3] && ZYX_from[3] < bounding_box[1][3] && ZYX_to[4] >= bounding_box[0][4] && ZYX_from[4] < bounding_box[1][4])
-      {
-        layout->hz_block_count_array[m] = layout->hz_block_count_array[m] + 1;
-        layout->hz_block_number_array[m][t] = block_number - 1;
-      }
-      
-      free(ZYX_from);
-      ZYX_from = 0;
-      free(ZYX_to);
-      ZYX_to = 0;
+      for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+        walk.below[p + 1][d] = walk.below[p][d] + (walk.axis[p] == d ? walk.value[p] : 0);
     }
+    
+    walk.box_count = box_count;
+    walk.box = boxes;
+    walk.active = malloc(sizeof(int) * box_count * (layout->levels + 1));
+    for (i = 0; i < box_count; i++)
+      walk.active[i] = i;
+    
+    walk_blocks(&walk, 1, 0, prefix, walk.active, box_count, layout);
+    
+    free(walk.active);
   }
   
+  build_rank(layout);
+  
   return 0;
 }
 
@@ -153,32 +306,38 @@ void PIDX_blocks_print_layout(PIDX_block_layout layout)
 
 
 ///
-int PIDX_blocks_is_block_present(int block_number, /*int bits_per_block,*/ PIDX_block_layout layout)
+void PIDX_blocks_index_layout(PIDX_block_layout layout)
 {
-  long i, j;
-  
-  if (block_number == 0)
-    return 1;
+  int i, j;
   
+  memset(layout->block_bitmap, 0, sizeof(uint64_t) * (layout->block_count / BITMAP_WORD_BITS + 1));
+  layout->block_bitmap[0] = 1;
   for (i = 1 ; i < layout->levels ; i++)
     for (j = 0 ; j < layout->hz_block_count_array[i] ; j++)
-      if (layout->hz_block_number_array[i][j] == block_number)
-        return 1;
-    
-  return(0);
+      if (layout->hz_block_number_array[i][j] > 0 && layout->hz_block_number_array[i][j] < layout->block_count)
+        set_block(layout, layout->hz_block_number_array[i][j]);
+  
+  build_rank(layout);
+}
+
+
+///
+int PIDX_blocks_is_block_present(int block_number, /*int bits_per_block,*/ PIDX_block_layout layout)
+{
+  if (block_number < 0 || block_number >= layout->block_count)
+    return 0;
+  
+  return (layout->block_bitmap[block_number / BITMAP_WORD_BITS] >> (block_number % BITMAP_WORD_BITS)) & 1;
 }
 
 
 ///
 int PIDX_blocks_find_negative_offset(int blocks_per_file, int block_number, PIDX_block_layout layout)
 {
-  int b;
-  int file_no = block_number/blocks_per_file;
-  int block_offset = 0;
-  for (b = file_no * blocks_per_file ; b < block_number; b++)
-    if (!PIDX_blocks_is_block_present(b, layout))
-      block_offset++;
-  return block_offset;
+  int file_start = (block_number / blocks_per_file) * blocks_per_file;
+  
+  // blocks of the file before block_number minus the filled ones among them
+  return (block_number - file_start) - (rank(layout, block_number) - rank(layout, file_start));
 }
 
 
@@ -195,4 +354,82 @@ void PIDX_blocks_free_layout(PIDX_block_layout layout)
   free(layout->hz_block_number_array);
   layout->hz_block_number_array = 0;
   layout->levels = 0;
+  
+  free(layout->block_bitmap);
+  layout->block_bitmap = 0;
+  free(layout->block_rank);
+  layout->block_rank = 0;
+  layout->block_count = 0;
+}
+
+
+///
+int PIDX_blocks_create_offset_table(PIDX_block_layout layout, int file_count, int blocks_per_file, int variable_count, const uint64_t* block_size, PIDX_block_offset_table table)
+{
+  int i, f, v, block_count = file_count * blocks_per_file;
+  
+  table->file_count = file_count;
+  table->blocks_per_file = blocks_per_file;
+  table->variable_count = variable_count;
+  
+  table->block_index = malloc(sizeof(int) * block_count);
+  table->file_block_count = malloc(sizeof(int) * file_count);
+  table->block_size = malloc(sizeof(uint64_t) * (variable_count > 0 ? variable_count : 1));
+  table->variable_offset = malloc(sizeof(off_t) * file_count * (variable_count > 0 ? variable_count : 1));
+  if (table->block_index == NULL || table->file_block_count == NULL || table->block_size == NULL || table->variable_offset == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    PIDX_blocks_free_offset_table(table);
+    return 1;
+  }
+  
+  for (f = 0; f < file_count; f++)
+  {
+    table->file_block_count[f] = 0;
+    for (i = f * blocks_per_file; i < (f + 1) * blocks_per_file; i++)
+      table->block_index[i] = PIDX_blocks_is_block_present(i, layout) ? table->file_block_count[f]++ : -1;
+  }
+  
+  // the variables follow each other in every file, each one taking all the blocks present in the file
+  for (v = 0; v < variable_count; v++)
+    table->block_size[v] = block_size[v];
+  for (f = 0; f < file_count; f++)
+  {
+    off_t offset = 0;
+    for (v = 0; v < variable_count; v++)
+    {
+      table->variable_offset[f * variable_count + v] = offset;
+      offset = offset + (off_t)table->file_block_count[f] * table->block_size[v];
+    }
+  }
+  
+  return 0;
+}
+
+
+///
+off_t PIDX_blocks_find_offset(PIDX_block_offset_table table, int variable_index, int block_number)
+{
+  int file_number = block_number / table->blocks_per_file;
+  
+  if (block_number < 0 || file_number >= table->file_count || variable_index >= table->variable_count || table->block_index[block_number] == -1)
+    return -1;
+  
+  return table->variable_offset[file_number * table->variable_count + variable_index] + (off_t)table->block_index[block_number] * table->block_size[variable_index];
+}
+
+
+///
+void PIDX_blocks_free_offset_table(PIDX_block_offset_table table)
+{
+  free(table->block_index);
+  table->block_index = 0;
+  free(table->file_block_count);
+  table->file_block_count = 0;
+  free(table->block_size);
+  table->block_size = 0;
+  free(table->variable_offset);
+  table->variable_offset = 0;
+  table->file_count = 0;
+  table->variable_count = 0;
 }
@@ -32,10 +32,48 @@ struct PIDX_block_layout_struct
   
   /// Indices of filled blocks
   int ** hz_block_number_array;
+  
+  /// Number of block numbers covered by the bitmap (pow(2, levels - 1))
+  int block_count;
+  
+  /// One bit per block number, set if the block is filled
+  uint64_t *block_bitmap;
+  
+  /// Per 512 bit group of the bitmap: number of filled blocks before it
+  int *block_rank;
 };
 typedef struct PIDX_block_layout_struct* PIDX_block_layout;
 
 
+/// Where the blocks of every variable are in the binary files. Built once per
+/// layout so that the I/O and header code never scans the layout per run of samples.
+struct PIDX_block_offset_table_struct
+{
+  /// Number of files and blocks per file covered by the table
+  int file_count;
+  int blocks_per_file;
+  
+  /// Number of variables laid out in every file
+  int variable_count;
+  
+  /// Per block: index among the blocks present in its file (-1 if absent)
+  int *block_index;
+  
+  /// Per file: number of blocks present
+  int *file_block_count;
+  
+  /// Per variable: bytes of one block
+  uint64_t *block_size;
+  
+  /// Per file and variable (file * variable_count + variable): offset of the first block of the variable, from the start of the data
+  off_t *variable_offset;
+};
+typedef struct PIDX_block_offset_table_struct* PIDX_block_offset_table;
+
+
+/// Bits of the block bitmap that are summed up in one entry of block_rank
+#define PIDX_BLOCK_RANK_BITS 512
+
 /// Initialize the block layout structure.
 /// \param  layout create block layout
 /// \param maxh  maximum HZ levels
@@ -48,19 +86,49 @@ int PIDX_blocks_initialize_layout(PIDX_block_layout layout, int maxh, int bits_p
 int PIDX_blocks_create_layout(int bounding_box[2][5], int blocks_per_file, int bits_per_block, int maxH, const char* bitPattern, PIDX_block_layout layout);
 
 
+/// Same as PIDX_blocks_create_layout, keeping only the blocks that overlap at least one of the boxes
+/// (for sparse domains: the layout then covers the union of the patches instead of their bounding box).
+/// \param box_count number of boxes
+/// \param boxes the boxes, [0] is the first sample and [1] one past the last one
+int PIDX_blocks_create_layout_from_boxes(int box_count, int (*boxes)[2][PIDX_MAX_DIMENSIONS], int blocks_per_file, int bits_per_block, int maxH, const char* bitPattern, PIDX_block_layout layout);
+
+
 ///
 void PIDX_blocks_print_layout(PIDX_block_layout layout);
 
 
-///
+/// Rebuilds the bitmap and rank index from hz_block_number_array, for code that fills the arrays by hand.
+void PIDX_blocks_index_layout(PIDX_block_layout layout);
+
+
+/// Tests the bitmap, O(1).
 int PIDX_blocks_is_block_present(int block_number, PIDX_block_layout layout);
 
 
-///
+/// Number of empty blocks before block_number in its file, O(1) with the rank index.
 int PIDX_blocks_find_negative_offset(int blocks_per_file, int block_number, PIDX_block_layout layout );
 
 
 ///
 void PIDX_blocks_free_layout(PIDX_block_layout layout);
 
+
+/// Builds the offset table of a layout.
+/// \param layout the (global) block layout
+/// \param file_count number of files
+/// \param blocks_per_file blocks per file
+/// \param variable_count number of variables in every file
+/// \param block_size bytes of one block of every variable (samples_per_block * values_per_sample * bytes per value)
+/// \param table the table to fill
+/// \return Error code
+int PIDX_blocks_create_offset_table(PIDX_block_layout layout, int file_count, int blocks_per_file, int variable_count, const uint64_t* block_size, PIDX_block_offset_table table);
+
+
+/// Byte offset of a block of a variable from the start of the data in its file, -1 if the block is absent
+off_t PIDX_blocks_find_offset(PIDX_block_offset_table table, int variable_index, int block_number);
+
+
+///
+void PIDX_blocks_free_offset_table(PIDX_block_offset_table table);
+
 #endif
@@ -27,7 +27,14 @@
  *
  */
 
+#define _GNU_SOURCE
 #include "PIDX_inc.h"
+#include <sched.h>
+
+/// Values coded by one task of the brick codec (a chunk holds at least one brick)
+#define PIDX_COMPRESSION_CHUNK_VALUES 65536
+
+enum IO_MODE { PIDX_READ, PIDX_WRITE};
 
 ///Struct for restructuring ID
 struct PIDX_compression_id_struct 
@@ -91,14 +98,535 @@ int PIDX_compression_set_communicator(PIDX_compression_id compression_id, MPI_Co
 }
 #endif
 
+int PIDX_compression_thread_count(idx_dataset idx_meta_data)
+{
+  int thread_count = 1;
+
+  if (idx_meta_data->compression_thread_count > 0)
+    return idx_meta_data->compression_thread_count;
+
+  // with MPI the processes of a node share its cores, as for the read threads
+#if !PIDX_HAVE_MPI
+#if defined(CPU_COUNT)
+  cpu_set_t cpu_set;
+  if (sched_getaffinity(0, sizeof (cpu_set), &cpu_set) == 0)
+    thread_count = CPU_COUNT(&cpu_set);
+#elif defined(_SC_NPROCESSORS_ONLN)
+  thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+#endif
+
+  return (thread_count > 0) ? thread_count : 1;
+}
+
+/// Chunks shared by the threads of PIDX_compression_run
+struct run_struct
+{
+  PIDX_compression_task task;
+  void* arg;
+  int64_t count;
+  int64_t chunk_size;
+  int64_t chunk_count;
+  int64_t next_chunk;                                   ///< first chunk no thread has taken yet
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_t lock;
+#endif
+};
+
+static void* run_thread(void* arg)
+{
+  int64_t chunk, begin, end;
+  struct run_struct* run = (struct run_struct*)arg;
+
+  while (1)
+  {
+#if PIDX_HAVE_PTHREADS
+    pthread_mutex_lock(&run->lock);
+#endif
+    chunk = run->next_chunk++;
+#if PIDX_HAVE_PTHREADS
+    pthread_mutex_unlock(&run->lock);
+#endif
+    if (chunk >= run->chunk_count)
+      break;
+
+    begin = chunk * run->chunk_size;
+    end = min(begin + run->chunk_size, run->count);
+    run->task(run->arg, begin, end, chunk);
+  }
+
+  return NULL;
+}
+
+#if PIDX_HAVE_PTHREADS
+
+/// Threads of PIDX_compression_run, started on first use and kept for the lifetime of the process.
+/// They work on one run at a time; a run started while another one is going on (another thread of the
+/// process, or a task that runs codecs itself) is done by its calling thread alone.
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;    ///< signalled when a run is posted
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;    ///< signalled when a thread leaves the run
+static int pool_size = 0;                                       ///< threads started
+static int pool_wanted = 0;                                     ///< threads that may still join the run
+static int pool_busy = 0;                                       ///< threads working on the run
+static struct run_struct* pool_run = NULL;                      ///< the run going on (NULL if none)
+
+static void* pool_thread(void* arg)
+{
+  struct run_struct* run;
+
+  pthread_mutex_lock(&pool_lock);
+  while (1)
+  {
+    while (pool_wanted == 0)
+      pthread_cond_wait(&pool_work, &pool_lock);
+
+    pool_wanted--;
+    pool_busy++;
+    run = pool_run;
+    pthread_mutex_unlock(&pool_lock);
+
+    run_thread(run);
+
+    pthread_mutex_lock(&pool_lock);
+    pool_busy--;
+    if (pool_busy == 0)
+      pthread_cond_signal(&pool_done);
+  }
+
+  return NULL;
+}
+
+#endif
+
+int PIDX_compression_run(int thread_count, int64_t count, int64_t chunk_size, PIDX_compression_task task, void* arg)
+{
+  struct run_struct run;
+
+  if (count <= 0)
+    return 0;
+
+  memset(&run, 0, sizeof (run));
+  run.task = task;
+  run.arg = arg;
+  run.count = count;
+  run.chunk_size = (chunk_size > 0) ? chunk_size : 1;
+  run.chunk_count = (count + run.chunk_size - 1) / run.chunk_size;
+
+  if (thread_count > run.chunk_count)
+    thread_count = run.chunk_count;
+
+#if PIDX_HAVE_PTHREADS
+  if (thread_count > 1)
+  {
+    pthread_t thread;
+
+    pthread_mutex_lock(&pool_lock);
+    if (pool_run != NULL)
+    {
+      pthread_mutex_unlock(&pool_lock);
+      run_thread(&run);
+      return 0;
+    }
+
+    // with fewer threads the ones started (and the calling thread) take the remaining chunks
+    while (pool_size < thread_count - 1 && pthread_create(&thread, NULL, pool_thread, NULL) == 0)
+    {
+      pthread_detach(thread);
+      pool_size++;
+    }
+
+    pthread_mutex_init(&run.lock, NULL);
+    pool_run = &run;
+    pool_wanted = min(thread_count - 1, pool_size);
+    pthread_cond_broadcast(&pool_work);
+    pthread_mutex_unlock(&pool_lock);
+
+    run_thread(&run);
+
+    // all the chunks are taken, the threads that did not join by now stay out of it
+    pthread_mutex_lock(&pool_lock);
+    pool_wanted = 0;
+    while (pool_busy > 0)
+      pthread_cond_wait(&pool_done, &pool_lock);
+    pool_run = NULL;
+    pthread_mutex_unlock(&pool_lock);
+    pthread_mutex_destroy(&run.lock);
+
+    return 0;
+  }
+#endif
+
+  run_thread(&run);
+  return 0;
+}
+
+/// Number of values in a brick
+static int64_t brick_value_count(idx_dataset idx_meta_data)
+{
+  int d;
+  int64_t count = 1;
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    count = count * idx_meta_data->compression_block_size[d];
+  return count;
+}
+
+/// Bits per code of the lossy codec for a variable, 0 if the variable is stored raw
+static int code_bits(idx_dataset idx_meta_data, int variable_index)
+{
+  PIDX_variable var = idx_meta_data->variable[variable_index];
+  int64_t n = brick_value_count(idx_meta_data);
+  int64_t q;
+
+  if (n <= 1)
+    return 0;
+
+  // only floating point types, the codes are offsets between the brick minimum and maximum
+  if (strstr(var->type_name, "float") == NULL || (var->bits_per_value != 32 && var->bits_per_value != 64))
+    return 0;
+
+  // the brick minimum and maximum are stored in full, in the fixed rate modes the rest of the budget goes to the codes
+  switch (var->compression_mode)
+  {
+    case PIDX_COMPRESSION_FILE_DEFAULT:
+      if (idx_meta_data->compression_type != PIDX_LOSSY_COMPRESSION)
+        return 0;
+      q = (n * idx_meta_data->compression_bit_rate - 2 * var->bits_per_value) / n;
+      break;
+
+    case PIDX_COMPRESSION_FIXED_RATE:
+      q = (int64_t)((n * var->compression_param - 2 * var->bits_per_value) / n);
+      break;
+
+    case PIDX_COMPRESSION_FIXED_PRECISION:
+      q = (int64_t)var->compression_param;
+      break;
+
+    case PIDX_COMPRESSION_FIXED_ACCURACY:
+      q = var->compression_bits;
+      break;
+
+    default:
+      return 0;
+  }
+
+  if (q > 52)
+    q = 52;
+  if (q < 1 || 2 * var->bits_per_value + n * q >= n * var->bits_per_value)
+    return 0;
+
+  return (int)q;
+}
+
+int PIDX_compression_bytes_per_brick(idx_dataset idx_meta_data, int variable_index)
+{
+  PIDX_variable var = idx_meta_data->variable[variable_index];
+  int64_t n = brick_value_count(idx_meta_data);
+  int q = code_bits(idx_meta_data, variable_index);
+
+  if (q == 0)
+    return (int)(n * (var->bits_per_value / 8));
+
+  return (int)(2 * (var->bits_per_value / 8) + (n * q + 7) / 8);
+}
+
+static double get_value(const unsigned char* buffer, int64_t i, int bits_per_value)
+{
+  if (bits_per_value == 32)
+  {
+    float value;
+    memcpy(&value, buffer + i * sizeof(float), sizeof(float));
+    return value;
+  }
+  else
+  {
+    double value;
+    memcpy(&value, buffer + i * sizeof(double), sizeof(double));
+    return value;
+  }
+}
+
+static void set_value(unsigned char* buffer, int64_t i, int bits_per_value, double value)
+{
+  if (bits_per_value == 32)
+  {
+    float f = (float)value;
+    memcpy(buffer + i * sizeof(float), &f, sizeof(float));
+  }
+  else
+    memcpy(buffer + i * sizeof(double), &value, sizeof(double));
+}
+
+int PIDX_compression_value_range(idx_dataset idx_meta_data, int variable_index, double* minimum, double* maximum)
+{
+  int p, d;
+  int64_t i, count;
+  double value;
+  PIDX_variable var = idx_meta_data->variable[variable_index];
+
+  *minimum = DBL_MAX;
+  *maximum = -DBL_MAX;
+
+  if (strstr(var->type_name, "float") == NULL || (var->bits_per_value != 32 && var->bits_per_value != 64))
+    return 0;
+
+  for (p = 0; p < var->patch_count; p++)
+  {
+    count = var->values_per_sample;
+    for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      count = count * var->patch[p]->Ndim_box_size[d];
+
+    for (i = 0; i < count; i++)
+    {
+      value = get_value(var->patch[p]->Ndim_box_buffer, i, var->bits_per_value);
+      if (value < *minimum)
+        *minimum = value;
+      if (value > *maximum)
+        *maximum = value;
+    }
+  }
+
+  return 0;
+}
+
+int PIDX_compression_accuracy_bits(double minimum, double maximum, double tolerance)
+{
+  int q = 1;
+
+  // NaN or infinite ranges and a zero tolerance cannot be met by the codes
+  if (!(tolerance > 0) || !(maximum - minimum <= DBL_MAX))
+    return 0;
+
+  // codes are rounded to the nearest of 2^q - 1 steps over the brick range (at most maximum - minimum), the
+  // error is half a step; one more bit than that covers the rounding of the reconstruction
+  while (q < 52 && (maximum - minimum) / ((((uint64_t)1) << q) - 1) > tolerance)
+    q++;
+
+  // double values do not have more bits than that
+  if ((maximum - minimum) / ((((uint64_t)1) << q) - 1) > tolerance)
+    return 0;
+
+  return q;
+}
+
+/// Errors and sizes of the bricks coded by one process
+struct code_stats
+{
+  double max_error;
+  double square_error;
+  double value_count;
+  double raw_bytes;
+  double coded_bytes;
+};
+
+/// Encodes the n values of one brick as (minimum, maximum, n codes of q bits)
+static void compress_brick(const unsigned char* in, unsigned char* out, int64_t n, int bits_per_value, int q, struct code_stats* stats)
+{
+  int64_t i;
+  int bytes_per_value = bits_per_value / 8;
+  int filled = 0;
+  uint64_t accumulator = 0, code;
+  double minimum, maximum, value, scale, step, error;
+  uint64_t max_code = (((uint64_t)1) << q) - 1;
+  unsigned char* codes = out + 2 * bytes_per_value;
+
+  minimum = maximum = get_value(in, 0, bits_per_value);
+  for (i = 1; i < n; i++)
+  {
+    value = get_value(in, i, bits_per_value);
+    if (value < minimum)
+      minimum = value;
+    if (value > maximum)
+      maximum = value;
+  }
+  set_value(out, 0, bits_per_value, minimum);
+  set_value(out, 1, bits_per_value, maximum);
+
+  scale = (maximum > minimum) ? max_code / (maximum - minimum) : 0;
+  step = (maximum - minimum) / max_code;
+  for (i = 0; i < n; i++)
+  {
+    value = (get_value(in, i, bits_per_value) - minimum) * scale;
+    // NaN and rounding past the end of the range
+    if (!(value >= 0))
+      code = 0;
+    else if (value >= max_code)
+      code = max_code;
+    else
+      code = (uint64_t)(value + 0.5);
+
+    // same reconstruction as decompress_brick
+    value = minimum + code * step;
+    if (bits_per_value == 32)
+      value = (float)value;
+    error = fabs(value - get_value(in, i, bits_per_value));
+    if (error > stats->max_error)
+      stats->max_error = error;
+    stats->square_error = stats->square_error + error * error;
+
+    // codes are packed least significant bit first
+    accumulator = accumulator | (code << filled);
+    filled = filled + q;
+    while (filled >= 8)
+    {
+      *codes++ = (unsigned char)(accumulator & 0xff);
+      accumulator = accumulator >> 8;
+      filled = filled - 8;
+    }
+  }
+  if (filled > 0)
+    *codes = (unsigned char)(accumulator & 0xff);
+}
+
+static void decompress_brick(const unsigned char* in, unsigned char* out, int64_t n, int bits_per_value, int q)
+{
+  int64_t i;
+  int bytes_per_value = bits_per_value / 8;
+  int filled = 0;
+  uint64_t accumulator = 0;
+  double minimum, maximum, step;
+  uint64_t max_code = (((uint64_t)1) << q) - 1;
+  const unsigned char* codes = in + 2 * bytes_per_value;
+
+  minimum = get_value(in, 0, bits_per_value);
+  maximum = get_value(in, 1, bits_per_value);
+  step = (maximum - minimum) / max_code;
+
+  for (i = 0; i < n; i++)
+  {
+    while (filled < q)
+    {
+      accumulator = accumulator | ((uint64_t)(*codes++) << filled);
+      filled = filled + 8;
+    }
+    set_value(out, i, bits_per_value, minimum + (accumulator & max_code) * step);
+    accumulator = accumulator >> q;
+    filled = filled - q;
+  }
+}
+
+/// Bricks of one restructured group coded by the threads of PIDX_compression_run
+struct code_task
+{
+  const unsigned char* in;
+  unsigned char* out;
+  int64_t n;                                            ///< values per brick
+  int bits_per_value;
+  int q;                                                ///< bits per code
+  int raw_brick_size;
+  int brick_size;
+  int MODE;
+  struct code_stats* chunk_stats;                       ///< statistics of every chunk (PIDX_WRITE), summed in chunk order
+};
+
+static void code_bricks(void* arg, int64_t begin, int64_t end, int64_t chunk)
+{
+  int64_t b;
+  struct code_task* task = (struct code_task*)arg;
+
+  for (b = begin; b < end; b++)
+  {
+    if (task->MODE == PIDX_WRITE)
+      compress_brick(task->in + b * task->raw_brick_size, task->out + b * task->brick_size, task->n, task->bits_per_value, task->q, &task->chunk_stats[chunk]);
+    else
+      decompress_brick(task->in + b * task->brick_size, task->out + b * task->raw_brick_size, task->n, task->bits_per_value, task->q);
+  }
+}
+
+/// Compresses (PIDX_WRITE) or decompresses (PIDX_READ) the restructured groups of a variable, the buffers are replaced.
+/// Every brick has its own slot in the output, so the bricks are coded by several threads.
+static int code_variable(PIDX_compression_id compression_id, int variable_index, int MODE)
+{
+  int g, q;
+  int64_t d, c, brick_count, n, chunk_size, chunk_count;
+  int raw_brick_size, brick_size;
+  PIDX_variable var = compression_id->idx_ptr->variable[variable_index];
+  struct code_stats stats;
+  struct code_task task;
+
+  memset(&stats, 0, sizeof (stats));
+  q = code_bits(compression_id->idx_ptr, variable_index);
+
+  n = brick_value_count(compression_id->idx_ptr);
+  raw_brick_size = n * (var->bits_per_value / 8);
+  brick_size = PIDX_compression_bytes_per_brick(compression_id->idx_ptr, variable_index);
+  chunk_size = max(PIDX_COMPRESSION_CHUNK_VALUES / n, 1);
+
+  for (g = 0; g < var->patch_group_count; g++)
+  {
+    Ndim_box box = var->post_rst_block[g]->box[0];
+
+    brick_count = var->values_per_sample;
+    for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      brick_count = brick_count * (box->Ndim_box_size[d] / compression_id->idx_ptr->compression_block_size[d]);
+
+    stats.value_count = stats.value_count + brick_count * n;
+    stats.raw_bytes = stats.raw_bytes + brick_count * raw_brick_size;
+    stats.coded_bytes = stats.coded_bytes + brick_count * brick_size;
+    if (q == 0)
+      continue;
+
+    memset(&task, 0, sizeof (task));
+    task.in = box->Ndim_box_buffer;
+    task.n = n;
+    task.bits_per_value = var->bits_per_value;
+    task.q = q;
+    task.raw_brick_size = raw_brick_size;
+    task.brick_size = brick_size;
+    task.MODE = MODE;
+
+    chunk_count = (brick_count + chunk_size - 1) / chunk_size;
+    task.out = malloc(brick_count * (MODE == PIDX_WRITE ? brick_size : raw_brick_size));
+    task.chunk_stats = malloc(max(chunk_count, 1) * sizeof (*task.chunk_stats));
+    if (task.out == NULL || task.chunk_stats == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+      free(task.out);
+      free(task.chunk_stats);
+      return -1;
+    }
+    memset(task.chunk_stats, 0, max(chunk_count, 1) * sizeof (*task.chunk_stats));
+
+    PIDX_compression_run(PIDX_compression_thread_count(compression_id->idx_ptr), brick_count, chunk_size, code_bricks, &task);
+
+    for (c = 0; c < chunk_count; c++)
+    {
+      if (task.chunk_stats[c].max_error > stats.max_error)
+        stats.max_error = task.chunk_stats[c].max_error;
+      stats.square_error = stats.square_error + task.chunk_stats[c].square_error;
+    }
+
+    free(task.chunk_stats);
+    free(box->Ndim_box_buffer);
+    box->Ndim_box_buffer = task.out;
+  }
+
+  if (MODE == PIDX_WRITE)
+  {
+    double sum[4] = {stats.square_error, stats.value_count, stats.raw_bytes, stats.coded_bytes};
+#if PIDX_HAVE_MPI
+    MPI_Allreduce(MPI_IN_PLACE, &stats.max_error, 1, MPI_DOUBLE, MPI_MAX, compression_id->comm);
+    MPI_Allreduce(MPI_IN_PLACE, sum, 4, MPI_DOUBLE, MPI_SUM, compression_id->comm);
+#endif
+    var->compression_max_error = stats.max_error;
+    var->compression_square_error = sum[0];
+    var->compression_value_count = sum[1];
+    var->compression_raw_bytes = sum[2];
+    var->compression_coded_bytes = sum[3];
+  }
+
+  return 0;
+}
+
 int PIDX_compression_prepare(PIDX_compression_id compression_id)
 {
+  int var;
+
 #if PIDX_HAVE_LOSSY_ZFP
-  if (compression_id->idx_ptr->compression_type == 1)           ///< Lossy
+  if (compression_id->idx_ptr->compression_type == PIDX_LOSSY_COMPRESSION)
   {
-    int var = 0;
     int dp;
-    double rate = 16;
+    double rate = compression_id->idx_ptr->compression_bit_rate;
     uint mx, my, mz;
     size_t typesize;
     size_t insize;
@@ -156,36 +684,425 @@ int PIDX_compression_prepare(PIDX_compression_id compression_id)
       //printf("before zip : after zip %d (%d x %d x %d x %d) %d\n", (int)insize, (int)compression_id->idx_ptr->compression_block_size[0], (int)compression_id->idx_ptr->compression_block_size[1], (int)compression_id->idx_ptr->compression_block_size[2], (int)typesize, (int)compression_id->idx_ptr->variable[var]->lossy_compressed_block_size);
     }
   }
-  else if (compression_id->idx_ptr->compression_type == 0)      /// Lossless
-  {
-    
-  }
 #endif
+
+  // the built-in codec decides the sizes, the ZFP estimate above is not used by the compress stage
+  for (var = compression_id->start_variable_index; var <= compression_id->end_variable_index; var++)
+    compression_id->idx_ptr->variable[var]->lossy_compressed_block_size = PIDX_compression_bytes_per_brick(compression_id->idx_ptr, var);
+
   return 0;
 }
 
 int PIDX_compression_compress(PIDX_compression_id compression_id)
 {
-  /*
-  size_t outsize;
-  for(var = compression_id->start_variable_index; var <= compression_id->end_variable_index; var++)
+  int var;
+  for (var = compression_id->start_variable_index; var <= compression_id->end_variable_index; var++)
+    if (code_variable(compression_id, var, PIDX_WRITE) == -1)
+      return -1;
+
+  return 0;
+}
+
+int PIDX_compression_brick_decode(idx_dataset idx_meta_data, int variable_index, const unsigned char* in, unsigned char* out)
+{
+  PIDX_variable var = idx_meta_data->variable[variable_index];
+  int64_t n = brick_value_count(idx_meta_data);
+  int q = code_bits(idx_meta_data, variable_index);
+
+  if (q == 0)
+    memcpy(out, in, n * (var->bits_per_value / 8));
+  else
+    decompress_brick(in, out, n, var->bits_per_value, q);
+
+  return 0;
+}
+
+int PIDX_compression_decompress(PIDX_compression_id compression_id)
+{
+  int var;
+  for (var = compression_id->start_variable_index; var <= compression_id->end_variable_index; var++)
+    if (code_variable(compression_id, var, PIDX_READ) == -1)
+      return -1;
+
+  return 0;
+}
+
+/// Number of entries of the match finder hash table (log2)
+#define PIDX_LZ_HASH_BITS 12
+
+/// Shortest match, matches are never closer than this to the end of a block and the last literals are stored as is
+#define PIDX_LZ_MIN_MATCH 4
+#define PIDX_LZ_TAIL 12
+
+/// Furthest match (two byte offsets)
+#define PIDX_LZ_MAX_OFFSET 65535
+
+static void shuffle_bytes(const unsigned char* in, uint64_t size, int bytes_per_value, unsigned char* out, int MODE)
+{
+  uint64_t i, n = size / bytes_per_value;
+  int b;
+
+  for (b = 0; b < bytes_per_value; b++)
+    for (i = 0; i < n; i++)
+    {
+      if (MODE == PIDX_WRITE)
+        out[b * n + i] = in[i * bytes_per_value + b];
+      else
+        out[i * bytes_per_value + b] = in[b * n + i];
+    }
+
+  // the bytes past the last full value are not shuffled
+  memcpy(out + n * bytes_per_value, in + n * bytes_per_value, size - n * bytes_per_value);
+}
+
+static uint32_t read_32(const unsigned char* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/// Writes a length that did not fit in its token nibble as a run of 255 and the remainder
+static int put_length(unsigned char** op, unsigned char* end, uint64_t length)
+{
+  while (length >= 255)
   {
-    
-    outsize = zfp_compress(&compression_id->params[var], f, zip, outsize);
-    if (outsize == 0) 
+    if (*op >= end)
+      return -1;
+    *(*op)++ = 255;
+    length = length - 255;
+  }
+  if (*op >= end)
+    return -1;
+  *(*op)++ = (unsigned char)length;
+  return 0;
+}
+
+/// One sequence: token (literal count, match length - PIDX_LZ_MIN_MATCH), literals, two byte offset.
+/// The last sequence of a block only has literals.
+static int put_sequence(unsigned char** op, unsigned char* end, const unsigned char* literals, uint64_t literal_count, uint32_t offset, uint64_t match_length)
+{
+  unsigned char* token = *op;
+  uint64_t match_code = (match_length == 0) ? 0 : match_length - PIDX_LZ_MIN_MATCH;
+
+  if (*op >= end)
+    return -1;
+  *token = (unsigned char)(((literal_count >= 15) ? 15 : literal_count) << 4 | ((match_code >= 15) ? 15 : match_code));
+  (*op)++;
+
+  if (literal_count >= 15 && put_length(op, end, literal_count - 15) == -1)
+    return -1;
+  if ((uint64_t)(end - *op) < literal_count)
+    return -1;
+  memcpy(*op, literals, literal_count);
+  *op = *op + literal_count;
+
+  if (match_length == 0)
+    return 0;
+
+  if (end - *op < 2)
+    return -1;
+  *(*op)++ = (unsigned char)(offset & 0xff);
+  *(*op)++ = (unsigned char)(offset >> 8);
+  if (match_code >= 15 && put_length(op, end, match_code - 15) == -1)
+    return -1;
+
+  return 0;
+}
+
+static int64_t lz_encode(const unsigned char* in, uint64_t size, unsigned char* out, uint64_t capacity)
+{
+  uint32_t table[1 << PIDX_LZ_HASH_BITS];
+  uint64_t ip = 0, anchor = 0, reference, length;
+  uint32_t value, hash;
+  unsigned char* op = out;
+  unsigned char* end = out + capacity;
+
+  // positions are stored + 1, 0 is an empty slot
+  memset(table, 0, sizeof(table));
+
+  while (size > PIDX_LZ_TAIL && ip < size - PIDX_LZ_TAIL)
+  {
+    value = read_32(in + ip);
+    hash = (value * 2654435761u) >> (32 - PIDX_LZ_HASH_BITS);
+    reference = table[hash];
+    table[hash] = (uint32_t)(ip + 1);
+
+    if (reference == 0 || ip + 1 - reference > PIDX_LZ_MAX_OFFSET || read_32(in + reference - 1) != value)
+    {
+      ip++;
+      continue;
+    }
+    reference--;
+
+    length = PIDX_LZ_MIN_MATCH;
+    while (ip + length < size - PIDX_LZ_TAIL && in[reference + length] == in[ip + length])
+      length++;
+
+    if (put_sequence(&op, end, in + anchor, ip - anchor, (uint32_t)(ip - reference), length) == -1)
+      return -1;
+
+    ip = ip + length;
+    anchor = ip;
+  }
+
+  if (put_sequence(&op, end, in + anchor, size - anchor, 0, 0) == -1)
+    return -1;
+
+  return op - out;
+}
+
+/// Reads a length continued past its token nibble
+static int get_length(const unsigned char** ip, const unsigned char* end, uint64_t* length)
+{
+  unsigned char byte;
+  do
+  {
+    if (*ip >= end)
+      return -1;
+    byte = *(*ip)++;
+    *length = *length + byte;
+  }
+  while (byte == 255);
+  return 0;
+}
+
+static int lz_decode(const unsigned char* in, uint64_t coded_size, unsigned char* out, uint64_t size)
+{
+  const unsigned char* ip = in;
+  const unsigned char* end = in + coded_size;
+  uint64_t op = 0, literal_count, match_length, offset, i;
+  unsigned char token;
+
+  while (ip < end)
+  {
+    token = *ip++;
+
+    literal_count = token >> 4;
+    if (literal_count == 15 && get_length(&ip, end, &literal_count) == -1)
+      return -1;
+    if ((uint64_t)(end - ip) < literal_count || size - op < literal_count)
+      return -1;
+    memcpy(out + op, ip, literal_count);
+    ip = ip + literal_count;
+    op = op + literal_count;
+
+    // the last sequence has no match
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      return -1;
+    offset = ip[0] | (ip[1] << 8);
+    ip = ip + 2;
+    match_length = token & 15;
+    if (match_length == 15 && get_length(&ip, end, &match_length) == -1)
+      return -1;
+    match_length = match_length + PIDX_LZ_MIN_MATCH;
+
+    if (offset == 0 || offset > op || size - op < match_length)
+      return -1;
+    // the match may overlap the bytes it produces
+    for (i = 0; i < match_length; i++)
+      out[op + i] = out[op - offset + i];
+    op = op + match_length;
+  }
+
+  return (op == size) ? 0 : -1;
+}
+
+int64_t PIDX_compression_lossless_encode(const unsigned char* in, uint64_t size, int bytes_per_value, unsigned char* out, uint64_t capacity)
+{
+  int64_t coded_size;
+  unsigned char* shuffled = malloc(size);
+  if (shuffled == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  shuffle_bytes(in, size, (bytes_per_value > 0) ? bytes_per_value : 1, shuffled, PIDX_WRITE);
+  coded_size = lz_encode(shuffled, size, out, capacity);
+
+  free(shuffled);
+  return coded_size;
+}
+
+int PIDX_compression_lossless_decode(const unsigned char* in, uint64_t coded_size, int bytes_per_value, unsigned char* out, uint64_t size)
+{
+  int ret;
+  unsigned char* shuffled = malloc(size);
+  if (shuffled == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  ret = lz_decode(in, coded_size, shuffled, size);
+  if (ret == 0)
+    shuffle_bytes(shuffled, size, (bytes_per_value > 0) ? bytes_per_value : 1, out, PIDX_READ);
+
+  free(shuffled);
+  return ret;
+}
+
+/// Bytes of a block the adaptive codec trial codes (in PIDX_BLOCK_SAMPLE_SLICES slices spread over the block)
+/// to estimate what the lossless codec would make of the whole block
+#define PIDX_BLOCK_SAMPLE_BYTES 16384
+#define PIDX_BLOCK_SAMPLE_SLICES 4
+
+/// Lossless size of a block estimated from a sample, the whole block size if the sample does not shrink
+/// (0 for blocks no larger than a sample, the codec is tried on them directly)
+static uint64_t lossless_estimate(const unsigned char* in, uint64_t size, int bytes_per_value)
+{
+  int s;
+  int64_t coded;
+  uint64_t slice, sample_size, estimate = size;
+  unsigned char *sample, *coded_sample;
+
+  if (size <= PIDX_BLOCK_SAMPLE_BYTES)
+    return 0;
+
+  // slices of whole values, so the shuffle of the sample lines up with the shuffle of the block
+  slice = (PIDX_BLOCK_SAMPLE_BYTES / PIDX_BLOCK_SAMPLE_SLICES / bytes_per_value) * bytes_per_value;
+  sample_size = slice * PIDX_BLOCK_SAMPLE_SLICES;
+  sample = malloc(2 * sample_size);
+  if (sample == NULL)
+    return estimate;
+  coded_sample = sample + sample_size;
+
+  for (s = 0; s < PIDX_BLOCK_SAMPLE_SLICES; s++)
+    memcpy(sample + s * slice, in + ((size - slice) / (PIDX_BLOCK_SAMPLE_SLICES - 1) * s / bytes_per_value) * bytes_per_value, slice);
+
+  coded = PIDX_compression_lossless_encode(sample, sample_size, bytes_per_value, coded_sample, sample_size - 1);
+  if (coded > 0)
+    estimate = (uint64_t)((double)coded / sample_size * size);
+
+  free(sample);
+  return estimate;
+}
+
+int64_t PIDX_compression_block_encode(const unsigned char* in, uint64_t size, int bits_per_value, double tolerance, unsigned char* out, uint64_t capacity, int* codec)
+{
+  int q = 0;
+  int64_t coded;
+  uint64_t i, n, lossy_size = size, lossless_size;
+  int bytes_per_value = bits_per_value / 8;
+  double value, minimum, maximum;
+  struct code_stats stats;
+
+  *codec = PIDX_BLOCK_RAW;
+  if (bytes_per_value < 1 || size % bytes_per_value != 0)
+    bytes_per_value = 1;
+  n = size / bytes_per_value;
+  if (n == 0)
+    return 0;
+
+  // constant blocks (masks, untouched regions) keep one value
+  for (i = 1; i < n; i++)
+    if (memcmp(in, in + i * bytes_per_value, bytes_per_value) != 0)
+      break;
+  if (i == n)
+  {
+    if ((uint64_t)bytes_per_value > capacity)
+      return 0;
+    memcpy(out, in, bytes_per_value);
+    *codec = PIDX_BLOCK_CONSTANT;
+    return bytes_per_value;
+  }
+
+  // the lossy size follows from the value range, (bits per code, minimum, maximum, codes)
+  if (tolerance > 0 && (bits_per_value == 32 || bits_per_value == 64))
+  {
+    minimum = maximum = get_value(in, 0, bits_per_value);
+    for (i = 0; i < n; i++)
+    {
+      value = get_value(in, i, bits_per_value);
+      if (!(value == value) || fabs(value) > DBL_MAX)
+        break;
+      if (value < minimum)
+        minimum = value;
+      if (value > maximum)
+        maximum = value;
+    }
+    // no lossy coding with NaN or infinite values
+    if (i == n)
+    {
+      // the block stays lossless or raw if no number of bits meets the tolerance
+      q = PIDX_compression_accuracy_bits(minimum, maximum, tolerance);
+      if (q != 0)
+        lossy_size = 1 + 2 * bytes_per_value + (n * q + 7) / 8;
+    }
+  }
+
+  // the lossless codec runs on the whole block only if a sample of it says it beats the other codecs
+  lossless_size = lossless_estimate(in, size, bytes_per_value);
+  if (lossless_size < size && lossless_size < lossy_size)
+  {
+    coded = PIDX_compression_lossless_encode(in, size, bytes_per_value, out, min(capacity, min(size, lossy_size) - 1));
+    if (coded > 0)
     {
-      fprintf(stderr, "compression failed\n");
-      return EXIT_FAILURE;
+      *codec = PIDX_BLOCK_LOSSLESS;
+      return coded;
     }
-    rate = CHAR_BIT * (double)outsize / (mx * my * mz);
   }
-  */
+
+  if (lossy_size < size && lossy_size <= capacity)
+  {
+    memset(&stats, 0, sizeof (stats));
+    out[0] = (unsigned char)q;
+    compress_brick(in, out + 1, n, bits_per_value, q, &stats);
+    *codec = PIDX_BLOCK_LOSSY;
+    return lossy_size;
+  }
+
+  return 0;
+}
+
+int PIDX_compression_block_decode(const unsigned char* in, uint64_t coded_size, int codec, int bits_per_value, unsigned char* out, uint64_t size)
+{
+  int q;
+  uint64_t i, n;
+  int bytes_per_value = bits_per_value / 8;
+
+  if (bytes_per_value < 1 || size % bytes_per_value != 0)
+    bytes_per_value = 1;
+  n = size / bytes_per_value;
+
+  switch (codec)
+  {
+    case PIDX_BLOCK_RAW:
+      if (coded_size != size)
+        return -1;
+      memmove(out, in, size);
+      return 0;
+
+    case PIDX_BLOCK_CONSTANT:
+      if (coded_size != (uint64_t)bytes_per_value)
+        return -1;
+      for (i = 0; i < n; i++)
+        memcpy(out + i * bytes_per_value, in, bytes_per_value);
+      return 0;
+
+    case PIDX_BLOCK_LOSSLESS:
+      return PIDX_compression_lossless_decode(in, coded_size, bytes_per_value, out, size);
+
+    case PIDX_BLOCK_LOSSY:
+      if (coded_size < 1 || (bits_per_value != 32 && bits_per_value != 64))
+        return -1;
+      q = in[0];
+      if (q < 1 || q > 52 || coded_size != 1 + 2 * bytes_per_value + (n * q + 7) / 8)
+        return -1;
+      decompress_brick(in + 1, out, n, bits_per_value, q);
+      return 0;
+  }
+
   return -1;
 }
-  
+
 int PIDX_compression_buf_destroy(PIDX_compression_id compression_id)
 {
-  return -1;
+  return 0;
 }
 
 int PIDX_compression_finalize(PIDX_compression_id compression_id)
@@ -198,5 +1115,5 @@ int PIDX_compression_finalize(PIDX_compression_id compression_id)
   free(compression_id);
   compression_id = 0;
   
-  return -1;
-}
\ No newline at end of file
+  return 0;
+}
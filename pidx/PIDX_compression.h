@@ -20,19 +20,146 @@
 #define __PIDX_COMPRESSION_H 
 
 
+/// Compression types (PIDX_set_compression_type)
+/// \param PIDX_NO_COMPRESSION the bricks are only restructured (compression_block_size > 1) and stored raw
+/// \param PIDX_LOSSY_COMPRESSION every brick of a floating point variable is stored at compression_bit_rate bits per value
+/// \param PIDX_LOSSLESS_COMPRESSION every IDX block is byte shuffled and LZ coded by its aggregator (any type)
+/// \param PIDX_ADAPTIVE_COMPRESSION the aggregators pick the smallest of the block codecs below for every IDX block
+#define PIDX_NO_COMPRESSION 0
+#define PIDX_LOSSY_COMPRESSION 1
+#define PIDX_LOSSLESS_COMPRESSION 2
+#define PIDX_ADAPTIVE_COMPRESSION 3
+
+/// Codecs of the IDX blocks (word 5 of the block entries of the binary file header, word 4 is the coded size)
+/// \param PIDX_BLOCK_RAW the block as is
+/// \param PIDX_BLOCK_LOSSY (bits per code, minimum, maximum, codes), only for the variables in the
+/// PIDX_COMPRESSION_FIXED_ACCURACY mode without bricks, the error stays within the tolerance of the variable
+/// \param PIDX_BLOCK_LOSSLESS byte shuffle and LZ
+/// \param PIDX_BLOCK_CONSTANT one value (all the values of the block are the same)
+#define PIDX_BLOCK_RAW 0
+#define PIDX_BLOCK_LOSSY 1
+#define PIDX_BLOCK_LOSSLESS 2
+#define PIDX_BLOCK_CONSTANT 3
+#define PIDX_BLOCK_CODEC_COUNT 4
+
+/// Default bits per value of the lossy codec
+#define PIDX_default_compression_bit_rate 16
+
+/// Per variable modes of the lossy codec (PIDX_variable_set_compression)
+/// \param PIDX_COMPRESSION_FILE_DEFAULT the file compression type and bit rate apply
+/// \param PIDX_COMPRESSION_FIXED_RATE the parameter is the bits per value
+/// \param PIDX_COMPRESSION_FIXED_PRECISION the parameter is the bits per code (the brick range is split in 2^bits steps)
+/// \param PIDX_COMPRESSION_FIXED_ACCURACY the parameter is the largest absolute error
+#define PIDX_COMPRESSION_FILE_DEFAULT 0
+#define PIDX_COMPRESSION_FIXED_RATE 1
+#define PIDX_COMPRESSION_FIXED_PRECISION 2
+#define PIDX_COMPRESSION_FIXED_ACCURACY 3
+
+
 struct PIDX_compression_id_struct;
 typedef struct PIDX_compression_id_struct* PIDX_compression_id;
 
+
+/// Creates a compression ID
+/// \param idx_meta_data All infor regarding the idx file passed from PIDX.c
+/// \param idx_derived_ptr All derived idx related derived metadata passed from PIDX.c
+/// \param start_var_index starting index of the variable on which the relevant operation is to be applied
+/// \param end_var_index ending index of the variable on which the relevant operation is to be applied
+/// \return PIDX_compression_id The identifier associated with the task
 PIDX_compression_id PIDX_compression_init(idx_dataset idx_meta_data, idx_dataset_derived_metadata idx_derived_ptr, int start_var_index, int end_var_index );
 
 #if PIDX_HAVE_MPI
 int PIDX_compression_set_communicator(PIDX_compression_id id, MPI_Comm comm);
 #endif
 
+/// Bytes one value of one brick of a variable takes once compressed (the raw brick size if the variable is not compressed).
+/// The codec works at a fixed rate, so this only depends on the .idx metadata and the reader finds the same
+/// block sizes the writer used.
+/// \param idx_meta_data the dataset
+/// \param variable_index the variable
+/// \return bytes per brick
+int PIDX_compression_bytes_per_brick(idx_dataset idx_meta_data, int variable_index);
+
+/// Smallest and largest value of the patches a process writes for a variable (floating point types only).
+/// \param idx_meta_data the dataset
+/// \param variable_index the variable
+/// \param minimum the smallest value (DBL_MAX without values)
+/// \param maximum the largest value (-DBL_MAX without values)
+/// \return error code
+int PIDX_compression_value_range(idx_dataset idx_meta_data, int variable_index, double* minimum, double* maximum);
+
+/// Bits per code that keep the error of every value within tolerance (PIDX_COMPRESSION_FIXED_ACCURACY)
+/// when the values lie in [minimum, maximum].
+/// \return bits per code, 0 if no number of bits (up to 52) meets the tolerance
+int PIDX_compression_accuracy_bits(double minimum, double maximum, double tolerance);
+
+/// Work of PIDX_compression_run: codes items [begin, end), chunk is the index of the range
+typedef void (*PIDX_compression_task)(void* arg, int64_t begin, int64_t end, int64_t chunk);
+
+/// Threads the codecs use (compression_thread_count, or if it is 0, one with MPI and the cores the process may run on without)
+int PIDX_compression_thread_count(idx_dataset idx_meta_data);
+
+/// Runs task over [0, count) in chunks of chunk_size items on up to thread_count threads (the calling thread is one of them,
+/// the others come from a pool kept for the lifetime of the process).
+/// The chunks are the same whatever the number of threads, so a task that keeps its results per chunk gives the same
+/// output with one thread or many.
+/// \return error code
+int PIDX_compression_run(int thread_count, int64_t count, int64_t chunk_size, PIDX_compression_task task, void* arg);
+
+/// Sets lossy_compressed_block_size of the variables
 int PIDX_compression_prepare(PIDX_compression_id id);
 
+/// Compresses, in place, the brick ordered buffers of the restructured groups (post_rst_block).
+/// The achieved ratio and errors (over all processes) are left in the compression_* statistics of the variables.
 int PIDX_compression_compress(PIDX_compression_id id);
-  
+
+/// Inverse of PIDX_compression_compress (for reads)
+int PIDX_compression_decompress(PIDX_compression_id id);
+
+/// Decodes one brick of a variable (bytes_per_brick bytes, as stored in an HZ sample) into its raw values, x fastest.
+/// \param idx_meta_data the dataset
+/// \param variable_index the variable
+/// \param in the stored brick
+/// \param out the values of the brick
+/// \return error code
+int PIDX_compression_brick_decode(idx_dataset idx_meta_data, int variable_index, const unsigned char* in, unsigned char* out);
+
+/// Lossless codec: the bytes of the values are shuffled (all first bytes, then all second bytes, ...)
+/// and the result is LZ coded. Works on any buffer, the compression ID is not needed.
+/// \param in the raw bytes
+/// \param size number of raw bytes
+/// \param bytes_per_value size of one value (the shuffle stride)
+/// \param out the coded bytes
+/// \param capacity bytes available in out
+/// \return number of coded bytes, -1 if they do not fit in capacity
+int64_t PIDX_compression_lossless_encode(const unsigned char* in, uint64_t size, int bytes_per_value, unsigned char* out, uint64_t capacity);
+
+/// Inverse of PIDX_compression_lossless_encode
+/// \param in the coded bytes
+/// \param coded_size number of coded bytes
+/// \param bytes_per_value size of one value (the shuffle stride)
+/// \param out the raw bytes
+/// \param size number of raw bytes
+/// \return error code (-1 if the coded bytes are corrupt)
+int PIDX_compression_lossless_decode(const unsigned char* in, uint64_t coded_size, int bytes_per_value, unsigned char* out, uint64_t size);
+
+/// Adaptive codec (PIDX_ADAPTIVE_COMPRESSION): codes a block with the smallest of the block codecs. Constant blocks
+/// are found by a scan, the lossy size follows from the value range and the lossless codec only runs on the whole
+/// block when a trial on a sample of it beats the other codecs, so a block costs about two passes over its values.
+/// \param in the raw bytes
+/// \param size number of raw bytes
+/// \param bits_per_value size of one value
+/// \param tolerance largest absolute error of the lossy codec (0: no lossy coding)
+/// \param out the coded bytes
+/// \param capacity bytes available in out
+/// \param codec PIDX_BLOCK_RAW, PIDX_BLOCK_LOSSY, PIDX_BLOCK_LOSSLESS or PIDX_BLOCK_CONSTANT
+/// \return number of coded bytes, 0 if the block is best stored raw
+int64_t PIDX_compression_block_encode(const unsigned char* in, uint64_t size, int bits_per_value, double tolerance, unsigned char* out, uint64_t capacity, int* codec);
+
+/// Inverse of PIDX_compression_block_encode
+/// \return error code (-1 if the coded bytes are corrupt)
+int PIDX_compression_block_decode(const unsigned char* in, uint64_t coded_size, int codec, int bits_per_value, unsigned char* out, uint64_t size);
+
 int PIDX_compression_buf_destroy(PIDX_compression_id id);
 
 int PIDX_compression_finalize(PIDX_compression_id id);  
@@ -171,6 +171,26 @@ int PIDX_header_io_write_idx (PIDX_header_io_id header_io, char* data_set_path,
     
     fprintf(idx_file_p, "\n(bits)\n%s\n", header_io->idx_ptr->bitSequence);
     fprintf(idx_file_p, "(bitsperblock)\n%d\n(blocksperfile)\n%d\n", header_io->idx_ptr->bits_per_block, header_io->idx_ptr->blocks_per_file);
+    if (header_io->idx_ptr->compression_type != PIDX_NO_COMPRESSION || header_io->idx_ptr->compression_block_size[0] * header_io->idx_ptr->compression_block_size[1] * header_io->idx_ptr->compression_block_size[2] * header_io->idx_ptr->compression_block_size[3] * header_io->idx_ptr->compression_block_size[4] > 1)
+    {
+      // the reader needs all three to find the size of the bricks in the binary files (and whether the blocks are coded)
+      fprintf(idx_file_p, "(compression type)\n%d\n(compression bit rate)\n%d\n", header_io->idx_ptr->compression_type, header_io->idx_ptr->compression_bit_rate);
+      fprintf(idx_file_p, "(compression block size)\n%lld %lld %lld %lld %lld\n", (long long)header_io->idx_ptr->compression_block_size[0], (long long)header_io->idx_ptr->compression_block_size[1], (long long)header_io->idx_ptr->compression_block_size[2], (long long)header_io->idx_ptr->compression_block_size[3], (long long)header_io->idx_ptr->compression_block_size[4]);
+      
+      // per variable modes of the lossy codec (mode, parameter and bits per code, one line per variable)
+      for (l = 0; l < header_io->end_var_index; l++)
+        if (header_io->idx_ptr->variable[l]->compression_mode != PIDX_COMPRESSION_FILE_DEFAULT)
+          break;
+      if (l != header_io->end_var_index)
+      {
+        fprintf(idx_file_p, "(compression modes)\n");
+        for (l = 0; l < header_io->end_var_index; l++)
+          fprintf(idx_file_p, "%d %.17g %d\n", header_io->idx_ptr->variable[l]->compression_mode, header_io->idx_ptr->variable[l]->compression_param, header_io->idx_ptr->variable[l]->compression_bits);
+      }
+    }
+    // the layout is not that of the bounding box, the reader takes it from the headers of the binary files
+    if (header_io->idx_ptr->sparse_layout == 1)
+      fprintf(idx_file_p, "(sparse layout)\n1\n");
     fprintf(idx_file_p, "(filename_template)\n./%s\n", header_io->filename_template);
     fprintf(idx_file_p, "(time)\n0 %d time%%06d/"/*note: uintah starts at timestep 1, but we shouldn't assume...*/, header_io->idx_ptr->current_time_step);
     fclose(idx_file_p);
@@ -190,12 +210,7 @@ int PIDX_header_io_file_create(PIDX_header_io_id header_io_id)
   char this_path[PATH_MAX] = {0};
   char tmp_path[PATH_MAX] = {0};
   char* pos;
-#if PIDX_HAVE_MPI
-  MPI_File fh;
-  //MPI_Status status;
-#else
-  int fh = 0;
-#endif  
+  PIDX_io_backend_file fh;
   
 #if PIDX_HAVE_MPI
   MPI_Comm_rank(header_io_id->comm, &rank);
@@ -222,9 +237,9 @@ int PIDX_header_io_file_create(PIDX_header_io_id header_io_id)
         //walks up the tree attempting to mkdir() each segment every
         //time we switch to a new directory when creating binary files.
 
-        // see if we need to make parent directory 
+        // see if we need to make parent directory (the in-memory backend has no directories)
         strcpy(this_path, bin_file);
-        if ((pos = rindex(this_path, '/'))) 
+        if (PIDX_io_backend_get_ops(header_io_id->idx_derived_ptr->io_backend)->file_system == 1 && (pos = rindex(this_path, '/'))) 
         {
           pos[1] = '\0';
           if (!strcmp(this_path, last_path) == 0) 
@@ -264,13 +279,14 @@ int PIDX_header_io_file_create(PIDX_header_io_id header_io_id)
         */
         //printf("[BEFORE] : [AFTER] :: %s : %s\n", bin_file, adjusted_name);
         //printf("[FOLDER NAME] : %s\n", folder_name);
-#if PIDX_HAVE_MPI
-        MPI_File_open(MPI_COMM_SELF, bin_file, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh);
-        MPI_File_close(&fh);
-#else
-        fh = open(bin_file, O_CREAT, 0664);
-        close(fh);
-#endif
+        // a new write (PIDX_file_trunc) starts from empty files
+        ret = PIDX_io_backend_open(header_io_id->idx_derived_ptr->io_backend, bin_file, PIDX_IO_BACKEND_WRITE | PIDX_IO_BACKEND_CREATE | PIDX_IO_BACKEND_TRUNCATE, &fh);
+        if (ret == -1)
+        {
+          fprintf(stderr, "[%s] [%d] PIDX_io_backend_open() failed on %s\n", __FILE__, __LINE__, bin_file);
+          return 1;
+        }
+        PIDX_io_backend_close(fh);
       }
   }
   
@@ -316,13 +332,7 @@ static int populate_meta_data(PIDX_header_io_id header_io_id, int file_number, c
 {
   int total_header_size, ret = 0, block_negative_offset = 0, block_limit = 0;
   int bytes_per_sample, bytes_per_sample_previous;
-  
-#if PIDX_HAVE_MPI
-  MPI_File fh;
-  MPI_Status status;
-#else
-  int fh = 0;
-#endif  
+  PIDX_io_backend_file fh;
   int first_block = 0;
   int i = 0, m = 0, n = 0, b = 0;
   uint32_t* headers;
@@ -334,16 +344,13 @@ static int populate_meta_data(PIDX_header_io_id header_io_id, int file_number, c
   total_header_size = (10 + (10 * header_io_id->idx_ptr->blocks_per_file)) * sizeof (uint32_t) * header_io_id->end_var_index;
   headers = (uint32_t*)malloc(total_header_size);
   
-#if PIDX_HAVE_MPI      
-  ret = MPI_File_open(MPI_COMM_SELF, bin_file, MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
-  if (ret != MPI_SUCCESS)
+  ret = PIDX_io_backend_open(header_io_id->idx_derived_ptr->io_backend, bin_file, PIDX_IO_BACKEND_WRITE, &fh);
+  if (ret == -1)
   {
-    fprintf(stderr, "[%s] [%d] MPI_File_open() failed on %s\n", __FILE__, __LINE__, bin_file);
+    fprintf(stderr, "[%s] [%d] PIDX_io_backend_open() failed on %s\n", __FILE__, __LINE__, bin_file);
+    free(headers);
     return 1;
   }
-#else
-  fh = open(bin_file, O_WRONLY, 0664);
-#endif
   if (PIDX_VAR == 1)
   {
     for (m = 0; m < 10; m++)
@@ -358,7 +365,7 @@ static int populate_meta_data(PIDX_header_io_id header_io_id, int file_number, c
           break;
         }
       }
-      bytes_per_sample = header_io_id->idx_ptr->variable[n]->bits_per_value / 8;
+      bytes_per_sample = header_io_id->idx_ptr->variable[n]->bytes_per_brick;
       initial_offset = 0;
       for (i = 0; i < header_io_id->idx_ptr->blocks_per_file; i++) 
       {
@@ -376,7 +383,7 @@ static int populate_meta_data(PIDX_header_io_id header_io_id, int file_number, c
             if (i == first_block)
               for (b = 0; b < n; b++)
               {
-                bytes_per_sample_previous = header_io_id->idx_ptr->variable[b]->bits_per_value / 8;
+                bytes_per_sample_previous = header_io_id->idx_ptr->variable[b]->bytes_per_brick;
                 initial_offset = initial_offset + ((block_limit + 1) * header_io_id->idx_derived_ptr->samples_per_block * bytes_per_sample_previous * header_io_id->idx_ptr->variable[b]->values_per_sample);
               }
 
@@ -417,44 +424,14 @@ static int populate_meta_data(PIDX_header_io_id header_io_id, int file_number, c
       headers[m] = htonl(0);
     for (n = 0; n < header_io_id->end_var_index; n++)
     {
+      bytes_per_sample = header_io_id->idx_ptr->variable[n]->bytes_per_brick;
       for (i = 0; i < header_io_id->idx_ptr->blocks_per_file; i++) 
       {
-        if (PIDX_blocks_is_block_present((i + (header_io_id->idx_ptr->blocks_per_file * file_number)), header_io_id->idx_derived_ptr->global_block_layout))
-        {
-          first_block = i;
-          break;
-        }
-      }
-      bytes_per_sample = header_io_id->idx_ptr->variable[n]->bits_per_value / 8;
-      initial_offset = 0;
-      for (i = 0; i < header_io_id->idx_ptr->blocks_per_file; i++) 
-      {
-        if (PIDX_blocks_is_block_present((i + (header_io_id->idx_ptr->blocks_per_file * file_number)), header_io_id->idx_derived_ptr->global_block_layout))
+        data_offset = PIDX_blocks_find_offset(header_io_id->idx_derived_ptr->block_offset_table, n, (i + (header_io_id->idx_ptr->blocks_per_file * file_number)));
+        if (data_offset != -1)
         {
-          block_negative_offset = PIDX_blocks_find_negative_offset(header_io_id->idx_ptr->blocks_per_file, (i + (header_io_id->idx_ptr->blocks_per_file * file_number)), header_io_id->idx_derived_ptr->global_block_layout);
-          if (n == 0) 
-          {
-            block_limit = i - block_negative_offset;
-            data_offset = ((i) - block_negative_offset) * header_io_id->idx_derived_ptr->samples_per_block * bytes_per_sample * header_io_id->idx_ptr->variable[n]->values_per_sample;
-            data_offset += header_io_id->idx_derived_ptr->start_fs_block * header_io_id->idx_derived_ptr->fs_block_size;
-          }
-          else 
-          {
-            if (i == first_block)
-              for (b = 0; b < n; b++)
-              {
-                bytes_per_sample_previous = header_io_id->idx_ptr->variable[b]->bits_per_value / 8;
-                initial_offset = initial_offset + ((block_limit + 1) * header_io_id->idx_derived_ptr->samples_per_block * bytes_per_sample_previous * header_io_id->idx_ptr->variable[b]->values_per_sample);
-              }
-
-            data_offset = initial_offset + ((i) - block_negative_offset) * header_io_id->idx_derived_ptr->samples_per_block * bytes_per_sample * header_io_id->idx_ptr->variable[n]->values_per_sample;
-            data_offset += header_io_id->idx_derived_ptr->start_fs_block * header_io_id->idx_derived_ptr->fs_block_size;
-            
-            //if (file_number == 13 || file_number == 12)
-            //printf("[%d] [%d] [%d] data_offset = %ld initial_offset = %ld block limit %d\n", file_number, n, i, data_offset, initial_offset, block_limit);
-          }
-          //max_offset = data_offset + header_io_id->idx_derived_ptr->samples_per_block * bytes_per_sample * header_io_id->idx_ptr->variable[n]->values_per_sample;
-            
+          data_offset += header_io_id->idx_derived_ptr->start_fs_block * header_io_id->idx_derived_ptr->fs_block_size;
+          
           little_data_offset = 0;
           little_data_offset += data_offset;
 
@@ -464,9 +441,6 @@ static int populate_meta_data(PIDX_header_io_id header_io_id, int file_number, c
           headers[13 + ((i + (header_io_id->idx_ptr->blocks_per_file * n))*10)] = htonl(0);
           headers[14 + ((i + (header_io_id->idx_ptr->blocks_per_file * n))*10)] = htonl(header_io_id->idx_derived_ptr->samples_per_block * bytes_per_sample * header_io_id->idx_ptr->variable[n]->values_per_sample);
           
-          //if (file_number == 13 || file_number == 12)
-          //printf("[%d] [%d] [%d] (%ld) :: [%d %d %d] Offste and Count %d %d\n", file_number, n, i, header_io_id->idx_derived_ptr->start_fs_block, header_io_id->idx_derived_ptr->samples_per_block, bytes_per_sample, header_io_id->idx_ptr->variable[n]->values_per_sample, little_data_offset, header_io_id->idx_derived_ptr->samples_per_block * bytes_per_sample * header_io_id->idx_ptr->variable[n]->values_per_sample);
-          
           for (m = 15; m < 20; m++)
             headers[m + ((i + (header_io_id->idx_ptr->blocks_per_file * n))*10)] = htonl(0);
         } 
@@ -478,16 +452,14 @@ static int populate_meta_data(PIDX_header_io_id header_io_id, int file_number, c
       }
     }
   }
-#if PIDX_HAVE_MPI
-  ret = MPI_File_write_at(fh, 0, headers, total_header_size, MPI_BYTE, &status);
-  if (ret != MPI_SUCCESS)
+  ret = PIDX_io_backend_pwrite(fh, (unsigned char*) headers, total_header_size, 0);
+  if (ret == -1)
   {
-    fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
+    fprintf(stderr, "[%s] [%d] PIDX_io_backend_pwrite() failed.\n", __FILE__, __LINE__);
+    free(headers);
+    PIDX_io_backend_close(fh);
     return 1;
   }
-#else
-  pwrite(fh, headers, total_header_size, 0);
-#endif
   
   free(headers);
 
@@ -507,16 +479,12 @@ static int populate_meta_data(PIDX_header_io_id header_io_id, int file_number, c
   }
 #endif
   
-#if PIDX_HAVE_MPI  
-  ret = MPI_File_close(&fh);
-  if (ret != MPI_SUCCESS)
+  ret = PIDX_io_backend_close(fh);
+  if (ret == -1)
   {
-    fprintf(stderr, "[%s] [%d] MPI_File_open() failed on %s\n", __FILE__, __LINE__, bin_file);
+    fprintf(stderr, "[%s] [%d] PIDX_io_backend_close() failed on %s\n", __FILE__, __LINE__, bin_file);
     return 1;
   }
-#else
-  close(fh);
-#endif
   
   return 0;
 }
@@ -45,6 +45,9 @@ struct PIDX_hz_encode_struct
   int start_var_index;
   int end_var_index;
   
+  //If set, PIDX_hz_encode_read gathers the samples from the mapped files
+  PIDX_io_map_id io_map;
+  
 #if PIDX_HAVE_MPI
   MPI_Comm comm;
 #endif
@@ -59,6 +62,12 @@ int PIDX_hz_encode_set_communicator(PIDX_hz_encode_id id, MPI_Comm comm)
 }
 #endif
 
+int PIDX_hz_encode_set_io_map(PIDX_hz_encode_id id, PIDX_io_map_id map_id)
+{
+  id->io_map = map_id;
+  return 0;
+}
+
 int compare( const void* a, const void* b)
 {
   int64_t int_a = ((const hz_tupple*)a)->index;
@@ -330,14 +339,14 @@ int PIDX_hz_encode_buf_create(PIDX_hz_encode_id id)
       id->idx_ptr->variable[i]->HZ_patch[k]->buffer = (unsigned char**)malloc( id->idx_derived_ptr->maxh * sizeof (unsigned char*));
       memset(id->idx_ptr->variable[i]->HZ_patch[k]->buffer, 0,  id->idx_derived_ptr->maxh * sizeof (unsigned char*));
       //printf("p g type %d = %d\n", k, id->idx_ptr->variable[id->start_var_index]->patch_group_ptr[k]->box_group_type);
-      if(id->idx_ptr->variable[id->start_var_index]->patch_group_ptr[k]->box_group_type == 1 || id->idx_ptr->variable[id->start_var_index]->patch_group_ptr[k]->box_group_type == 2)
+      if(id->io_map == NULL && (id->idx_ptr->variable[id->start_var_index]->patch_group_ptr[k]->box_group_type == 1 || id->idx_ptr->variable[id->start_var_index]->patch_group_ptr[k]->box_group_type == 2))
       {
         for(c = 0 ; c < id->idx_derived_ptr->maxh ; c++)
         {
-          //printf("buffer at %d = %d\n", c, bytes_for_datatype * (id->idx_ptr->variable[i]->HZ_patch[k]->end_hz_index[c] - id->idx_ptr->variable[i]->HZ_patch[k]->start_hz_index[c] + 1) * id->idx_ptr->variable[i]->values_per_sample * id->idx_ptr->compression_block_size[0] * id->idx_ptr->compression_block_size[1] * id->idx_ptr->compression_block_size[2] * id->idx_ptr->compression_block_size[3] * id->idx_ptr->compression_block_size[4]);
-          bytes_for_datatype = id->idx_ptr->variable[i]->bits_per_value / 8;
-          id->idx_ptr->variable[i]->HZ_patch[k]->buffer[c] = malloc(bytes_for_datatype * (id->idx_ptr->variable[i]->HZ_patch[k]->end_hz_index[c] - id->idx_ptr->variable[i]->HZ_patch[k]->start_hz_index[c] + 1) * id->idx_ptr->variable[i]->values_per_sample * id->idx_ptr->compression_block_size[0] * id->idx_ptr->compression_block_size[1] * id->idx_ptr->compression_block_size[2] * id->idx_ptr->compression_block_size[3] * id->idx_ptr->compression_block_size[4]);
-          memset(id->idx_ptr->variable[i]->HZ_patch[k]->buffer[c], 0, bytes_for_datatype * (id->idx_ptr->variable[i]->HZ_patch[k]->end_hz_index[c] - id->idx_ptr->variable[i]->HZ_patch[k]->start_hz_index[c] + 1) * id->idx_ptr->variable[i]->values_per_sample * id->idx_ptr->compression_block_size[0] * id->idx_ptr->compression_block_size[1] * id->idx_ptr->compression_block_size[2] * id->idx_ptr->compression_block_size[3] * id->idx_ptr->compression_block_size[4]);        
+          //printf("buffer at %d = %d\n", c, bytes_for_datatype * (id->idx_ptr->variable[i]->HZ_patch[k]->end_hz_index[c] - id->idx_ptr->variable[i]->HZ_patch[k]->start_hz_index[c] + 1) * id->idx_ptr->variable[i]->values_per_sample);
+          bytes_for_datatype = id->idx_ptr->variable[i]->bytes_per_brick;
+          id->idx_ptr->variable[i]->HZ_patch[k]->buffer[c] = malloc(bytes_for_datatype * (id->idx_ptr->variable[i]->HZ_patch[k]->end_hz_index[c] - id->idx_ptr->variable[i]->HZ_patch[k]->start_hz_index[c] + 1) * id->idx_ptr->variable[i]->values_per_sample);
+          memset(id->idx_ptr->variable[i]->HZ_patch[k]->buffer[c], 0, bytes_for_datatype * (id->idx_ptr->variable[i]->HZ_patch[k]->end_hz_index[c] - id->idx_ptr->variable[i]->HZ_patch[k]->start_hz_index[c] + 1) * id->idx_ptr->variable[i]->values_per_sample);        
         }
       }
     }
@@ -366,7 +375,6 @@ int PIDX_hz_encode_write(PIDX_hz_encode_id id)
   int64_t hz_index;
   int64_t total_compressed_patch_size;
   
-  int64_t total_compression_block_size = id->idx_ptr->compression_block_size[0] * id->idx_ptr->compression_block_size[1] * id->idx_ptr->compression_block_size[2] * id->idx_ptr->compression_block_size[3] * id->idx_ptr->compression_block_size[4];
   
   int compressed_patch_offset[PIDX_MAX_DIMENSIONS] = {0, 0, 0, 0, 0};
   int compressed_patch_size[PIDX_MAX_DIMENSIONS] = {0, 0, 0, 0, 0};
@@ -458,12 +466,12 @@ int PIDX_hz_encode_write(PIDX_hz_encode_id id)
                   for(var = id->start_var_index; var <= id->end_var_index; var++)
                   {
                     tupple[index_count].value[var - id->start_var_index] = malloc(id->idx_ptr->variable[var]->values_per_sample * sizeof(unsigned char*));
-                    bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
+                    bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
                     
                     for (s = 0; s < id->idx_ptr->variable[var]->values_per_sample; s++) 
                     {
-                      tupple[index_count].value[var - id->start_var_index][s] = malloc(bytes_for_datatype * total_compression_block_size);
-                      memcpy(tupple[index_count].value[var - id->start_var_index][s], id->idx_ptr->variable[var]->patch[y]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype * total_compression_block_size, bytes_for_datatype * total_compression_block_size);
+                      tupple[index_count].value[var - id->start_var_index][s] = malloc(bytes_for_datatype);
+                      memcpy(tupple[index_count].value[var - id->start_var_index][s], id->idx_ptr->variable[var]->patch_group_ptr[y]->box[0]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype, bytes_for_datatype);
                       
 #if 0
                       if(bytes_for_datatype == sizeof(double))
@@ -544,12 +552,12 @@ int PIDX_hz_encode_write(PIDX_hz_encode_id id)
                   for(var = id->start_var_index; var <= id->end_var_index; var++)
                   {
                     tupple[index_count].value[var - id->start_var_index] = malloc(id->idx_ptr->variable[var]->values_per_sample * sizeof(unsigned char*));
-                    bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
+                    bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
                     
                     for (s = 0; s < id->idx_ptr->variable[var]->values_per_sample; s++) 
                     {
-                      tupple[index_count].value[var - id->start_var_index][s] = malloc(bytes_for_datatype * total_compression_block_size);
-                      memcpy(tupple[index_count].value[var - id->start_var_index][s], id->idx_ptr->variable[var]->patch[y]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype * total_compression_block_size, bytes_for_datatype * total_compression_block_size);
+                      tupple[index_count].value[var - id->start_var_index][s] = malloc(bytes_for_datatype);
+                      memcpy(tupple[index_count].value[var - id->start_var_index][s], id->idx_ptr->variable[var]->patch_group_ptr[y]->box[0]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype, bytes_for_datatype);
 
 #if 0
                       if(bytes_for_datatype == sizeof(double))
@@ -583,9 +591,9 @@ int PIDX_hz_encode_write(PIDX_hz_encode_id id)
       for(var = id->start_var_index; var <= id->end_var_index; var++)
         for(c = 0 ; c < id->idx_derived_ptr->maxh ; c++)
         {
-          bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
-          id->idx_ptr->variable[var]->HZ_patch[y]->buffer[c] = malloc(bytes_for_datatype * id->idx_ptr->variable[id->start_var_index]->HZ_patch[y]->samples_per_level[c] * id->idx_ptr->variable[var]->values_per_sample * total_compression_block_size);
-          memset(id->idx_ptr->variable[var]->HZ_patch[y]->buffer[c], 0, bytes_for_datatype * id->idx_ptr->variable[id->start_var_index]->HZ_patch[y]->samples_per_level[c] * id->idx_ptr->variable[var]->values_per_sample * total_compression_block_size);
+          bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
+          id->idx_ptr->variable[var]->HZ_patch[y]->buffer[c] = malloc(bytes_for_datatype * id->idx_ptr->variable[id->start_var_index]->HZ_patch[y]->samples_per_level[c] * id->idx_ptr->variable[var]->values_per_sample);
+          memset(id->idx_ptr->variable[var]->HZ_patch[y]->buffer[c], 0, bytes_for_datatype * id->idx_ptr->variable[id->start_var_index]->HZ_patch[y]->samples_per_level[c] * id->idx_ptr->variable[var]->values_per_sample);
         }
       
       cnt = 0;
@@ -598,8 +606,8 @@ int PIDX_hz_encode_write(PIDX_hz_encode_id id)
           {
             for (i = 0; i < id->idx_ptr->variable[var]->values_per_sample; i++) 
             {
-              bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
-              memcpy(id->idx_ptr->variable[var]->HZ_patch[y]->buffer[c] + ((s * id->idx_ptr->variable[var]->values_per_sample + i) * bytes_for_datatype * total_compression_block_size), tupple[cnt].value[var - id->start_var_index][i], bytes_for_datatype * total_compression_block_size);
+              bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
+              memcpy(id->idx_ptr->variable[var]->HZ_patch[y]->buffer[c] + ((s * id->idx_ptr->variable[var]->values_per_sample + i) * bytes_for_datatype), tupple[cnt].value[var - id->start_var_index][i], bytes_for_datatype);
               id->idx_ptr->variable[var]->HZ_patch[y]->buffer_index[cnt] = tupple[cnt].index;
       
 #if 0
@@ -701,12 +709,12 @@ int PIDX_hz_encode_write(PIDX_hz_encode_id id)
                     hz_index = hz_order - id->idx_ptr->variable[id->start_var_index]->HZ_patch[y]->start_hz_index[level];
                     for(var = id->start_var_index; var <= id->end_var_index; var++)
                     {
-                      bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
+                      bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
                       for (s = 0; s < id->idx_ptr->variable[var]->values_per_sample; s++)
                       {                        
-                        memcpy(id->idx_ptr->variable[var]->HZ_patch[y]->buffer[level] + ((hz_index * id->idx_ptr->variable[var]->values_per_sample + s) * bytes_for_datatype * total_compression_block_size), 
-                                id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype * total_compression_block_size,
-                                bytes_for_datatype * total_compression_block_size);
+                        memcpy(id->idx_ptr->variable[var]->HZ_patch[y]->buffer[level] + ((hz_index * id->idx_ptr->variable[var]->values_per_sample + s) * bytes_for_datatype), 
+                                id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype,
+                                bytes_for_datatype);
                         
 #if 0
                         //if (hz_order == 985668 || hz_order == 985669 || hz_order == 1971392 || hz_order == 1971394)
@@ -782,11 +790,11 @@ int PIDX_hz_encode_write(PIDX_hz_encode_id id)
                     for(var = id->start_var_index; var <= id->end_var_index; var++)
                     {
                       hz_index = hz_order - id->idx_ptr->variable[var]->HZ_patch[y]->start_hz_index[level];
-                      bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
+                      bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
                       for (s = 0; s < id->idx_ptr->variable[var]->values_per_sample; s++)
                       {
-                        bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
-                        memcpy(id->idx_ptr->variable[var]->HZ_patch[y]->buffer[level] + ((hz_index * id->idx_ptr->variable[var]->values_per_sample + s) * bytes_for_datatype * total_compression_block_size), id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype * total_compression_block_size, bytes_for_datatype * total_compression_block_size);                        
+                        bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
+                        memcpy(id->idx_ptr->variable[var]->HZ_patch[y]->buffer[level] + ((hz_index * id->idx_ptr->variable[var]->values_per_sample + s) * bytes_for_datatype), id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype, bytes_for_datatype);                        
                       }
                     }
                   }
@@ -802,7 +810,7 @@ int PIDX_hz_encode_write(PIDX_hz_encode_id id)
     {
       for (i = id->start_var_index; i <= id->end_var_index; i++)
       {
-        bytes_for_datatype = id->idx_ptr->variable[i]->bits_per_value / 8;  
+        bytes_for_datatype = id->idx_ptr->variable[i]->bytes_per_brick;  
         for (j = 0; j < id->idx_derived_ptr->maxh; j++) 
         {
           int level_blocks = 0;
@@ -861,8 +869,8 @@ int PIDX_hz_encode_read(PIDX_hz_encode_id id)
   int bytes_for_datatype;
   int64_t hz_index;
   int64_t total_compressed_patch_size;
+  unsigned char* sample;
   
-  int64_t total_compression_block_size = id->idx_ptr->compression_block_size[0] * id->idx_ptr->compression_block_size[1] * id->idx_ptr->compression_block_size[2] * id->idx_ptr->compression_block_size[3] * id->idx_ptr->compression_block_size[4];
   
   int compressed_patch_offset[PIDX_MAX_DIMENSIONS] = {0, 0, 0, 0, 0};
   int compressed_patch_size[PIDX_MAX_DIMENSIONS] = {0, 0, 0, 0, 0};
@@ -953,12 +961,22 @@ int PIDX_hz_encode_read(PIDX_hz_encode_id id)
                   hz_index = hz_order - id->idx_ptr->variable[id->start_var_index]->HZ_patch[y]->start_hz_index[level];
                   for(var = id->start_var_index; var <= id->end_var_index; var++)
                   {
-                    bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
+                    bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
+                    if (id->io_map != NULL)
+                    {
+                      if (PIDX_io_map_get_sample(id->io_map, var, hz_order, &sample) == -1)
+                        return -1;
+                      if (sample != NULL)
+                        memcpy(id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + index * id->idx_ptr->variable[var]->values_per_sample * bytes_for_datatype, sample, id->idx_ptr->variable[var]->values_per_sample * bytes_for_datatype);
+                      else
+                        memset(id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + index * id->idx_ptr->variable[var]->values_per_sample * bytes_for_datatype, 0, id->idx_ptr->variable[var]->values_per_sample * bytes_for_datatype);
+                      continue;
+                    }
                     for (s = 0; s < id->idx_ptr->variable[var]->values_per_sample; s++)
                     {                        
-                      memcpy(id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype * total_compression_block_size,
-                             id->idx_ptr->variable[var]->HZ_patch[y]->buffer[level] + ((hz_index * id->idx_ptr->variable[var]->values_per_sample + s) * bytes_for_datatype * total_compression_block_size),
-                             bytes_for_datatype * total_compression_block_size);
+                      memcpy(id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype,
+                             id->idx_ptr->variable[var]->HZ_patch[y]->buffer[level] + ((hz_index * id->idx_ptr->variable[var]->values_per_sample + s) * bytes_for_datatype),
+                             bytes_for_datatype);
                     }
                   }
                 }
@@ -1010,22 +1028,32 @@ int PIDX_hz_encode_read(PIDX_hz_encode_id id)
                   for(var = id->start_var_index; var <= id->end_var_index; var++)
                   {
                     hz_index = hz_order - id->idx_ptr->variable[var]->HZ_patch[y]->start_hz_index[level];
-                    bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
+                    bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
+                    if (id->io_map != NULL)
+                    {
+                      if (PIDX_io_map_get_sample(id->io_map, var, hz_order, &sample) == -1)
+                        return -1;
+                      if (sample != NULL)
+                        memcpy(id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + index * id->idx_ptr->variable[var]->values_per_sample * bytes_for_datatype, sample, id->idx_ptr->variable[var]->values_per_sample * bytes_for_datatype);
+                      else
+                        memset(id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + index * id->idx_ptr->variable[var]->values_per_sample * bytes_for_datatype, 0, id->idx_ptr->variable[var]->values_per_sample * bytes_for_datatype);
+                      continue;
+                    }
                     for (s = 0; s < id->idx_ptr->variable[var]->values_per_sample; s++)
                     {
-                      bytes_for_datatype = id->idx_ptr->variable[var]->bits_per_value / 8;
-                      memcpy(id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype * total_compression_block_size, id->idx_ptr->variable[var]->HZ_patch[y]->buffer[level] + ((hz_index * id->idx_ptr->variable[var]->values_per_sample + s) * bytes_for_datatype * total_compression_block_size), bytes_for_datatype * total_compression_block_size);                        
+                      bytes_for_datatype = id->idx_ptr->variable[var]->bytes_per_brick;
+                      memcpy(id->idx_ptr->variable[var]->patch_group_ptr[y]->box[b]->Ndim_box_buffer + ((index * id->idx_ptr->variable[var]->values_per_sample) + s) * bytes_for_datatype, id->idx_ptr->variable[var]->HZ_patch[y]->buffer[level] + ((hz_index * id->idx_ptr->variable[var]->values_per_sample + s) * bytes_for_datatype), bytes_for_datatype);                        
                     }
                   }
                 }
       }
     }
     
-    if (id->idx_ptr->variable[id->start_var_index]->patch_group_ptr[y]->box_group_type == 2)
+    if (id->io_map == NULL && id->idx_ptr->variable[id->start_var_index]->patch_group_ptr[y]->box_group_type == 2)
     {
       for (i = id->start_var_index; i <= id->end_var_index; i++)
       {
-        bytes_for_datatype = id->idx_ptr->variable[i]->bits_per_value / 8;  
+        bytes_for_datatype = id->idx_ptr->variable[i]->bytes_per_brick;  
         for (j = 0; j < id->idx_derived_ptr->maxh; j++) 
         {
           int level_blocks = 0;
@@ -55,6 +55,14 @@ int PIDX_hz_encode_set_communicator(PIDX_hz_encode_id id, MPI_Comm comm);
 
 
 
+/// Read straight from the mapped binary files instead of the HZ buffers (which are then not allocated).
+/// \param id hz encoding id
+/// \param map_id the IO map id (NULL to read from the HZ buffers)
+/// \return error code
+int PIDX_hz_encode_set_io_map(PIDX_hz_encode_id id, PIDX_io_map_id map_id);
+
+
+
 ///
 int PIDX_hz_encode_create_cache_buffers(PIDX_hz_encode_id id);
 
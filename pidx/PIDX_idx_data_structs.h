@@ -64,6 +64,17 @@ struct PIDX_variable_struct
   
   //Compression related
   int lossy_compressed_block_size;                                      ///< The expected size of the compressed buffer
+  int bytes_per_brick;                                                  ///< Bytes one value of one HZ sample (a compression_block_size brick, compressed or not) takes in the HZ, aggregation and file buffers
+  int compression_mode;                                                 ///< PIDX_COMPRESSION_FILE_DEFAULT or the fixed rate, precision or accuracy mode of the variable
+  double compression_param;                                             ///< Bits per value, bits per code or largest absolute error of the mode
+  int compression_bits;                                                 ///< Bits per code of the fixed accuracy mode, found from the value range at the first write (-1 if no number of bits meets the tolerance, the bricks are raw)
+  double compression_max_error;                                         ///< Largest absolute error of the last write (all processes)
+  double compression_square_error;                                      ///< Sum of the squared errors of the last write (all processes)
+  double compression_value_count;                                       ///< Values coded by the last write (all processes)
+  double compression_raw_bytes;                                         ///< Bytes of the bricks before compression in the last write (all processes)
+  double compression_coded_bytes;                                       ///< Bytes of the bricks after compression in the last write (all processes)
+  int64_t compression_block_count[4];                                   ///< IDX blocks of the last write per block codec (PIDX_BLOCK_RAW ... PIDX_BLOCK_CONSTANT)
+  int64_t compression_block_bytes[4];                                   ///< Bytes written for the blocks of every block codec in the last write
   
   //extents fo meta-data
   int64_t *rank_r_offset;                                                   ///< Offset of variables in each dimension
@@ -90,7 +101,11 @@ struct idx_file_struct
   char bitPattern[512];
   char filename_template[1024];                                         ///< Depends on the time step
   
-  int compression_type;                                                 ///< lossy or lossless. 1 for lossy 0 for lossless
+  int compression_type;                                                 ///< PIDX_NO_COMPRESSION or PIDX_LOSSY_COMPRESSION
+  int compression_bit_rate;                                             ///< bits per value of the lossy (fixed rate) codec
+  int compression_thread_count;                                         ///< threads coding the bricks and blocks (0: one with MPI, one per core the process may run on without)
+  int read_thread_count;                                                ///< threads reading the blocks of a region of interest read (0: one per core without MPI, 1 with MPI)
+  int sparse_layout;                                                    ///< 1 if only the blocks touched by the patches are laid out (recorded in the .idx file)
   int64_t compression_block_size[PIDX_MAX_DIMENSIONS];                  ///< size of the block at which compression is applied eg. (4x4x4)                                                      
                                                                         ///< the current compression schemes only work in three dimensions
   int64_t compressed_global_bounds[PIDX_MAX_DIMENSIONS];                ///< Compressed global extents
@@ -109,8 +124,11 @@ struct idx_dataset_derived_metadata_struct
   
   int fs_block_size;
   off_t start_fs_block;
+  int direct_io;                                        ///< 1 to write the aligned aggregator buffers (header and extents) with O_DIRECT
+  PIDX_io_backend io_backend;                           ///< where the .bin files are written to and read from
   
   PIDX_block_layout global_block_layout;
+  PIDX_block_offset_table block_offset_table;           ///< offsets of the blocks of global_block_layout in the files
   int *existing_blocks_index_per_file;
   int existing_file_count;
   int *existing_file_index;
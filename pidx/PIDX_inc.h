@@ -15,12 +15,15 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
+#include <float.h>
 #include <stdint.h>
 #include <arpa/inet.h>
 #include <stdio.h>
@@ -33,6 +36,10 @@
   #include <sys/time.h>
 #endif
 
+#if PIDX_HAVE_PTHREADS
+  #include <pthread.h>
+#endif
+
 #if PIDX_HAVE_LOSSY_ZFP
   #include "zfp.h"
   #include "fpzip.h"
@@ -46,6 +53,7 @@ extern "C" {
 #include "PIDX_data_types.h"
 #include "PIDX_error_codes.h"
 #include "PIDX_file_access_modes.h"
+#include "PIDX_io_backend.h"
 
 #include "PIDX_blocks.h"
 #include "PIDX_idx_data_structs.h"
@@ -55,11 +63,16 @@ extern "C" {
 #include "PIDX_file_name.h"
 
 #include "PIDX_header_io.h"
+#include "PIDX_io_map.h"
+#include "PIDX_block_cache.h"
+#include "PIDX_prefetch.h"
+#include "PIDX_query.h"
 #include "PIDX_rst.h"
 #include "PIDX_hz_encode.h"
 #include "PIDX_block_restructure.h"
 #include "PIDX_compression.h"
 #include "PIDX_agg.h"
+#include "PIDX_async_io.h"
 #include "PIDX_io.h"
 
 #ifdef __cplusplus
@@ -23,8 +23,27 @@
 static uint32_t *cached_header_copy;
 static int enable_caching = 0;
 
+/// Maximum number of files kept open at once by the per-process write/read path
+#define PIDX_IO_HANDLE_CACHE_SIZE 16
+
 enum IO_MODE { PIDX_READ, PIDX_WRITE};
 
+/// One open file in the handle cache
+struct PIDX_io_handle_struct
+{
+  int file_number;                                      ///< file number the handle belongs to (-1 if the slot is free)
+  int mode;                                             ///< PIDX_READ or PIDX_WRITE
+  uint64_t last_use;                                    ///< value of the use clock at the last lookup (for LRU eviction)
+  PIDX_io_backend_file fh;                              ///< the open file
+};
+
+/// One contiguous run of bytes in a file, queued by write_read_samples
+struct PIDX_io_segment_struct
+{
+  int file_number;                                      ///< target file
+  struct PIDX_io_backend_segment_struct extent;         ///< where in the file and in memory
+};
+
 struct PIDX_io_struct 
 {
 #if PIDX_HAVE_MPI
@@ -41,104 +60,611 @@ struct PIDX_io_struct
   
   int start_var_index;
   int end_var_index;
+  
+  //File names generated once per file number (max_file_count entries, filled lazily)
+  char **file_name_cache;
+  
+  //Runs queued by write_read_samples, issued per file (sorted by offset) by flush_segments
+  struct PIDX_io_segment_struct *segment;
+  struct PIDX_io_backend_segment_struct *file_segment;
+  int segment_count;
+  int segment_capacity;
+  
+  //LRU cache of open files, shared by all the HZ runs written/read through this ID
+  struct PIDX_io_handle_struct handle_cache[PIDX_IO_HANDLE_CACHE_SIZE];
+  int handle_count;
+  uint64_t handle_clock;
+  
+  //If set aggregator buffers are handed to this background writer instead of being written in place
+  PIDX_async_io_id async_id;
+  
+  //Block codecs (PIDX_LOSSLESS_COMPRESSION, PIDX_ADAPTIVE_COMPRESSION): coded bytes of every block of every variable of the ID
+  //in the file of the aggregator ((variable - start_var_index) * blocks_per_file + block, 0 for raw blocks), filled by PIDX_io_lossless_encode
+  uint32_t *coded_size;
+  //PIDX_BLOCK_* codec of the same blocks (second half of the coded_size allocation)
+  uint32_t *block_codec;
 };
 
 static int write_read_samples(PIDX_io_id io_id, int variable_index, uint64_t hz_start_index, uint64_t hz_count, unsigned char* hz_buffer, int64_t buffer_offset, int MODE);
 
-//static int generate_file_name(PIDX_io_id io_id, int file_number, char* filename, int maxlen);
+static int get_file_name(PIDX_io_id io_id, int file_number, char** file_name);
 
-static int write_read_samples(PIDX_io_id io_id, int variable_index, uint64_t hz_start_index, uint64_t hz_count, unsigned char* hz_buffer, int64_t buffer_offset, int MODE)
-{
-  int samples_per_file, block_number, file_index, file_count, ret = 0, block_negative_offset = 0, file_number;
-  int mpi_ret;
-  int bytes_per_sample, bytes_per_datatype;
-  int i = 0, l = 0;
-  char file_name[PATH_MAX];
-  off_t data_offset = 0;
+static int get_file_handle(PIDX_io_id io_id, int file_number, int MODE, PIDX_io_backend_file* fh);
 
-#if PIDX_HAVE_MPI
-  MPI_File fh;
-  MPI_Status status;
+static int close_file_handle(struct PIDX_io_handle_struct* handle);
+
+static int close_all_file_handles(PIDX_io_id io_id);
+
+static int aggregated_blocks_in_file(PIDX_io_id io_id, int variable_index, int file_number);
+
+static int queue_segment(PIDX_io_id io_id, int file_number, off_t offset, unsigned char* buffer, uint64_t size, int MODE);
+
+static int flush_segments(PIDX_io_id io_id, int MODE);
+
+static uint64_t lossless_block_size(PIDX_io_id io_id, int variable_index);
+
+static int lossless_write(PIDX_io_id io_id, PIDX_io_backend_file fh, int64_t data_offset, int header_write);
+
+static int lossless_read(PIDX_io_id io_id, PIDX_io_backend_file fh, int64_t data_offset);
+
+static int aggregated_blocks_in_file(PIDX_io_id io_id, int variable_index, int file_number)
+{
+#ifdef PIDX_VAR_SLOW_LOOP
+  return io_id->idx_ptr->variable[variable_index]->VAR_blocks_per_file[file_number];
 #else
-  int fh;
+  return io_id->idx_derived_ptr->existing_blocks_index_per_file[file_number];
 #endif
-    
-  samples_per_file = io_id->idx_derived_ptr->samples_per_block * io_id->idx_ptr->blocks_per_file;    
+}
 
-  bytes_per_datatype = (io_id->idx_ptr->variable[variable_index]->bits_per_value / 8) * (io_id->idx_ptr->compression_block_size[0] * io_id->idx_ptr->compression_block_size[1] * io_id->idx_ptr->compression_block_size[2] * io_id->idx_ptr->compression_block_size[3] * io_id->idx_ptr->compression_block_size[4]);
+static int get_file_name(PIDX_io_id io_id, int file_number, char** file_name)
+{
+  int ret = 0;
   
-  hz_buffer = hz_buffer + buffer_offset * bytes_per_datatype * io_id->idx_ptr->variable[variable_index]->values_per_sample;
+  if (file_number < 0 || file_number >= io_id->idx_derived_ptr->max_file_count)
+  {
+    fprintf(stderr, "[%s] [%d] file number %d out of range [0 %d).\n", __FILE__, __LINE__, file_number, io_id->idx_derived_ptr->max_file_count);
+    return -1;
+  }
   
-  while (hz_count) 
+  if (io_id->file_name_cache == NULL)
   {
-    block_number = hz_start_index / io_id->idx_derived_ptr->samples_per_block;
-    file_number = hz_start_index / samples_per_file;
-    file_index = hz_start_index % samples_per_file;
-    file_count = samples_per_file - file_index;
-    
-    if ((int64_t)file_count > hz_count)
-      file_count = hz_count;
-
-    // build file name
-    ret = generate_file_name(io_id->idx_ptr->blocks_per_file, io_id->idx_ptr->filename_template, file_number, file_name, PATH_MAX);
+    io_id->file_name_cache = malloc(io_id->idx_derived_ptr->max_file_count * sizeof (char*));
+    memset(io_id->file_name_cache, 0, io_id->idx_derived_ptr->max_file_count * sizeof (char*));
+  }
+  
+  if (io_id->file_name_cache[file_number] == NULL)
+  {
+    io_id->file_name_cache[file_number] = malloc(PATH_MAX);
+    ret = generate_file_name(io_id->idx_ptr->blocks_per_file, io_id->idx_ptr->filename_template, file_number, io_id->file_name_cache[file_number], PATH_MAX);
     if (ret == 1)
     {
       fprintf(stderr, "[%s] [%d] generate_file_name() failed.\n", __FILE__, __LINE__);
+      free(io_id->file_name_cache[file_number]);
+      io_id->file_name_cache[file_number] = 0;
       return -1;
     }
-    //printf("File name = %s\n", file_name);
-#if PIDX_HAVE_MPI
-    if(MODE == PIDX_WRITE)
+  }
+  
+  *file_name = io_id->file_name_cache[file_number];
+  return 0;
+}
+
+static int get_file_handle(PIDX_io_id io_id, int file_number, int MODE, PIDX_io_backend_file* fh)
+{
+  int i, ret = 0, slot = -1;
+  char *file_name;
+  struct PIDX_io_handle_struct* handle;
+  
+  io_id->handle_clock++;
+  
+  for (i = 0; i < io_id->handle_count; i++)
+  {
+    if (io_id->handle_cache[i].file_number == file_number && io_id->handle_cache[i].mode == MODE)
+    {
+      io_id->handle_cache[i].last_use = io_id->handle_clock;
+      *fh = io_id->handle_cache[i].fh;
+      return 0;
+    }
+  }
+  
+  ret = get_file_name(io_id, file_number, &file_name);
+  if (ret == -1)
+    return -1;
+  
+  if (io_id->handle_count < PIDX_IO_HANDLE_CACHE_SIZE)
+    slot = io_id->handle_count++;
+  else
+  {
+    //evict the least recently used handle
+    slot = 0;
+    for (i = 1; i < io_id->handle_count; i++)
+      if (io_id->handle_cache[i].last_use < io_id->handle_cache[slot].last_use)
+        slot = i;
+    
+    ret = close_file_handle(&io_id->handle_cache[slot]);
+    if (ret == -1)
+      return -1;
+  }
+  
+  handle = &io_id->handle_cache[slot];
+  handle->file_number = -1;
+  
+  ret = PIDX_io_backend_open(io_id->idx_derived_ptr->io_backend, file_name, (MODE == PIDX_WRITE) ? PIDX_IO_BACKEND_WRITE : PIDX_IO_BACKEND_READ, &handle->fh);
+  if (ret == -1)
+  {
+    fprintf(stderr, "[%s] [%d] PIDX_io_backend_open() failed. (%s)\n", __FILE__, __LINE__, file_name);
+    io_id->handle_count--;
+    if (slot != io_id->handle_count)
+      io_id->handle_cache[slot] = io_id->handle_cache[io_id->handle_count];
+    return -1;
+  }
+  
+  handle->file_number = file_number;
+  handle->mode = MODE;
+  handle->last_use = io_id->handle_clock;
+  *fh = handle->fh;
+  
+  return 0;
+}
+
+static int close_file_handle(struct PIDX_io_handle_struct* handle)
+{
+  if (handle->file_number == -1)
+    return 0;
+  
+  handle->file_number = -1;
+  if (PIDX_io_backend_close(handle->fh) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] PIDX_io_backend_close() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+  
+  return 0;
+}
+
+static int close_all_file_handles(PIDX_io_id io_id)
+{
+  int i, ret = 0;
+  
+  for (i = 0; i < io_id->handle_count; i++)
+    if (close_file_handle(&io_id->handle_cache[i]) == -1)
+      ret = -1;
+  io_id->handle_count = 0;
+  
+  return ret;
+}
+
+static int queue_segment(PIDX_io_id io_id, int file_number, off_t offset, unsigned char* buffer, uint64_t size, int MODE)
+{
+  struct PIDX_io_segment_struct *temp_segment;
+  struct PIDX_io_backend_segment_struct *temp_file_segment;
+  
+  if (size == 0)
+    return 0;
+  
+  if (io_id->segment_count == io_id->segment_capacity)
+  {
+    io_id->segment_capacity = (io_id->segment_capacity == 0) ? 1024 : io_id->segment_capacity * 2;
+    temp_segment = realloc(io_id->segment, io_id->segment_capacity * sizeof (*io_id->segment));
+    temp_file_segment = realloc(io_id->file_segment, io_id->segment_capacity * sizeof (*io_id->file_segment));
+    if (temp_segment == NULL || temp_file_segment == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+      return -1;
+    }
+    io_id->segment = temp_segment;
+    io_id->file_segment = temp_file_segment;
+  }
+  
+  io_id->segment[io_id->segment_count].file_number = file_number;
+  io_id->segment[io_id->segment_count].extent.offset = offset;
+  io_id->segment[io_id->segment_count].extent.buffer = buffer;
+  io_id->segment[io_id->segment_count].extent.size = size;
+  io_id->segment_count++;
+  
+  return 0;
+}
+
+static int compare_segments(const void* a, const void* b)
+{
+  const struct PIDX_io_segment_struct* sa = a;
+  const struct PIDX_io_segment_struct* sb = b;
+  
+  if (sa->file_number != sb->file_number)
+    return (sa->file_number < sb->file_number) ? -1 : 1;
+  if (sa->extent.offset != sb->extent.offset)
+    return (sa->extent.offset < sb->extent.offset) ? -1 : 1;
+  return 0;
+}
+
+/// Issues all the queued segments, one batch per file
+static int flush_segments(PIDX_io_id io_id, int MODE)
+{
+  int i, first, last, ret = 0;
+  PIDX_io_backend_file fh;
+  
+  qsort(io_id->segment, io_id->segment_count, sizeof (*io_id->segment), compare_segments);
+  
+  for (first = 0; first < io_id->segment_count; first = last)
+  {
+    for (last = first + 1; last < io_id->segment_count; last++)
+      if (io_id->segment[last].file_number != io_id->segment[first].file_number)
+        break;
+    
+    ret = get_file_handle(io_id, io_id->segment[first].file_number, MODE, &fh);
+    if (ret == -1)
+    {
+      fprintf(stderr, "[%s] [%d] get_file_handle() failed.\n", __FILE__, __LINE__);
+      break;
+    }
+    
+    for (i = first; i < last; i++)
+      io_id->file_segment[i - first] = io_id->segment[i].extent;
+    
+    if (MODE == PIDX_WRITE)
+      ret = PIDX_io_backend_pwritev(fh, io_id->file_segment, last - first);
+    else
+      ret = PIDX_io_backend_preadv(fh, io_id->file_segment, last - first);
+    if (ret == -1)
+    {
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_pwritev/PIDX_io_backend_preadv() failed.\n", __FILE__, __LINE__);
+      break;
+    }
+  }
+  
+  io_id->segment_count = 0;
+  return ret;
+}
+
+/// Bytes of one block in the aggregator buffer of a variable if the block codecs (lossless or adaptive) apply to it, 0 otherwise.
+/// The codecs work on whole blocks, so every block has to be owned by one aggregator
+/// (one value per sample and no aggregation factor).
+static uint64_t lossless_block_size(PIDX_io_id io_id, int variable_index)
+{
+  PIDX_variable var = io_id->idx_ptr->variable[variable_index];
+
+  if ((io_id->idx_ptr->compression_type != PIDX_LOSSLESS_COMPRESSION && io_id->idx_ptr->compression_type != PIDX_ADAPTIVE_COMPRESSION) || var->values_per_sample != 1 || io_id->idx_derived_ptr->aggregation_factor != 1)
+    return 0;
+
+  return (uint64_t) io_id->idx_derived_ptr->samples_per_block * var->bytes_per_brick;
+}
+
+/// Index in the binary file header of the entry of a block (offset, size and compression words)
+static int header_entry(PIDX_io_id io_id, int variable_index, int block)
+{
+  return 10 + ((block + (io_id->idx_ptr->blocks_per_file * variable_index)) * 10);
+}
+
+/// Sets the offset (word 2) and size (word 4) of the block entries of every variable in a copy of the file header.
+/// A sparse layout is not that of the bounding box, readers rebuild it from these entries.
+static void layout_header(PIDX_io_id io_id, int file_number, uint32_t* headers)
+{
+  int var, i;
+  off_t data_offset;
+  PIDX_block_offset_table table = io_id->idx_derived_ptr->block_offset_table;
+  off_t header_size = (off_t) io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size;
+
+  for (var = 0; var < io_id->idx_ptr->variable_count && var < table->variable_count; var++)
+  {
+    for (i = 0; i < io_id->idx_ptr->blocks_per_file; i++)
     {
-      mpi_ret = MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
-      if (mpi_ret != MPI_SUCCESS) 
+      data_offset = PIDX_blocks_find_offset(table, var, file_number * io_id->idx_ptr->blocks_per_file + i);
+      if (data_offset == -1)
+        continue;
+      headers[header_entry(io_id, var, i) + 2] = htonl(header_size + data_offset);
+      headers[header_entry(io_id, var, i) + 4] = htonl(table->block_size[var]);
+    }
+  }
+}
+
+/// Sets the size (word 4) and compression (word 5) of the block entries of the coded variables in a copy of the file header
+static void lossless_header(PIDX_io_id io_id, int file_number, uint32_t* headers)
+{
+  int var, i;
+  uint64_t block_size;
+  uint32_t *coded_size, *block_codec;
+
+  for (var = io_id->start_var_index; var <= io_id->end_var_index; var++)
+  {
+    block_size = lossless_block_size(io_id, var);
+    if (block_size == 0)
+      continue;
+
+    coded_size = io_id->coded_size + (int64_t) (var - io_id->start_var_index) * io_id->idx_ptr->blocks_per_file;
+    block_codec = io_id->block_codec + (int64_t) (var - io_id->start_var_index) * io_id->idx_ptr->blocks_per_file;
+    for (i = 0; i < io_id->idx_ptr->blocks_per_file; i++)
+    {
+      if (io_id->idx_derived_ptr->block_offset_table->block_index[file_number * io_id->idx_ptr->blocks_per_file + i] < 0)
+        continue;
+      headers[header_entry(io_id, var, i) + 4] = htonl((coded_size[i] != 0) ? coded_size[i] : block_size);
+      headers[header_entry(io_id, var, i) + 5] = htonl((coded_size[i] != 0) ? block_codec[i] : PIDX_BLOCK_RAW);
+    }
+  }
+}
+
+/// Writes the aggregator buffer of a coded variable: only the coded bytes of every block are written (the blocks keep
+/// their raw size slots, so no offset changes) and the block entries of the file header are updated.
+static int lossless_write(PIDX_io_id io_id, PIDX_io_backend_file fh, int64_t data_offset, int header_write)
+{
+  int i, c, count = 0, ret = 0;
+  Agg_buffer agg_buffer = io_id->idx_derived_ptr->agg_buffer;
+  int blocks_per_file = io_id->idx_ptr->blocks_per_file;
+  uint64_t block_size = lossless_block_size(io_id, agg_buffer->var_number);
+  uint32_t* coded_size = io_id->coded_size + (int64_t) (agg_buffer->var_number - io_id->start_var_index) * blocks_per_file;
+  uint32_t* block_codec = io_id->block_codec + (int64_t) (agg_buffer->var_number - io_id->start_var_index) * blocks_per_file;
+  struct PIDX_io_backend_segment_struct* segment;
+  uint32_t* header_words;
+
+  segment = malloc((2 * blocks_per_file + 1) * sizeof (*segment));
+  header_words = malloc(2 * blocks_per_file * sizeof (*header_words));
+  if (segment == NULL || header_words == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    free(segment);
+    free(header_words);
+    return -1;
+  }
+
+  if (header_write == 1)
+  {
+    // the whole header (lossless_header already filled in the block entries) is in front of the data
+    segment[count].offset = 0;
+    segment[count].buffer = agg_buffer->buffer_memory;
+    segment[count].size = agg_buffer->buffer_header_size;
+    count++;
+    data_offset = data_offset + agg_buffer->buffer_header_size;
+  }
+  else
+  {
+    // the first aggregator of the file writes the same entries with the whole header, whichever lands last
+    for (i = 0; i < blocks_per_file; i++)
+    {
+      if (io_id->idx_derived_ptr->block_offset_table->block_index[agg_buffer->file_number * blocks_per_file + i] < 0)
+        continue;
+      header_words[2 * i] = htonl((coded_size[i] != 0) ? coded_size[i] : block_size);
+      header_words[2 * i + 1] = htonl((coded_size[i] != 0) ? block_codec[i] : PIDX_BLOCK_RAW);
+      segment[count].offset = (header_entry(io_id, agg_buffer->var_number, i) + 4) * sizeof (uint32_t);
+      segment[count].buffer = (unsigned char*) (header_words + 2 * i);
+      segment[count].size = 2 * sizeof (uint32_t);
+      count++;
+    }
+  }
+
+  for (i = 0; i < blocks_per_file; i++)
+  {
+    c = io_id->idx_derived_ptr->block_offset_table->block_index[agg_buffer->file_number * blocks_per_file + i];
+    if (c < 0)
+      continue;
+    segment[count].offset = data_offset + c * block_size;
+    segment[count].buffer = agg_buffer->buffer + c * block_size;
+    segment[count].size = (coded_size[i] != 0) ? coded_size[i] : block_size;
+    count++;
+  }
+
+  if (PIDX_io_backend_pwritev(fh, segment, count) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] PIDX_io_backend_pwritev() failed.\n", __FILE__, __LINE__);
+    ret = -1;
+  }
+
+  free(segment);
+  free(header_words);
+  return ret;
+}
+
+/// Blocks of an aggregator buffer coded by the threads of PIDX_compression_run (one block per chunk)
+struct lossless_task
+{
+  unsigned char* buffer;                                ///< aggregator buffer
+  int* block_index;                                     ///< slot of every block of the file in the buffer (-1 if absent)
+  uint64_t block_size;
+  int bits_per_value;
+  int adaptive;                                         ///< pick the codec of every block (PIDX_ADAPTIVE_COMPRESSION)
+  double tolerance;                                     ///< largest error of the lossy block codec (0: lossless codecs only)
+  uint32_t* coded_size;                                 ///< coded bytes of every block of the file (0 for raw blocks)
+  uint32_t* block_codec;                                ///< PIDX_BLOCK_* codec of every block of the file
+  int MODE;
+  int error;                                            ///< set by any block that does not decode
+};
+
+/// Codes (PIDX_WRITE) or decodes (PIDX_READ) in place the blocks [begin, end) of the file.
+/// Each block goes through its own scratch buffer before it is copied back to its slot, so the layout
+/// of the buffer does not depend on the order the threads finish.
+static void lossless_blocks(void* arg, int64_t begin, int64_t end, int64_t chunk)
+{
+  int codec;
+  int64_t i, coded;
+  struct lossless_task* task = (struct lossless_task*)arg;
+  unsigned char* block;
+  unsigned char* scratch;
+
+  scratch = malloc(task->block_size);
+  if (scratch == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    task->error = 1;
+    return;
+  }
+
+  for (i = begin; i < end; i++)
+  {
+    if (task->block_index[i] < 0)
+      continue;
+    block = task->buffer + task->block_index[i] * task->block_size;
+
+    if (task->MODE == PIDX_WRITE)
+    {
+      // blocks that do not shrink are stored raw
+      codec = PIDX_BLOCK_LOSSLESS;
+      if (task->adaptive == 1)
+        coded = PIDX_compression_block_encode(block, task->block_size, task->bits_per_value, task->tolerance, scratch, task->block_size - 1, &codec);
+      else
+        coded = PIDX_compression_lossless_encode(block, task->block_size, task->bits_per_value / 8, scratch, task->block_size - 1);
+      if (coded <= 0)
+        continue;
+
+      memcpy(block, scratch, coded);
+      task->coded_size[i] = (uint32_t) coded;
+      task->block_codec[i] = (uint32_t) codec;
+    }
+    else
+    {
+      if (task->coded_size[i] == 0)
+        continue;
+
+      if (task->coded_size[i] >= task->block_size || PIDX_compression_block_decode(block, task->coded_size[i], task->block_codec[i], task->bits_per_value, scratch, task->block_size) == -1)
       {
-	fprintf(stderr, "[%s] [%d] MPI_File_open() failed. (%s)\n", __FILE__, __LINE__, file_name);
-	return -1;
+        fprintf(stderr, "[%s] [%d] block %d is corrupt.\n", __FILE__, __LINE__, (int)i);
+        task->error = 1;
+        continue;
       }
+      memcpy(block, scratch, task->block_size);
     }
-    else
+  }
+
+  free(scratch);
+}
+
+/// Reads the blocks of the aggregator buffer of a coded variable (only their stored bytes, the file header
+/// tells how many) into their raw size slots, and decodes them in place.
+static int lossless_read(PIDX_io_id io_id, PIDX_io_backend_file fh, int64_t data_offset)
+{
+  int i, c, count = 0, ret = 0;
+  Agg_buffer agg_buffer = io_id->idx_derived_ptr->agg_buffer;
+  int blocks_per_file = io_id->idx_ptr->blocks_per_file;
+  uint64_t block_size = lossless_block_size(io_id, agg_buffer->var_number);
+  uint32_t* headers;
+  uint32_t* coded_size;
+  struct PIDX_io_backend_segment_struct* segment;
+  struct lossless_task task;
+
+  headers = malloc(10 * blocks_per_file * sizeof (*headers));
+  coded_size = malloc(2 * blocks_per_file * sizeof (*coded_size));
+  segment = malloc(blocks_per_file * sizeof (*segment));
+  if (headers == NULL || coded_size == NULL || segment == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    free(headers);
+    free(coded_size);
+    free(segment);
+    return -1;
+  }
+
+  if (PIDX_io_backend_pread(fh, (unsigned char*) headers, 10 * blocks_per_file * sizeof (*headers), header_entry(io_id, agg_buffer->var_number, 0) * sizeof (uint32_t)) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] PIDX_io_backend_pread() failed.\n", __FILE__, __LINE__);
+    ret = -1;
+  }
+
+  if (ret == 0)
+  {
+    // the codec of every block is in its header entry (files of the lossless codec only have raw and lossless blocks)
+    for (i = 0; i < blocks_per_file; i++)
+    {
+      coded_size[blocks_per_file + i] = ntohl(headers[i * 10 + 5]);
+      coded_size[i] = (coded_size[blocks_per_file + i] != PIDX_BLOCK_RAW) ? ntohl(headers[i * 10 + 4]) : 0;
+    }
+
+    // a coded block is shorter than its slot, reading the whole slot would run past the end of the file
+    for (i = 0; i < blocks_per_file; i++)
     {
-      mpi_ret = MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
-      if (mpi_ret != MPI_SUCCESS) 
+      c = io_id->idx_derived_ptr->block_offset_table->block_index[agg_buffer->file_number * blocks_per_file + i];
+      if (c < 0)
+        continue;
+      if (coded_size[i] >= block_size)
       {
-	fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
-	return -1;
+        fprintf(stderr, "[%s] [%d] block %d is corrupt.\n", __FILE__, __LINE__, i);
+        ret = -1;
+        break;
       }
+      segment[count].offset = data_offset + c * block_size;
+      segment[count].buffer = agg_buffer->buffer + c * block_size;
+      segment[count].size = (coded_size[i] != 0) ? coded_size[i] : block_size;
+      count++;
     }
-#else
-    fh = open(file_name, O_WRONLY);
-#endif
+
+    if (ret == 0 && PIDX_io_backend_preadv(fh, segment, count) == -1)
+    {
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_preadv() failed.\n", __FILE__, __LINE__);
+      ret = -1;
+    }
+  }
+
+  if (ret == 0)
+  {
+    memset(&task, 0, sizeof (task));
+    task.buffer = agg_buffer->buffer;
+    task.block_index = io_id->idx_derived_ptr->block_offset_table->block_index + agg_buffer->file_number * blocks_per_file;
+    task.block_size = block_size;
+    task.bits_per_value = io_id->idx_ptr->variable[agg_buffer->var_number]->bits_per_value;
+    task.coded_size = coded_size;
+    task.block_codec = coded_size + blocks_per_file;
+    task.MODE = PIDX_READ;
+
+    PIDX_compression_run(PIDX_compression_thread_count(io_id->idx_ptr), blocks_per_file, 1, lossless_blocks, &task);
+    if (task.error != 0)
+    {
+      fprintf(stderr, "[%s] [%d] file %d (variable %d) has corrupt blocks.\n", __FILE__, __LINE__, agg_buffer->file_number, agg_buffer->var_number);
+      ret = -1;
+    }
+  }
+
+  free(headers);
+  free(coded_size);
+  free(segment);
+  return ret;
+}
+
+static int write_read_samples(PIDX_io_id io_id, int variable_index, uint64_t hz_start_index, uint64_t hz_count, unsigned char* hz_buffer, int64_t buffer_offset, int MODE)
+{
+  int samples_per_file, block_number, file_index, file_count, ret = 0, file_number;
+  int bytes_per_sample, bytes_per_datatype;
+  off_t data_offset = 0;
+    
+  samples_per_file = io_id->idx_derived_ptr->samples_per_block * io_id->idx_ptr->blocks_per_file;    
+
+  bytes_per_datatype = io_id->idx_ptr->variable[variable_index]->bytes_per_brick;
+  
+  hz_buffer = hz_buffer + buffer_offset * bytes_per_datatype * io_id->idx_ptr->variable[variable_index]->values_per_sample;
+  
+  while (hz_count) 
+  {
+    block_number = hz_start_index / io_id->idx_derived_ptr->samples_per_block;
+    file_number = hz_start_index / samples_per_file;
+    file_index = hz_start_index % samples_per_file;
+    file_count = samples_per_file - file_index;
     
+    if ((int64_t)file_count > hz_count)
+      file_count = hz_count;
+
     data_offset = 0;
-    bytes_per_sample = io_id->idx_ptr->variable[variable_index]->bits_per_value / 8;
+    bytes_per_sample = io_id->idx_ptr->variable[variable_index]->bytes_per_brick;
+    
+#ifdef PIDX_VAR_SLOW_LOOP
+    int i = 0, l = 0, block_negative_offset = 0;
+    
     data_offset = file_index * bytes_per_sample * io_id->idx_ptr->variable[variable_index]->values_per_sample;
     data_offset += io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size;
     
-#ifdef PIDX_VAR_SLOW_LOOP
     block_negative_offset = PIDX_blocks_find_negative_offset(io_id->idx_ptr->blocks_per_file, block_number, io_id->idx_ptr->variable[variable_index]->VAR_global_block_layout);
-#else
-    block_negative_offset = PIDX_blocks_find_negative_offset(io_id->idx_ptr->blocks_per_file, block_number, io_id->idx_derived_ptr->global_block_layout);
-#endif
-      
     data_offset -= block_negative_offset * io_id->idx_derived_ptr->samples_per_block * bytes_per_sample * io_id->idx_ptr->variable[variable_index]->values_per_sample;
       
-#ifdef PIDX_VAR_SLOW_LOOP
     for (l = 0; l < variable_index; l++) 
     {
-      bytes_per_sample = io_id->idx_ptr->variable[l]->bits_per_value / 8;
+      bytes_per_sample = io_id->idx_ptr->variable[l]->bytes_per_brick;
       for (i = 0; i < io_id->idx_ptr->blocks_per_file; i++)
         if (PIDX_blocks_is_block_present((i + (io_id->idx_ptr->blocks_per_file * file_number)), io_id->idx_ptr->variable[l]->VAR_global_block_layout))
           data_offset = data_offset + (io_id->idx_ptr->variable[l]->values_per_sample * bytes_per_sample * io_id->idx_derived_ptr->samples_per_block);
     }
 #else
-    for (l = 0; l < variable_index; l++) 
+    data_offset = PIDX_blocks_find_offset(io_id->idx_derived_ptr->block_offset_table, variable_index, block_number);
+    if (data_offset == -1)
     {
-      bytes_per_sample = io_id->idx_ptr->variable[l]->bits_per_value / 8;
-      for (i = 0; i < io_id->idx_ptr->blocks_per_file; i++)
-        if (PIDX_blocks_is_block_present((i + (io_id->idx_ptr->blocks_per_file * file_number)), io_id->idx_derived_ptr->global_block_layout))
-          data_offset = data_offset + (io_id->idx_ptr->variable[l]->values_per_sample * bytes_per_sample * io_id->idx_derived_ptr->samples_per_block);
+      fprintf(stderr, "[%s] [%d] block %d of variable %d is not in the block layout.\n", __FILE__, __LINE__, block_number, variable_index);
+      return -1;
     }
+    data_offset += (off_t)(hz_start_index % io_id->idx_derived_ptr->samples_per_block) * bytes_per_sample * io_id->idx_ptr->variable[variable_index]->values_per_sample;
+    data_offset += io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size;
 #endif
     
 #if 0
@@ -181,53 +707,20 @@ static int write_read_samples(PIDX_io_id io_id, int variable_index, uint64_t hz_
       for(u = 0 ; u < file_count ; u++)
       {
 	memcpy(&uivalue, hz_buffer + (u * sizeof(unsigned char)), sizeof(unsigned char));
-	printf("[U INT] Value at %d = %f\n", u,  uivalue);
-      }
-    }
-#endif
-
-    if(MODE == PIDX_WRITE)
-    {
-#if PIDX_HAVE_MPI
-      
-      //printf("[Offset Count] [%d %d] :: [%d %d] File Number %d HZ Start %lld Total Samples %d\n", io_id->idx_derived_ptr->start_fs_block, io_id->idx_derived_ptr->fs_block_size, data_offset, file_count * io_id->idx_ptr->variable[variable_index]->values_per_sample * (io_id->idx_ptr->variable[variable_index]->bits_per_value/8), file_number, hz_start_index, samples_per_file);
-      
-      mpi_ret = MPI_File_write_at(fh, data_offset, hz_buffer, file_count * io_id->idx_ptr->variable[variable_index]->values_per_sample * (io_id->idx_ptr->variable[variable_index]->bits_per_value/8), MPI_BYTE, &status);
-      if (mpi_ret != MPI_SUCCESS) 
-      {
-        fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
-        return -1;
-      }
-#else
-      pwrite(fh, hz_buffer, file_count * io_id->idx_ptr->variable[variable_index]->values_per_sample * (io_id->idx_ptr->variable[variable_index]->bits_per_value/8), data_offset);
-#endif
-    }
-    if(MODE == PIDX_READ)
-    {
-#if PIDX_HAVE_MPI
-      mpi_ret = MPI_File_read_at(fh, data_offset, hz_buffer, file_count * io_id->idx_ptr->variable[variable_index]->values_per_sample * (io_id->idx_ptr->variable[variable_index]->bits_per_value/8), MPI_BYTE, &status);
-      if (mpi_ret != MPI_SUCCESS) 
-      {
-	fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
-	return -1;
+	printf("[U INT] Value at %d = %f\n", u,  uivalue);
       }
-#else
-      pread(fh, hz_buffer, file_count * io_id->idx_ptr->variable[variable_index]->values_per_sample * (io_id->idx_ptr->variable[variable_index]->bits_per_value/8), data_offset);
-#endif
     }
+#endif
+
+    ret = queue_segment(io_id, file_number, data_offset, hz_buffer, file_count * io_id->idx_ptr->variable[variable_index]->values_per_sample * bytes_per_datatype, MODE);
+    if (ret == -1)
+      return -1;
         
     //file_count = file_count / io_id->idx_ptr->variable[variable_index]->values_per_sample;
     
     hz_count -= file_count;
     hz_start_index += file_count;
     hz_buffer += file_count * io_id->idx_ptr->variable[variable_index]->values_per_sample * bytes_per_datatype;
-
-#if PIDX_HAVE_MPI
-    MPI_File_close(&fh);
-#else
-    close(fh);
-#endif
-
   }
   return (0);
 }
@@ -307,286 +800,274 @@ void print_buffer(unsigned char *buffer, int offset, int count, int sample_size,
   }
 }
 
+int PIDX_io_set_async(PIDX_io_id io_id, PIDX_async_io_id async_id)
+{
+  io_id->async_id = async_id;
+  return 0;
+}
+
 int PIDX_io_cached_data(uint32_t* cached_header)
 {
   cached_header_copy = cached_header;
   enable_caching = 1;
-  
+
   return 0;
 }
 
 
+int PIDX_io_lossless_encode(PIDX_io_id io_id)
+{
+  int var, i, codec, ret = 0;
+  uint64_t block_size;
+  int64_t table_offset;
+  int64_t *block_stats;
+  struct lossless_task task;
+  PIDX_variable variable;
+  Agg_buffer agg_buffer = io_id->idx_derived_ptr->agg_buffer;
+  int blocks_per_file = io_id->idx_ptr->blocks_per_file;
+  int variable_count = io_id->end_var_index - io_id->start_var_index + 1;
+  int64_t table_count = (int64_t) variable_count * blocks_per_file;
+  int is_aggregator = (agg_buffer->var_number != -1 && agg_buffer->sample_number != -1 && agg_buffer->file_number != -1);
+  PIDX_block_offset_table offset_table = io_id->idx_derived_ptr->block_offset_table;
+#if PIDX_HAVE_MPI
+  MPI_Comm file_comm;
+#endif
+
+  if (io_id->idx_ptr->compression_type != PIDX_LOSSLESS_COMPRESSION && io_id->idx_ptr->compression_type != PIDX_ADAPTIVE_COMPRESSION)
+    return 0;
+
+  free(io_id->coded_size);
+  io_id->coded_size = malloc(2 * table_count * sizeof (*io_id->coded_size));
+  block_stats = malloc(2 * PIDX_BLOCK_CODEC_COUNT * variable_count * sizeof (*block_stats));
+  if (io_id->coded_size == NULL || block_stats == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    free(block_stats);
+    return -1;
+  }
+  memset(io_id->coded_size, 0, 2 * table_count * sizeof (*io_id->coded_size));
+  memset(block_stats, 0, 2 * PIDX_BLOCK_CODEC_COUNT * variable_count * sizeof (*block_stats));
+  io_id->block_codec = io_id->coded_size + table_count;
+
+  if (is_aggregator == 1)
+  {
+    block_size = lossless_block_size(io_id, agg_buffer->var_number);
+    if (block_size != 0)
+    {
+      variable = io_id->idx_ptr->variable[agg_buffer->var_number];
+      table_offset = (int64_t) (agg_buffer->var_number - io_id->start_var_index) * blocks_per_file;
+      memset(&task, 0, sizeof (task));
+      task.buffer = agg_buffer->buffer;
+      task.block_index = offset_table->block_index + agg_buffer->file_number * blocks_per_file;
+      task.block_size = block_size;
+      task.bits_per_value = variable->bits_per_value;
+      task.adaptive = (io_id->idx_ptr->compression_type == PIDX_ADAPTIVE_COMPRESSION);
+      // the lossy block codec only for a variable that accepts an error and whose bricks were not already coded
+      if (task.adaptive == 1 && variable->compression_mode == PIDX_COMPRESSION_FIXED_ACCURACY && variable->bytes_per_brick == (variable->bits_per_value / 8) * io_id->idx_ptr->compression_block_size[0] * io_id->idx_ptr->compression_block_size[1] * io_id->idx_ptr->compression_block_size[2] * io_id->idx_ptr->compression_block_size[3] * io_id->idx_ptr->compression_block_size[4])
+        task.tolerance = variable->compression_param;
+      task.coded_size = io_id->coded_size + table_offset;
+      task.block_codec = io_id->block_codec + table_offset;
+      task.MODE = PIDX_WRITE;
+
+      PIDX_compression_run(PIDX_compression_thread_count(io_id->idx_ptr), blocks_per_file, 1, lossless_blocks, &task);
+      if (task.error != 0)
+        ret = -1;
+
+      // codec mix of the blocks of this aggregator (every coded block has exactly one)
+      for (i = 0; i < blocks_per_file; i++)
+      {
+        if (offset_table->block_index[agg_buffer->file_number * blocks_per_file + i] < 0)
+          continue;
+        codec = (task.coded_size[i] != 0) ? task.block_codec[i] : PIDX_BLOCK_RAW;
+        block_stats[(agg_buffer->var_number - io_id->start_var_index) * 2 * PIDX_BLOCK_CODEC_COUNT + codec]++;
+        block_stats[(agg_buffer->var_number - io_id->start_var_index) * 2 * PIDX_BLOCK_CODEC_COUNT + PIDX_BLOCK_CODEC_COUNT + codec] += (task.coded_size[i] != 0) ? task.coded_size[i] : block_size;
+      }
+    }
+  }
+
+#if PIDX_HAVE_MPI
+  // the first aggregator of a file (variable 0, so only in the variable group that starts with it) writes the whole
+  // header and needs the sizes and codecs of the blocks of the other aggregators of its file, and of no other file
+  if (io_id->start_var_index == 0)
+  {
+    MPI_Comm_split(io_id->comm, (is_aggregator == 1) ? agg_buffer->file_number : MPI_UNDEFINED, (is_aggregator == 1 && agg_buffer->var_number == 0 && agg_buffer->sample_number == 0) ? 0 : 1, &file_comm);
+    if (file_comm != MPI_COMM_NULL)
+    {
+      MPI_Reduce((agg_buffer->var_number == 0 && agg_buffer->sample_number == 0) ? MPI_IN_PLACE : io_id->coded_size, io_id->coded_size, 2 * table_count, MPI_UNSIGNED, MPI_MAX, 0, file_comm);
+      MPI_Comm_free(&file_comm);
+    }
+  }
+
+  MPI_Allreduce(MPI_IN_PLACE, block_stats, 2 * PIDX_BLOCK_CODEC_COUNT * variable_count, MPI_INT64_T, MPI_SUM, io_id->comm);
+#endif
+
+  for (var = io_id->start_var_index; var <= io_id->end_var_index; var++)
+  {
+    variable = io_id->idx_ptr->variable[var];
+    memcpy(variable->compression_block_count, block_stats + (var - io_id->start_var_index) * 2 * PIDX_BLOCK_CODEC_COUNT, sizeof (variable->compression_block_count));
+    memcpy(variable->compression_block_bytes, block_stats + (var - io_id->start_var_index) * 2 * PIDX_BLOCK_CODEC_COUNT + PIDX_BLOCK_CODEC_COUNT, sizeof (variable->compression_block_bytes));
+  }
+
+  free(block_stats);
+  return ret;
+}
+
+
 int PIDX_io_aggregated_write(PIDX_io_id io_id)
 {
   int64_t data_offset = 0;  
+  uint64_t write_size = 0;
   char file_name[PATH_MAX];
-  int i = 0, k = 0, rank, mpi_ret;
-  uint32_t *headers;
+  int i = 0, k = 0, rank = 0;
   int total_header_size;
-  int write_count;
   int bytes_per_datatype;
+  int header_write = 0;
+  int alignment = 0;
+  Agg_buffer agg_buffer = io_id->idx_derived_ptr->agg_buffer;
+  PIDX_io_backend_file fh;
   
 #if PIDX_RECORD_TIME
   double t1, t2, t3, t4, t5;
 #endif
   
 #if PIDX_HAVE_MPI
-  MPI_File fh;
-  MPI_Status status;
   MPI_Comm_rank(io_id->comm, &rank);
-#else
-  int fh;
 #endif
   
-  if (io_id->idx_derived_ptr->agg_buffer->var_number == 0 && io_id->idx_derived_ptr->agg_buffer->sample_number == 0)
-  {
-    bytes_per_datatype =  (io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8)  * (io_id->idx_ptr->compression_block_size[0] * io_id->idx_ptr->compression_block_size[1] * io_id->idx_ptr->compression_block_size[2] * io_id->idx_ptr->compression_block_size[3] * io_id->idx_ptr->compression_block_size[4]);
-    
+  if (agg_buffer->var_number == -1 || agg_buffer->sample_number == -1 || agg_buffer->file_number == -1)
+    return 0;
+  
 #if PIDX_RECORD_TIME
-    t1 = MPI_Wtime();
-#endif
-    generate_file_name(io_id->idx_ptr->blocks_per_file, io_id->idx_ptr->filename_template, (unsigned int) io_id->idx_derived_ptr->agg_buffer->file_number, file_name, PATH_MAX);
-
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
-    if (mpi_ret != MPI_SUCCESS) 
-    {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed filename %s.\n", __FILE__, __LINE__, file_name);
-      return -1;
-    }
-#else
-    fh = open(file_name, O_WRONLY);
+  t1 = MPI_Wtime();
 #endif
-    
+  
+  bytes_per_datatype = io_id->idx_ptr->variable[agg_buffer->var_number]->bytes_per_brick;
+  
+  write_size = (uint64_t) aggregated_blocks_in_file(io_id, agg_buffer->var_number, agg_buffer->file_number) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * bytes_per_datatype;
+  
+  generate_file_name(io_id->idx_ptr->blocks_per_file, io_id->idx_ptr->filename_template, (unsigned int) agg_buffer->file_number, file_name, PATH_MAX);
+  
 #if PIDX_RECORD_TIME
-    t2 = MPI_Wtime();
+  t2 = MPI_Wtime();
 #endif
-    
+  
+  if (agg_buffer->var_number == 0 && agg_buffer->sample_number == 0)
+  {
+    // the first aggregator of a file also writes the file header, PIDX_agg_buf_create left room for it in front of the data
+    header_write = 1;
     data_offset = 0;
     total_header_size = (10 + (10 * io_id->idx_ptr->blocks_per_file)) * sizeof (uint32_t) * io_id->idx_ptr->variable_count;
-    
-    headers = (uint32_t*)malloc(total_header_size);
-    memset(headers, 0, total_header_size);
+    assert(agg_buffer->buffer_header_size == io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size);
     
     if (enable_caching == 1)
-      memcpy (headers, cached_header_copy, total_header_size);
-    
-#if PIDX_RECORD_TIME
-    t3 = MPI_Wtime();
-#endif
-    
-#ifdef PIDX_VAR_SLOW_LOOP
-    unsigned char* temp_buffer = realloc(io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size));
-    
-    if (temp_buffer == NULL)
-    {
-      ;
-    }
-    else
-    {
-      io_id->idx_derived_ptr->agg_buffer->buffer = temp_buffer;
-      memmove(io_id->idx_derived_ptr->agg_buffer->buffer + io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size, io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * ( io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) );
-      memcpy(io_id->idx_derived_ptr->agg_buffer->buffer, headers, total_header_size);
-      memset(io_id->idx_derived_ptr->agg_buffer->buffer + total_header_size, 0, (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size - total_header_size));
-    }
-    free(headers);
-    
-    
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_write_at(fh, 0, io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size), MPI_BYTE, &status);
-    if (mpi_ret != MPI_SUCCESS) 
-    {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
-      return -1;
-    }
-    
-    MPI_Get_count(&status, MPI_BYTE, &write_count);
-    if (write_count != (((io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * ( io_id->idx_derived_ptr->samples_per_block  / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size))
-    {
-      fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
-      return -1;
-    }
-    
-#else
-    pwrite(fh, io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size), 0);
-#endif
-    
-#else
-    unsigned char* temp_buffer = (unsigned char*)realloc(io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size));
-    
-    if (temp_buffer == NULL)
-    {
-      fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
-      return -1;
-    }
+      memcpy(agg_buffer->buffer_memory, cached_header_copy, total_header_size);
     else
-    {
-      io_id->idx_derived_ptr->agg_buffer->buffer = temp_buffer;
-      memmove(io_id->idx_derived_ptr->agg_buffer->buffer + io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size, io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * ( io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) );
-      memcpy(io_id->idx_derived_ptr->agg_buffer->buffer, headers, total_header_size);
-      memset(io_id->idx_derived_ptr->agg_buffer->buffer + total_header_size, 0, (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size - total_header_size));
-    }
-    free(headers);
-    
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_write_at(fh, 0, io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size), MPI_BYTE, &status);
-    if (mpi_ret != MPI_SUCCESS) 
-    {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
-      return -1;
-    }
-    
-    MPI_Get_count(&status, MPI_BYTE, &write_count);
-    //printf("[A] Elemets to write %d\n", write_count);
-    if (write_count != (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * ( io_id->idx_derived_ptr->samples_per_block  / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size))
-    {
-      fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
-      return -1;
-    } 
+      memset(agg_buffer->buffer_memory, 0, total_header_size);
+    memset(agg_buffer->buffer_memory + total_header_size, 0, agg_buffer->buffer_header_size - total_header_size);
+    if (io_id->idx_ptr->sparse_layout == 1 && enable_caching == 0)
+      layout_header(io_id, agg_buffer->file_number, (uint32_t*) agg_buffer->buffer_memory);
+    if (io_id->coded_size != NULL)
+      lossless_header(io_id, agg_buffer->file_number, (uint32_t*) agg_buffer->buffer_memory);
+    
+    write_size = write_size + agg_buffer->buffer_header_size;
+  }
+  else
+  {
+    data_offset = io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size;
     
-#else
-    pwrite(fh, io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size), 0);
-#endif
-
-#endif      
+    for (k = 0; k < agg_buffer->var_number; k++) 
+      for (i = 0; i < io_id->idx_ptr->variable[k]->values_per_sample; i++)
+        data_offset = (int64_t) data_offset + (int64_t) aggregated_blocks_in_file(io_id, k, agg_buffer->file_number) * io_id->idx_derived_ptr->samples_per_block * io_id->idx_ptr->variable[k]->bytes_per_brick;
     
+    for (i = 0; i < agg_buffer->sample_number; i++)
+      data_offset = (int64_t) data_offset + (int64_t) aggregated_blocks_in_file(io_id, agg_buffer->var_number, agg_buffer->file_number) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype);
+  }
+  
 #if PIDX_RECORD_TIME
-    t4 = MPI_Wtime();
+  t3 = MPI_Wtime();
 #endif
-
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_close(&fh);
-    if (mpi_ret != MPI_SUCCESS) 
+  
+  // buffer_memory is the header followed by the data for the first aggregator of a file and just the data otherwise
+  if (io_id->idx_derived_ptr->direct_io == 1)
+    alignment = io_id->idx_derived_ptr->fs_block_size;
+  
+  // the background and O_DIRECT writers go straight to the files, they only make sense for backends that use them
+  // (synchronous writes through MPI-IO stay with MPI-IO, they only keep the aligned buffers)
+  // (the coded blocks and their header entries are written in place, a late header from the writer thread would undo the entries)
+  if (PIDX_io_backend_get_ops(io_id->idx_derived_ptr->io_backend)->file_system == 0 || io_id->coded_size != NULL)
+    alignment = 0;
+  
+  if (io_id->async_id != NULL && PIDX_io_backend_get_ops(io_id->idx_derived_ptr->io_backend)->file_system == 1 && io_id->coded_size == NULL)
+  {
+    // the writer thread now owns the aggregator buffer
+    if (PIDX_async_io_submit(io_id->async_id, file_name, data_offset, agg_buffer->buffer_memory, write_size, alignment) != 0)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "[%s] [%d] PIDX_async_io_submit() failed.\n", __FILE__, __LINE__);
       return -1;
     }
-#else
-      close(fh);
-#endif
-
-#if PIDX_RECORD_TIME
-    t5 = MPI_Wtime();
-#endif
-
+    agg_buffer->buffer_memory = 0;
+    agg_buffer->buffer = 0;
+    
 #if PIDX_RECORD_TIME
-    printf("A. [R %d] [OS 0 %ld %ld (%d %d %d) %ld] [FVS %d %d %d] Time: O %f H %f W %f C %f\n", rank, 
-            (long int)(((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))) + (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size), 
-            (long int)io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number] * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * bytes_per_datatype, 
-            (int)io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number], (int)(io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor), (int)bytes_per_datatype, 
-            (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size), io_id->idx_derived_ptr->agg_buffer->file_number, io_id->idx_derived_ptr->agg_buffer->var_number, io_id->idx_derived_ptr->agg_buffer->sample_number, (t2-t1), (t3-t2), (t4-t3), (t5-t4));
+    t4 = t5 = MPI_Wtime();
 #endif
   }
-  else if (io_id->idx_derived_ptr->agg_buffer->var_number != -1 && io_id->idx_derived_ptr->agg_buffer->sample_number != -1 && io_id->idx_derived_ptr->agg_buffer->file_number != -1) 
+  else if (alignment != 0 && io_id->idx_derived_ptr->io_backend != PIDX_io_backend_mpi)
   {
-#if PIDX_RECORD_TIME
-    t1 = MPI_Wtime();
-#endif
-    bytes_per_datatype =  (io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8) * (io_id->idx_ptr->compression_block_size[0] * io_id->idx_ptr->compression_block_size[1] * io_id->idx_ptr->compression_block_size[2] * io_id->idx_ptr->compression_block_size[3] * io_id->idx_ptr->compression_block_size[4]);
-    
-    generate_file_name(io_id->idx_ptr->blocks_per_file, io_id->idx_ptr->filename_template, (unsigned int) io_id->idx_derived_ptr->agg_buffer->file_number, file_name, PATH_MAX);
-    
-    
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
-    if (mpi_ret != MPI_SUCCESS) 
+    // no fdatasync per extent, the page cache only holds the unaligned tail
+    if (PIDX_async_io_pwrite(file_name, data_offset, agg_buffer->buffer_memory, write_size, alignment, 0) != 0)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() filename %s failed.\n", __FILE__, __LINE__, file_name);
+      fprintf(stderr, "[%s] [%d] PIDX_async_io_pwrite() failed.\n", __FILE__, __LINE__);
       return -1;
     }
-#else
-    fh = open(file_name, O_WRONLY);
-#endif
-
+    
 #if PIDX_RECORD_TIME
-    t2 = MPI_Wtime();
+    t4 = t5 = MPI_Wtime();
 #endif
-    
-    data_offset = 0;
-    data_offset += io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size;
-    
-#ifdef PIDX_VAR_SLOW_LOOP
-    
-    for (k = 0; k < io_id->idx_derived_ptr->agg_buffer->var_number; k++) 
-      for (i = 0; i < io_id->idx_ptr->variable[k]->values_per_sample; i++)
-        data_offset = data_offset + io_id->idx_ptr->variable[k]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number] * io_id->idx_derived_ptr->samples_per_block * (io_id->idx_ptr->variable[k]->bits_per_value/8) /* io_id->idx_derived_ptr->aggregation_factor*/;
-    
-    for (i = 0; i < io_id->idx_derived_ptr->agg_buffer->sample_number; i++)
-      data_offset = data_offset + io_id->idx_ptr->variable[k]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number] * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype);
-    
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_write_at(fh, data_offset, io_id->idx_derived_ptr->agg_buffer->buffer, ((io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype)) , MPI_BYTE, &status);
-    if (mpi_ret != MPI_SUCCESS) 
-    {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
-      return -1;
-    }
-    
-    MPI_Get_count(&status, MPI_BYTE, &write_count);
-    if (write_count != ((io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->VAR_blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype)) )
+  }
+  else
+  {
+    if (PIDX_io_backend_open(io_id->idx_derived_ptr->io_backend, file_name, PIDX_IO_BACKEND_WRITE, &fh) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_open() failed filename %s.\n", __FILE__, __LINE__, file_name);
       return -1;
     }
-        
-#else
-    pwrite(fh, io_id->idx_derived_ptr->agg_buffer->buffer, ((io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->blocks_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype)), data_offset);
-#endif
-    
-#else
-    for (k = 0; k < io_id->idx_derived_ptr->agg_buffer->var_number; k++) 
-      for (i = 0; i < io_id->idx_ptr->variable[k]->values_per_sample; i++)
-        data_offset = (int64_t) data_offset + (int64_t) io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number] * io_id->idx_derived_ptr->samples_per_block * (io_id->idx_ptr->variable[k]->bits_per_value/8) /* io_id->idx_derived_ptr->aggregation_factor */;
-    
-    for (i = 0; i < io_id->idx_derived_ptr->agg_buffer->sample_number; i++)
-      data_offset = (int64_t) data_offset + (int64_t) io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number] * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype);
     
-#if PIDX_HAVE_MPI
-
-    mpi_ret = MPI_File_write_at(fh, data_offset, io_id->idx_derived_ptr->agg_buffer->buffer, ((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor)  * (bytes_per_datatype)) , MPI_BYTE, &status);
-    if (mpi_ret != MPI_SUCCESS) 
+    if (io_id->coded_size != NULL && lossless_block_size(io_id, agg_buffer->var_number) != 0)
     {
-      fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_open() failed.\n", (long long) data_offset, __FILE__, __LINE__);
-      return -1;
+      if (lossless_write(io_id, fh, data_offset, header_write) == -1)
+      {
+        fprintf(stderr, "Data offset = %lld [%s] [%d] lossless_write() failed.\n", (long long) data_offset, __FILE__, __LINE__);
+        PIDX_io_backend_close(fh);
+        return -1;
+      }
     }
-    
-    MPI_Get_count(&status, MPI_BYTE, &write_count);
-    //printf("[B] Elemets to write %d\n", write_count);
-    if (write_count != ((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype)))
+    else if (PIDX_io_backend_pwrite(fh, agg_buffer->buffer_memory, write_size, data_offset) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "Data offset = %lld [%s] [%d] PIDX_io_backend_pwrite() failed.\n", (long long) data_offset, __FILE__, __LINE__);
+      PIDX_io_backend_close(fh);
       return -1;
     }
     
-#else
-    pwrite(fh, io_id->idx_derived_ptr->agg_buffer->buffer, ((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype)), data_offset);
-#endif
-    
-#endif
-    
 #if PIDX_RECORD_TIME
-    t3 = MPI_Wtime();
+    t4 = MPI_Wtime();
 #endif
     
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_close(&fh);
-    if (mpi_ret != MPI_SUCCESS) 
+    if (PIDX_io_backend_close(fh) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_close() failed.\n", __FILE__, __LINE__);
       return -1;
     }
-#else
-    close(fh);
-#endif
-      
-#if PIDX_RECORD_TIME
-    t4 = MPI_Wtime();
-#endif
     
 #if PIDX_RECORD_TIME
-    printf("B. [R %d] [OS %lld %d] [FVS %d %d %d] Time: O %f H %f W %f C %f\n", rank, (long long) data_offset, ((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor)  * (bytes_per_datatype)), io_id->idx_derived_ptr->agg_buffer->file_number, io_id->idx_derived_ptr->agg_buffer->var_number, io_id->idx_derived_ptr->agg_buffer->sample_number, (t2-t1), (t2-t2), (t3-t2), (t4-t3));
+    t5 = MPI_Wtime();
 #endif
   }
+  
+#if PIDX_RECORD_TIME
+  printf("%s. [R %d] [OS %lld %lld] [FVS %d %d %d] Time: O %f H %f W %f C %f\n", (header_write == 1) ? "A" : "B", rank, (long long) data_offset, (long long) write_size, agg_buffer->file_number, agg_buffer->var_number, agg_buffer->sample_number, (t2-t1), (t3-t2), (t4-t3), (t5-t4));
+#endif
+  
   return 0;
 }
 
@@ -594,43 +1075,34 @@ int PIDX_io_aggregated_read(PIDX_io_id io_id)
 {
   int64_t data_offset = 0;  
   char file_name[PATH_MAX];
-  int i = 0, k = 0, rank, mpi_ret;
+  int i = 0, k = 0, rank = 0;
   uint32_t *headers;
   int total_header_size;
-  int write_count;
   int bytes_per_datatype;
+  PIDX_io_backend_file fh;
   
 #if PIDX_RECORD_TIME
   double t1, t2, t3, t4, t5;
 #endif
   
 #if PIDX_HAVE_MPI
-  MPI_File fh;
-  MPI_Status status;
   MPI_Comm_rank(io_id->comm, &rank);
-#else
-  int fh;
 #endif
   
   if (io_id->idx_derived_ptr->agg_buffer->var_number == 0 && io_id->idx_derived_ptr->agg_buffer->sample_number == 0)
   {
-    bytes_per_datatype =  (io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8)  * (io_id->idx_ptr->compression_block_size[0] * io_id->idx_ptr->compression_block_size[1] * io_id->idx_ptr->compression_block_size[2] * io_id->idx_ptr->compression_block_size[3] * io_id->idx_ptr->compression_block_size[4]);
+    bytes_per_datatype = io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->bytes_per_brick;
     
 #if PIDX_RECORD_TIME
     t1 = MPI_Wtime();
 #endif
     generate_file_name(io_id->idx_ptr->blocks_per_file, io_id->idx_ptr->filename_template, (unsigned int) io_id->idx_derived_ptr->agg_buffer->file_number, file_name, PATH_MAX);
 
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
-    if (mpi_ret != MPI_SUCCESS) 
+    if (PIDX_io_backend_open(io_id->idx_derived_ptr->io_backend, file_name, PIDX_IO_BACKEND_READ, &fh) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed filename %s.\n", __FILE__, __LINE__, file_name);
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_open() failed filename %s.\n", __FILE__, __LINE__, file_name);
       return -1;
     }
-#else
-    fh = open(file_name, O_RDONLY);
-#endif
     
 #if PIDX_RECORD_TIME
     t2 = MPI_Wtime();
@@ -642,46 +1114,30 @@ int PIDX_io_aggregated_read(PIDX_io_id io_id)
 #endif
 
     
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_read_at(fh, (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size), io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))), MPI_BYTE, &status);
-    if (mpi_ret != MPI_SUCCESS) 
+    if (lossless_block_size(io_id, io_id->idx_derived_ptr->agg_buffer->var_number) == 0 && PIDX_io_backend_pread(fh, io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))), (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size)) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_pread() failed.\n", __FILE__, __LINE__);
+      PIDX_io_backend_close(fh);
       return -1;
     }
     
-    MPI_Get_count(&status, MPI_BYTE, &write_count);
-    //printf("[A] Elemets to write %d\n", write_count);
-    if (write_count != (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * ( io_id->idx_derived_ptr->samples_per_block  / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))))
+    if (lossless_block_size(io_id, io_id->idx_derived_ptr->agg_buffer->var_number) != 0 && lossless_read(io_id, fh, io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "[%s] [%d] lossless_read() failed.\n", __FILE__, __LINE__);
+      PIDX_io_backend_close(fh);
       return -1;
     }
-    
-#else
-    pread(fh, io_id->idx_derived_ptr->agg_buffer->buffer, (((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype))), (io_id->idx_derived_ptr->start_fs_block * io_id->idx_derived_ptr->fs_block_size));
-    
-    double x[8];
-    memcpy(x, io_id->idx_derived_ptr->agg_buffer->buffer, sizeof(double) * 8);
-    printf("count = %f %f %f %f %f %f %f %f\n", x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7]);
-    
-#endif
 
     
 #if PIDX_RECORD_TIME
     t4 = MPI_Wtime();
 #endif
 
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_close(&fh);
-    if (mpi_ret != MPI_SUCCESS) 
+    if (PIDX_io_backend_close(fh) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_close() failed.\n", __FILE__, __LINE__);
       return -1;
     }
-#else
-      close(fh);
-#endif
 
 #if PIDX_RECORD_TIME
     t5 = MPI_Wtime();
@@ -700,21 +1156,16 @@ int PIDX_io_aggregated_read(PIDX_io_id io_id)
 #if PIDX_RECORD_TIME
     t1 = MPI_Wtime();
 #endif
-    bytes_per_datatype =  (io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->bits_per_value/8) * (io_id->idx_ptr->compression_block_size[0] * io_id->idx_ptr->compression_block_size[1] * io_id->idx_ptr->compression_block_size[2] * io_id->idx_ptr->compression_block_size[3] * io_id->idx_ptr->compression_block_size[4]);
+    bytes_per_datatype = io_id->idx_ptr->variable[io_id->idx_derived_ptr->agg_buffer->var_number]->bytes_per_brick;
     
     generate_file_name(io_id->idx_ptr->blocks_per_file, io_id->idx_ptr->filename_template, (unsigned int) io_id->idx_derived_ptr->agg_buffer->file_number, file_name, PATH_MAX);
     
     
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_open(MPI_COMM_SELF, file_name, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
-    if (mpi_ret != MPI_SUCCESS) 
+    if (PIDX_io_backend_open(io_id->idx_derived_ptr->io_backend, file_name, PIDX_IO_BACKEND_READ, &fh) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() filename %s failed.\n", __FILE__, __LINE__, file_name);
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_open() failed filename %s.\n", __FILE__, __LINE__, file_name);
       return -1;
     }
-#else
-    fh = open(file_name, O_WRONLY);
-#endif
 
 #if PIDX_RECORD_TIME
     t2 = MPI_Wtime();
@@ -726,47 +1177,35 @@ int PIDX_io_aggregated_read(PIDX_io_id io_id)
 
     for (k = 0; k < io_id->idx_derived_ptr->agg_buffer->var_number; k++) 
       for (i = 0; i < io_id->idx_ptr->variable[k]->values_per_sample; i++)
-        data_offset = (int64_t) data_offset + (int64_t) io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number] * io_id->idx_derived_ptr->samples_per_block * (io_id->idx_ptr->variable[k]->bits_per_value/8) /* io_id->idx_derived_ptr->aggregation_factor */;
+        data_offset = (int64_t) data_offset + (int64_t) io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number] * io_id->idx_derived_ptr->samples_per_block * io_id->idx_ptr->variable[k]->bytes_per_brick /* io_id->idx_derived_ptr->aggregation_factor */;
     
     for (i = 0; i < io_id->idx_derived_ptr->agg_buffer->sample_number; i++)
       data_offset = (int64_t) data_offset + (int64_t) io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number] * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype);
     
-#if PIDX_HAVE_MPI
-
-    mpi_ret = MPI_File_read_at(fh, data_offset, io_id->idx_derived_ptr->agg_buffer->buffer, ((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor)  * (bytes_per_datatype)) , MPI_BYTE, &status);
-    if (mpi_ret != MPI_SUCCESS) 
+    if (lossless_block_size(io_id, io_id->idx_derived_ptr->agg_buffer->var_number) == 0 && PIDX_io_backend_pread(fh, io_id->idx_derived_ptr->agg_buffer->buffer, ((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype)), data_offset) == -1)
     {
-      fprintf(stderr, "Data offset = %lld [%s] [%d] MPI_File_open() failed.\n", (long long) data_offset, __FILE__, __LINE__);
+      fprintf(stderr, "Data offset = %lld [%s] [%d] PIDX_io_backend_pread() failed.\n", (long long) data_offset, __FILE__, __LINE__);
+      PIDX_io_backend_close(fh);
       return -1;
     }
     
-    MPI_Get_count(&status, MPI_BYTE, &write_count);
-    //printf("[B] Elemets to write %d\n", write_count);
-    if (write_count != ((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block/io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype)))
+    if (lossless_block_size(io_id, io_id->idx_derived_ptr->agg_buffer->var_number) != 0 && lossless_read(io_id, fh, data_offset) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "[%s] [%d] lossless_read() failed.\n", __FILE__, __LINE__);
+      PIDX_io_backend_close(fh);
       return -1;
     }
     
-#else
-    pread(fh, io_id->idx_derived_ptr->agg_buffer->buffer, ((io_id->idx_derived_ptr->existing_blocks_index_per_file[io_id->idx_derived_ptr->agg_buffer->file_number]) * (io_id->idx_derived_ptr->samples_per_block / io_id->idx_derived_ptr->aggregation_factor) * (bytes_per_datatype)), data_offset);
-#endif
-    
     
 #if PIDX_RECORD_TIME
     t3 = MPI_Wtime();
 #endif
     
-#if PIDX_HAVE_MPI
-    mpi_ret = MPI_File_close(&fh);
-    if (mpi_ret != MPI_SUCCESS) 
+    if (PIDX_io_backend_close(fh) == -1)
     {
-      fprintf(stderr, "[%s] [%d] MPI_File_open() failed.\n", __FILE__, __LINE__);
+      fprintf(stderr, "[%s] [%d] PIDX_io_backend_close() failed.\n", __FILE__, __LINE__);
       return -1;
     }
-#else
-    close(fh);
-#endif
       
 #if PIDX_RECORD_TIME
     t4 = MPI_Wtime();
@@ -880,14 +1319,15 @@ int PIDX_io_per_process_write(PIDX_io_id io_id)
     
     else if(io_id->idx_ptr->variable[io_id->start_var_index]->patch_group_ptr[p]->box_group_type == 1)
     {
-      for (i = /*io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_from*/io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_to - 1; i < io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_to; i++)
+      // as in PIDX_agg_write, every level
+      for (i = io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_from; i < io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_to; i++)
       {
         if (io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->samples_per_level[i] != 0)
         {
           for(var = io_id->start_var_index; var <= io_id->end_var_index; var++)
           {
             index = 0;
-            count =  io_id->idx_ptr->variable[var]->HZ_patch[p]->end_hz_index[i] - io_id->idx_ptr->variable[var]->HZ_patch[p]->start_hz_index[i] + 1;
+            count =  io_id->idx_ptr->variable[var]->HZ_patch[p]->end_hz_index[i] - io_id->idx_ptr->variable[var]->HZ_patch[p]->start_hz_index[i] + 1 - (io_id->idx_ptr->variable[var]->HZ_patch[p]->missing_block_count_per_level[i] * io_id->idx_derived_ptr->samples_per_block);
             ret = write_read_samples(io_id, var, io_id->idx_ptr->variable[var]->HZ_patch[p]->start_hz_index[i], count, io_id->idx_ptr->variable[var]->HZ_patch[p]->buffer[i], 0, PIDX_WRITE);
             if (ret == -1)
             {
@@ -951,6 +1391,15 @@ int PIDX_io_per_process_write(PIDX_io_id io_id)
       }
     }
   }
+  
+  // everything above only queued the runs, issue them now (one batch per file)
+  ret = flush_segments(io_id, PIDX_WRITE);
+  if (ret == -1)
+  {
+    fprintf(stderr, "[%s] [%d] flush_segments() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+  
   return 0;
 }
 
@@ -1054,20 +1503,20 @@ int PIDX_io_per_process_read(PIDX_io_id io_id)
     
     else if(io_id->idx_ptr->variable[io_id->start_var_index]->patch_group_ptr[p]->box_group_type == 1)
     {
-      for (i = /*io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_from*/io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_to - 1; i < io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_to; i++)
+      // as in PIDX_agg_read, every level (samples_per_level is only known once the samples are decoded)
+      for (i = io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_from; i < io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->HZ_level_to; i++)
       {
-        if (io_id->idx_ptr->variable[io_id->start_var_index]->HZ_patch[p]->samples_per_level[i] != 0)
+        for(var = io_id->start_var_index; var <= io_id->end_var_index; var++)
         {
-          for(var = io_id->start_var_index; var <= io_id->end_var_index; var++)
+          index = 0;
+          count =  io_id->idx_ptr->variable[var]->HZ_patch[p]->end_hz_index[i] - io_id->idx_ptr->variable[var]->HZ_patch[p]->start_hz_index[i] + 1 - (io_id->idx_ptr->variable[var]->HZ_patch[p]->missing_block_count_per_level[i] * io_id->idx_derived_ptr->samples_per_block);
+          if (count == 0)
+            continue;
+          ret = write_read_samples(io_id, var, io_id->idx_ptr->variable[var]->HZ_patch[p]->start_hz_index[i], count, io_id->idx_ptr->variable[var]->HZ_patch[p]->buffer[i], 0, PIDX_READ);
+          if (ret == -1)
           {
-            index = 0;
-            count =  io_id->idx_ptr->variable[var]->HZ_patch[p]->end_hz_index[i] - io_id->idx_ptr->variable[var]->HZ_patch[p]->start_hz_index[i] + 1;
-            ret = write_read_samples(io_id, var, io_id->idx_ptr->variable[var]->HZ_patch[p]->start_hz_index[i], count, io_id->idx_ptr->variable[var]->HZ_patch[p]->buffer[i], 0, PIDX_READ);
-            if (ret == -1)
-            {
-              fprintf(stderr, "[%s] [%d] write_read_samples() failed.\n", __FILE__, __LINE__);
-              return -1;
-            }
+            fprintf(stderr, "[%s] [%d] write_read_samples() failed.\n", __FILE__, __LINE__);
+            return -1;
           }
         }
       }
@@ -1132,15 +1581,43 @@ int PIDX_io_per_process_read(PIDX_io_id io_id)
       }
     }
   }
+  
+  // everything above only queued the runs, issue them now (one batch per file)
+  ret = flush_segments(io_id, PIDX_READ);
+  if (ret == -1)
+  {
+    fprintf(stderr, "[%s] [%d] flush_segments() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+  
   return 0;
 }
 
 
 int PIDX_io_finalize(PIDX_io_id io_id) 
 {
+  int i, ret = 0;
+  
+  ret = close_all_file_handles(io_id);
+  
+  free(io_id->coded_size);
+  io_id->coded_size = 0;
+  io_id->block_codec = 0;
+  free(io_id->segment);
+  io_id->segment = 0;
+  free(io_id->file_segment);
+  io_id->file_segment = 0;
+  
+  if (io_id->file_name_cache != NULL)
+  {
+    for (i = 0; i < io_id->idx_derived_ptr->max_file_count; i++)
+      free(io_id->file_name_cache[i]);
+    free(io_id->file_name_cache);
+    io_id->file_name_cache = 0;
+  }
   
   free(io_id);
   io_id = 0;
 
-  return 0;
+  return ret;
 }
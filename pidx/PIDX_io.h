@@ -53,6 +53,14 @@ int PIDX_io_set_communicator(PIDX_io_id io_id, MPI_Comm comm);
 
 
 
+/// Hand the aggregator buffers to a background writer instead of writing them in PIDX_io_aggregated_write.
+/// \param io_id IO id
+/// \param async_id the async IO id (NULL to write synchronously)
+/// \return error code
+int PIDX_io_set_async(PIDX_io_id io_id, PIDX_async_io_id async_id);
+
+
+
 ///
 int PIDX_io_cached_data(uint32_t* cached_header);
 
@@ -63,6 +71,15 @@ int PIDX_io_file_create(PIDX_io_id io_id, int time_step, char* data_set_path, in
 
 
 
+/// Block codecs (PIDX_LOSSLESS_COMPRESSION, PIDX_ADAPTIVE_COMPRESSION): codes, in place, the blocks of the aggregator buffer and
+/// gives the coded sizes and codecs to the aggregator that writes the header of its file (collective, to be called by all
+/// the processes before PIDX_io_aggregated_write). Leaves the codec mix of the variables in their compression_block_* counters.
+/// \param io_id IO id
+/// \return error code
+int PIDX_io_lossless_encode(PIDX_io_id io_id);
+
+
+
 ///
 int PIDX_io_aggregated_write(PIDX_io_id io_id);
 
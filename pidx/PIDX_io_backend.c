@@ -0,0 +1,846 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+#include "PIDX_inc.h"
+
+/////////////////////////////////////////////////
+// IO BACKENDS
+/////////////////////////////////////////////////
+
+PIDX_io_backend PIDX_io_backend_mpi         = 0;
+PIDX_io_backend PIDX_io_backend_posix       = 1;
+PIDX_io_backend PIDX_io_backend_mmap        = 2;
+PIDX_io_backend PIDX_io_backend_memory      = 3;
+
+/// Maximum number of iovecs per pwritev/preadv call (POSIX guarantees at least 16, Linux allows 1024)
+#ifdef IOV_MAX
+#define PIDX_IO_BACKEND_MAX_IOV IOV_MAX
+#else
+#define PIDX_IO_BACKEND_MAX_IOV 16
+#endif
+
+/// One file of the in-memory backend
+struct PIDX_io_backend_memory_file_struct
+{
+  char* file_name;
+  unsigned char* data;
+  uint64_t size;                                        ///< bytes written so far (highest written offset)
+  uint64_t capacity;                                    ///< bytes allocated
+  struct PIDX_io_backend_memory_file_struct* next;
+};
+
+struct PIDX_io_backend_file_struct
+{
+  const struct PIDX_io_backend_ops_struct* ops;
+  int flags;
+
+  int fd;                                               ///< posix and mmap
+#if PIDX_HAVE_MPI
+  MPI_File fh;                                          ///< mpi
+#endif
+  unsigned char* map;                                   ///< mmap: the mapping (NULL until the first access)
+  uint64_t map_size;                                    ///< mmap: length of the mapping
+  struct PIDX_io_backend_memory_file_struct* memory;    ///< memory: the file
+};
+
+static struct PIDX_io_backend_memory_file_struct* memory_files = NULL;
+#if PIDX_HAVE_PTHREADS
+static pthread_mutex_t memory_files_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+/////////////////////////////////////////////////
+// POSIX
+/////////////////////////////////////////////////
+
+static int posix_open_flags(int flags)
+{
+  int posix_flags;
+
+  if ((flags & PIDX_IO_BACKEND_READ) && (flags & PIDX_IO_BACKEND_WRITE))
+    posix_flags = O_RDWR;
+  else if (flags & PIDX_IO_BACKEND_WRITE)
+    posix_flags = O_WRONLY;
+  else
+    posix_flags = O_RDONLY;
+
+  if (flags & PIDX_IO_BACKEND_CREATE)
+    posix_flags |= O_CREAT;
+  if (flags & PIDX_IO_BACKEND_TRUNCATE)
+    posix_flags |= O_TRUNC;
+
+  return posix_flags;
+}
+
+static int posix_open(const char* file_name, int flags, PIDX_io_backend_file file)
+{
+  file->fd = open(file_name, posix_open_flags(flags), 0664);
+  if (file->fd == -1)
+  {
+    fprintf(stderr, "[%s] [%d] open() failed. (%s)\n", __FILE__, __LINE__, file_name);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int posix_pwrite(PIDX_io_backend_file file, const unsigned char* buffer, uint64_t size, off_t offset)
+{
+  ssize_t ret;
+  uint64_t written = 0;
+
+  while (written < size)
+  {
+    ret = pwrite(file->fd, buffer + written, size - written, offset + written);
+    if (ret == -1 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+    {
+      fprintf(stderr, "[%s] [%d] pwrite() failed.\n", __FILE__, __LINE__);
+      return -1;
+    }
+    written += ret;
+  }
+
+  return 0;
+}
+
+static int posix_pread(PIDX_io_backend_file file, unsigned char* buffer, uint64_t size, off_t offset)
+{
+  ssize_t ret;
+  uint64_t done = 0;
+
+  while (done < size)
+  {
+    ret = pread(file->fd, buffer + done, size - done, offset + done);
+    if (ret == -1 && errno == EINTR)
+      continue;
+    if (ret == -1)
+    {
+      fprintf(stderr, "[%s] [%d] pread() failed.\n", __FILE__, __LINE__);
+      return -1;
+    }
+    if (ret == 0)
+    {
+      fprintf(stderr, "[%s] [%d] pread() read %lld of %lld bytes at %lld (truncated file).\n", __FILE__, __LINE__, (long long)done, (long long)size, (long long)offset);
+      return -1;
+    }
+    done += ret;
+  }
+
+  return 0;
+}
+
+/// Segments that are contiguous in the file go in one pwritev/preadv, a short transfer
+/// is finished segment by segment
+static int posix_pwritev_preadv(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count, int write)
+{
+  int i, j, k, iov_count;
+  ssize_t ret;
+  uint64_t total;
+  struct iovec iov[PIDX_IO_BACKEND_MAX_IOV];
+
+  for (i = 0; i < count; i = j)
+  {
+    iov_count = 0;
+    total = 0;
+    for (j = i; j < count && iov_count < PIDX_IO_BACKEND_MAX_IOV; j++)
+    {
+      if (j != i && segment[j].offset != segment[i].offset + (off_t)total)
+        break;
+      iov[iov_count].iov_base = segment[j].buffer;
+      iov[iov_count].iov_len = segment[j].size;
+      iov_count++;
+      total = total + segment[j].size;
+    }
+
+    if (write == 1)
+      ret = pwritev(file->fd, iov, iov_count, segment[i].offset);
+    else
+      ret = preadv(file->fd, iov, iov_count, segment[i].offset);
+
+    if (ret != (ssize_t)total)
+    {
+      for (k = i; k < j; k++)
+      {
+        if (write == 1)
+          ret = posix_pwrite(file, segment[k].buffer, segment[k].size, segment[k].offset);
+        else
+          ret = posix_pread(file, segment[k].buffer, segment[k].size, segment[k].offset);
+        if (ret == -1)
+          return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int posix_pwritev(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count)
+{
+  return posix_pwritev_preadv(file, segment, count, 1);
+}
+
+static int posix_preadv(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count)
+{
+  return posix_pwritev_preadv(file, segment, count, 0);
+}
+
+static int posix_sync(PIDX_io_backend_file file)
+{
+  if (fsync(file->fd) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] fsync() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int posix_close(PIDX_io_backend_file file)
+{
+  if (close(file->fd) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] close() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/////////////////////////////////////////////////
+// MPI-IO
+/////////////////////////////////////////////////
+
+#if PIDX_HAVE_MPI
+static int mpi_open(const char* file_name, int flags, PIDX_io_backend_file file)
+{
+  int amode;
+
+  if ((flags & PIDX_IO_BACKEND_READ) && (flags & PIDX_IO_BACKEND_WRITE))
+    amode = MPI_MODE_RDWR;
+  else if (flags & PIDX_IO_BACKEND_WRITE)
+    amode = MPI_MODE_WRONLY;
+  else
+    amode = MPI_MODE_RDONLY;
+
+  if (flags & PIDX_IO_BACKEND_CREATE)
+    amode |= MPI_MODE_CREATE;
+
+  if (MPI_File_open(MPI_COMM_SELF, (char*) file_name, amode, MPI_INFO_NULL, &file->fh) != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_open() failed. (%s)\n", __FILE__, __LINE__, file_name);
+    return -1;
+  }
+
+  if ((flags & PIDX_IO_BACKEND_TRUNCATE) && MPI_File_set_size(file->fh, 0) != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_set_size() failed. (%s)\n", __FILE__, __LINE__, file_name);
+    MPI_File_close(&file->fh);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int mpi_pwrite(PIDX_io_backend_file file, const unsigned char* buffer, uint64_t size, off_t offset)
+{
+  int count, write_count;
+  uint64_t written = 0;
+  MPI_Status status;
+
+  // MPI counts are int
+  while (written < size)
+  {
+    count = (size - written > INT_MAX) ? INT_MAX : (int)(size - written);
+    if (MPI_File_write_at(file->fh, offset + written, (void*) (buffer + written), count, MPI_BYTE, &status) != MPI_SUCCESS)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_File_write_at() failed.\n", __FILE__, __LINE__);
+      return -1;
+    }
+
+    MPI_Get_count(&status, MPI_BYTE, &write_count);
+    if (write_count != count)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_File_write_at() wrote %d of %d bytes.\n", __FILE__, __LINE__, write_count, count);
+      return -1;
+    }
+    written += count;
+  }
+
+  return 0;
+}
+
+static int mpi_pread(PIDX_io_backend_file file, unsigned char* buffer, uint64_t size, off_t offset)
+{
+  int count, read_count;
+  uint64_t done = 0;
+  MPI_Status status;
+
+  while (done < size)
+  {
+    count = (size - done > INT_MAX) ? INT_MAX : (int)(size - done);
+    if (MPI_File_read_at(file->fh, offset + done, buffer + done, count, MPI_BYTE, &status) != MPI_SUCCESS)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_File_read_at() failed.\n", __FILE__, __LINE__);
+      return -1;
+    }
+
+    MPI_Get_count(&status, MPI_BYTE, &read_count);
+    if (read_count != count)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_File_read_at() read %lld of %lld bytes at %lld (truncated file).\n", __FILE__, __LINE__, (long long)(done + read_count), (long long)size, (long long)offset);
+      return -1;
+    }
+    done += count;
+  }
+
+  return 0;
+}
+
+/// One call through an hindexed file view (and an hindexed memory type) for all the segments
+static int mpi_pwritev_preadv(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count, int write)
+{
+  int i, mpi_ret, ret = 0, transfer_count;
+  int *block_lengths;
+  uint64_t total = 0;
+  MPI_Aint *file_displacements, *memory_displacements;
+  MPI_Datatype file_type, memory_type;
+  MPI_Status status;
+
+  for (i = 0; i < count; i++)
+  {
+    total = total + segment[i].size;
+
+    // a file view can not go back over itself (reads of overlapping runs), split the batch there
+    if (i > 0 && segment[i].offset < segment[i - 1].offset + (off_t) segment[i - 1].size)
+    {
+      if (mpi_pwritev_preadv(file, segment, i, write) == -1)
+        return -1;
+      return mpi_pwritev_preadv(file, segment + i, count - i, write);
+    }
+
+    // MPI counts are int, fall back to one call per segment for huge runs
+    if (segment[i].size > INT_MAX || total > INT_MAX)
+    {
+      for (i = 0; i < count; i++)
+      {
+        if (write == 1)
+          ret = mpi_pwrite(file, segment[i].buffer, segment[i].size, segment[i].offset);
+        else
+          ret = mpi_pread(file, segment[i].buffer, segment[i].size, segment[i].offset);
+        if (ret == -1)
+          return -1;
+      }
+      return 0;
+    }
+  }
+
+  block_lengths = malloc(count * sizeof (int));
+  file_displacements = malloc(count * sizeof (MPI_Aint));
+  memory_displacements = malloc(count * sizeof (MPI_Aint));
+
+  for (i = 0; i < count; i++)
+  {
+    block_lengths[i] = segment[i].size;
+    file_displacements[i] = segment[i].offset;
+    MPI_Get_address(segment[i].buffer, &memory_displacements[i]);
+  }
+
+  MPI_Type_create_hindexed(count, block_lengths, file_displacements, MPI_BYTE, &file_type);
+  MPI_Type_commit(&file_type);
+  MPI_Type_create_hindexed(count, block_lengths, memory_displacements, MPI_BYTE, &memory_type);
+  MPI_Type_commit(&memory_type);
+
+  mpi_ret = MPI_File_set_view(file->fh, 0, MPI_BYTE, file_type, "native", MPI_INFO_NULL);
+  if (mpi_ret != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_set_view() failed.\n", __FILE__, __LINE__);
+    ret = -1;
+  }
+  else
+  {
+    if (write == 1)
+      mpi_ret = MPI_File_write_at(file->fh, 0, MPI_BOTTOM, 1, memory_type, &status);
+    else
+      mpi_ret = MPI_File_read_at(file->fh, 0, MPI_BOTTOM, 1, memory_type, &status);
+    if (mpi_ret != MPI_SUCCESS)
+    {
+      fprintf(stderr, "[%s] [%d] MPI_File_write_at/MPI_File_read_at() failed.\n", __FILE__, __LINE__);
+      ret = -1;
+    }
+    else
+    {
+      MPI_Get_count(&status, MPI_BYTE, &transfer_count);
+      if (transfer_count != (int)total)
+        ret = -2;
+    }
+
+    // handles may be cached, restore the default view for the next user
+    MPI_File_set_view(file->fh, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+  }
+
+  MPI_Type_free(&file_type);
+  MPI_Type_free(&memory_type);
+  free(block_lengths);
+  free(file_displacements);
+  free(memory_displacements);
+
+  // short transfer, redo it segment by segment to find the segment that failed
+  if (ret == -2)
+  {
+    ret = 0;
+    for (i = 0; i < count && ret == 0; i++)
+    {
+      if (write == 1)
+        ret = mpi_pwrite(file, segment[i].buffer, segment[i].size, segment[i].offset);
+      else
+        ret = mpi_pread(file, segment[i].buffer, segment[i].size, segment[i].offset);
+    }
+  }
+
+  return ret;
+}
+
+static int mpi_pwritev(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count)
+{
+  return mpi_pwritev_preadv(file, segment, count, 1);
+}
+
+static int mpi_preadv(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count)
+{
+  return mpi_pwritev_preadv(file, segment, count, 0);
+}
+
+static int mpi_sync(PIDX_io_backend_file file)
+{
+  if (MPI_File_sync(file->fh) != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_sync() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int mpi_close(PIDX_io_backend_file file)
+{
+  if (MPI_File_close(&file->fh) != MPI_SUCCESS)
+  {
+    fprintf(stderr, "[%s] [%d] MPI_File_close() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  return 0;
+}
+#endif
+
+
+/////////////////////////////////////////////////
+// MMAP
+/////////////////////////////////////////////////
+
+static int mmap_open(const char* file_name, int flags, PIDX_io_backend_file file)
+{
+  // a shared writable mapping needs read access as well
+  if (flags & PIDX_IO_BACKEND_WRITE)
+    flags |= PIDX_IO_BACKEND_READ;
+
+  file->flags = flags;
+  return posix_open(file_name, flags, file);
+}
+
+/// Makes sure the bytes [0, end) are mapped, writers grow the file (never shrink it, other processes may be writing past end)
+static int mmap_map(PIDX_io_backend_file file, uint64_t end)
+{
+  struct stat file_stat;
+  int prot = PROT_READ;
+  void* map;
+
+  if (end <= file->map_size)
+    return 0;
+
+  if (fstat(file->fd, &file_stat) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] fstat() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  if (file->flags & PIDX_IO_BACKEND_WRITE)
+  {
+    prot |= PROT_WRITE;
+    if ((uint64_t)file_stat.st_size < end)
+    {
+      if (posix_fallocate(file->fd, file_stat.st_size, end - file_stat.st_size) != 0)
+      {
+        fprintf(stderr, "[%s] [%d] posix_fallocate() failed.\n", __FILE__, __LINE__);
+        return -1;
+      }
+      if (fstat(file->fd, &file_stat) == -1)
+      {
+        fprintf(stderr, "[%s] [%d] fstat() failed.\n", __FILE__, __LINE__);
+        return -1;
+      }
+    }
+  }
+
+  if ((uint64_t)file_stat.st_size <= file->map_size)
+    return 0;
+
+  map = mmap(NULL, file_stat.st_size, prot, MAP_SHARED, file->fd, 0);
+  if (map == MAP_FAILED)
+  {
+    fprintf(stderr, "[%s] [%d] mmap() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  if (file->map != NULL)
+    munmap(file->map, file->map_size);
+  file->map = map;
+  file->map_size = file_stat.st_size;
+
+  return 0;
+}
+
+static int mmap_pwrite(PIDX_io_backend_file file, const unsigned char* buffer, uint64_t size, off_t offset)
+{
+  if (size == 0)
+    return 0;
+
+  if (mmap_map(file, offset + size) == -1)
+    return -1;
+
+  memcpy(file->map + offset, buffer, size);
+  return 0;
+}
+
+static int mmap_pread(PIDX_io_backend_file file, unsigned char* buffer, uint64_t size, off_t offset)
+{
+  uint64_t available = 0;
+
+  if (size == 0)
+    return 0;
+
+  if (mmap_map(file, offset + size) == -1)
+    return -1;
+
+  if ((uint64_t)offset < file->map_size)
+    available = min(size, file->map_size - offset);
+
+  if (available != size)
+  {
+    fprintf(stderr, "[%s] [%d] read %lld of %lld bytes at %lld (truncated file).\n", __FILE__, __LINE__, (long long)available, (long long)size, (long long)offset);
+    return -1;
+  }
+
+  memcpy(buffer, file->map + offset, size);
+  return 0;
+}
+
+static int mmap_sync(PIDX_io_backend_file file)
+{
+  if (file->map != NULL && msync(file->map, file->map_size, MS_SYNC) == -1)
+  {
+    fprintf(stderr, "[%s] [%d] msync() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int mmap_close(PIDX_io_backend_file file)
+{
+  if (file->map != NULL)
+    munmap(file->map, file->map_size);
+  file->map = NULL;
+  file->map_size = 0;
+
+  return posix_close(file);
+}
+
+
+/////////////////////////////////////////////////
+// MEMORY
+/////////////////////////////////////////////////
+
+static int memory_open(const char* file_name, int flags, PIDX_io_backend_file file)
+{
+  struct PIDX_io_backend_memory_file_struct* memory_file;
+
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_lock(&memory_files_lock);
+#endif
+
+  for (memory_file = memory_files; memory_file != NULL; memory_file = memory_file->next)
+    if (strcmp(memory_file->file_name, file_name) == 0)
+      break;
+
+  // files are per process, a process may write to a file another process created
+  if (memory_file == NULL)
+  {
+    memory_file = malloc(sizeof (*memory_file));
+    memset(memory_file, 0, sizeof (*memory_file));
+    memory_file->file_name = strdup(file_name);
+    memory_file->next = memory_files;
+    memory_files = memory_file;
+  }
+  // the bytes past size read as zeros once written over (pwrite clears the capacity it adds)
+  else if (flags & PIDX_IO_BACKEND_TRUNCATE)
+  {
+    if (memory_file->data != NULL)
+      memset(memory_file->data, 0, memory_file->size);
+    memory_file->size = 0;
+  }
+
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_unlock(&memory_files_lock);
+#endif
+
+  file->memory = memory_file;
+  return 0;
+}
+
+static int memory_pwrite(PIDX_io_backend_file file, const unsigned char* buffer, uint64_t size, off_t offset)
+{
+  int ret = 0;
+  uint64_t capacity;
+  unsigned char* data;
+  struct PIDX_io_backend_memory_file_struct* memory_file = file->memory;
+
+  if (size == 0)
+    return 0;
+
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_lock(&memory_files_lock);
+#endif
+
+  if (offset + size > memory_file->capacity)
+  {
+    capacity = (memory_file->capacity == 0) ? 4096 : memory_file->capacity;
+    while (capacity < offset + size)
+      capacity = capacity * 2;
+
+    data = realloc(memory_file->data, capacity);
+    if (data == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+      ret = -1;
+    }
+    else
+    {
+      memset(data + memory_file->capacity, 0, capacity - memory_file->capacity);
+      memory_file->data = data;
+      memory_file->capacity = capacity;
+    }
+  }
+
+  if (ret == 0)
+  {
+    memcpy(memory_file->data + offset, buffer, size);
+    if (offset + size > memory_file->size)
+      memory_file->size = offset + size;
+  }
+
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_unlock(&memory_files_lock);
+#endif
+
+  return ret;
+}
+
+static int memory_pread(PIDX_io_backend_file file, unsigned char* buffer, uint64_t size, off_t offset)
+{
+  uint64_t available = 0;
+  struct PIDX_io_backend_memory_file_struct* memory_file = file->memory;
+
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_lock(&memory_files_lock);
+#endif
+
+  if ((uint64_t)offset < memory_file->size)
+    available = min(size, memory_file->size - offset);
+
+  if (available == size && size != 0)
+    memcpy(buffer, memory_file->data + offset, size);
+
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_unlock(&memory_files_lock);
+#endif
+
+  if (available != size)
+  {
+    fprintf(stderr, "[%s] [%d] read %lld of %lld bytes at %lld (truncated file).\n", __FILE__, __LINE__, (long long)available, (long long)size, (long long)offset);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int memory_sync(PIDX_io_backend_file file)
+{
+  return 0;
+}
+
+static int memory_close(PIDX_io_backend_file file)
+{
+  file->memory = NULL;
+  return 0;
+}
+
+int PIDX_io_backend_memory_release()
+{
+  struct PIDX_io_backend_memory_file_struct* memory_file;
+
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_lock(&memory_files_lock);
+#endif
+
+  while (memory_files != NULL)
+  {
+    memory_file = memory_files;
+    memory_files = memory_file->next;
+
+    free(memory_file->file_name);
+    free(memory_file->data);
+    free(memory_file);
+  }
+
+#if PIDX_HAVE_PTHREADS
+  pthread_mutex_unlock(&memory_files_lock);
+#endif
+
+  return 0;
+}
+
+
+/////////////////////////////////////////////////
+// DISPATCH
+/////////////////////////////////////////////////
+
+static const struct PIDX_io_backend_ops_struct posix_ops =
+{
+  "posix", 1, posix_open, posix_pwrite, posix_pread, posix_pwritev, posix_preadv, posix_sync, posix_close
+};
+
+#if PIDX_HAVE_MPI
+static const struct PIDX_io_backend_ops_struct mpi_ops =
+{
+  "mpi", 1, mpi_open, mpi_pwrite, mpi_pread, mpi_pwritev, mpi_preadv, mpi_sync, mpi_close
+};
+#endif
+
+static const struct PIDX_io_backend_ops_struct mmap_ops =
+{
+  "mmap", 1, mmap_open, mmap_pwrite, mmap_pread, NULL, NULL, mmap_sync, mmap_close
+};
+
+static const struct PIDX_io_backend_ops_struct memory_ops =
+{
+  "memory", 0, memory_open, memory_pwrite, memory_pread, NULL, NULL, memory_sync, memory_close
+};
+
+const struct PIDX_io_backend_ops_struct* PIDX_io_backend_get_ops(PIDX_io_backend backend)
+{
+  if (backend == PIDX_io_backend_posix)
+    return &posix_ops;
+  else if (backend == PIDX_io_backend_mmap)
+    return &mmap_ops;
+  else if (backend == PIDX_io_backend_memory)
+    return &memory_ops;
+
+#if PIDX_HAVE_MPI
+  return &mpi_ops;
+#else
+  return &posix_ops;
+#endif
+}
+
+int PIDX_io_backend_open(PIDX_io_backend backend, const char* file_name, int flags, PIDX_io_backend_file* file)
+{
+  PIDX_io_backend_file new_file;
+
+  new_file = malloc(sizeof (*new_file));
+  memset(new_file, 0, sizeof (*new_file));
+  new_file->ops = PIDX_io_backend_get_ops(backend);
+  new_file->flags = flags;
+  new_file->fd = -1;
+
+  if (new_file->ops->open(file_name, flags, new_file) == -1)
+  {
+    free(new_file);
+    *file = NULL;
+    return -1;
+  }
+
+  *file = new_file;
+  return 0;
+}
+
+int PIDX_io_backend_pwrite(PIDX_io_backend_file file, const unsigned char* buffer, uint64_t size, off_t offset)
+{
+  return file->ops->pwrite(file, buffer, size, offset);
+}
+
+int PIDX_io_backend_pread(PIDX_io_backend_file file, unsigned char* buffer, uint64_t size, off_t offset)
+{
+  return file->ops->pread(file, buffer, size, offset);
+}
+
+int PIDX_io_backend_pwritev(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count)
+{
+  int i;
+
+  if (file->ops->pwritev != NULL)
+    return file->ops->pwritev(file, segment, count);
+
+  for (i = 0; i < count; i++)
+    if (file->ops->pwrite(file, segment[i].buffer, segment[i].size, segment[i].offset) == -1)
+      return -1;
+
+  return 0;
+}
+
+int PIDX_io_backend_preadv(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count)
+{
+  int i;
+
+  if (file->ops->preadv != NULL)
+    return file->ops->preadv(file, segment, count);
+
+  for (i = 0; i < count; i++)
+    if (file->ops->pread(file, segment[i].buffer, segment[i].size, segment[i].offset) == -1)
+      return -1;
+
+  return 0;
+}
+
+int PIDX_io_backend_sync(PIDX_io_backend_file file)
+{
+  return file->ops->sync(file);
+}
+
+int PIDX_io_backend_close(PIDX_io_backend_file file)
+{
+  int ret;
+
+  ret = file->ops->close(file);
+  free(file);
+
+  return ret;
+}
@@ -0,0 +1,135 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+/**
+ * \file PIDX_io_backend.h
+ *
+ * The storage backends behind the binary (.bin) files. Every backend
+ * provides the same small set of operations (open, pwrite, pread, sync,
+ * close) so that the header, aggregation and per-process I/O code does
+ * not need to know where the bytes end up.
+ *
+ */
+
+#ifndef __PIDX_IO_BACKEND_H
+#define __PIDX_IO_BACKEND_H
+
+
+typedef unsigned int PIDX_io_backend;
+
+/// Backend options
+/// \param PIDX_io_backend_mpi MPI-IO on MPI_COMM_SELF (the default, same as PIDX_io_backend_posix without MPI)
+/// \param PIDX_io_backend_posix open/pwrite/pread
+/// \param PIDX_io_backend_mmap files are mapped with mmap and accessed with memcpy
+/// \param PIDX_io_backend_memory files live in (per process) memory, nothing touches the disk
+extern PIDX_io_backend PIDX_io_backend_mpi;
+extern PIDX_io_backend PIDX_io_backend_posix;
+extern PIDX_io_backend PIDX_io_backend_mmap;
+extern PIDX_io_backend PIDX_io_backend_memory;
+
+
+/// Open flags
+#define PIDX_IO_BACKEND_READ    0x1
+#define PIDX_IO_BACKEND_WRITE   0x2
+#define PIDX_IO_BACKEND_CREATE  0x4
+#define PIDX_IO_BACKEND_TRUNCATE 0x8
+
+
+struct PIDX_io_backend_file_struct;
+typedef struct PIDX_io_backend_file_struct* PIDX_io_backend_file;
+
+
+/// One contiguous run of bytes in a file
+struct PIDX_io_backend_segment_struct
+{
+  off_t offset;                                         ///< byte offset in the file
+  unsigned char* buffer;                                ///< source (write) or destination (read) in memory
+  uint64_t size;                                        ///< number of bytes
+};
+
+
+/// The operations of one backend. All of them return 0 on success and -1 on failure; a read past the end
+/// of a file (a truncated file) fails, holes inside the file read as zeros.
+struct PIDX_io_backend_ops_struct
+{
+  const char* name;                                     ///< backend name (for messages)
+  int file_system;                                      ///< 1 if the data ends up in the named files on disk
+
+  int (*open)(const char* file_name, int flags, PIDX_io_backend_file file);
+  int (*pwrite)(PIDX_io_backend_file file, const unsigned char* buffer, uint64_t size, off_t offset);
+  int (*pread)(PIDX_io_backend_file file, unsigned char* buffer, uint64_t size, off_t offset);
+
+  /// Vectored versions, the segments are sorted by offset (NULL to loop over pwrite/pread)
+  int (*pwritev)(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count);
+  int (*preadv)(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count);
+
+  int (*sync)(PIDX_io_backend_file file);
+  int (*close)(PIDX_io_backend_file file);
+};
+
+
+/// Returns the operations of a backend (unknown backends get the default one).
+const struct PIDX_io_backend_ops_struct* PIDX_io_backend_get_ops(PIDX_io_backend backend);
+
+
+
+/// Opens a file.
+/// \param backend the backend to go through
+/// \param file_name the file
+/// \param flags PIDX_IO_BACKEND_READ, PIDX_IO_BACKEND_WRITE, PIDX_IO_BACKEND_CREATE and/or PIDX_IO_BACKEND_TRUNCATE
+/// \param file the opened file
+/// \return error code
+int PIDX_io_backend_open(PIDX_io_backend backend, const char* file_name, int flags, PIDX_io_backend_file* file);
+
+
+
+/// Writes size bytes at offset.
+int PIDX_io_backend_pwrite(PIDX_io_backend_file file, const unsigned char* buffer, uint64_t size, off_t offset);
+
+
+
+/// Reads size bytes at offset.
+int PIDX_io_backend_pread(PIDX_io_backend_file file, unsigned char* buffer, uint64_t size, off_t offset);
+
+
+
+/// Writes count segments (sorted by offset) with as few calls as the backend allows.
+int PIDX_io_backend_pwritev(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count);
+
+
+
+/// Reads count segments (sorted by offset) with as few calls as the backend allows.
+int PIDX_io_backend_preadv(PIDX_io_backend_file file, const struct PIDX_io_backend_segment_struct* segment, int count);
+
+
+
+/// Flushes the written data to stable storage.
+int PIDX_io_backend_sync(PIDX_io_backend_file file);
+
+
+
+/// Closes the file and frees the handle.
+int PIDX_io_backend_close(PIDX_io_backend_file file);
+
+
+
+/// Frees all the files of the in-memory backend of this process.
+/// \return error code
+int PIDX_io_backend_memory_release();
+
+#endif //__PIDX_IO_BACKEND_H
@@ -0,0 +1,268 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+#include "PIDX_inc.h"
+
+/// Maximum number of files kept mapped at once (the file descriptors are closed right after mmap)
+#define PIDX_IO_MAP_CACHE_SIZE 256
+
+enum PIDX_IO_MAP_BLOCK_STATE { PIDX_IO_MAP_BLOCK_UNKNOWN, PIDX_IO_MAP_BLOCK_MAPPED, PIDX_IO_MAP_BLOCK_ABSENT };
+
+/// One mapped file
+struct PIDX_io_map_file_struct
+{
+  char file_name[PATH_MAX];                             ///< the file (empty if the slot is free)
+  int file_number;                                      ///< number of the file (its blocks are the blocks_per_file from file_number * blocks_per_file)
+  unsigned char* address;                               ///< the mapping (NULL for missing or empty files)
+  uint64_t size;                                        ///< length of the mapping
+  uint64_t last_use;                                    ///< value of the use clock at the last lookup (for LRU eviction)
+};
+
+/// Where the samples of one block of one variable are
+struct PIDX_io_map_block_struct
+{
+  int state;                                            ///< PIDX_IO_MAP_BLOCK_UNKNOWN, _MAPPED or _ABSENT
+  unsigned char* address;                               ///< first byte of the block in the mapping
+  uint64_t size;                                        ///< bytes of the block present in the file
+};
+
+struct PIDX_io_map_struct
+{
+  //Contains all relevant IDX file info
+  //Blocks per file, samples per block, bitmask, box, file name template and more
+  idx_dataset idx_ptr;
+
+  //Contains all derieved IDX file info
+  //number of files, files that are ging to be populated
+  idx_dataset_derived_metadata idx_derived_ptr;
+
+  struct PIDX_io_map_file_struct file[PIDX_IO_MAP_CACHE_SIZE];
+  int file_count;
+  uint64_t clock;
+
+  //Per variable block tables (max_file_count * blocks_per_file entries, allocated on first use)
+  struct PIDX_io_map_block_struct** block;
+  int variable_capacity;
+  int block_count;
+};
+
+static int map_file(PIDX_io_map_id map_id, int file_number, struct PIDX_io_map_file_struct** mapped_file);
+
+static int find_block(PIDX_io_map_id map_id, int variable_index, int block_number);
+
+static void forget_file_blocks(PIDX_io_map_id map_id, int file_number);
+
+/// Forgets the block addresses of one file, for every variable (they point into its mapping)
+static void forget_file_blocks(PIDX_io_map_id map_id, int file_number)
+{
+  int var;
+  int64_t first = (int64_t) file_number * map_id->idx_ptr->blocks_per_file;
+
+  if (first >= map_id->block_count)
+    return;
+
+  for (var = 0; var < map_id->variable_capacity; var++)
+    if (map_id->block[var] != NULL)
+      memset(map_id->block[var] + first, 0, min(map_id->idx_ptr->blocks_per_file, map_id->block_count - first) * sizeof (*map_id->block[var]));
+}
+
+static int map_file(PIDX_io_map_id map_id, int file_number, struct PIDX_io_map_file_struct** mapped_file)
+{
+  int i, fd, slot;
+  char file_name[PATH_MAX];
+  struct stat file_stat;
+  struct PIDX_io_map_file_struct* file;
+
+  if (generate_file_name(map_id->idx_ptr->blocks_per_file, map_id->idx_ptr->filename_template, file_number, file_name, PATH_MAX) == 1)
+  {
+    fprintf(stderr, "[%s] [%d] generate_file_name() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  map_id->clock++;
+
+  for (i = 0; i < map_id->file_count; i++)
+  {
+    if (strcmp(map_id->file[i].file_name, file_name) == 0)
+    {
+      map_id->file[i].last_use = map_id->clock;
+      *mapped_file = &map_id->file[i];
+      return 0;
+    }
+  }
+
+  if (map_id->file_count < PIDX_IO_MAP_CACHE_SIZE)
+    slot = map_id->file_count++;
+  else
+  {
+    // evict the least recently used mapping, and the block addresses that point into it
+    slot = 0;
+    for (i = 1; i < map_id->file_count; i++)
+      if (map_id->file[i].last_use < map_id->file[slot].last_use)
+        slot = i;
+
+    if (map_id->file[slot].address != NULL)
+      munmap(map_id->file[slot].address, map_id->file[slot].size);
+    forget_file_blocks(map_id, map_id->file[slot].file_number);
+  }
+
+  file = &map_id->file[slot];
+  strcpy(file->file_name, file_name);
+  file->file_number = file_number;
+  file->address = NULL;
+  file->size = 0;
+  file->last_use = map_id->clock;
+
+  // a missing file reads as zeros, like the other read paths
+  fd = open(file_name, O_RDONLY);
+  if (fd != -1)
+  {
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+    {
+      file->address = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (file->address == MAP_FAILED)
+      {
+        fprintf(stderr, "[%s] [%d] mmap() failed. (%s)\n", __FILE__, __LINE__, file_name);
+        file->address = NULL;
+      }
+      else
+        file->size = file_stat.st_size;
+    }
+    close(fd);
+  }
+
+  *mapped_file = file;
+  return 0;
+}
+
+static int find_block(PIDX_io_map_id map_id, int variable_index, int block_number)
+{
+  int file_number;
+  off_t data_offset;
+  struct PIDX_io_map_file_struct* file;
+  struct PIDX_io_map_block_struct* block;
+
+  data_offset = PIDX_blocks_find_offset(map_id->idx_derived_ptr->block_offset_table, variable_index, block_number);
+  if (data_offset == -1)
+  {
+    map_id->block[variable_index][block_number].state = PIDX_IO_MAP_BLOCK_ABSENT;
+    return 0;
+  }
+  data_offset += map_id->idx_derived_ptr->start_fs_block * map_id->idx_derived_ptr->fs_block_size;
+
+  file_number = block_number / map_id->idx_ptr->blocks_per_file;
+  if (map_file(map_id, file_number, &file) == -1)
+    return -1;
+
+  block = &map_id->block[variable_index][block_number];
+  block->state = PIDX_IO_MAP_BLOCK_ABSENT;
+
+  if (file->address == NULL || (uint64_t)data_offset >= file->size)
+    return 0;
+
+  block->state = PIDX_IO_MAP_BLOCK_MAPPED;
+  block->address = file->address + data_offset;
+  block->size = min(map_id->idx_derived_ptr->block_offset_table->block_size[variable_index], file->size - data_offset);
+
+  return 0;
+}
+
+PIDX_io_map_id PIDX_io_map_init(idx_dataset idx_meta_data, idx_dataset_derived_metadata idx_derived_ptr)
+{
+  PIDX_io_map_id map_id;
+
+  map_id = (PIDX_io_map_id)malloc(sizeof (*map_id));
+  memset(map_id, 0, sizeof (*map_id));
+
+  map_id->idx_ptr = idx_meta_data;
+  map_id->idx_derived_ptr = idx_derived_ptr;
+
+  map_id->variable_capacity = sizeof (idx_meta_data->variable) / sizeof (idx_meta_data->variable[0]);
+  map_id->block = malloc(map_id->variable_capacity * sizeof (*map_id->block));
+  memset(map_id->block, 0, map_id->variable_capacity * sizeof (*map_id->block));
+
+  return map_id;
+}
+
+int PIDX_io_map_reset(PIDX_io_map_id map_id)
+{
+  int var;
+
+  for (var = 0; var < map_id->variable_capacity; var++)
+  {
+    free(map_id->block[var]);
+    map_id->block[var] = 0;
+  }
+  map_id->block_count = 0;
+
+  return 0;
+}
+
+int PIDX_io_map_get_sample(PIDX_io_map_id map_id, int variable_index, int64_t hz_index, unsigned char** sample)
+{
+  int block_number, bytes_per_sample;
+  uint64_t sample_offset;
+  struct PIDX_io_map_block_struct* block;
+
+  *sample = NULL;
+
+  if (map_id->block[variable_index] == NULL)
+  {
+    map_id->block_count = map_id->idx_derived_ptr->max_file_count * map_id->idx_ptr->blocks_per_file;
+    map_id->block[variable_index] = malloc(map_id->block_count * sizeof (*map_id->block[variable_index]));
+    memset(map_id->block[variable_index], 0, map_id->block_count * sizeof (*map_id->block[variable_index]));
+  }
+
+  block_number = hz_index / map_id->idx_derived_ptr->samples_per_block;
+  if (block_number >= map_id->block_count)
+    return 0;
+
+  block = &map_id->block[variable_index][block_number];
+  if (block->state == PIDX_IO_MAP_BLOCK_UNKNOWN)
+  {
+    if (find_block(map_id, variable_index, block_number) == -1)
+      return -1;
+  }
+
+  if (block->state == PIDX_IO_MAP_BLOCK_ABSENT)
+    return 0;
+
+  bytes_per_sample = map_id->idx_ptr->variable[variable_index]->bytes_per_brick * map_id->idx_ptr->variable[variable_index]->values_per_sample;
+  sample_offset = (uint64_t)(hz_index % map_id->idx_derived_ptr->samples_per_block) * bytes_per_sample;
+  if (sample_offset + bytes_per_sample <= block->size)
+    *sample = block->address + sample_offset;
+
+  return 0;
+}
+
+int PIDX_io_map_finalize(PIDX_io_map_id map_id)
+{
+  int i;
+
+  for (i = 0; i < map_id->file_count; i++)
+    if (map_id->file[i].address != NULL)
+      munmap(map_id->file[i].address, map_id->file[i].size);
+
+  PIDX_io_map_reset(map_id);
+  free(map_id->block);
+
+  free(map_id);
+  map_id = 0;
+
+  return 0;
+}
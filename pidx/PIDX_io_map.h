@@ -0,0 +1,67 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+/**
+ * \file PIDX_io_map.h
+ *
+ * Memory mapped access to the binary files for reads. The files are
+ * mapped (read only, shared) on first use and the last 256 used stay
+ * mapped, so HZ samples can be copied straight from the page cache
+ * into the destination buffers.
+ *
+ */
+
+#ifndef __PIDX_IO_MAP_H
+#define __PIDX_IO_MAP_H
+
+
+struct PIDX_io_map_struct;
+typedef struct PIDX_io_map_struct* PIDX_io_map_id;
+
+
+/// Creates the IO map ID.
+/// \param idx_meta_data All infor regarding the idx file passed from PIDX.c
+/// \param idx_derived_ptr All derived idx related derived metadata passed from PIDX.c
+/// \return PIDX_io_map_id The identifier
+PIDX_io_map_id PIDX_io_map_init(idx_dataset idx_meta_data, idx_dataset_derived_metadata idx_derived_ptr);
+
+
+
+/// Forgets the block addresses, to be called when the time step or the block layout changes (the mappings are kept).
+/// \param map_id IO map id
+/// \return error code
+int PIDX_io_map_reset(PIDX_io_map_id map_id);
+
+
+
+/// Finds a sample in the mapped files.
+/// \param map_id IO map id
+/// \param variable_index the variable
+/// \param hz_index HZ index of the sample
+/// \param sample set to the address of the values_per_sample values of the sample, NULL if the sample is not in the files (reads as zeros)
+/// \return error code
+int PIDX_io_map_get_sample(PIDX_io_map_id map_id, int variable_index, int64_t hz_index, unsigned char** sample);
+
+
+
+/// Unmaps all the files and frees the ID.
+/// \param map_id IO map id
+/// \return error code
+int PIDX_io_map_finalize(PIDX_io_map_id map_id);
+
+#endif //__PIDX_IO_MAP_H
@@ -81,6 +81,8 @@ struct PIDX_HZ_Agg_buffer_struct
   uint64_t buffer_size;                                 ///< Aggregator buffer size
   int ***rank_holder;                                   ///<
   unsigned char* buffer;                                ///< The actual aggregator buffer
+  unsigned char* buffer_memory;                         ///< Start of the allocation, buffer_header_size bytes before buffer
+  uint64_t buffer_header_size;                          ///< Room kept in front of buffer for the file header (first aggregator of a file only)
 };
 typedef struct PIDX_HZ_Agg_buffer_struct* Agg_buffer;
 
@@ -0,0 +1,365 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+#include "PIDX_inc.h"
+
+#if PIDX_HAVE_PTHREADS
+
+/// One block to read ahead
+struct prefetch_block
+{
+  int file_number;                                      ///< binary file of the block (block_number / blocks_per_file)
+  int variable_index;
+  int block_number;
+  off_t offset;                                         ///< byte offset of the block in its file
+  uint64_t block_size;                                  ///< size of the decoded block
+  int coded;                                            ///< 1 if the size and codec are in the file header
+  int bits_per_value;
+};
+
+struct PIDX_prefetch_struct
+{
+  PIDX_io_backend io_backend;
+  int blocks_per_file;
+
+  //Blocks recorded for the next prefetch
+  int block_count;
+  int block_capacity;
+  struct prefetch_block* block;
+
+  //The running prefetch, owned by its thread until it is done
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;                                  ///< signalled when the running prefetch is done
+  int running;
+  int finalized;                                        ///< set by PIDX_prefetch_finalize, the thread frees the id once it is done
+  int batch_count;
+  struct prefetch_block* batch;                         ///< the blocks, sorted by file
+  int time_step_count;
+  char (*filename_template)[1024];                      ///< binary file name template of every time step
+};
+
+static int compare_blocks(const void* a, const void* b)
+{
+  const struct prefetch_block* block_a = a;
+  const struct prefetch_block* block_b = b;
+
+  if (block_a->file_number != block_b->file_number)
+    return (block_a->file_number < block_b->file_number) ? -1 : 1;
+  if (block_a->variable_index != block_b->variable_index)
+    return (block_a->variable_index < block_b->variable_index) ? -1 : 1;
+  if (block_a->block_number != block_b->block_number)
+    return (block_a->block_number < block_b->block_number) ? -1 : 1;
+  return 0;
+}
+
+/// Number of prefetch threads still running (finalized or not)
+static int live_prefetch_count = 0;
+static pthread_mutex_t live_prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t live_prefetch_cond = PTHREAD_COND_INITIALIZER;
+
+/// Reads one block of an open file into the cache (nothing if the block is corrupt)
+static void prefetch_block(PIDX_prefetch_id prefetch_id, PIDX_io_backend_file fh, const char* file_name, const uint32_t* headers, const struct prefetch_block* block, unsigned char* data, unsigned char* coded_data)
+{
+  int codec = PIDX_BLOCK_RAW;
+  uint64_t coded_size = block->block_size;
+  int entry = (block->block_number % prefetch_id->blocks_per_file) * 10;
+
+  if (block->coded == 1)
+  {
+    codec = ntohl(headers[entry + 5]);
+    if (codec != PIDX_BLOCK_RAW)
+      coded_size = ntohl(headers[entry + 4]);
+  }
+
+  if (codec == PIDX_BLOCK_RAW)
+  {
+    if (PIDX_io_backend_pread(fh, data, block->block_size, block->offset) == -1)
+      return;
+  }
+  else if (coded_size >= block->block_size || PIDX_io_backend_pread(fh, coded_data, coded_size, block->offset) == -1 || PIDX_compression_block_decode(coded_data, coded_size, codec, block->bits_per_value, data, block->block_size) == -1)
+    return;
+
+  PIDX_block_cache_put(file_name, block->variable_index, block->block_number, data, block->block_size);
+}
+
+static void* prefetch_thread(void* arg)
+{
+  int t, i, open_file, header_variable;
+  uint64_t max_block_size = 0;
+  char file_name[PATH_MAX];
+  uint32_t* headers;
+  unsigned char *data, *coded_data;
+  PIDX_io_backend_file fh;
+  PIDX_prefetch_id prefetch_id = (PIDX_prefetch_id)arg;
+
+  for (i = 0; i < prefetch_id->batch_count; i++)
+    if (prefetch_id->batch[i].block_size > max_block_size)
+      max_block_size = prefetch_id->batch[i].block_size;
+
+  data = malloc(max_block_size);
+  coded_data = malloc(max_block_size);
+  headers = malloc(10 * prefetch_id->blocks_per_file * sizeof (*headers));
+  if (data == NULL || coded_data == NULL || headers == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    prefetch_id->time_step_count = 0;
+  }
+
+  for (t = 0; t < prefetch_id->time_step_count; t++)
+  {
+    fh = NULL;
+    open_file = -1;
+    header_variable = -1;
+    for (i = 0; i < prefetch_id->batch_count; i++)
+    {
+      const struct prefetch_block* block = &prefetch_id->batch[i];
+
+      if (block->file_number != open_file)
+      {
+        if (fh != NULL)
+          PIDX_io_backend_close(fh);
+        fh = NULL;
+        open_file = block->file_number;
+        header_variable = -1;
+
+        if (generate_file_name(prefetch_id->blocks_per_file, prefetch_id->filename_template[t], block->file_number, file_name, PATH_MAX) == 1)
+          break;
+
+        // the time step may not be written (yet)
+        if (PIDX_io_backend_open(prefetch_id->io_backend, file_name, PIDX_IO_BACKEND_READ, &fh) == -1)
+          fh = NULL;
+      }
+      if (fh == NULL || PIDX_block_cache_contains(file_name, block->variable_index, block->block_number) == 1)
+        continue;
+
+      if (block->coded == 1 && block->variable_index != header_variable)
+      {
+        if (PIDX_io_backend_pread(fh, (unsigned char*)headers, 10 * prefetch_id->blocks_per_file * sizeof (*headers), (10 + (off_t)prefetch_id->blocks_per_file * block->variable_index * 10) * sizeof (*headers)) == -1)
+          continue;
+        header_variable = block->variable_index;
+      }
+
+      prefetch_block(prefetch_id, fh, file_name, headers, block, data, coded_data);
+    }
+    if (fh != NULL)
+      PIDX_io_backend_close(fh);
+  }
+
+  free(data);
+  free(coded_data);
+  free(headers);
+
+  pthread_mutex_lock(&prefetch_id->lock);
+  free(prefetch_id->batch);
+  free(prefetch_id->filename_template);
+  prefetch_id->batch = NULL;
+  prefetch_id->batch_count = 0;
+  prefetch_id->filename_template = NULL;
+  prefetch_id->time_step_count = 0;
+  prefetch_id->running = 0;
+  if (prefetch_id->finalized == 1)
+  {
+    pthread_mutex_unlock(&prefetch_id->lock);
+    pthread_mutex_destroy(&prefetch_id->lock);
+    pthread_cond_destroy(&prefetch_id->cond);
+    free(prefetch_id->block);
+    free(prefetch_id);
+  }
+  else
+  {
+    pthread_cond_broadcast(&prefetch_id->cond);
+    pthread_mutex_unlock(&prefetch_id->lock);
+  }
+
+  pthread_mutex_lock(&live_prefetch_lock);
+  live_prefetch_count--;
+  pthread_cond_broadcast(&live_prefetch_cond);
+  pthread_mutex_unlock(&live_prefetch_lock);
+
+  return NULL;
+}
+
+PIDX_prefetch_id PIDX_prefetch_init(PIDX_io_backend io_backend, int blocks_per_file)
+{
+  PIDX_prefetch_id prefetch_id;
+
+  prefetch_id = malloc(sizeof (*prefetch_id));
+  memset(prefetch_id, 0, sizeof (*prefetch_id));
+
+  // MPI-IO is not called from the thread, the files are the same on disk
+  prefetch_id->io_backend = (io_backend == PIDX_io_backend_mpi) ? PIDX_io_backend_posix : io_backend;
+  prefetch_id->blocks_per_file = blocks_per_file;
+
+  pthread_mutex_init(&prefetch_id->lock, NULL);
+  pthread_cond_init(&prefetch_id->cond, NULL);
+
+  return prefetch_id;
+}
+
+int PIDX_prefetch_add_block(PIDX_prefetch_id prefetch_id, int variable_index, int block_number, off_t offset, uint64_t block_size, int coded, int bits_per_value)
+{
+  struct prefetch_block* block;
+
+  if (prefetch_id->block_count == prefetch_id->block_capacity)
+  {
+    prefetch_id->block_capacity = (prefetch_id->block_capacity == 0) ? 64 : 2 * prefetch_id->block_capacity;
+    block = realloc(prefetch_id->block, prefetch_id->block_capacity * sizeof (*prefetch_id->block));
+    if (block == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+      return -1;
+    }
+    prefetch_id->block = block;
+  }
+
+  block = &prefetch_id->block[prefetch_id->block_count++];
+  block->file_number = block_number / prefetch_id->blocks_per_file;
+  block->variable_index = variable_index;
+  block->block_number = block_number;
+  block->offset = offset;
+  block->block_size = block_size;
+  block->coded = coded;
+  block->bits_per_value = bits_per_value;
+
+  return 0;
+}
+
+int PIDX_prefetch_start(PIDX_prefetch_id prefetch_id, char filename_template[][1024], int time_step_count)
+{
+  PIDX_prefetch_wait(prefetch_id);
+
+  if (prefetch_id->block_count == 0 || time_step_count == 0)
+    return 0;
+
+  prefetch_id->filename_template = malloc(time_step_count * sizeof (*prefetch_id->filename_template));
+  if (prefetch_id->filename_template == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+  memcpy(prefetch_id->filename_template, filename_template, time_step_count * sizeof (*prefetch_id->filename_template));
+  prefetch_id->time_step_count = time_step_count;
+
+  // the thread takes the recorded blocks, the next reads record new ones
+  qsort(prefetch_id->block, prefetch_id->block_count, sizeof (*prefetch_id->block), compare_blocks);
+  prefetch_id->batch = prefetch_id->block;
+  prefetch_id->batch_count = prefetch_id->block_count;
+  prefetch_id->block = NULL;
+  prefetch_id->block_count = 0;
+  prefetch_id->block_capacity = 0;
+  prefetch_id->running = 1;
+
+  pthread_mutex_lock(&live_prefetch_lock);
+  live_prefetch_count++;
+  pthread_mutex_unlock(&live_prefetch_lock);
+
+  if (pthread_create(&prefetch_id->thread, NULL, prefetch_thread, prefetch_id) != 0)
+  {
+    fprintf(stderr, "[%s] [%d] pthread_create() failed.\n", __FILE__, __LINE__);
+    pthread_mutex_lock(&live_prefetch_lock);
+    live_prefetch_count--;
+    pthread_mutex_unlock(&live_prefetch_lock);
+
+    free(prefetch_id->batch);
+    free(prefetch_id->filename_template);
+    prefetch_id->batch = NULL;
+    prefetch_id->batch_count = 0;
+    prefetch_id->filename_template = NULL;
+    prefetch_id->running = 0;
+    return -1;
+  }
+  pthread_detach(prefetch_id->thread);
+
+  return 0;
+}
+
+int PIDX_prefetch_wait(PIDX_prefetch_id prefetch_id)
+{
+  pthread_mutex_lock(&prefetch_id->lock);
+  while (prefetch_id->running != 0)
+    pthread_cond_wait(&prefetch_id->cond, &prefetch_id->lock);
+  pthread_mutex_unlock(&prefetch_id->lock);
+
+  return 0;
+}
+
+int PIDX_prefetch_finalize(PIDX_prefetch_id prefetch_id)
+{
+  // a running prefetch carries on (its blocks are for the files of the next time steps), then frees the id
+  pthread_mutex_lock(&prefetch_id->lock);
+  if (prefetch_id->running != 0)
+  {
+    prefetch_id->finalized = 1;
+    pthread_mutex_unlock(&prefetch_id->lock);
+    return 0;
+  }
+  pthread_mutex_unlock(&prefetch_id->lock);
+
+  pthread_mutex_destroy(&prefetch_id->lock);
+  pthread_cond_destroy(&prefetch_id->cond);
+  free(prefetch_id->block);
+  free(prefetch_id);
+  prefetch_id = 0;
+
+  return 0;
+}
+
+int PIDX_prefetch_wait_all()
+{
+  pthread_mutex_lock(&live_prefetch_lock);
+  while (live_prefetch_count != 0)
+    pthread_cond_wait(&live_prefetch_cond, &live_prefetch_lock);
+  pthread_mutex_unlock(&live_prefetch_lock);
+
+  return 0;
+}
+
+#else
+
+PIDX_prefetch_id PIDX_prefetch_init(PIDX_io_backend io_backend, int blocks_per_file)
+{
+  return NULL;
+}
+
+int PIDX_prefetch_add_block(PIDX_prefetch_id prefetch_id, int variable_index, int block_number, off_t offset, uint64_t block_size, int coded, int bits_per_value)
+{
+  return PIDX_err_not_implemented;
+}
+
+int PIDX_prefetch_start(PIDX_prefetch_id prefetch_id, char filename_template[][1024], int time_step_count)
+{
+  return PIDX_err_not_implemented;
+}
+
+int PIDX_prefetch_wait(PIDX_prefetch_id prefetch_id)
+{
+  return 0;
+}
+
+int PIDX_prefetch_finalize(PIDX_prefetch_id prefetch_id)
+{
+  return 0;
+}
+
+int PIDX_prefetch_wait_all()
+{
+  return 0;
+}
+
+#endif
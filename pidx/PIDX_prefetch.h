@@ -0,0 +1,87 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+/**
+ * \file PIDX_prefetch.h
+ *
+ * Time step read-ahead. The blocks read by the region of interest reads
+ * of a time step are read again, by a background thread, from the binary
+ * files of the next time steps and kept in the block cache, so that the
+ * reads of those time steps find them there while the application is
+ * still busy with the current one.
+ *
+ */
+
+#ifndef __PIDX_PREFETCH_H
+#define __PIDX_PREFETCH_H
+
+
+struct PIDX_prefetch_struct;
+typedef struct PIDX_prefetch_struct* PIDX_prefetch_id;
+
+
+/// Creates the prefetch ID.
+/// \param io_backend backend of the binary files (MPI-IO files are read through POSIX by the thread)
+/// \param blocks_per_file blocks per binary file
+/// \return PIDX_prefetch_id The identifier (NULL if threads are not available)
+PIDX_prefetch_id PIDX_prefetch_init(PIDX_io_backend io_backend, int blocks_per_file);
+
+
+
+/// Records a block for the next PIDX_prefetch_start.
+/// \param prefetch_id prefetch id
+/// \param variable_index the variable
+/// \param block_number the block (in the dataset)
+/// \param offset byte offset of the block in its file
+/// \param block_size size of the decoded block
+/// \param coded 1 if the size and codec of the block are in the block entries of the file header
+/// \param bits_per_value bits per value of the variable (to decode the block)
+/// \return error code
+int PIDX_prefetch_add_block(PIDX_prefetch_id prefetch_id, int variable_index, int block_number, off_t offset, uint64_t block_size, int coded, int bits_per_value);
+
+
+
+/// Starts reading the recorded blocks from the binary files of the given time steps into the block cache (the
+/// blocks already cached are skipped, so are missing files). Waits for the previous prefetch first.
+/// \param prefetch_id prefetch id
+/// \param filename_template binary file name template of every time step to read, in order
+/// \param time_step_count number of templates
+/// \return error code
+int PIDX_prefetch_start(PIDX_prefetch_id prefetch_id, char filename_template[][1024], int time_step_count);
+
+
+
+/// Blocks until the running prefetch (if any) is done.
+/// \param prefetch_id prefetch id
+/// \return error code
+int PIDX_prefetch_wait(PIDX_prefetch_id prefetch_id);
+
+
+
+/// Frees the ID; a running prefetch goes on in the background and frees it once it is done.
+/// \param prefetch_id prefetch id
+/// \return error code
+int PIDX_prefetch_finalize(PIDX_prefetch_id prefetch_id);
+
+
+
+/// Blocks until the prefetches of all the IDs, including the finalized ones, are done.
+/// \return error code
+int PIDX_prefetch_wait_all();
+
+#endif //__PIDX_PREFETCH_H
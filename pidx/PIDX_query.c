@@ -0,0 +1,877 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+#include "PIDX_inc.h"
+
+/// Samples of one level held by one block. A sample of level h has bit 1 at bitmask position h, bits 0 after it and
+/// free bits before it; here the positions 1 ... fixed are set to the bits of a prefix (position 1 the highest).
+/// The bits of every axis are consecutive bits of its coordinate, so in every axis the samples are an arithmetic
+/// progression and the piece is the product of the progressions.
+struct query_piece
+{
+  int64_t start[PIDX_MAX_DIMENSIONS];                   ///< first coordinate
+  int64_t stride[PIDX_MAX_DIMENSIONS];                  ///< distance between the samples
+  int64_t count[PIDX_MAX_DIMENSIONS];                   ///< number of samples
+  int bit_count[PIDX_MAX_DIMENSIONS];                   ///< free bits of every axis
+  int64_t bit_weight[PIDX_MAX_DIMENSIONS][64];          ///< position in the piece (HZ order) of the free bits of every axis, lowest bit first
+};
+
+struct PIDX_query_struct
+{
+  //Contains all relevant IDX file info
+  //Blocks per file, samples per block, bitmask, box, file name template and more
+  idx_dataset idx_ptr;
+
+  //Contains all derieved IDX file info
+  //number of files, files that are ging to be populated
+  idx_dataset_derived_metadata idx_derived_ptr;
+
+  //The planned read
+  int variable_index;
+  int64_t box_offset[PIDX_MAX_DIMENSIONS];              ///< first sample of the box
+  int64_t box_size[PIDX_MAX_DIMENSIONS];                ///< samples of the box
+  int64_t lo[PIDX_MAX_DIMENSIONS];                      ///< first HZ sample (brick) of the box
+  int64_t hi[PIDX_MAX_DIMENSIONS];                      ///< last HZ sample (brick) of the box
+  int max_level;                                        ///< deepest HZ level read
+  int64_t stride[PIDX_MAX_DIMENSIONS];                  ///< distance between the samples of the box copied into the buffer
+  int64_t first[PIDX_MAX_DIMENSIONS];                   ///< first sample copied into the buffer
+  int64_t count[PIDX_MAX_DIMENSIONS];                   ///< samples copied into the buffer
+  int block_count;
+  int block_capacity;
+  int* block;                                           ///< blocks holding samples of the box, sorted
+
+  //Progressive reads
+  PIDX_query_callback callback;                         ///< called as every HZ level of the box is read (NULL: none)
+  void* callback_data;
+
+  //Time step read-ahead
+  PIDX_prefetch_id prefetch;                            ///< records the blocks read (NULL: none)
+
+  //Statistics
+  int64_t blocks_read;
+  int64_t files_read;
+  int64_t bytes_read;
+};
+
+/// What one chunk of the blocks of a read did
+struct block_read_chunk
+{
+  int ret;
+  int64_t blocks_read;
+  int64_t files_read;
+  int64_t bytes_read;
+};
+
+/// Blocks of a PIDX_query_read read together (a level of a progressive read, all of them otherwise)
+struct block_read
+{
+  PIDX_query_id query_id;
+  unsigned char* buffer;                                ///< the box
+  const int64_t* pitch;                                 ///< distance between the samples of the box in every dimension
+  PIDX_io_backend io_backend;
+  uint64_t block_size;                                  ///< size of a decoded block
+  int coded;                                            ///< 1 if the size and codec of the blocks are in the file headers
+  int first;                                            ///< first block (of the plan) of the run
+  struct block_read_chunk* chunk;                       ///< what every chunk of the run did
+};
+
+static int add_block(PIDX_query_id query_id, int block_number);
+
+static void piece_lattice(PIDX_query_id query_id, int level, int fixed, int64_t prefix, struct query_piece* piece);
+
+static int piece_range(PIDX_query_id query_id, const struct query_piece* piece, int64_t* first, int64_t* last);
+
+static int piece_intersects(PIDX_query_id query_id, int level, int fixed, int64_t prefix);
+
+static int plan_blocks(PIDX_query_id query_id, int level, int fixed, int64_t prefix);
+
+static int copy_piece(PIDX_query_id query_id, int level, int fixed, int64_t prefix, int64_t base, const unsigned char* block, unsigned char* buffer, const int64_t* pitch, unsigned char* brick);
+
+static void copy_brick(PIDX_query_id query_id, const int64_t* brick_index, const unsigned char* brick, int value, unsigned char* buffer, const int64_t* pitch);
+
+static int copy_block(PIDX_query_id query_id, int block_number, const unsigned char* block, unsigned char* buffer, const int64_t* pitch, unsigned char* brick);
+
+static int block_level(PIDX_query_id query_id, int block_number);
+
+static int fill_level(PIDX_query_id query_id, int level, unsigned char* buffer, const int64_t* pitch);
+
+static int read_level_done(PIDX_query_id query_id, int level, unsigned char* buffer, const int64_t* pitch);
+
+static int read_thread_count(PIDX_query_id query_id);
+
+static void read_chunk(void* arg, int64_t begin, int64_t end, int64_t chunk);
+
+static int read_blocks(struct block_read* read, int first, int count, int thread_count);
+
+static int add_block(PIDX_query_id query_id, int block_number)
+{
+  if (query_id->block_count == query_id->block_capacity)
+  {
+    int* block;
+    query_id->block_capacity = (query_id->block_capacity == 0) ? 64 : 2 * query_id->block_capacity;
+    block = realloc(query_id->block, query_id->block_capacity * sizeof (*query_id->block));
+    if (block == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] realloc() failed.\n", __FILE__, __LINE__);
+      return -1;
+    }
+    query_id->block = block;
+  }
+
+  query_id->block[query_id->block_count++] = block_number;
+  return 0;
+}
+
+static void piece_lattice(PIDX_query_id query_id, int level, int fixed, int64_t prefix, struct query_piece* piece)
+{
+  int p, d;
+  int64_t weight[PIDX_MAX_DIMENSIONS];
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    piece->start[d] = 0;
+    piece->stride[d] = 1;
+    piece->count[d] = 1;
+    piece->bit_count[d] = 0;
+    weight[d] = 1;
+  }
+
+  // level 0 is the first sample alone
+  if (level == 0)
+    return;
+
+  // the last position of the bitmask is the lowest bit of the coordinates
+  for (p = query_id->idx_derived_ptr->maxh - 1; p >= 1; p--)
+  {
+    d = query_id->idx_ptr->bitPattern[p];
+    if (p == level)
+      piece->start[d] = piece->start[d] + weight[d];
+    else if (p < level && p > fixed)
+    {
+      if (piece->bit_count[d] == 0)
+        piece->stride[d] = weight[d];
+      piece->bit_weight[d][piece->bit_count[d]++] = ((int64_t)1) << (level - 1 - p);
+      piece->count[d] = piece->count[d] * 2;
+    }
+    else if (p <= fixed)
+      piece->start[d] = piece->start[d] + ((prefix >> (fixed - p)) & 1) * weight[d];
+    weight[d] = weight[d] << 1;
+  }
+}
+
+/// Samples of a piece in the box: [first, last] in every axis (indices in the progressions), 0 if there are none
+static int piece_range(PIDX_query_id query_id, const struct query_piece* piece, int64_t* first, int64_t* last)
+{
+  int d;
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (piece->start[d] > query_id->hi[d])
+      return 0;
+
+    first[d] = 0;
+    if (query_id->lo[d] > piece->start[d])
+      first[d] = (query_id->lo[d] - piece->start[d] + piece->stride[d] - 1) / piece->stride[d];
+
+    last[d] = (query_id->hi[d] - piece->start[d]) / piece->stride[d];
+    if (last[d] >= piece->count[d])
+      last[d] = piece->count[d] - 1;
+
+    if (first[d] > last[d])
+      return 0;
+  }
+
+  return 1;
+}
+
+static int piece_intersects(PIDX_query_id query_id, int level, int fixed, int64_t prefix)
+{
+  struct query_piece piece;
+  int64_t first[PIDX_MAX_DIMENSIONS], last[PIDX_MAX_DIMENSIONS];
+
+  piece_lattice(query_id, level, fixed, prefix, &piece);
+  return piece_range(query_id, &piece, first, last);
+}
+
+/// Blocks of a level (past the levels of block 0) holding samples of the box: the bitmask positions that number
+/// the blocks of the level are fixed one at a time, the prefixes whose samples miss the box are dropped
+static int plan_blocks(PIDX_query_id query_id, int level, int fixed, int64_t prefix)
+{
+  if (piece_intersects(query_id, level, fixed, prefix) == 0)
+    return 0;
+
+  // level h is split in 2^(h - 1 - bits_per_block) blocks, numbered from 2^(h - 1 - bits_per_block)
+  if (fixed == level - 1 - query_id->idx_ptr->bits_per_block)
+    return add_block(query_id, (int)((((int64_t)1) << fixed) + prefix));
+
+  if (plan_blocks(query_id, level, fixed + 1, 2 * prefix) == -1)
+    return -1;
+
+  return plan_blocks(query_id, level, fixed + 1, 2 * prefix + 1);
+}
+
+PIDX_query_id PIDX_query_init(idx_dataset idx_meta_data, idx_dataset_derived_metadata idx_derived_ptr)
+{
+  PIDX_query_id query_id;
+
+  query_id = (PIDX_query_id)malloc(sizeof (*query_id));
+  memset(query_id, 0, sizeof (*query_id));
+
+  query_id->idx_ptr = idx_meta_data;
+  query_id->idx_derived_ptr = idx_derived_ptr;
+
+  PIDX_query_set_resolution(query_id, -1, NULL);
+
+  return query_id;
+}
+
+int PIDX_query_resolution(idx_dataset idx_meta_data, int max_level, const int64_t* subsampling, int* level, int64_t* stride)
+{
+  int d, p, h, bits;
+  int64_t step[PIDX_MAX_DIMENSIONS];
+  char bit_sequence[512];
+  char bit_pattern[512];
+  PointND bounds;
+
+  // same bitmask as populate_idx_dataset, the HZ samples are the bricks
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (subsampling != NULL && (subsampling[d] < 1 || (subsampling[d] & (subsampling[d] - 1)) != 0))
+    {
+      fprintf(stderr, "[%s] [%d] the subsampling factor (%lld) is not a power of two in dimension %d.\n", __FILE__, __LINE__, (long long)subsampling[d], d);
+      return -1;
+    }
+    PGET(bounds, d) = (int)((idx_meta_data->global_bounds[d] + idx_meta_data->compression_block_size[d] - 1) / idx_meta_data->compression_block_size[d]);
+  }
+  GuessBitmaskPattern(bit_sequence, bounds);
+  bits = strlen(bit_sequence) - 1;
+  for (p = 1; p <= bits; p++)
+    bit_pattern[p] = RegExBitmaskBit(bit_sequence, p);
+
+  h = (max_level < 0 || max_level > bits) ? bits : max_level;
+  if (subsampling != NULL)
+    h = 0;
+
+  // the samples of the levels 0 ... h have zeros in the bitmask positions past h: in every axis they are 2^(positions
+  // of the axis past h) HZ samples apart; the subsampling picks the coarsest level whose samples are all wanted
+  for (; ; h++)
+  {
+    for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      step[d] = 1;
+    for (p = h + 1; p <= bits; p++)
+      step[(int)bit_pattern[p]] = step[(int)bit_pattern[p]] * 2;
+
+    // past the full resolution one value per brick
+    for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      if (step[d] > 1)
+        step[d] = step[d] * idx_meta_data->compression_block_size[d];
+
+    if (subsampling == NULL || h == bits)
+      break;
+    for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+      if (subsampling[d] % step[d] != 0)
+        break;
+    if (d == PIDX_MAX_DIMENSIONS)
+      break;
+  }
+
+  *level = h;
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    stride[d] = (subsampling != NULL) ? subsampling[d] : step[d];
+
+  return 0;
+}
+
+int PIDX_query_set_resolution(PIDX_query_id query_id, int max_level, const int64_t* stride)
+{
+  int d;
+
+  query_id->max_level = (max_level < 0) ? INT_MAX : max_level;
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    query_id->stride[d] = (stride != NULL) ? stride[d] : 1;
+
+  return 0;
+}
+
+int PIDX_query_set_callback(PIDX_query_id query_id, PIDX_query_callback callback, void* user_data)
+{
+  query_id->callback = callback;
+  query_id->callback_data = user_data;
+
+  return 0;
+}
+
+int PIDX_query_set_prefetch(PIDX_query_id query_id, PIDX_prefetch_id prefetch_id)
+{
+  query_id->prefetch = prefetch_id;
+
+  return 0;
+}
+
+int PIDX_query_plan(PIDX_query_id query_id, int variable_index, const int64_t* offset, const int64_t* size)
+{
+  int d, level, bits = query_id->idx_derived_ptr->maxh - 1;
+
+  query_id->variable_index = variable_index;
+  memset(query_id->count, 0, sizeof (query_id->count));
+  query_id->block_count = 0;
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    if (offset[d] < 0 || size[d] < 1 || offset[d] + size[d] > query_id->idx_ptr->global_bounds[d])
+    {
+      fprintf(stderr, "[%s] [%d] the box (%lld + %lld) is not in the dataset (%lld) in dimension %d.\n", __FILE__, __LINE__, (long long)offset[d], (long long)size[d], (long long)query_id->idx_ptr->global_bounds[d], d);
+      return -1;
+    }
+    query_id->box_offset[d] = offset[d];
+    query_id->box_size[d] = size[d];
+
+    // every HZ sample is a brick
+    query_id->lo[d] = offset[d] / query_id->idx_ptr->compression_block_size[d];
+    query_id->hi[d] = (offset[d] + size[d] - 1) / query_id->idx_ptr->compression_block_size[d];
+
+    // the samples of the box that are multiples of the stride
+    query_id->first[d] = (offset[d] + query_id->stride[d] - 1) / query_id->stride[d] * query_id->stride[d];
+    query_id->count[d] = (offset[d] + size[d] - 1) / query_id->stride[d] - offset[d] / query_id->stride[d] + ((offset[d] % query_id->stride[d] == 0) ? 1 : 0);
+    if (query_id->count[d] == 0)
+      return 0;
+  }
+
+  if (bits > query_id->max_level)
+    bits = query_id->max_level;
+
+  // block 0 holds the levels 0 ... bits_per_block
+  for (level = 0; level <= bits && level <= query_id->idx_ptr->bits_per_block; level++)
+  {
+    if (piece_intersects(query_id, level, 0, 0) == 1)
+    {
+      if (add_block(query_id, 0) == -1)
+        return -1;
+      break;
+    }
+  }
+
+  // the blocks of the deeper levels come in increasing order, level after level
+  for (level = query_id->idx_ptr->bits_per_block + 1; level <= bits; level++)
+    if (plan_blocks(query_id, level, 0, 0) == -1)
+      return -1;
+
+  return 0;
+}
+
+int PIDX_query_block_count(PIDX_query_id query_id)
+{
+  return query_id->block_count;
+}
+
+/// Copies the values of one brick (one value of a sample) that lie in the box
+static void copy_brick(PIDX_query_id query_id, const int64_t* brick_index, const unsigned char* brick, int value, unsigned char* buffer, const int64_t* pitch)
+{
+  int d;
+  int64_t x, y, z, u, v, intra, index;
+  int64_t from[PIDX_MAX_DIMENSIONS], to[PIDX_MAX_DIMENSIONS], corner[PIDX_MAX_DIMENSIONS];
+  int64_t *stride = query_id->stride;
+  int64_t *compression_block_size = query_id->idx_ptr->compression_block_size;
+  PIDX_variable var = query_id->idx_ptr->variable[query_id->variable_index];
+  int bytes_per_value = var->bits_per_value / 8;
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    corner[d] = brick_index[d] * compression_block_size[d];
+    from[d] = max(corner[d], query_id->first[d]);
+    from[d] = (from[d] + stride[d] - 1) / stride[d] * stride[d];
+    to[d] = min(corner[d] + compression_block_size[d], query_id->box_offset[d] + query_id->box_size[d]);
+  }
+
+  for (v = from[4]; v < to[4]; v = v + stride[4])
+    for (u = from[3]; u < to[3]; u = u + stride[3])
+      for (z = from[2]; z < to[2]; z = z + stride[2])
+        for (y = from[1]; y < to[1]; y = y + stride[1])
+          for (x = from[0]; x < to[0]; x = x + stride[0])
+          {
+            // the values of a brick are x fastest
+            intra = ((((v - corner[4]) * compression_block_size[3] + (u - corner[3])) * compression_block_size[2] + (z - corner[2])) * compression_block_size[1] + (y - corner[1])) * compression_block_size[0] + (x - corner[0]);
+            index = (x - query_id->first[0]) / stride[0] * pitch[0] + (y - query_id->first[1]) / stride[1] * pitch[1] + (z - query_id->first[2]) / stride[2] * pitch[2] + (u - query_id->first[3]) / stride[3] * pitch[3] + (v - query_id->first[4]) / stride[4] * pitch[4];
+            memcpy(buffer + (index * var->values_per_sample + value) * bytes_per_value, brick + intra * bytes_per_value, bytes_per_value);
+          }
+}
+
+/// Copies the samples of a piece that lie in the box, base is the index in the block of the first sample of the piece
+static int copy_piece(PIDX_query_id query_id, int level, int fixed, int64_t prefix, int64_t base, const unsigned char* block, unsigned char* buffer, const int64_t* pitch, unsigned char* brick)
+{
+  int d, t, s, ret = 0;
+  int64_t i, index;
+  int64_t first[PIDX_MAX_DIMENSIONS], last[PIDX_MAX_DIMENSIONS], k[PIDX_MAX_DIMENSIONS], c[PIDX_MAX_DIMENSIONS];
+  int64_t *spread[PIDX_MAX_DIMENSIONS];
+  struct query_piece piece;
+  PIDX_variable var = query_id->idx_ptr->variable[query_id->variable_index];
+  int bytes_per_sample = var->bytes_per_brick * var->values_per_sample;
+  int bytes_per_value = var->bits_per_value / 8;
+  int bricks = (brick != NULL);
+  const unsigned char* sample;
+
+  piece_lattice(query_id, level, fixed, prefix, &piece);
+  if (piece_range(query_id, &piece, first, last) == 0)
+    return 0;
+
+  // index in the piece of every sample of the range, per axis (the index of a sample is the sum over its axes)
+  memset(spread, 0, sizeof (spread));
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    spread[d] = malloc((last[d] - first[d] + 1) * sizeof (*spread[d]));
+    if (spread[d] == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+      ret = -1;
+      goto free_spread;
+    }
+    for (i = first[d]; i <= last[d]; i++)
+    {
+      spread[d][i - first[d]] = 0;
+      for (t = 0; t < piece.bit_count[d]; t++)
+        if ((i >> t) & 1)
+          spread[d][i - first[d]] = spread[d][i - first[d]] + piece.bit_weight[d][t];
+    }
+  }
+
+  for (k[4] = first[4]; k[4] <= last[4]; k[4]++)
+    for (k[3] = first[3]; k[3] <= last[3]; k[3]++)
+      for (k[2] = first[2]; k[2] <= last[2]; k[2]++)
+        for (k[1] = first[1]; k[1] <= last[1]; k[1]++)
+          for (k[0] = first[0]; k[0] <= last[0]; k[0]++)
+          {
+            sample = block + (base + spread[0][k[0] - first[0]] + spread[1][k[1] - first[1]] + spread[2][k[2] - first[2]] + spread[3][k[3] - first[3]] + spread[4][k[4] - first[4]]) * bytes_per_sample;
+            for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+              c[d] = piece.start[d] + k[d] * piece.stride[d];
+
+            if (bricks == 0)
+            {
+              // subsampled reads skip the samples between the strides
+              if (c[0] % query_id->stride[0] != 0 || c[1] % query_id->stride[1] != 0 || c[2] % query_id->stride[2] != 0 || c[3] % query_id->stride[3] != 0 || c[4] % query_id->stride[4] != 0)
+                continue;
+              index = (c[0] - query_id->first[0]) / query_id->stride[0] * pitch[0] + (c[1] - query_id->first[1]) / query_id->stride[1] * pitch[1] + (c[2] - query_id->first[2]) / query_id->stride[2] * pitch[2] + (c[3] - query_id->first[3]) / query_id->stride[3] * pitch[3] + (c[4] - query_id->first[4]) / query_id->stride[4] * pitch[4];
+              memcpy(buffer + index * var->values_per_sample * bytes_per_value, sample, bytes_per_sample);
+              continue;
+            }
+
+            for (s = 0; s < var->values_per_sample; s++)
+            {
+              PIDX_compression_brick_decode(query_id->idx_ptr, query_id->variable_index, sample + s * var->bytes_per_brick, brick);
+              copy_brick(query_id, c, brick, s, buffer, pitch);
+            }
+          }
+
+free_spread:
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    free(spread[d]);
+
+  return ret;
+}
+
+/// Copies the samples of a block that lie in the box
+static int copy_block(PIDX_query_id query_id, int block_number, const unsigned char* block, unsigned char* buffer, const int64_t* pitch, unsigned char* brick)
+{
+  int level, fixed;
+
+  // block 0 holds the first sample (level 0) then the 2^(h - 1) samples of every level h up to bits_per_block
+  if (block_number == 0)
+  {
+    for (level = 0; level <= block_level(query_id, 0); level++)
+      if (copy_piece(query_id, level, 0, 0, (level == 0) ? 0 : ((int64_t)1) << (level - 1), block, buffer, pitch, brick) == -1)
+        return -1;
+    return 0;
+  }
+
+  level = block_level(query_id, block_number);
+  fixed = level - 1 - query_id->idx_ptr->bits_per_block;
+
+  return copy_piece(query_id, level, fixed, block_number - (((int64_t)1) << fixed), 0, block, buffer, pitch, brick);
+}
+
+/// Deepest HZ level (read) held by a block
+static int block_level(PIDX_query_id query_id, int block_number)
+{
+  int fixed, level, bits = query_id->idx_derived_ptr->maxh - 1;
+
+  if (block_number == 0)
+  {
+    level = (query_id->idx_ptr->bits_per_block < bits) ? query_id->idx_ptr->bits_per_block : bits;
+    return (level < query_id->max_level) ? level : query_id->max_level;
+  }
+
+  for (fixed = 0; (((int64_t)2) << fixed) <= block_number; fixed++)
+    ;
+  return fixed + 1 + query_id->idx_ptr->bits_per_block;
+}
+
+/// Once the levels 0 ... level are read the box holds the samples of their (coarser) stride; every other sample of
+/// the buffer takes the value of the one before it on that stride (the one after it at the start of the box), so the
+/// buffer is a blocky copy of the box. The deeper levels overwrite these values as they are read.
+static int fill_level(PIDX_query_id query_id, int level, unsigned char* buffer, const int64_t* pitch)
+{
+  int d, h, ret = 0;
+  int64_t i[PIDX_MAX_DIMENSIONS];
+  int64_t* source[PIDX_MAX_DIMENSIONS] = {NULL};
+  int64_t step[PIDX_MAX_DIMENSIONS];
+  int64_t c, b, t, f, index, source_index;
+  PIDX_variable var = query_id->idx_ptr->variable[query_id->variable_index];
+  int bytes_per_sample = var->values_per_sample * (var->bits_per_value / 8);
+
+  if (PIDX_query_resolution(query_id->idx_ptr, level, NULL, &h, step) == -1)
+    return -1;
+
+  // source[d][i] is the sample of the buffer read for the i-th sample of the axis (-1: none in the box); with bricks
+  // a level holds whole bricks, every (step / brick size)-th one
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+  {
+    source[d] = malloc(query_id->count[d] * sizeof (*source[d]));
+    if (source[d] == NULL)
+    {
+      fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+      ret = -1;
+      goto free_source;
+    }
+
+    b = query_id->idx_ptr->compression_block_size[d];
+    t = (step[d] > 1) ? step[d] / b : 1;
+    for (i[d] = 0; i[d] < query_id->count[d]; i[d]++)
+    {
+      c = query_id->first[d] + i[d] * query_id->stride[d];
+      f = (c / b) / t * t * b + c % b;
+      if (f < query_id->first[d])
+        f = f + t * b;
+      source[d][i[d]] = (f < query_id->box_offset[d] + query_id->box_size[d]) ? (f - query_id->first[d]) / query_id->stride[d] : -1;
+    }
+  }
+
+  for (i[4] = 0; i[4] < query_id->count[4]; i[4]++)
+    for (i[3] = 0; i[3] < query_id->count[3]; i[3]++)
+      for (i[2] = 0; i[2] < query_id->count[2]; i[2]++)
+        for (i[1] = 0; i[1] < query_id->count[1]; i[1]++)
+          for (i[0] = 0; i[0] < query_id->count[0]; i[0]++)
+          {
+            if (source[0][i[0]] == -1 || source[1][i[1]] == -1 || source[2][i[2]] == -1 || source[3][i[3]] == -1 || source[4][i[4]] == -1)
+              continue;
+            index = i[0] * pitch[0] + i[1] * pitch[1] + i[2] * pitch[2] + i[3] * pitch[3] + i[4] * pitch[4];
+            source_index = source[0][i[0]] * pitch[0] + source[1][i[1]] * pitch[1] + source[2][i[2]] * pitch[2] + source[3][i[3]] * pitch[3] + source[4][i[4]] * pitch[4];
+            if (source_index != index)
+              memcpy(buffer + index * bytes_per_sample, buffer + source_index * bytes_per_sample, bytes_per_sample);
+          }
+
+free_source:
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    free(source[d]);
+
+  return ret;
+}
+
+/// Hands the box to the callback once the levels 0 ... level are read; 1 if the callback ends the read
+static int read_level_done(PIDX_query_id query_id, int level, unsigned char* buffer, const int64_t* pitch)
+{
+  int bits = query_id->idx_derived_ptr->maxh - 1;
+  int last_level = (bits < query_id->max_level) ? bits : query_id->max_level;
+
+  if (level < last_level && fill_level(query_id, level, buffer, pitch) == -1)
+    return -1;
+
+  return (query_id->callback(level, last_level, query_id->callback_data) != 0) ? 1 : 0;
+}
+
+/// Threads reading the blocks: read_thread_count, or without MPI one per core (the processes of a node share its
+/// cores with MPI)
+static int read_thread_count(PIDX_query_id query_id)
+{
+  int thread_count = 1;
+
+  if (query_id->idx_ptr->read_thread_count > 0)
+    return query_id->idx_ptr->read_thread_count;
+
+#if !PIDX_HAVE_MPI && defined(_SC_NPROCESSORS_ONLN)
+  thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+  return (thread_count > 0) ? thread_count : 1;
+}
+
+/// Reads the blocks [begin, end) of a run and copies their samples into the box. Every thread opens its own files and
+/// the blocks hold different samples, so the chunks of a run are read side by side.
+static void read_chunk(void* arg, int64_t begin, int64_t end, int64_t chunk)
+{
+  int i, codec, file_number, open_file = -1, file_opened = 0;
+  struct block_read* read = (struct block_read*)arg;
+  struct block_read_chunk* result = &read->chunk[chunk];
+  PIDX_query_id query_id = read->query_id;
+  int blocks_per_file = query_id->idx_ptr->blocks_per_file;
+  int64_t d, brick_size = 1;
+  uint64_t coded_size;
+  off_t data_offset;
+  char file_name[PATH_MAX];
+  uint32_t* headers = NULL;
+  unsigned char *block = NULL, *coded_block = NULL, *brick = NULL;
+  PIDX_io_backend_file fh = NULL;
+  PIDX_variable var = query_id->idx_ptr->variable[query_id->variable_index];
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    brick_size = brick_size * query_id->idx_ptr->compression_block_size[d];
+
+  block = malloc(read->block_size);
+  if (read->coded == 1)
+  {
+    coded_block = malloc(read->block_size);
+    headers = malloc(10 * blocks_per_file * sizeof (*headers));
+  }
+  if (brick_size > 1)
+    brick = malloc(brick_size * (var->bits_per_value / 8));
+  if (block == NULL || (read->coded == 1 && (coded_block == NULL || headers == NULL)) || (brick_size > 1 && brick == NULL))
+  {
+    fprintf(stderr, "[%s] [%d] malloc() failed.\n", __FILE__, __LINE__);
+    result->ret = -1;
+  }
+
+  for (i = read->first + begin; i < read->first + end && result->ret == 0; i++)
+  {
+    data_offset = PIDX_blocks_find_offset(query_id->idx_derived_ptr->block_offset_table, query_id->variable_index, query_id->block[i]);
+    if (data_offset == -1)
+      continue;
+    data_offset += query_id->idx_derived_ptr->start_fs_block * query_id->idx_derived_ptr->fs_block_size;
+
+    file_number = query_id->block[i] / blocks_per_file;
+    if (file_number != open_file)
+    {
+      if (fh != NULL)
+        PIDX_io_backend_close(fh);
+      fh = NULL;
+      open_file = file_number;
+      file_opened = 0;
+
+      if (generate_file_name(blocks_per_file, query_id->idx_ptr->filename_template, file_number, file_name, PATH_MAX) == 1)
+      {
+        fprintf(stderr, "[%s] [%d] generate_file_name() failed.\n", __FILE__, __LINE__);
+        result->ret = -1;
+        break;
+      }
+    }
+
+    // the blocks already read by the process come from the block cache, without opening their file
+    if (PIDX_block_cache_get(file_name, query_id->variable_index, query_id->block[i], block, read->block_size) == 1)
+    {
+      result->ret = copy_block(query_id, query_id->block[i], block, read->buffer, read->pitch, brick);
+      continue;
+    }
+
+    if (file_opened == 0)
+    {
+      file_opened = 1;
+
+      // a missing file reads as zeros, like the other read paths
+      if (PIDX_io_backend_open(read->io_backend, file_name, PIDX_IO_BACKEND_READ, &fh) == -1)
+      {
+        fh = NULL;
+        continue;
+      }
+      result->files_read++;
+
+      if (read->coded == 1 && PIDX_io_backend_pread(fh, (unsigned char*)headers, 10 * blocks_per_file * sizeof (*headers), (10 + (off_t)blocks_per_file * query_id->variable_index * 10) * sizeof (*headers)) == -1)
+      {
+        fprintf(stderr, "[%s] [%d] PIDX_io_backend_pread() failed on %s.\n", __FILE__, __LINE__, file_name);
+        result->ret = -1;
+        break;
+      }
+    }
+    if (fh == NULL)
+      continue;
+
+    codec = PIDX_BLOCK_RAW;
+    coded_size = read->block_size;
+    if (read->coded == 1)
+    {
+      codec = ntohl(headers[(query_id->block[i] % blocks_per_file) * 10 + 5]);
+      if (codec != PIDX_BLOCK_RAW)
+        coded_size = ntohl(headers[(query_id->block[i] % blocks_per_file) * 10 + 4]);
+    }
+
+    if (codec == PIDX_BLOCK_RAW)
+    {
+      if (PIDX_io_backend_pread(fh, block, read->block_size, data_offset) == -1)
+      {
+        fprintf(stderr, "[%s] [%d] PIDX_io_backend_pread() failed on %s.\n", __FILE__, __LINE__, file_name);
+        result->ret = -1;
+        break;
+      }
+    }
+    else
+    {
+      if (coded_size >= read->block_size || PIDX_io_backend_pread(fh, coded_block, coded_size, data_offset) == -1 || PIDX_compression_block_decode(coded_block, coded_size, codec, var->bits_per_value, block, read->block_size) == -1)
+      {
+        fprintf(stderr, "[%s] [%d] block %d of %s is corrupt.\n", __FILE__, __LINE__, query_id->block[i], file_name);
+        result->ret = -1;
+        break;
+      }
+    }
+    result->blocks_read++;
+    result->bytes_read += coded_size;
+    PIDX_block_cache_put(file_name, query_id->variable_index, query_id->block[i], block, read->block_size);
+
+    result->ret = copy_block(query_id, query_id->block[i], block, read->buffer, read->pitch, brick);
+  }
+
+  if (fh != NULL)
+    PIDX_io_backend_close(fh);
+
+  free(block);
+  free(coded_block);
+  free(headers);
+  free(brick);
+}
+
+/// Reads the planned blocks [first, first + count), split in chunks over the threads
+static int read_blocks(struct block_read* read, int first, int count, int thread_count)
+{
+  int ret = 0;
+  int64_t c, chunk_size, chunk_count;
+
+  // a few chunks per thread balance the blocks found in the cache against the ones read from the files
+  chunk_size = (thread_count > 1) ? (count + 4 * thread_count - 1) / (4 * thread_count) : count;
+  chunk_count = (count + chunk_size - 1) / chunk_size;
+
+  read->first = first;
+  read->chunk = calloc(chunk_count, sizeof (*read->chunk));
+  if (read->chunk == NULL)
+  {
+    fprintf(stderr, "[%s] [%d] calloc() failed.\n", __FILE__, __LINE__);
+    return -1;
+  }
+
+  PIDX_compression_run(thread_count, count, chunk_size, read_chunk, read);
+
+  for (c = 0; c < chunk_count; c++)
+  {
+    if (read->chunk[c].ret == -1)
+      ret = -1;
+    read->query_id->blocks_read += read->chunk[c].blocks_read;
+    read->query_id->files_read += read->chunk[c].files_read;
+    read->query_id->bytes_read += read->chunk[c].bytes_read;
+  }
+  free(read->chunk);
+  read->chunk = NULL;
+
+  return ret;
+}
+
+int PIDX_query_read(PIDX_query_id query_id, unsigned char* buffer, PIDX_data_layout layout)
+{
+  int i, d, first, ret = 0;
+  int bits = query_id->idx_derived_ptr->maxh - 1;
+  int thread_count = read_thread_count(query_id);
+  int64_t pitch[PIDX_MAX_DIMENSIONS];
+  int64_t sample_count = 1;
+  off_t data_offset;
+  struct block_read read;
+  PIDX_variable var = query_id->idx_ptr->variable[query_id->variable_index];
+  int bytes_per_value = var->bits_per_value / 8;
+
+  for (d = 0; d < PIDX_MAX_DIMENSIONS; d++)
+    sample_count = sample_count * query_id->count[d];
+
+  if (layout == PIDX_column_major)
+  {
+    pitch[2] = 1;
+    pitch[1] = query_id->count[2];
+    pitch[0] = query_id->count[1] * query_id->count[2];
+    pitch[3] = query_id->count[0] * pitch[0];
+    pitch[4] = query_id->count[3] * pitch[3];
+  }
+  else
+  {
+    pitch[0] = 1;
+    for (d = 1; d < PIDX_MAX_DIMENSIONS; d++)
+      pitch[d] = pitch[d - 1] * query_id->count[d - 1];
+  }
+
+  // samples of the blocks missing from the files read as zeros
+  memset(buffer, 0, sample_count * var->values_per_sample * bytes_per_value);
+  if (query_id->block_count == 0)
+    return 0;
+
+  memset(&read, 0, sizeof (read));
+  read.query_id = query_id;
+  read.buffer = buffer;
+  read.pitch = pitch;
+  read.block_size = (uint64_t)query_id->idx_derived_ptr->samples_per_block * var->bytes_per_brick * var->values_per_sample;
+
+  // MPI-IO is not called from the threads, the files are the same on disk
+  read.io_backend = query_id->idx_derived_ptr->io_backend;
+  if (thread_count > 1 && read.io_backend == PIDX_io_backend_mpi)
+    read.io_backend = PIDX_io_backend_posix;
+
+  // the blocks coded by the aggregators have their size and codec in the block entries of the file header
+  read.coded = ((query_id->idx_ptr->compression_type == PIDX_LOSSLESS_COMPRESSION || query_id->idx_ptr->compression_type == PIDX_ADAPTIVE_COMPRESSION) && var->values_per_sample == 1 && query_id->idx_derived_ptr->aggregation_factor == 1);
+
+  if (query_id->prefetch != NULL)
+  {
+    for (i = 0; i < query_id->block_count; i++)
+    {
+      data_offset = PIDX_blocks_find_offset(query_id->idx_derived_ptr->block_offset_table, query_id->variable_index, query_id->block[i]);
+      if (data_offset == -1)
+        continue;
+      data_offset += query_id->idx_derived_ptr->start_fs_block * query_id->idx_derived_ptr->fs_block_size;
+
+      if (PIDX_prefetch_add_block(query_id->prefetch, query_id->variable_index, query_id->block[i], data_offset, read.block_size, read.coded, var->bits_per_value) == -1)
+        return -1;
+    }
+  }
+
+  if (query_id->callback == NULL)
+    return read_blocks(&read, 0, query_id->block_count, thread_count);
+
+  // the blocks are sorted by level, coarsest first: past the last block of a level the box holds the levels up to it
+  for (first = 0; first < query_id->block_count && ret == 0; first = i)
+  {
+    for (i = first + 1; i < query_id->block_count && block_level(query_id, query_id->block[i]) == block_level(query_id, query_id->block[first]); i++)
+      ;
+
+    ret = read_blocks(&read, first, i - first, thread_count);
+    if (ret == 0)
+      ret = read_level_done(query_id, (i < query_id->block_count) ? block_level(query_id, query_id->block[i]) - 1 : ((bits < query_id->max_level) ? bits : query_id->max_level), buffer, pitch);
+  }
+
+  // a callback that ends the read leaves the coarse box in the buffer
+  if (ret == 1)
+    ret = 0;
+
+  return ret;
+}
+
+int PIDX_query_get_stats(PIDX_query_id query_id, int64_t* block_count, int64_t* file_count, int64_t* byte_count)
+{
+  *block_count = query_id->blocks_read;
+  *file_count = query_id->files_read;
+  *byte_count = query_id->bytes_read;
+
+  return 0;
+}
+
+int PIDX_query_finalize(PIDX_query_id query_id)
+{
+  free(query_id->block);
+
+  free(query_id);
+  query_id = 0;
+
+  return 0;
+}
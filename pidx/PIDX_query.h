@@ -0,0 +1,122 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+/**
+ * \file PIDX_query.h
+ *
+ * Region of interest reads. A box is mapped to the samples it holds at
+ * every HZ level, the levels to the IDX blocks that hold those samples
+ * and the blocks to their files; only these blocks are read, by the
+ * process that asked for the box and without talking to the others.
+ * The cost of a read follows the size of the box, not of the dataset.
+ *
+ */
+
+#ifndef __PIDX_QUERY_H
+#define __PIDX_QUERY_H
+
+
+struct PIDX_query_struct;
+typedef struct PIDX_query_struct* PIDX_query_id;
+
+/// Called by PIDX_query_read once the HZ levels 0 ... level of the box are read (last_level is the deepest one read);
+/// returns 0 to go on reading, anything else to end the read there
+typedef int (*PIDX_query_callback)(int level, int last_level, void* user_data);
+
+
+/// Creates the query ID.
+/// \param idx_meta_data All infor regarding the idx file passed from PIDX.c
+/// \param idx_derived_ptr All derived idx related derived metadata passed from PIDX.c (the block offset table must be built)
+/// \return PIDX_query_id The identifier
+PIDX_query_id PIDX_query_init(idx_dataset idx_meta_data, idx_dataset_derived_metadata idx_derived_ptr);
+
+
+
+/// Coarse grid of a resolution limited read. The samples of the HZ levels 0 ... h are the samples whose coordinates are
+/// multiples of a stride (2^bits of the axis in the bitmask past h, times the brick size with bricks).
+/// \param idx_meta_data the dataset (global bounds and compression block size)
+/// \param max_level deepest HZ level to read (-1: all of them)
+/// \param subsampling wanted stride in every dimension (powers of two), NULL to read the levels up to max_level;
+/// the coarsest level whose samples include every multiple of the stride is picked
+/// \param level the deepest HZ level that has to be read
+/// \param stride distance between the samples read in every dimension
+/// \return error code
+int PIDX_query_resolution(idx_dataset idx_meta_data, int max_level, const int64_t* subsampling, int* level, int64_t* stride);
+
+
+
+/// Limits the next plans to the HZ levels 0 ... max_level (-1: no limit) and copies only the samples of the box that are
+/// multiples of stride (NULL: every sample), see PIDX_query_resolution. The buffer of PIDX_query_read then holds the
+/// coarse grid, ordered as the box.
+/// \return error code
+int PIDX_query_set_resolution(PIDX_query_id query_id, int max_level, const int64_t* stride);
+
+
+
+/// Reads progressively: PIDX_query_read reads the blocks level by level, coarsest first, and calls callback as every
+/// level is done (NULL: no callback). Before the last level the samples between the ones read hold copies of them,
+/// so the buffer is a coarse version of the box that the deeper levels refine in place.
+/// \return error code
+int PIDX_query_set_callback(PIDX_query_id query_id, PIDX_query_callback callback, void* user_data);
+
+
+
+/// Records every block PIDX_query_read reads (with where it is in its file) for a read-ahead of the next time steps
+/// (NULL: no recording).
+/// \return error code
+int PIDX_query_set_prefetch(PIDX_query_id query_id, PIDX_prefetch_id prefetch_id);
+
+
+
+/// Finds the blocks of a variable that hold samples of a box (sorted by block number, so by file).
+/// \param query_id query id
+/// \param variable_index the variable
+/// \param offset first sample of the box
+/// \param size number of samples of the box in every dimension
+/// \return error code
+int PIDX_query_plan(PIDX_query_id query_id, int variable_index, const int64_t* offset, const int64_t* size);
+
+
+
+/// Number of blocks found by the last PIDX_query_plan
+int PIDX_query_block_count(PIDX_query_id query_id);
+
+
+
+/// Reads the planned blocks and copies the samples of the box into buffer. Samples of blocks that are
+/// not in the files read as zeros.
+/// \param query_id query id
+/// \param buffer the box, values_per_sample values per sample
+/// \param layout PIDX_row_major (x fastest) or PIDX_column_major
+/// \return error code
+int PIDX_query_read(PIDX_query_id query_id, unsigned char* buffer, PIDX_data_layout layout);
+
+
+
+/// Blocks, files and bytes read since the ID was created.
+/// \return error code
+int PIDX_query_get_stats(PIDX_query_id query_id, int64_t* block_count, int64_t* file_count, int64_t* byte_count);
+
+
+
+/// Frees the ID.
+/// \param query_id query id
+/// \return error code
+int PIDX_query_finalize(PIDX_query_id query_id);
+
+#endif //__PIDX_QUERY_H
@@ -44,6 +44,8 @@ static void usage(enum Kind kind)
   //case PARALLEL_MULTI_PATCH_WRITER:        usage_multi_var_writer();    break;
   case SERIAL_READER:                      usage_serial_reader();              break;
   case PARALLEL_READER:                    usage_reader();              break;
+  case RESTART_READER:                     usage_restart_reader();      break;
+  case ROUNDTRIP:                          usage_roundtrip();           break;
   case DEFAULT:
   default:                                 usage_multi_idx_writer();
   }
@@ -52,7 +54,7 @@ static void usage(enum Kind kind)
 /// main
 int main(int argc, char **argv) 
 {
-  int ret, nprocs = 1, rank = 0;
+  int ret, failed = 0, nprocs = 1, rank = 0;
   struct Args args;
 
 #if PIDX_HAVE_MPI
@@ -82,7 +84,7 @@ int main(int argc, char **argv)
       MPI_Abort(MPI_COMM_WORLD, -1);
 #endif
     } 
-    else 
+    else if (args.kind != RESTART_READER)
     {
       if ((args.extents[0] / args.count_local[0]) * (args.extents[1] / args.count_local[1]) * (args.extents[2] / args.count_local[2]) != nprocs) 
       {
@@ -107,6 +109,16 @@ int main(int argc, char **argv)
 	printf("Performing Parallel Read....\n");
       test_reader(args, rank, nprocs);
       break;
+    case RESTART_READER:
+      if(rank == 0)
+	printf("Performing Restart Read....\n");
+      test_restart_reader(args, rank, nprocs);
+      break;
+    case ROUNDTRIP:
+      if(rank == 0)
+	printf("Performing Write and Read Back....\n");
+      failed = test_roundtrip(args, rank, nprocs);
+      break;
     /*
     case SERIAL_READER:  
       if(rank == 0)
@@ -145,13 +157,14 @@ int main(int argc, char **argv)
 #if PIDX_HAVE_MPI
   MPI_Finalize();
 #endif
-  return 0;
+  return failed;
 }
 
 /*parse_args*/
 int parse_args(struct Args *args, int argc, char **argv) 
 {
   char strkind[128];
+  char section[128];
   FILE* config_file;
   
   if (!args)
@@ -185,7 +198,7 @@ int parse_args(struct Args *args, int argc, char **argv)
   fscanf(config_file, "(idx count x:y:z)\n");
   fscanf(config_file, "%d %d %d\n", &args->idx_count[0], &args->idx_count[1], &args->idx_count[2]);
   
-  if (strcmp(strkind, "parallel-writer") == 0 || strcmp(strkind, "serial-writer") == 0)
+  if (strcmp(strkind, "parallel-writer") == 0 || strcmp(strkind, "serial-writer") == 0 || strcmp(strkind, "roundtrip") == 0)
   {
     fscanf(config_file, "(debug rst:hz:agg)\n");
     fscanf(config_file, "%d %d %d\n", &args->debug_rst, &args->debug_hz, &args->dump_agg);
@@ -211,6 +224,53 @@ int parse_args(struct Args *args, int argc, char **argv)
     fscanf(config_file, "(aggregation factor)\n");
     fscanf(config_file, "%d\n", &args->aggregation_factor);
   }
+
+  /// Optional sections of the roundtrip test, in any order
+  if (strcmp(strkind, "roundtrip") == 0)
+  {
+    while (fscanf(config_file, " (%127[^)])\n", section) == 1)
+    {
+      if (strcmp(section, "accuracy") == 0)
+        fscanf(config_file, "%lf\n", &args->accuracy);
+      else if (strcmp(section, "tolerance") == 0)
+        fscanf(config_file, "%lf\n", &args->tolerance);
+      else if (strcmp(section, "roi") == 0)
+        fscanf(config_file, "%d\n", &args->roi_read);
+      else if (strcmp(section, "subsampling") == 0)
+        fscanf(config_file, "%d\n", &args->subsampling);
+      else if (strcmp(section, "block cache") == 0)
+        fscanf(config_file, "%lld\n", (long long*)&args->block_cache_size);
+      else if (strcmp(section, "prefetch") == 0)
+        fscanf(config_file, "%d\n", &args->prefetch_depth);
+      else if (strcmp(section, "read threads") == 0)
+        fscanf(config_file, "%d\n", &args->read_thread_count);
+      else if (strcmp(section, "iflush") == 0)
+        fscanf(config_file, "%d\n", &args->iflush);
+      else if (strcmp(section, "memory budget") == 0)
+        fscanf(config_file, "%lld\n", (long long*)&args->memory_budget);
+      else if (strcmp(section, "dataset box") == 0)
+        fscanf(config_file, "%lld %lld %lld\n", (long long*)&args->dataset_extents[0], (long long*)&args->dataset_extents[1], (long long*)&args->dataset_extents[2]);
+      else if (strcmp(section, "sparse layout") == 0)
+        fscanf(config_file, "%d\n", &args->sparse_layout);
+      else if (strcmp(section, "io backend") == 0)
+        fscanf(config_file, "%15s\n", args->io_backend);
+      else if (strcmp(section, "async io") == 0)
+        fscanf(config_file, "%d\n", &args->async_io);
+      else if (strcmp(section, "progressive") == 0)
+        fscanf(config_file, "%d\n", &args->progressive);
+      else if (strcmp(section, "data") == 0)
+      {
+        fscanf(config_file, "%127s\n", section);
+        args->mixed_data = (strcmp(section, "mixed") == 0);
+      }
+      else
+      {
+        fprintf(stderr, " [%s] [%d] unknown section (%s).\n", __FILE__, __LINE__, section);
+        fclose(config_file);
+        return (-1);
+      }
+    }
+  }
   
   fclose(config_file);
   
@@ -242,6 +302,8 @@ char* kindToStr(enum Kind k)
   {
     case PARALLEL_READER:                return "parallel-reader";
     case SERIAL_READER:                  return "serial-reader";    
+    case RESTART_READER:                 return "restart-reader";
+    case ROUNDTRIP:                      return "roundtrip";
     case PARALLEL_WRITER:                return "parallel-writer";
     case PARALLEL_MULTI_PATCH_WRITER:    return "parallel-multi-patch-writer";
     case SERIAL_WRITER:                  return "serial-writer";
@@ -255,6 +317,8 @@ enum Kind strToKind(const char *str)
 {
   if (strcmp(str,"parallel-reader")   == 0)             return PARALLEL_READER;
   if (strcmp(str,"serial-reader")     == 0)             return SERIAL_READER;
+  if (strcmp(str,"restart-reader")    == 0)             return RESTART_READER;
+  if (strcmp(str,"roundtrip")         == 0)             return ROUNDTRIP;
   if (strcmp(str,"parallel-writer")   == 0)             return PARALLEL_WRITER;
   if (strcmp(str,"parallel-multi-patch-writer")   == 0) return PARALLEL_MULTI_PATCH_WRITER;
   if (strcmp(str,"serial-writer")     == 0)             return SERIAL_WRITER;
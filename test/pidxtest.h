@@ -22,7 +22,7 @@
 #include <PIDX.h>
 
 /// Kind of test to run
-enum Kind { DEFAULT = 0, SERIAL_READER, PARALLEL_READER, SERIAL_WRITER, PARALLEL_WRITER, PARALLEL_MULTI_PATCH_WRITER};
+enum Kind { DEFAULT = 0, SERIAL_READER, PARALLEL_READER, SERIAL_WRITER, PARALLEL_WRITER, PARALLEL_MULTI_PATCH_WRITER, RESTART_READER, ROUNDTRIP};
 
 /// kindToStr
 char* kindToStr(enum Kind k);
@@ -97,6 +97,51 @@ struct Args
   
   /// 1 for lossy 0 for lossless
   int compression_type;
+
+  /// Largest error of the fixed accuracy mode for every variable (roundtrip only, 0 for the file compression)
+  double accuracy;
+
+  /// Largest error accepted when the data is read back (roundtrip only, 0 for an exact check)
+  double tolerance;
+
+  /// 1 for a smooth field in the first octant and a constant elsewhere, 0 for a ramp (roundtrip only)
+  int mixed_data;
+
+  /// 1 to read back a box in the middle of every process's box with region of interest reads (roundtrip only)
+  int roi_read;
+
+  /// Stride of the region of interest reads, a power of two (roundtrip only, 0 or 1 for all the samples)
+  int subsampling;
+
+  /// Bytes of the block cache of the region of interest reads, which are then done twice (roundtrip only)
+  int64_t block_cache_size;
+
+  /// Time steps read ahead into the block cache by the region of interest reads (roundtrip only)
+  int prefetch_depth;
+
+  /// Threads of the region of interest reads of every process (roundtrip only, 0 for the default)
+  int read_thread_count;
+
+  /// 1 to write with PIDX_iflush and PIDX_request_wait (roundtrip only)
+  int iflush;
+
+  /// Bytes the variables flushed together may take on a process (roundtrip only, 0 for the default groups)
+  int64_t memory_budget;
+
+  /// Dimensions of the dataset, of which the global box is the corner the processes write (roundtrip only, 0 for the global box)
+  int64_t dataset_extents[3];
+
+  /// 1 to lay out only the blocks touched by the boxes (roundtrip only)
+  int sparse_layout;
+
+  /// Backend of the binary files: mpi, posix, mmap or memory (roundtrip only, empty for mpi)
+  char io_backend[16];
+
+  /// 1 to write the aggregator buffers from the background writer (roundtrip only)
+  int async_io;
+
+  /// 1 for progressive region of interest reads (roundtrip only)
+  int progressive;
 };
 
 /// main
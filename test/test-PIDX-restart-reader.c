@@ -0,0 +1,165 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+#include "pidxtest.h"
+
+/// Restart benchmark: reads a dataset written by test_multi_idx_writer on any number of processes, split into
+/// boxes of the reader's own (MPI_Dims_create) decomposition, and reports how long the read took and what every
+/// process read; the local box of the configuration (the writer's) is not used.
+int test_restart_reader(struct Args args, int rank, int nprocs)
+{
+#if PIDX_HAVE_MPI
+  int ts, var, d;
+  int sub_div[3] = {0, 0, 0}, grid_offset[3];
+  int64_t local_offset[3], local_count[3];
+  int64_t block_count, file_count, byte_count;
+  int64_t local_stats[4], max_stats[4], total_stats[4];
+  double start_time, read_time, max_read_time;
+
+  /// IDX file descriptor
+  PIDX_file file;
+
+  /// IDX File variable counts
+  int variable_count;
+
+  PIDX_variable* variable;
+  double **double_data;
+
+  /// The command line arguments are shared by all processes
+  MPI_Bcast(args.extents, 5, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.time_step, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.output_file_template, 512, MPI_CHAR, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.idx_count, 3, MPI_INT, 0, MPI_COMM_WORLD);
+
+  //   Creating the filename
+  args.output_file_name = (char*) malloc(sizeof (char) * 512);
+  snprintf(args.output_file_name, 512, "%s%s", args.output_file_template, ".idx");
+
+  //   Every process gets a box of a balanced grid of nprocs boxes, whatever the writer used
+  MPI_Dims_create(nprocs, 3, sub_div);
+  grid_offset[0] = rank % sub_div[0];
+  grid_offset[1] = (rank / sub_div[0]) % sub_div[1];
+  grid_offset[2] = rank / (sub_div[0] * sub_div[1]);
+  for (d = 0; d < 3; d++)
+  {
+    local_offset[d] = args.extents[d] * grid_offset[d] / sub_div[d];
+    local_count[d] = args.extents[d] * (grid_offset[d] + 1) / sub_div[d] - local_offset[d];
+  }
+
+  PIDX_point global_bounding_box, local_offset_point, local_box_count_point;
+
+  PIDX_set_point_5D(local_offset_point, local_offset[0], local_offset[1], local_offset[2], 0, 0);
+  PIDX_set_point_5D(local_box_count_point, local_count[0], local_count[1], local_count[2], 1, 1);
+
+  for (ts = 0; ts < args.time_step; ts++)
+  {
+    PIDX_access access;
+    PIDX_create_access(&access);
+    PIDX_set_mpi_access(access, args.idx_count[0], args.idx_count[1], args.idx_count[2], MPI_COMM_WORLD);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start_time = MPI_Wtime();
+
+    PIDX_file_open(args.output_file_name, PIDX_file_rdonly, access, &file);
+
+    PIDX_get_dims(file, global_bounding_box);
+    PIDX_set_current_time_step(file, ts);
+    PIDX_get_variable_count(file, &variable_count);
+
+    variable = (PIDX_variable*)malloc(sizeof(*variable) * variable_count);
+    memset(variable, 0, sizeof(*variable) * variable_count);
+
+    double_data = (double**)malloc(sizeof(*double_data) * variable_count);
+    memset(double_data, 0, sizeof(*double_data) * variable_count);
+
+    for (var = 0; var < variable_count; var++)
+    {
+      PIDX_get_next_variable(file, &variable[var]);
+
+      double_data[var] = (double*)malloc(sizeof (double) * local_count[0] * local_count[1] * local_count[2] * variable[var]->values_per_sample);
+      memset(double_data[var], 0, sizeof (double) * local_count[0] * local_count[1] * local_count[2] * variable[var]->values_per_sample);
+
+      PIDX_read_next_variable(variable[var], local_offset_point, local_box_count_point, double_data[var], PIDX_row_major);
+    }
+
+    PIDX_flush(file);
+    PIDX_get_roi_read_stats(file, &block_count, &file_count, &byte_count);
+    PIDX_close(file);
+    PIDX_close_access(access);
+
+    read_time = MPI_Wtime() - start_time;
+
+    int64_t equal_count = 0, sample_count = 0;
+    for (var = 0; var < variable_count; var++)
+    {
+      int64_t i, j, k, spv;
+      for (k = 0; k < local_count[2]; k++)
+        for (j = 0; j < local_count[1]; j++)
+          for (i = 0; i < local_count[0]; i++)
+          {
+            int64_t index = (local_count[0] * local_count[1] * k) + (local_count[0] * j) + i;
+            for (spv = 0; spv < variable[var]->values_per_sample; spv++)
+            {
+              if (double_data[var][index * variable[var]->values_per_sample + spv] == 100 + var + ((args.extents[0] * args.extents[1] * (local_offset[2] + k)) + (args.extents[0] * (local_offset[1] + j)) + (local_offset[0] + i)))
+                equal_count++;
+              sample_count++;
+            }
+          }
+      free(double_data[var]);
+      double_data[var] = 0;
+    }
+
+    // the blocks and bytes are those of the processes that read their own blocks (0 through the aggregators)
+    local_stats[0] = sample_count;
+    local_stats[1] = equal_count;
+    local_stats[2] = block_count;
+    local_stats[3] = byte_count;
+    MPI_Reduce(local_stats, max_stats, 4, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local_stats, total_stats, 4, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&read_time, &max_read_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+      printf("[restart] time step %d: %d processes (%d x %d x %d boxes of up to %lld samples of %lld), read time %f s\n", ts, nprocs, sub_div[0], sub_div[1], sub_div[2], (long long)max_stats[0], (long long)(args.extents[0] * args.extents[1] * args.extents[2] * variable_count), max_read_time);
+      printf("[restart] blocks read %lld (at most %lld by a process), bytes read %lld (at most %lld by a process)\n", (long long)total_stats[2], (long long)max_stats[2], (long long)total_stats[3], (long long)max_stats[3]);
+      printf("[restart] equal element count = %lld of %lld\n", (long long)total_stats[1], (long long)total_stats[0]);
+    }
+
+    free(double_data);
+    double_data = 0;
+
+    free(variable);
+    variable = 0;
+  }
+  free(args.output_file_name);
+#endif
+
+  return 0;
+}
+
+/*   prints usage instructions   */
+void usage_restart_reader(void)
+{
+  printf("Usage: pidxtest config_file (mode restart-reader)\n");
+  printf("  global box: dimensions of the dataset\n");
+  printf("  local box: not used, the dataset is read in nprocs boxes of any size\n");
+  printf("  file name: IDX file name (without .idx)\n");
+  printf("  time steps: number of time steps to read\n");
+  printf("\n");
+  return;
+}
@@ -0,0 +1,450 @@
+/*****************************************************
+ **  PIDX Parallel I/O Library                      **
+ **  Copyright (c) 2010-2014 University of Utah     **
+ **  Scientific Computing and Imaging Institute     **
+ **  72 S Central Campus Drive, Room 3750           **
+ **  Salt Lake City, UT 84112                       **
+ **                                                 **
+ **  PIDX is licensed under the Creative Commons    **
+ **  Attribution-NonCommercial-NoDerivatives 4.0    **
+ **  International License. See LICENSE.md.         **
+ **                                                 **
+ **  For information about this project see:        **
+ **  http://www.cedmav.com/pidx                     **
+ **  or contact: pascucci@sci.utah.edu              **
+ **  For support: PIDX-support@visus.net            **
+ **                                                 **
+ *****************************************************/
+
+#include "pidxtest.h"
+
+#if PIDX_HAVE_MPI
+/// Value of a sample of a variable at a global position; a ramp, or with the mixed data a smooth field in the first
+/// octant and a constant elsewhere (the blocks of a mask); the same for the writer and the reader
+static double roundtrip_value(struct Args* args, int var, int64_t x, int64_t y, int64_t z)
+{
+  if (args->mixed_data == 1 && (x >= args->extents[0] / 2 || y >= args->extents[1] / 2 || z >= args->extents[2] / 2))
+    return 7 + var;
+  if (args->mixed_data == 1)
+    return var + sin(x / 7.0) + cos(y / 5.0) * z;
+  return 100 + var + (args->extents[0] * args->extents[1] * z) + (args->extents[0] * y) + x;
+}
+
+/// Backend of the binary files named by the configuration (mpi, the default, posix, mmap or memory)
+static PIDX_io_backend roundtrip_io_backend(struct Args* args)
+{
+  if (strcmp(args->io_backend, "posix") == 0)
+    return PIDX_io_backend_posix;
+  if (strcmp(args->io_backend, "mmap") == 0)
+    return PIDX_io_backend_mmap;
+  if (strcmp(args->io_backend, "memory") == 0)
+    return PIDX_io_backend_memory;
+  return PIDX_io_backend_mpi;
+}
+
+/// Progressive read callback: counts the levels of the boxes (the number of calls is in user_data)
+static int roundtrip_progress(PIDX_variable variable, int patch, int level, int max_level, void* user_data)
+{
+  (*(int64_t*)user_data)++;
+  return 0;
+}
+
+/// Fills the box of a process with the values of a variable
+static void roundtrip_fill(struct Args* args, int var, int* local_offset, double* data)
+{
+  int64_t i, j, k;
+
+  for (k = 0; k < args->count_local[2]; k++)
+    for (j = 0; j < args->count_local[1]; j++)
+      for (i = 0; i < args->count_local[0]; i++)
+        data[(args->count_local[0] * args->count_local[1] * k) + (args->count_local[0] * j) + i] = roundtrip_value(args, var, local_offset[0] + i, local_offset[1] + j, local_offset[2] + k);
+}
+
+/// Reads a box of every variable of a time step with the region of interest reads (and the subsampling of the
+/// configuration) and checks the samples; returns the number of samples off by more than the tolerance
+static int64_t roundtrip_roi_read(struct Args* args, int* sub_div, int ts, PIDX_point box_offset, PIDX_point box_count, int64_t* sample_count, int64_t* roi_blocks, int64_t* progress_calls, double* max_error)
+{
+  int var;
+  int64_t i, j, k, first[3], off_count = 0, roi_files, roi_bytes;
+  double error, **read_data;
+  PIDX_point subsampling, stride, coarse_dims;
+  PIDX_access access;
+  PIDX_file file;
+  PIDX_variable* variable;
+
+  PIDX_create_access(&access);
+  PIDX_set_mpi_access(access, args->idx_count[0], args->idx_count[1], args->idx_count[2], MPI_COMM_WORLD);
+  PIDX_set_process_extent(access, sub_div[0], sub_div[1], sub_div[2]);
+
+  PIDX_file_open(args->output_file_name, PIDX_file_rdonly, access, &file);
+  PIDX_set_current_time_step(file, ts);
+  PIDX_set_io_backend(file, roundtrip_io_backend(args));
+  PIDX_enable_roi_read(file, 1);
+  if (args->progressive == 1)
+    PIDX_set_progressive_callback(file, roundtrip_progress, progress_calls);
+  if (args->prefetch_depth > 0)
+    PIDX_set_prefetch_depth(file, args->prefetch_depth);
+  if (args->read_thread_count > 0)
+    PIDX_set_read_thread_count(file, args->read_thread_count);
+  if (args->subsampling > 1)
+  {
+    PIDX_set_point_5D(subsampling, args->subsampling, args->subsampling, args->subsampling, 1, 1);
+    PIDX_set_subsampling(file, subsampling);
+  }
+  PIDX_get_resolution_dims(file, box_offset, box_count, stride, coarse_dims);
+  *sample_count = coarse_dims[0] * coarse_dims[1] * coarse_dims[2];
+
+  variable = (PIDX_variable*)malloc(sizeof(*variable) * args->variable_count);
+  read_data = (double**)malloc(sizeof(*read_data) * args->variable_count);
+  for (var = 0; var < args->variable_count; var++)
+  {
+    read_data[var] = (double*)calloc(*sample_count, sizeof (double));
+    PIDX_get_next_variable(file, &variable[var]);
+    PIDX_read_next_variable(variable[var], box_offset, box_count, read_data[var], PIDX_row_major);
+  }
+  PIDX_flush(file);
+  PIDX_get_roi_read_stats(file, roi_blocks, &roi_files, &roi_bytes);
+
+  PIDX_close(file);
+  PIDX_close_access(access);
+
+  /// the samples read are the ones whose coordinates are multiples of the stride
+  for (i = 0; i < 3; i++)
+    first[i] = (box_offset[i] + stride[i] - 1) / stride[i] * stride[i];
+
+  for (var = 0; var < args->variable_count; var++)
+  {
+    for (k = 0; k < coarse_dims[2]; k++)
+      for (j = 0; j < coarse_dims[1]; j++)
+        for (i = 0; i < coarse_dims[0]; i++)
+        {
+          error = fabs(read_data[var][(coarse_dims[0] * coarse_dims[1] * k) + (coarse_dims[0] * j) + i] - roundtrip_value(args, var, first[0] + i * stride[0], first[1] + j * stride[1], first[2] + k * stride[2]));
+          if (!(error <= args->tolerance))
+            off_count++;
+          if (error > *max_error || error != error)
+            *max_error = error;
+        }
+    free(read_data[var]);
+  }
+  *sample_count = *sample_count * args->variable_count;
+
+  free(read_data);
+  free(variable);
+
+  return off_count;
+}
+#endif
+
+/// Round trip test: writes every time step with the settings of the configuration, reads it back on the same
+/// decomposition and checks every sample against what was written, exactly or within the tolerance of the lossy modes.
+int test_roundtrip(struct Args args, int rank, int nprocs)
+{
+  int failed = 0;
+#if PIDX_HAVE_MPI
+  int ts, var;
+  int64_t index;
+  int slice;
+  int sub_div[3], local_offset[3];
+  int64_t local_stats[2], total_stats[2];
+  int64_t block_count[PIDX_BLOCK_CODEC_COUNT], block_bytes[PIDX_BLOCK_CODEC_COUNT], coded_blocks;
+  int raw_bricks;
+  int pass, roi_failed;
+  int group_count;
+  int64_t roi_stats[5], total_roi_stats[5], cache_hits, cache_misses, cache_bytes;
+  PIDX_point roi_offset_point, roi_count_point;
+  double error, max_error, all_max_error;
+
+  /// IDX file descriptor
+  PIDX_file file;
+
+  PIDX_variable* variable;
+  PIDX_request request = NULL;
+  double **write_data, **read_data;
+  int64_t sample_count;
+
+  PIDX_point global_bounding_box, local_offset_point, local_box_count_point;
+  PIDX_point compression_block_size_point;
+
+  /// The command line arguments are shared by all processes
+  MPI_Bcast(args.extents, 5, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+  MPI_Bcast(args.count_local, 5, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(args.compression_block_size, 5, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.compression_type, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.perform_agg, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.accuracy, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.tolerance, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.mixed_data, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.roi_read, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.subsampling, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.block_cache_size, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.prefetch_depth, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.read_thread_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.iflush, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.memory_budget, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+  MPI_Bcast(args.dataset_extents, 3, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.sparse_layout, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(args.io_backend, 16, MPI_CHAR, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.async_io, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.progressive, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.time_step, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.idx_count, 3, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.blocks_per_file, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.bits_per_block, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.aggregation_factor, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.variable_count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&args.output_file_template, 512, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+  variable = (PIDX_variable*)malloc(sizeof(*variable) * args.variable_count);
+  write_data = (double**)malloc(sizeof(*write_data) * args.variable_count);
+  read_data = (double**)malloc(sizeof(*read_data) * args.variable_count);
+
+  /// Creating the filename
+  args.output_file_name = (char*) malloc(sizeof (char) * 512);
+  snprintf(args.output_file_name, 512, "%s%s", args.output_file_template, ".idx");
+
+  /// Calculating every process's offset and count
+  sub_div[0] = (args.extents[0] / args.count_local[0]);
+  sub_div[1] = (args.extents[1] / args.count_local[1]);
+  sub_div[2] = (args.extents[2] / args.count_local[2]);
+  local_offset[2] = (rank / (sub_div[0] * sub_div[1])) * args.count_local[2];
+  slice = rank % (sub_div[0] * sub_div[1]);
+  local_offset[1] = (slice / sub_div[0]) * args.count_local[1];
+  local_offset[0] = (slice % sub_div[0]) * args.count_local[0];
+  sample_count = (int64_t)args.count_local[0] * args.count_local[1] * args.count_local[2];
+  /// the lossy block codec only takes the blocks of bricks that were not already coded
+  raw_bricks = (args.compression_block_size[0] * args.compression_block_size[1] * args.compression_block_size[2] <= 1);
+
+  if (args.dataset_extents[0] > 0)
+    PIDX_set_point_5D(global_bounding_box, args.dataset_extents[0], args.dataset_extents[1], args.dataset_extents[2], 1, 1);
+  else
+    PIDX_set_point_5D(global_bounding_box, (int64_t)args.extents[0], (int64_t)args.extents[1], (int64_t)args.extents[2], 1, 1);
+  PIDX_set_point_5D(compression_block_size_point, (int64_t)args.compression_block_size[0], (int64_t)args.compression_block_size[1], (int64_t)args.compression_block_size[2], 1, 1);
+  PIDX_set_point_5D(local_offset_point, (int64_t)local_offset[0], (int64_t)local_offset[1], (int64_t)local_offset[2], 0, 0);
+  PIDX_set_point_5D(local_box_count_point, (int64_t)args.count_local[0], (int64_t)args.count_local[1], (int64_t)args.count_local[2], 1, 1);
+
+  /// the boxes of the region of interest reads are the middle halves of the boxes of the processes, an eighth of the dataset
+  PIDX_set_point_5D(roi_offset_point, (int64_t)(local_offset[0] + args.count_local[0] / 4), (int64_t)(local_offset[1] + args.count_local[1] / 4), (int64_t)(local_offset[2] + args.count_local[2] / 4), 0, 0);
+  PIDX_set_point_5D(roi_count_point, (int64_t)(args.count_local[0] / 2), (int64_t)(args.count_local[1] / 2), (int64_t)(args.count_local[2] / 2), 1, 1);
+  if (args.block_cache_size > 0)
+    PIDX_set_block_cache_size((uint64_t)args.block_cache_size);
+
+  for (var = 0; var < args.variable_count; var++)
+  {
+    write_data[var] = (double*)malloc(sizeof (double) * sample_count);
+    read_data[var] = (double*)malloc(sizeof (double) * sample_count);
+    roundtrip_fill(&args, var, local_offset, write_data[var]);
+  }
+
+  /// Write every time step, then read them back in order (the time steps after the first one can then be prefetched)
+  for (ts = 0; ts < args.time_step; ts++)
+  {
+    char variable_name[512];
+    PIDX_access access;
+    PIDX_create_access(&access);
+    PIDX_set_mpi_access(access, args.idx_count[0], args.idx_count[1], args.idx_count[2], MPI_COMM_WORLD);
+    PIDX_set_process_extent(access, sub_div[0], sub_div[1], sub_div[2]);
+
+    PIDX_file_create(args.output_file_name, PIDX_file_trunc, access, &file);
+    PIDX_set_dims(file, global_bounding_box);
+    PIDX_set_current_time_step(file, ts);
+    if (args.sparse_layout == 1)
+      PIDX_enable_sparse_layout(file, 1);
+    PIDX_set_io_backend(file, roundtrip_io_backend(&args));
+    PIDX_enable_agg(file, args.perform_agg);
+    if (args.async_io == 1)
+      PIDX_enable_async_io(file, 1);
+    PIDX_set_block_size(file, args.bits_per_block);
+    PIDX_set_aggregation_factor(file, args.aggregation_factor);
+    PIDX_set_block_count(file, args.blocks_per_file);
+    PIDX_set_variable_count(file, args.variable_count);
+    PIDX_set_compression_type(file, args.compression_type);
+    PIDX_set_compression_block_size(file, compression_block_size_point);
+    if (args.memory_budget > 0)
+      PIDX_set_memory_budget(file, (uint64_t)args.memory_budget);
+
+    for (var = 0; var < args.variable_count; var++)
+    {
+      snprintf(variable_name, sizeof variable_name, "variable_%d", var);
+      PIDX_variable_create(file, variable_name, sizeof(double) * 8, "1*float64", &variable[var]);
+      if (args.accuracy > 0)
+        PIDX_variable_set_compression(variable[var], PIDX_COMPRESSION_FIXED_ACCURACY, args.accuracy);
+      PIDX_append_and_write_variable(variable[var], local_offset_point, local_box_count_point, write_data[var], PIDX_row_major);
+    }
+
+    /// The block codecs of the variables are known once they are written
+    if (args.iflush == 1)
+    {
+      /// the buffers may be reused once PIDX_iflush returns, they are overwritten while the write goes on
+      local_stats[0] = (PIDX_iflush(file, &request) != PIDX_success);
+      for (var = 0; var < args.variable_count; var++)
+        memset(write_data[var], 0, sizeof (double) * sample_count);
+      if (request != NULL)
+        local_stats[0] += (PIDX_request_wait(&request) != PIDX_success || request != NULL);
+      for (var = 0; var < args.variable_count; var++)
+        roundtrip_fill(&args, var, local_offset, write_data[var]);
+
+      MPI_Reduce(local_stats, total_stats, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+      if (rank == 0)
+      {
+        printf("[roundtrip] time step %d non-blocking flush: %lld errors %s\n", ts, (long long)total_stats[0], (total_stats[0] == 0) ? "PASSED" : "FAILED");
+        if (total_stats[0] != 0)
+          failed = 1;
+      }
+    }
+    else
+      PIDX_flush(file);
+    if (args.memory_budget > 0)
+    {
+      PIDX_get_variable_groups(file, &group_count, NULL, NULL);
+      if (rank == 0)
+      {
+        printf("[roundtrip] time step %d memory budget %lld bytes: %d variable groups %s\n", ts, (long long)args.memory_budget, group_count, (group_count > 1 || args.variable_count == 1) ? "PASSED" : "FAILED");
+        if (group_count <= 1 && args.variable_count > 1)
+          failed = 1;
+      }
+    }
+
+    if (args.compression_type == PIDX_LOSSLESS_COMPRESSION || args.compression_type == PIDX_ADAPTIVE_COMPRESSION)
+    {
+      for (var = 0; var < args.variable_count; var++)
+      {
+        PIDX_variable_get_block_codecs(variable[var], block_count, block_bytes);
+        coded_blocks = block_count[PIDX_BLOCK_RAW] + block_count[PIDX_BLOCK_LOSSY] + block_count[PIDX_BLOCK_LOSSLESS] + block_count[PIDX_BLOCK_CONSTANT];
+        if (rank == 0)
+        {
+          printf("[roundtrip] time step %d variable %d blocks: %lld raw %lld lossy %lld lossless %lld constant\n", ts, var, (long long)block_count[PIDX_BLOCK_RAW], (long long)block_count[PIDX_BLOCK_LOSSY], (long long)block_count[PIDX_BLOCK_LOSSLESS], (long long)block_count[PIDX_BLOCK_CONSTANT]);
+          if (coded_blocks == 0 || (args.compression_type == PIDX_LOSSLESS_COMPRESSION && block_count[PIDX_BLOCK_LOSSY] != 0) || (args.compression_type == PIDX_ADAPTIVE_COMPRESSION && args.mixed_data == 1 && (block_count[PIDX_BLOCK_CONSTANT] == 0 || (raw_bricks == 1 && args.accuracy > 0 && block_count[PIDX_BLOCK_LOSSY] == 0))))
+          {
+            printf("[roundtrip] time step %d variable %d: wrong block codecs FAILED\n", ts, var);
+            failed = 1;
+          }
+        }
+      }
+    }
+
+    PIDX_close(file);
+    PIDX_close_access(access);
+
+    /// the background writer may still be writing the aggregator buffers of a closed file
+    if (args.async_io == 1)
+      PIDX_wait_all();
+  }
+
+  for (ts = 0; ts < args.time_step; ts++)
+  {
+    /// Read back on the same decomposition
+    PIDX_access access;
+    PIDX_create_access(&access);
+    PIDX_set_mpi_access(access, args.idx_count[0], args.idx_count[1], args.idx_count[2], MPI_COMM_WORLD);
+    PIDX_set_process_extent(access, sub_div[0], sub_div[1], sub_div[2]);
+
+    PIDX_file_open(args.output_file_name, PIDX_file_rdonly, access, &file);
+    PIDX_set_current_time_step(file, ts);
+    PIDX_set_io_backend(file, roundtrip_io_backend(&args));
+    PIDX_enable_agg(file, args.perform_agg);
+
+    for (var = 0; var < args.variable_count; var++)
+    {
+      memset(read_data[var], 0, sizeof (double) * sample_count);
+      PIDX_get_next_variable(file, &variable[var]);
+      PIDX_read_next_variable(variable[var], local_offset_point, local_box_count_point, read_data[var], PIDX_row_major);
+    }
+
+    PIDX_close(file);
+    PIDX_close_access(access);
+
+    /// Check
+    local_stats[0] = 0;
+    local_stats[1] = 0;
+    max_error = 0;
+    for (var = 0; var < args.variable_count; var++)
+      for (index = 0; index < sample_count; index++)
+      {
+        error = fabs(read_data[var][index] - write_data[var][index]);
+        if (!(error <= args.tolerance))
+          local_stats[1]++;
+        if (error > max_error || error != error)
+          max_error = error;
+        local_stats[0]++;
+      }
+
+    MPI_Reduce(local_stats, total_stats, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&max_error, &all_max_error, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+      printf("[roundtrip] time step %d: %lld of %lld samples off by more than %g (max error %g) %s\n", ts, (long long)total_stats[1], (long long)total_stats[0], args.tolerance, all_max_error, (total_stats[1] == 0) ? "PASSED" : "FAILED");
+      if (total_stats[1] != 0)
+        failed = 1;
+    }
+
+    /// Region of interest reads, twice with the block cache (the second one from the cache); with the read ahead the
+    /// blocks of the time steps after the first one are in the cache before their first read
+    for (pass = 0; args.roi_read == 1 && pass < ((args.block_cache_size > 0) ? 2 : 1); pass++)
+    {
+      max_error = 0;
+      PIDX_get_block_cache_stats(&cache_hits, &cache_misses, &cache_bytes);
+      roi_stats[4] = 0;
+      roi_stats[0] = roundtrip_roi_read(&args, sub_div, ts, roi_offset_point, roi_count_point, &roi_stats[1], &roi_stats[2], &roi_stats[4], &max_error);
+      roi_stats[3] = -cache_hits;
+      PIDX_get_block_cache_stats(&cache_hits, &cache_misses, &cache_bytes);
+      roi_stats[3] += cache_hits;
+
+      MPI_Reduce(roi_stats, total_roi_stats, 5, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+      MPI_Reduce(&max_error, &all_max_error, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+      if (rank == 0)
+      {
+        roi_failed = (total_roi_stats[0] != 0 || (pass == 0 && total_roi_stats[2] == 0 && total_roi_stats[3] == 0) || (pass == 1 && total_roi_stats[3] == 0) || (pass == 0 && ts > 0 && args.prefetch_depth > 0 && total_roi_stats[3] == 0) || (args.progressive == 1 && total_roi_stats[4] == 0));
+        if (roi_failed == 1)
+          failed = 1;
+        printf("[roundtrip] time step %d region of interest read %d: %lld of %lld samples off by more than %g (max error %g), %lld blocks, %lld cache hits, %lld progressive levels %s\n", ts, pass, (long long)total_roi_stats[0], (long long)total_roi_stats[1], args.tolerance, all_max_error, (long long)total_roi_stats[2], (long long)total_roi_stats[3], (long long)total_roi_stats[4], (roi_failed == 0) ? "PASSED" : "FAILED");
+      }
+    }
+  }
+
+  for (var = 0; var < args.variable_count; var++)
+  {
+    free(write_data[var]);
+    free(read_data[var]);
+  }
+  free(write_data);
+  free(read_data);
+  free(variable);
+  free(args.output_file_name);
+  if (args.block_cache_size > 0)
+    PIDX_set_block_cache_size(0);
+
+  MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+
+  return failed;
+}
+
+/*   prints usage instructions   */
+void usage_roundtrip(void)
+{
+  printf("Usage: pidxtest config_file (mode roundtrip)\n");
+  printf("  the sections of a parallel-writer configuration, then any of\n");
+  printf("  (accuracy): largest error of the fixed accuracy mode for all the variables (0: the file compression)\n");
+  printf("  (tolerance): largest error accepted by the check (0: exact)\n");
+  printf("  (data): ramp (default) or mixed (smooth in the first octant and constant elsewhere; compression type 3 has to code constant blocks, and lossy\n          blocks too with (accuracy) and a compression block size of 1)\n");
+  printf("  (roi): 1 to read back the middle halves of the boxes with region of interest reads too\n");
+  printf("  (subsampling): stride (a power of two) of the region of interest reads\n");
+  printf("  (block cache): bytes of the block cache; the region of interest reads are then done twice, the second one from the cache\n");
+  printf("  (prefetch): read ahead depth of the region of interest reads (needs the block cache); the first read of every time\n");
+  printf("          step after the first one then has to hit the cache\n");
+  printf("  (read threads): threads of the region of interest reads of every process\n");
+  printf("  (iflush): 1 to write with PIDX_iflush and PIDX_request_wait, overwriting the buffers in between\n");
+  printf("  (memory budget): bytes of the variable groups of the writes, which then have to take more than one group\n");
+  printf("  (dataset box): dimensions of the dataset when the boxes of the processes (the global box) only cover part of it\n");
+  printf("  (sparse layout): 1 to lay out only the blocks the boxes touch\n");
+  printf("  (io backend): mpi (default), posix, mmap or memory, for the writes and the reads (the files of the memory backend\n          stay in the process that wrote them, so no region of interest reads)\n");
+  printf("  (async io): 1 to write the aggregator buffers from the background writer\n");
+  printf("  (progressive): 1 for coarse to fine region of interest reads, which then have to call back for every level\n");
+  printf("  every time step is written, then all of them are read back on the same decomposition and checked\n");
+  printf("  with aggregation off in (perform hz:agg:io), every process writes and reads its own HZ runs\n");
+  printf("  with compression types 2 and 3 the block codecs of every variable are printed and checked too\n");
+  printf("\n");
+  return;
+}
@@ -25,6 +25,12 @@
 int test_reader(struct Args args, int rank, int nprocs);
 int usage_reader();
 
+int test_restart_reader(struct Args args, int rank, int nprocs);
+int usage_restart_reader();
+
+int test_roundtrip(struct Args args, int rank, int nprocs);
+void usage_roundtrip(void);
+
 // int test_one_var_writer(struct Args args, int rank, int nprocs);
 // int usage_one_var_writer();
 